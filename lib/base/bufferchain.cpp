@@ -0,0 +1,291 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/bufferchain.hpp"
+#include <algorithm>
+#include <string.h>
+
+using namespace icinga;
+
+BufferSegment::BufferSegment(size_t capacity)
+	: m_Data(static_cast<char *>(malloc(capacity))), m_Capacity(capacity)
+{
+	if (!m_Data)
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+}
+
+BufferSegment::~BufferSegment(void)
+{
+	free(m_Data);
+}
+
+char *BufferSegment::GetData(void) const
+{
+	return m_Data;
+}
+
+size_t BufferSegment::GetCapacity(void) const
+{
+	return m_Capacity;
+}
+
+BufferRange::BufferRange(void)
+	: Offset(0), Length(0)
+{ }
+
+BufferRange::BufferRange(const BufferSegment::Ptr& segment, size_t offset, size_t length)
+	: Segment(segment), Offset(offset), Length(length)
+{ }
+
+/**
+ * Copies a string into a new segment.
+ *
+ * @param data The string.
+ * @returns A range which covers the whole string.
+ */
+BufferRange BufferRange::FromString(const String& data)
+{
+	BufferSegment::Ptr segment = new BufferSegment(std::max<size_t>(data.GetLength(), 1));
+	memcpy(segment->GetData(), data.CStr(), data.GetLength());
+
+	return BufferRange(segment, 0, data.GetLength());
+}
+
+const char *BufferRange::GetData(void) const
+{
+	return Segment->GetData() + Offset;
+}
+
+BufferChain::BufferChain(void)
+	: m_Size(0), m_WriteOffset(0)
+{ }
+
+/**
+ * Copies data into the chain.
+ *
+ * @param data The data.
+ * @param count The number of bytes.
+ */
+void BufferChain::Append(const void *data, size_t count)
+{
+	const char *p = static_cast<const char *>(data);
+
+	while (count > 0) {
+		size_t available = 0;
+		char *buffer = Reserve(&available);
+
+		size_t rc = std::min(available, count);
+		memcpy(buffer, p, rc);
+		Commit(rc);
+
+		p += rc;
+		count -= rc;
+	}
+}
+
+/**
+ * Adds a range to the chain without copying it.
+ *
+ * @param range The range.
+ */
+void BufferChain::Append(const BufferRange& range)
+{
+	if (range.Length == 0)
+		return;
+
+	m_Ranges.push_back(range);
+	m_Size += range.Length;
+}
+
+/**
+ * Moves all data from another chain to the end of this chain.
+ *
+ * @param chain The other chain. It is empty afterwards.
+ */
+void BufferChain::Append(BufferChain& chain)
+{
+	m_Ranges.insert(m_Ranges.end(), chain.m_Ranges.begin(), chain.m_Ranges.end());
+	m_Size += chain.m_Size;
+
+	chain.m_Ranges.clear();
+	chain.m_Size = 0;
+}
+
+/**
+ * Returns a buffer at the end of the chain which can be written to.
+ * The data becomes part of the chain once Commit() is called.
+ *
+ * @param count The minimum number of bytes the caller wants to write
+ *		(or 0). Receives the size of the buffer.
+ * @returns The buffer.
+ */
+char *BufferChain::Reserve(size_t *count)
+{
+	size_t minimum = std::max<size_t>(*count, 1);
+
+	if (!m_WriteSegment || m_WriteSegment->GetCapacity() - m_WriteOffset < minimum) {
+		m_WriteSegment = new BufferSegment(std::max<size_t>(minimum, BUFFER_SEGMENT_SIZE));
+		m_WriteOffset = 0;
+	}
+
+	*count = m_WriteSegment->GetCapacity() - m_WriteOffset;
+
+	return m_WriteSegment->GetData() + m_WriteOffset;
+}
+
+/**
+ * Adds data which was written to the buffer returned by Reserve() to the chain.
+ *
+ * @param count The number of bytes.
+ */
+void BufferChain::Commit(size_t count)
+{
+	if (count == 0)
+		return;
+
+	ASSERT(m_WriteSegment && m_WriteOffset + count <= m_WriteSegment->GetCapacity());
+
+	if (!m_Ranges.empty()) {
+		BufferRange& last = m_Ranges.back();
+
+		if (last.Segment == m_WriteSegment && last.Offset + last.Length == m_WriteOffset) {
+			last.Length += count;
+			m_WriteOffset += count;
+			m_Size += count;
+			return;
+		}
+	}
+
+	m_Ranges.push_back(BufferRange(m_WriteSegment, m_WriteOffset, count));
+	m_WriteOffset += count;
+	m_Size += count;
+}
+
+/**
+ * Copies data from the beginning of the chain without removing it.
+ *
+ * @param buffer The buffer.
+ * @param count The maximum number of bytes.
+ * @returns The number of bytes that were copied.
+ */
+size_t BufferChain::Peek(void *buffer, size_t count) const
+{
+	char *p = static_cast<char *>(buffer);
+	size_t total = 0;
+
+	for (const BufferRange& range : m_Ranges) {
+		if (total == count)
+			break;
+
+		size_t rc = std::min(range.Length, count - total);
+		memcpy(p + total, range.GetData(), rc);
+		total += rc;
+	}
+
+	return total;
+}
+
+/**
+ * Removes data from the beginning of the chain.
+ *
+ * @param buffer The buffer the data is copied to. May be NULL.
+ * @param count The maximum number of bytes.
+ * @returns The number of bytes that were removed.
+ */
+size_t BufferChain::Read(void *buffer, size_t count)
+{
+	char *p = static_cast<char *>(buffer);
+	size_t total = 0;
+
+	while (total < count && !m_Ranges.empty()) {
+		BufferRange& range = m_Ranges.front();
+
+		size_t rc = std::min(range.Length, count - total);
+
+		if (p)
+			memcpy(p + total, range.GetData(), rc);
+
+		total += rc;
+
+		if (rc == range.Length)
+			m_Ranges.pop_front();
+		else {
+			range.Offset += rc;
+			range.Length -= rc;
+		}
+	}
+
+	m_Size -= total;
+
+	return total;
+}
+
+/**
+ * Removes data from the beginning of the chain and returns it as a single
+ * range. The data is only copied if it spans more than one segment.
+ *
+ * @param count The number of bytes.
+ * @param range Receives the range.
+ * @returns false if the chain contains less than count bytes.
+ */
+bool BufferChain::ReadRange(size_t count, BufferRange *range)
+{
+	if (m_Size < count)
+		return false;
+
+	if (count == 0) {
+		*range = BufferRange();
+		return true;
+	}
+
+	BufferRange& first = m_Ranges.front();
+
+	if (first.Length >= count) {
+		*range = BufferRange(first.Segment, first.Offset, count);
+		Read(NULL, count);
+		return true;
+	}
+
+	BufferSegment::Ptr segment = new BufferSegment(count);
+	Read(segment->GetData(), count);
+	*range = BufferRange(segment, 0, count);
+
+	return true;
+}
+
+/**
+ * Returns the first range of the chain.
+ *
+ * @param range Receives the range.
+ * @returns false if the chain is empty.
+ */
+bool BufferChain::GetFirst(BufferRange *range) const
+{
+	if (m_Ranges.empty())
+		return false;
+
+	*range = m_Ranges.front();
+
+	return true;
+}
+
+size_t BufferChain::GetAvailableBytes(void) const
+{
+	return m_Size;
+}
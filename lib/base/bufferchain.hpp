@@ -0,0 +1,116 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef BUFFERCHAIN_H
+#define BUFFERCHAIN_H
+
+#include "base/i2-base.hpp"
+#include "base/object.hpp"
+#include "base/string.hpp"
+#include <deque>
+
+namespace icinga
+{
+
+/**
+ * Default size of the segments which are allocated by a BufferChain.
+ */
+#define BUFFER_SEGMENT_SIZE (16 * 1024)
+
+/**
+ * A reference-counted block of memory. Bytes which have been handed out as
+ * part of a BufferRange are never modified again, so ranges can be shared
+ * between threads without copying them.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API BufferSegment : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(BufferSegment);
+
+	explicit BufferSegment(size_t capacity);
+	~BufferSegment(void);
+
+	char *GetData(void) const;
+	size_t GetCapacity(void) const;
+
+private:
+	char *m_Data;
+	size_t m_Capacity;
+};
+
+/**
+ * A range of bytes in a BufferSegment.
+ *
+ * @ingroup base
+ */
+struct I2_BASE_API BufferRange
+{
+	BufferSegment::Ptr Segment;
+	size_t Offset;
+	size_t Length;
+
+	BufferRange(void);
+	BufferRange(const BufferSegment::Ptr& segment, size_t offset, size_t length);
+
+	static BufferRange FromString(const String& data);
+
+	const char *GetData(void) const;
+};
+
+/**
+ * A chain of buffer ranges. Data is appended either by copying it into the
+ * chain's own segments or by adding ranges which reference existing segments.
+ *
+ * Instances of this class are not thread-safe.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API BufferChain
+{
+public:
+	BufferChain(void);
+
+	void Append(const void *data, size_t count);
+	void Append(const BufferRange& range);
+	void Append(BufferChain& chain);
+
+	char *Reserve(size_t *count);
+	void Commit(size_t count);
+
+	size_t Peek(void *buffer, size_t count) const;
+	size_t Read(void *buffer, size_t count);
+	bool ReadRange(size_t count, BufferRange *range);
+
+	bool GetFirst(BufferRange *range) const;
+
+	size_t GetAvailableBytes(void) const;
+
+private:
+	std::deque<BufferRange> m_Ranges;
+	size_t m_Size;
+
+	BufferSegment::Ptr m_WriteSegment;
+	size_t m_WriteOffset;
+};
+
+}
+
+#endif /* BUFFERCHAIN_H */
@@ -0,0 +1,168 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/deadlinequeue.hpp"
+#include "base/utility.hpp"
+#include "base/logger.hpp"
+#include "base/exception.hpp"
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+/**
+ * Constructor for the DeadlineQueue class.
+ *
+ * @param callback The function which is called for objects which are due.
+ * @param interval How often the queue is looked at even if no deadline is
+ *                 due, this only matters if the clock is changed.
+ */
+DeadlineQueue::DeadlineQueue(const Callback& callback, double interval)
+	: m_Callback(callback), m_Interval(interval), m_TimerNext(-1)
+{
+	m_Timer = new Timer();
+	m_Timer->SetInterval(interval);
+	m_Timer->OnTimerExpired.connect(boost::bind(&DeadlineQueue::TimerHandler, this));
+}
+
+DeadlineQueue::~DeadlineQueue(void)
+{
+	m_Timer->Stop(true);
+}
+
+void DeadlineQueue::Start(void)
+{
+	m_Timer->Start();
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_TimerNext = -1;
+	RescheduleTimer(GetNextDeadline());
+}
+
+void DeadlineQueue::Stop(void)
+{
+	m_Timer->Stop(true);
+}
+
+/**
+ * Schedules the callback for the object, replacing any previous deadline.
+ *
+ * @param object The object.
+ * @param deadline When the callback should be invoked.
+ */
+void DeadlineQueue::Set(const Object::Ptr& object, double deadline)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	auto it = m_Entries.find(object);
+
+	if (it != m_Entries.end())
+		m_Entries.erase(it);
+
+	Entry entry;
+	entry.Target = object;
+	entry.Deadline = deadline;
+	m_Entries.insert(entry);
+
+	if (m_TimerNext < 0 || deadline < m_TimerNext)
+		RescheduleTimer(deadline);
+}
+
+void DeadlineQueue::Remove(const Object::Ptr& object)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_Entries.erase(object);
+}
+
+size_t DeadlineQueue::GetLength(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_Entries.size();
+}
+
+/**
+ * Returns the earliest deadline, or -1 if the queue is empty.
+ */
+double DeadlineQueue::GetNextDeadline(void) const
+{
+	const auto& idx = boost::get<1>(m_Entries);
+
+	if (idx.empty())
+		return -1;
+
+	return idx.begin()->Deadline;
+}
+
+/**
+ * Removes the objects which are due and invokes the callback for them. The
+ * callback may call Set() to schedule the object again.
+ *
+ * @param now The current time.
+ * @returns The number of objects which were due.
+ */
+size_t DeadlineQueue::Process(double now)
+{
+	std::vector<Object::Ptr> objects;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		auto& idx = boost::get<1>(m_Entries);
+
+		for (auto it = idx.begin(); it != idx.end() && it->Deadline <= now;) {
+			objects.push_back(it->Target);
+			it = idx.erase(it);
+		}
+
+		m_TimerNext = -1;
+		RescheduleTimer(GetNextDeadline());
+	}
+
+	for (const Object::Ptr& object : objects) {
+		try {
+			m_Callback(object);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "DeadlineQueue")
+			    << "Exception thrown in deadline handler:\n"
+			    << DiagnosticInformation(ex);
+		}
+	}
+
+	return objects.size();
+}
+
+/**
+ * Makes sure the timer fires no later than the specified deadline.
+ *
+ * @param next The deadline, or -1 to fall back to the timer's interval.
+ */
+void DeadlineQueue::RescheduleTimer(double next)
+{
+	double fallback = Utility::GetTime() + m_Interval;
+
+	if (next < 0 || next > fallback)
+		next = fallback;
+
+	m_TimerNext = next;
+	m_Timer->Reschedule(next);
+}
+
+void DeadlineQueue::TimerHandler(void)
+{
+	Process(Utility::GetTime());
+}
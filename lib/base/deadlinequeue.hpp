@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef DEADLINEQUEUE_H
+#define DEADLINEQUEUE_H
+
+#include "base/i2-base.hpp"
+#include "base/object.hpp"
+#include "base/timer.hpp"
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+namespace icinga
+{
+
+/**
+ * Invokes a callback for objects once their deadline has been reached.
+ * Only the objects which are due are looked at, and the underlying timer
+ * is rescheduled to the earliest deadline rather than polling.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API DeadlineQueue : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(DeadlineQueue);
+
+	typedef boost::function<void (const Object::Ptr&)> Callback;
+
+	DeadlineQueue(const Callback& callback, double interval = 60);
+	~DeadlineQueue(void);
+
+	void Start(void);
+	void Stop(void);
+
+	void Set(const Object::Ptr& object, double deadline);
+	void Remove(const Object::Ptr& object);
+
+	size_t GetLength(void) const;
+	double GetNextDeadline(void) const;
+
+	size_t Process(double now);
+
+private:
+	struct Entry
+	{
+		Object::Ptr Target;
+		double Deadline;
+	};
+
+	typedef boost::multi_index_container<
+		Entry,
+		boost::multi_index::indexed_by<
+			boost::multi_index::ordered_unique<boost::multi_index::member<Entry, Object::Ptr, &Entry::Target> >,
+			boost::multi_index::ordered_non_unique<boost::multi_index::member<Entry, double, &Entry::Deadline> >
+		>
+	> EntrySet;
+
+	mutable boost::mutex m_Mutex;
+	EntrySet m_Entries;
+	Callback m_Callback;
+	double m_Interval;
+	double m_TimerNext;
+	Timer::Ptr m_Timer;
+
+	void RescheduleTimer(double next);
+	void TimerHandler(void);
+};
+
+}
+
+#endif /* DEADLINEQUEUE_H */
@@ -22,11 +22,109 @@
 #include "base/debug.hpp"
 #include "base/primitivetype.hpp"
 #include "base/configwriter.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
 REGISTER_PRIMITIVE_TYPE(Dictionary, Object, Dictionary::GetPrototype());
 
+std::atomic<Dictionary::AllocationHook> Dictionary::m_AllocationHook(NULL);
+
+static bool DictionaryPairKeyLess(const Dictionary::Pair& pair, const String& key)
+{
+	return pair.first < key;
+}
+
+static bool DictionaryPairLess(const Dictionary::Pair& a, const Dictionary::Pair& b)
+{
+	return a.first < b.first;
+}
+
+/**
+ * Constructor for the Dictionary class. Builds the dictionary from a list
+ * of key-value pairs in one go. If a key is specified more than once the
+ * last value is used.
+ *
+ * @param data The key-value pairs.
+ */
+Dictionary::Dictionary(PairVector&& data)
+	: m_IsMap(false), m_Flat(std::move(data))
+{
+	std::stable_sort(m_Flat.begin(), m_Flat.end(), DictionaryPairLess);
+
+	/* keep the last value for duplicate keys */
+	PairVector::iterator out = m_Flat.begin();
+
+	for (PairVector::iterator it = m_Flat.begin(); it != m_Flat.end(); ++it) {
+		PairVector::iterator next = it + 1;
+
+		if (next != m_Flat.end() && next->first == it->first)
+			continue;
+
+		if (out != it)
+			*out = std::move(*it);
+
+		++out;
+	}
+
+	m_Flat.erase(out, m_Flat.end());
+
+	if (m_Flat.size() > DICTIONARY_FLAT_THRESHOLD)
+		ConvertToMap();
+}
+
+const Dictionary::Pair *Dictionary::Find(const String& key) const
+{
+	if (m_IsMap) {
+		auto it = m_Map.find(key);
+
+		if (it == m_Map.end())
+			return NULL;
+
+		return &it->second;
+	}
+
+	auto it = std::lower_bound(m_Flat.begin(), m_Flat.end(), key, DictionaryPairKeyLess);
+
+	if (it == m_Flat.end() || it->first != key)
+		return NULL;
+
+	return &*it;
+}
+
+Dictionary::Pair *Dictionary::Find(const String& key)
+{
+	return const_cast<Pair *>(static_cast<const Dictionary *>(this)->Find(key));
+}
+
+/**
+ * Inserts a key which is not yet in the dictionary.
+ */
+void Dictionary::Insert(const String& key, Value&& value)
+{
+	if (!m_IsMap && m_Flat.size() >= DICTIONARY_FLAT_THRESHOLD)
+		ConvertToMap();
+
+	if (m_IsMap) {
+		m_Map.insert(std::make_pair(key, Pair(key, std::move(value))));
+		return;
+	}
+
+	auto it = std::lower_bound(m_Flat.begin(), m_Flat.end(), key, DictionaryPairKeyLess);
+	m_Flat.insert(it, Pair(key, std::move(value)));
+}
+
+void Dictionary::ConvertToMap(void)
+{
+	for (Pair& kv : m_Flat) {
+		String key = kv.first;
+		m_Map.insert(m_Map.end(), std::make_pair(std::move(key), std::move(kv)));
+	}
+
+	PairVector().swap(m_Flat);
+	m_IsMap = true;
+}
+
 /**
  * Retrieves a value from a dictionary.
  *
@@ -37,12 +135,12 @@ Value Dictionary::Get(const String& key) const
 {
 	ObjectLock olock(this);
 
-	auto it = m_Data.find(key);
+	const Pair *kv = Find(key);
 
-	if (it == m_Data.end())
+	if (!kv)
 		return Empty;
 
-	return it->second;
+	return kv->second;
 }
 
 
@@ -57,12 +155,12 @@ bool Dictionary::Get(const String& key, Value *result) const
 {
 	ObjectLock olock(this);
 
-	auto it = m_Data.find(key);
+	const Pair *kv = Find(key);
 
-	if (it == m_Data.end())
+	if (!kv)
 		return false;
 
-	*result = it->second;
+	*result = kv->second;
 	return true;
 }
 
@@ -76,7 +174,12 @@ void Dictionary::Set(const String& key, const Value& value)
 {
 	ObjectLock olock(this);
 
-	m_Data[key] = value;
+	Pair *kv = Find(key);
+
+	if (kv)
+		kv->second = value;
+	else
+		Insert(key, Value(value));
 }
 
 /**
@@ -89,7 +192,12 @@ void Dictionary::Set(const String& key, Value&& value)
 {
 	ObjectLock olock(this);
 
-	m_Data[key] = std::move(value);
+	Pair *kv = Find(key);
+
+	if (kv)
+		kv->second = std::move(value);
+	else
+		Insert(key, std::move(value));
 }
 
 /**
@@ -101,7 +209,7 @@ size_t Dictionary::GetLength(void) const
 {
 	ObjectLock olock(this);
 
-	return m_Data.size();
+	return m_IsMap ? m_Map.size() : m_Flat.size();
 }
 
 /**
@@ -114,7 +222,7 @@ bool Dictionary::Contains(const String& key) const
 {
 	ObjectLock olock(this);
 
-	return (m_Data.find(key) != m_Data.end());
+	return Find(key) != NULL;
 }
 
 /**
@@ -126,13 +234,17 @@ void Dictionary::Remove(const String& key)
 {
 	ObjectLock olock(this);
 
-	Dictionary::Iterator it;
-	it = m_Data.find(key);
+	if (m_IsMap) {
+		m_Map.erase(key);
+		return;
+	}
 
-	if (it == m_Data.end())
+	auto it = std::lower_bound(m_Flat.begin(), m_Flat.end(), key, DictionaryPairKeyLess);
+
+	if (it == m_Flat.end() || it->first != key)
 		return;
 
-	m_Data.erase(it);
+	m_Flat.erase(it);
 }
 
 /**
@@ -142,14 +254,16 @@ void Dictionary::Clear(void)
 {
 	ObjectLock olock(this);
 
-	m_Data.clear();
+	m_Flat.clear();
+	m_Map.clear();
+	m_IsMap = false;
 }
 
 void Dictionary::CopyTo(const Dictionary::Ptr& dest) const
 {
 	ObjectLock olock(this);
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	for (const Dictionary::Pair& kv : const_cast<Dictionary *>(this)) {
 		dest->Set(kv.first, kv.second);
 	}
 }
@@ -177,7 +291,7 @@ Object::Ptr Dictionary::Clone(void) const
 	Dictionary::Ptr dict = new Dictionary();
 
 	ObjectLock olock(this);
-	for (const Dictionary::Pair& kv : m_Data) {
+	for (const Dictionary::Pair& kv : const_cast<Dictionary *>(this)) {
 		dict->Set(kv.first, kv.second.Clone());
 	}
 
@@ -195,8 +309,9 @@ std::vector<String> Dictionary::GetKeys(void) const
 	ObjectLock olock(this);
 
 	std::vector<String> keys;
+	keys.reserve(GetLength());
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	for (const Dictionary::Pair& kv : const_cast<Dictionary *>(this)) {
 		keys.push_back(kv.first);
 	}
 
@@ -234,3 +349,14 @@ bool Dictionary::GetOwnField(const String& field, Value *result) const
 {
 	return Get(field, result);
 }
+
+/**
+ * Sets a function which is called for every allocation that is made for the
+ * data of any dictionary. This is meant for the unit tests.
+ *
+ * @param hook The function, or NULL to remove the hook.
+ */
+void Dictionary::SetAllocationHook(AllocationHook hook)
+{
+	m_AllocationHook = hook;
+}
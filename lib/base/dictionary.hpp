@@ -24,15 +24,55 @@
 #include "base/object.hpp"
 #include "base/value.hpp"
 #include <boost/range/iterator.hpp>
+#include <atomic>
+#include <iterator>
 #include <map>
 #include <vector>
 
 namespace icinga
 {
 
+/**
+ * Dictionaries with up to this many keys are stored in a sorted vector.
+ * Larger dictionaries are converted into a map.
+ */
+#define DICTIONARY_FLAT_THRESHOLD 32
+
+/**
+ * The allocator which is used for the data of a Dictionary. It works like
+ * std::allocator but reports each allocation to the hook which was set with
+ * Dictionary::SetAllocationHook().
+ *
+ * @ingroup base
+ */
+template<typename T>
+struct DictionaryAllocator : public std::allocator<T>
+{
+	template<typename U>
+	struct rebind
+	{
+		typedef DictionaryAllocator<U> other;
+	};
+
+	DictionaryAllocator(void)
+	{ }
+
+	template<typename U>
+	DictionaryAllocator(const DictionaryAllocator<U>&)
+	{ }
+
+	T *allocate(size_t n);
+};
+
 /**
  * A container that holds key-value pairs.
  *
+ * Keys are kept in sorted order. Small dictionaries (which most check
+ * results, macro dictionaries and cluster messages are) are stored in a
+ * sorted vector which doesn't need an allocation per key. Once a
+ * dictionary grows beyond DICTIONARY_FLAT_THRESHOLD keys it is converted
+ * into a map.
+ *
  * @ingroup base
  */
 class I2_BASE_API Dictionary : public Object
@@ -40,18 +80,92 @@ class I2_BASE_API Dictionary : public Object
 public:
 	DECLARE_OBJECT(Dictionary);
 
+	typedef std::pair<String, Value> Pair;
+	typedef std::vector<Pair, DictionaryAllocator<Pair> > PairVector;
+	typedef std::map<String, Pair, std::less<String>, DictionaryAllocator<std::pair<const String, Pair> > > PairMap;
+
+	typedef PairVector::size_type SizeType;
+
+	typedef void (*AllocationHook)(size_t size);
+
 	/**
 	 * An iterator that can be used to iterate over dictionary elements.
 	 */
-	typedef std::map<String, Value>::iterator Iterator;
+	class Iterator : public std::iterator<std::bidirectional_iterator_tag, Pair>
+	{
+	public:
+		inline Iterator(void)
+			: m_IsMap(false)
+		{ }
+
+		inline Pair& operator*(void) const
+		{
+			return m_IsMap ? m_MapIt->second : *m_FlatIt;
+		}
+
+		inline Pair *operator->(void) const
+		{
+			return &**this;
+		}
 
-	typedef std::map<String, Value>::size_type SizeType;
+		inline Iterator& operator++(void)
+		{
+			if (m_IsMap)
+				++m_MapIt;
+			else
+				++m_FlatIt;
 
-	typedef std::map<String, Value>::value_type Pair;
+			return *this;
+		}
+
+		inline Iterator operator++(int)
+		{
+			Iterator it = *this;
+			++*this;
+			return it;
+		}
+
+		inline Iterator& operator--(void)
+		{
+			if (m_IsMap)
+				--m_MapIt;
+			else
+				--m_FlatIt;
+
+			return *this;
+		}
+
+		inline Iterator operator--(int)
+		{
+			Iterator it = *this;
+			--*this;
+			return it;
+		}
+
+		inline bool operator==(const Iterator& other) const
+		{
+			return m_IsMap ? m_MapIt == other.m_MapIt : m_FlatIt == other.m_FlatIt;
+		}
+
+		inline bool operator!=(const Iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		friend class Dictionary;
+
+		bool m_IsMap;
+		PairVector::iterator m_FlatIt;
+		PairMap::iterator m_MapIt;
+	};
 
 	inline Dictionary(void)
+		: m_IsMap(false)
 	{ }
 
+	Dictionary(PairVector&& data);
+
 	inline ~Dictionary(void)
 	{ }
 
@@ -72,7 +186,15 @@ public:
 	{
 		ASSERT(OwnsLock());
 
-		return m_Data.begin();
+		Iterator it;
+		it.m_IsMap = m_IsMap;
+
+		if (m_IsMap)
+			it.m_MapIt = m_Map.begin();
+		else
+			it.m_FlatIt = m_Flat.begin();
+
+		return it;
 	}
 
 	/**
@@ -86,7 +208,15 @@ public:
 	{
 		ASSERT(OwnsLock());
 
-		return m_Data.end();
+		Iterator it;
+		it.m_IsMap = m_IsMap;
+
+		if (m_IsMap)
+			it.m_MapIt = m_Map.end();
+		else
+			it.m_FlatIt = m_Flat.end();
+
+		return it;
 	}
 
 	size_t GetLength(void) const;
@@ -102,7 +232,10 @@ public:
 	{
 		ASSERT(OwnsLock());
 
-		m_Data.erase(it);
+		if (m_IsMap)
+			m_Map.erase(it.m_MapIt);
+		else
+			m_Flat.erase(it.m_FlatIt);
 	}
 
 	void Clear(void);
@@ -113,6 +246,8 @@ public:
 	std::vector<String> GetKeys(void) const;
 
 	static Object::Ptr GetPrototype(void);
+
+	static void SetAllocationHook(AllocationHook hook);
 	
 	virtual Object::Ptr Clone(void) const override;
 
@@ -124,9 +259,32 @@ public:
 	virtual bool GetOwnField(const String& field, Value *result) const override;
 
 private:
-	std::map<String, Value> m_Data; /**< The data for the dictionary. */
+	bool m_IsMap; /**< Whether the data is stored in m_Map rather than m_Flat. */
+	PairVector m_Flat; /**< The data for small dictionaries, sorted by key. */
+	PairMap m_Map; /**< The data for large dictionaries. */
+
+	static std::atomic<AllocationHook> m_AllocationHook;
+
+	template<typename T>
+	friend struct DictionaryAllocator;
+
+	const Pair *Find(const String& key) const;
+	Pair *Find(const String& key);
+	void Insert(const String& key, Value&& value);
+	void ConvertToMap(void);
 };
 
+template<typename T>
+T *DictionaryAllocator<T>::allocate(size_t n)
+{
+	Dictionary::AllocationHook hook = Dictionary::m_AllocationHook.load(std::memory_order_relaxed);
+
+	if (hook)
+		hook(n * sizeof(T));
+
+	return std::allocator<T>::allocate(n);
+}
+
 inline Dictionary::Iterator begin(Dictionary::Ptr x)
 {
 	return x->Begin();
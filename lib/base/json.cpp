@@ -18,12 +18,14 @@
  ******************************************************************************/
 
 #include "base/json.hpp"
+#include "base/jsondecoder.hpp"
 #include "base/debug.hpp"
 #include "base/dictionary.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include "base/convert.hpp"
 #include <boost/exception_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <yajl/yajl_version.h>
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
@@ -123,6 +125,87 @@ String icinga::JsonEncode(const Value& value, bool pretty_print)
 	return result;
 }
 
+/**
+ * Collects the output of the yajl generator and hands it to the
+ * caller's callback in chunks of at most JSON_CHUNK_SIZE bytes.
+ */
+struct JsonChunkContext
+{
+	const JsonChunkCallback& Callback;
+	char Buffer[JSON_CHUNK_SIZE];
+	size_t Size;
+
+	JsonChunkContext(const JsonChunkCallback& callback)
+		: Callback(callback), Size(0)
+	{ }
+
+	void Append(const char *str, size_t len)
+	{
+		while (len > 0) {
+			size_t count = std::min(len, sizeof(Buffer) - Size);
+
+			memcpy(Buffer + Size, str, count);
+			Size += count;
+			str += count;
+			len -= count;
+
+			if (Size == sizeof(Buffer))
+				Flush();
+		}
+	}
+
+	void Flush(void)
+	{
+		if (Size == 0)
+			return;
+
+		Callback(Buffer, Size);
+		Size = 0;
+	}
+};
+
+static void JsonPrintCallback(void *ctx, const char *str, yajl_size len)
+{
+	static_cast<JsonChunkContext *>(ctx)->Append(str, len);
+}
+
+/**
+ * Encodes a value without building the whole document in memory. The
+ * encoded data is passed to the callback in chunks of at most
+ * JSON_CHUNK_SIZE bytes as soon as it is available.
+ *
+ * @param value The value.
+ * @param callback The callback which receives the encoded data.
+ * @param pretty_print Whether to indent the output.
+ */
+void icinga::JsonEncode(const Value& value, const JsonChunkCallback& callback, bool pretty_print)
+{
+	boost::scoped_ptr<JsonChunkContext> context(new JsonChunkContext(callback));
+
+#if YAJL_MAJOR < 2
+	yajl_gen_config conf = { pretty_print, "" };
+	yajl_gen handle = yajl_gen_alloc2(JsonPrintCallback, &conf, NULL, context.get());
+#else /* YAJL_MAJOR */
+	yajl_gen handle = yajl_gen_alloc(NULL);
+	yajl_gen_config(handle, yajl_gen_print_callback, JsonPrintCallback, context.get());
+	if (pretty_print)
+		yajl_gen_config(handle, yajl_gen_beautify, 1);
+#endif /* YAJL_MAJOR */
+
+	try {
+		Encode(handle, value);
+		context->Flush();
+	} catch (...) {
+		yajl_gen_free(handle);
+		throw;
+	}
+
+	yajl_gen_free(handle);
+}
+
+namespace icinga
+{
+
 struct JsonElement
 {
 	String Key;
@@ -203,6 +286,8 @@ private:
 	boost::exception_ptr m_Exception;
 };
 
+}
+
 static int DecodeNull(void *ctx)
 {
 	JsonContext *context = static_cast<JsonContext *>(ctx);
@@ -302,56 +387,138 @@ static int DecodeStartArray(void *ctx)
 	return 1;
 }
 
-Value icinga::JsonDecode(const String& data)
+static const yajl_callbacks l_JsonCallbacks = {
+	DecodeNull,
+	DecodeBoolean,
+	NULL,
+	NULL,
+	DecodeNumber,
+	DecodeString,
+	DecodeStartMap,
+	DecodeString,
+	DecodeEndMapOrArray,
+	DecodeStartArray,
+	DecodeEndMapOrArray
+};
+
+JsonStreamDecoder::JsonStreamDecoder(void)
+	: m_Context(new JsonContext()), m_Length(0)
 {
-	static const yajl_callbacks callbacks = {
-		DecodeNull,
-		DecodeBoolean,
-		NULL,
-		NULL,
-		DecodeNumber,
-		DecodeString,
-		DecodeStartMap,
-		DecodeString,
-		DecodeEndMapOrArray,
-		DecodeStartArray,
-		DecodeEndMapOrArray
-	};
-
-	yajl_handle handle;
 #if YAJL_MAJOR < 2
 	yajl_parser_config cfg = { 1, 0 };
+	m_Handle = yajl_alloc(&l_JsonCallbacks, &cfg, NULL, m_Context.get());
+#else /* YAJL_MAJOR */
+	m_Handle = yajl_alloc(&l_JsonCallbacks, NULL, m_Context.get());
+	yajl_config(m_Handle, yajl_dont_validate_strings, 1);
+	yajl_config(m_Handle, yajl_allow_comments, 1);
 #endif /* YAJL_MAJOR */
-	JsonContext context;
+}
+
+JsonStreamDecoder::~JsonStreamDecoder(void)
+{
+	yajl_free(m_Handle);
+}
+
+/**
+ * Passes the next part of the document to the parser. The data does not
+ * have to be split at token boundaries and is not retained after this
+ * function returns.
+ *
+ * @param data The data.
+ * @param length The length of the data.
+ */
+void JsonStreamDecoder::Feed(const char *data, size_t length)
+{
+	if (length == 0)
+		return;
+
+	m_Length += length;
+
+	yajl_status status = yajl_parse(m_Handle, reinterpret_cast<const unsigned char *>(data), length);
 
 #if YAJL_MAJOR < 2
-	handle = yajl_alloc(&callbacks, &cfg, NULL, &context);
-#else /* YAJL_MAJOR */
-	handle = yajl_alloc(&callbacks, NULL, &context);
-	yajl_config(handle, yajl_dont_validate_strings, 1);
-	yajl_config(handle, yajl_allow_comments, 1);
+	if (status == yajl_status_insufficient_data)
+		status = yajl_status_ok;
 #endif /* YAJL_MAJOR */
 
-	yajl_parse(handle, reinterpret_cast<const unsigned char *>(data.CStr()), data.GetLength());
+	if (status != yajl_status_ok) {
+		/* throw saved exception (if there is one) */
+		m_Context->ThrowException();
+
+		unsigned char *internal_err_str = yajl_get_error(m_Handle, 1, reinterpret_cast<const unsigned char *>(data), length);
+		String msg = reinterpret_cast<char *>(internal_err_str);
+		yajl_free_error(m_Handle, internal_err_str);
+
+		BOOST_THROW_EXCEPTION(std::invalid_argument(msg));
+	}
+}
 
+/**
+ * Tells the parser that the whole document has been fed.
+ *
+ * @returns The decoded value.
+ */
+Value JsonStreamDecoder::Finish(void)
+{
 #if YAJL_MAJOR < 2
-	if (yajl_parse_complete(handle) != yajl_status_ok) {
+	if (yajl_parse_complete(m_Handle) != yajl_status_ok) {
 #else /* YAJL_MAJOR */
-	if (yajl_complete_parse(handle) != yajl_status_ok) {
+	if (yajl_complete_parse(m_Handle) != yajl_status_ok) {
 #endif /* YAJL_MAJOR */
-		unsigned char *internal_err_str = yajl_get_error(handle, 1, reinterpret_cast<const unsigned char *>(data.CStr()), data.GetLength());
-		String msg = reinterpret_cast<char *>(internal_err_str);
-		yajl_free_error(handle, internal_err_str);
+		m_Context->ThrowException();
 
-		yajl_free(handle);
-
-		/* throw saved exception (if there is one) */
-		context.ThrowException();
+		unsigned char *internal_err_str = yajl_get_error(m_Handle, 0, NULL, 0);
+		String msg = reinterpret_cast<char *>(internal_err_str);
+		yajl_free_error(m_Handle, internal_err_str);
 
 		BOOST_THROW_EXCEPTION(std::invalid_argument(msg));
 	}
 
-	yajl_free(handle);
+	return m_Context->GetValue();
+}
+
+/**
+ * Returns the number of bytes which have been fed so far.
+ *
+ * @returns The number of bytes.
+ */
+size_t JsonStreamDecoder::GetLength(void) const
+{
+	return m_Length;
+}
+
+/**
+ * Decodes a JSON document.
+ *
+ * @param data The JSON document.
+ * @param use_index Whether to try the structural index decoder before
+ *                  falling back to yajl.
+ * @returns The decoded value.
+ */
+Value icinga::JsonDecode(const String& data, bool use_index)
+{
+	return JsonDecode(data.CStr(), data.GetLength(), use_index);
+}
+
+/**
+ * Decodes a JSON document which doesn't have to be stored in a String.
+ *
+ * @param data The JSON document.
+ * @param length The length of the document.
+ * @param use_index Whether to try the structural index decoder before
+ *                  falling back to yajl.
+ * @returns The decoded value.
+ */
+Value icinga::JsonDecode(const char *data, size_t length, bool use_index)
+{
+	if (use_index) {
+		Value result;
+
+		if (JsonDecoder::Decode(data, length, &result))
+			return result;
+	}
 
-	return context.GetValue();
+	JsonStreamDecoder decoder;
+	decoder.Feed(data, length);
+	return decoder.Finish();
 }
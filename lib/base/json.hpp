@@ -21,15 +21,52 @@
 #define JSON_H
 
 #include "base/i2-base.hpp"
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
+struct yajl_handle_t;
 
 namespace icinga
 {
 
 class String;
 class Value;
+struct JsonContext;
+
+/**
+ * Maximum number of bytes which are passed to a JsonChunkCallback at once.
+ */
+#define JSON_CHUNK_SIZE (16 * 1024)
+
+typedef boost::function<void (const char *data, size_t count)> JsonChunkCallback;
 
 I2_BASE_API String JsonEncode(const Value& value, bool pretty_print = false);
-I2_BASE_API Value JsonDecode(const String& data);
+I2_BASE_API void JsonEncode(const Value& value, const JsonChunkCallback& callback, bool pretty_print = false);
+I2_BASE_API Value JsonDecode(const String& data, bool use_index = true);
+I2_BASE_API Value JsonDecode(const char *data, size_t length, bool use_index = true);
+
+/**
+ * Incrementally decodes a JSON document which arrives in arbitrary pieces,
+ * e.g. while it is being read from a socket.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API JsonStreamDecoder
+{
+public:
+	JsonStreamDecoder(void);
+	~JsonStreamDecoder(void);
+
+	void Feed(const char *data, size_t length);
+	Value Finish(void);
+
+	size_t GetLength(void) const;
+
+private:
+	yajl_handle_t *m_Handle;
+	boost::scoped_ptr<JsonContext> m_Context;
+	size_t m_Length;
+};
 
 }
 
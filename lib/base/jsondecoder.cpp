@@ -0,0 +1,764 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/jsondecoder.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include <cstring>
+#include <stdint.h>
+#include <climits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#	define I2_JSONDECODER_X86
+#	include <immintrin.h>
+#endif /* __GNUC__ */
+
+using namespace icinga;
+
+#define JSONDECODER_MAX_DEPTH 512
+
+enum JsonCharClass
+{
+	JsonClassQuote = 1,
+	JsonClassBackslash = 2,
+	JsonClassStructural = 4,
+	JsonClassWhitespace = 8,
+	JsonClassControl = 16,
+	JsonClassSlash = 32
+};
+
+/**
+ * Character classes for a 64-byte block of input. Bit i in each of the
+ * masks belongs to the i-th byte of the block.
+ */
+struct JsonBlockMasks
+{
+	uint64_t Quote;
+	uint64_t Backslash;
+	uint64_t Structural;
+	uint64_t Whitespace;
+	uint64_t Control;
+	uint64_t Slash;
+};
+
+struct JsonCharClassTable
+{
+	unsigned char Classes[256];
+
+	JsonCharClassTable(void)
+	{
+		memset(Classes, 0, sizeof(Classes));
+
+		for (int i = 0; i < 0x20; i++)
+			Classes[i] = JsonClassControl;
+
+		Classes[static_cast<unsigned char>('"')] = JsonClassQuote;
+		Classes[static_cast<unsigned char>('\\')] = JsonClassBackslash;
+		Classes[static_cast<unsigned char>('/')] = JsonClassSlash;
+
+		const char *structural = "{}[]:,";
+		for (const char *p = structural; *p; p++)
+			Classes[static_cast<unsigned char>(*p)] = JsonClassStructural;
+
+		const char *whitespace = " \t\n\r";
+		for (const char *p = whitespace; *p; p++)
+			Classes[static_cast<unsigned char>(*p)] |= JsonClassWhitespace;
+	}
+};
+
+static JsonCharClassTable l_JsonCharClasses;
+
+static inline int JsonCountTrailingZeros(uint64_t value)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(value);
+#else /* __GNUC__ */
+	int count = 0;
+
+	while (!(value & 1)) {
+		value >>= 1;
+		count++;
+	}
+
+	return count;
+#endif /* __GNUC__ */
+}
+
+/**
+ * Computes a mask which has all bits set from an opening quote up to (but
+ * not including) the matching closing quote.
+ */
+static inline uint64_t JsonPrefixXor(uint64_t value)
+{
+	value ^= value << 1;
+	value ^= value << 2;
+	value ^= value << 4;
+	value ^= value << 8;
+	value ^= value << 16;
+	value ^= value << 32;
+	return value;
+}
+
+static void JsonClassifyBlockGeneric(const char *data, JsonBlockMasks& masks)
+{
+	memset(&masks, 0, sizeof(masks));
+
+	for (int i = 0; i < 64; i++) {
+		unsigned char cls = l_JsonCharClasses.Classes[static_cast<unsigned char>(data[i])];
+
+		if (!cls)
+			continue;
+
+		uint64_t bit = 1ULL << i;
+
+		if (cls & JsonClassQuote)
+			masks.Quote |= bit;
+		if (cls & JsonClassBackslash)
+			masks.Backslash |= bit;
+		if (cls & JsonClassStructural)
+			masks.Structural |= bit;
+		if (cls & JsonClassWhitespace)
+			masks.Whitespace |= bit;
+		if (cls & JsonClassControl)
+			masks.Control |= bit;
+		if (cls & JsonClassSlash)
+			masks.Slash |= bit;
+	}
+}
+
+#ifdef I2_JSONDECODER_X86
+static inline uint64_t JsonMaskSSE2(__m128i value)
+{
+	return static_cast<uint16_t>(_mm_movemask_epi8(value));
+}
+
+static void JsonClassifyBlockSSE2(const char *data, JsonBlockMasks& masks)
+{
+	memset(&masks, 0, sizeof(masks));
+
+	for (int i = 0; i < 4; i++) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16));
+		int shift = i * 16;
+
+		/* '[' and ']' only differ from '{' and '}' in the 0x20 bit */
+		__m128i lower = _mm_or_si128(in, _mm_set1_epi8(0x20));
+		__m128i structural = _mm_or_si128(
+		    _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+		    _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(':')), _mm_cmpeq_epi8(in, _mm_set1_epi8(','))));
+		__m128i whitespace = _mm_or_si128(
+		    _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t'))),
+		    _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\r'))));
+		/* unsigned comparison: in <= 0x1f */
+		__m128i control = _mm_cmpeq_epi8(_mm_max_epu8(in, _mm_set1_epi8(0x1f)), _mm_set1_epi8(0x1f));
+
+		masks.Quote |= JsonMaskSSE2(_mm_cmpeq_epi8(in, _mm_set1_epi8('"'))) << shift;
+		masks.Backslash |= JsonMaskSSE2(_mm_cmpeq_epi8(in, _mm_set1_epi8('\\'))) << shift;
+		masks.Structural |= JsonMaskSSE2(structural) << shift;
+		masks.Whitespace |= JsonMaskSSE2(whitespace) << shift;
+		masks.Control |= JsonMaskSSE2(control) << shift;
+		masks.Slash |= JsonMaskSSE2(_mm_cmpeq_epi8(in, _mm_set1_epi8('/'))) << shift;
+	}
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t JsonMaskAVX2(__m256i value)
+{
+	return static_cast<uint32_t>(_mm256_movemask_epi8(value));
+}
+
+__attribute__((target("avx2")))
+static void JsonClassifyBlockAVX2(const char *data, JsonBlockMasks& masks)
+{
+	memset(&masks, 0, sizeof(masks));
+
+	for (int i = 0; i < 2; i++) {
+		__m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i * 32));
+		int shift = i * 32;
+
+		__m256i lower = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+		__m256i structural = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8(','))));
+		__m256i whitespace = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\t'))),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\r'))));
+		__m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(in, _mm256_set1_epi8(0x1f)), _mm256_set1_epi8(0x1f));
+
+		masks.Quote |= JsonMaskAVX2(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('"'))) << shift;
+		masks.Backslash |= JsonMaskAVX2(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\\'))) << shift;
+		masks.Structural |= JsonMaskAVX2(structural) << shift;
+		masks.Whitespace |= JsonMaskAVX2(whitespace) << shift;
+		masks.Control |= JsonMaskAVX2(control) << shift;
+		masks.Slash |= JsonMaskAVX2(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'))) << shift;
+	}
+}
+#endif /* I2_JSONDECODER_X86 */
+
+typedef void (*JsonClassifyFunc)(const char *data, JsonBlockMasks& masks);
+
+struct JsonClassifier
+{
+	JsonClassifyFunc Classify;
+	const char *Name;
+
+	JsonClassifier(void)
+		: Classify(JsonClassifyBlockGeneric), Name("generic")
+	{
+#ifdef I2_JSONDECODER_X86
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2")) {
+			Classify = JsonClassifyBlockAVX2;
+			Name = "avx2";
+		} else {
+			Classify = JsonClassifyBlockSSE2;
+			Name = "sse2";
+		}
+#endif /* I2_JSONDECODER_X86 */
+	}
+};
+
+static JsonClassifier l_JsonClassifier;
+
+static const double l_JsonPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Builds the Value tree for a document from its structural index.
+ */
+class JsonIndexParser
+{
+public:
+	JsonIndexParser(const char *data, size_t length, const std::vector<unsigned int>& index)
+		: m_Data(data), m_Length(length), m_Index(index), m_Position(0)
+	{ }
+
+	bool Parse(Value *result)
+	{
+		if (!ParseValue(*result, 0))
+			return false;
+
+		/* trailing garbage */
+		return m_Position == m_Index.size();
+	}
+
+private:
+	const char *m_Data;
+	size_t m_Length;
+	const std::vector<unsigned int>& m_Index;
+	size_t m_Position;
+	std::vector<Value> m_Elements;
+	std::vector<Dictionary::Pair> m_Members;
+
+	inline bool Next(unsigned int& offset)
+	{
+		if (m_Position >= m_Index.size())
+			return false;
+
+		offset = m_Index[m_Position++];
+		return true;
+	}
+
+	bool ParseValue(Value& value, int depth)
+	{
+		unsigned int offset;
+
+		if (!Next(offset))
+			return false;
+
+		switch (m_Data[offset]) {
+			case '{':
+				return ParseObject(value, depth + 1);
+			case '[':
+				return ParseArray(value, depth + 1);
+			case '"': {
+				String str;
+
+				if (!ParseString(offset, str))
+					return false;
+
+				value = std::move(str);
+				return true;
+			}
+			default:
+				return ParseScalar(offset, value);
+		}
+	}
+
+	bool ParseObject(Value& value, int depth)
+	{
+		if (depth > JSONDECODER_MAX_DEPTH)
+			return false;
+
+		/* Like array elements, members are collected on a shared stack so
+		 * that the dictionary can be built with a single allocation. */
+		size_t first = m_Members.size();
+		unsigned int offset;
+
+		if (!Next(offset))
+			return false;
+
+		if (m_Data[offset] != '}') {
+			for (;;) {
+				String key;
+
+				if (m_Data[offset] != '"' || !ParseString(offset, key))
+					return false;
+
+				if (!Next(offset) || m_Data[offset] != ':')
+					return false;
+
+				Value member;
+
+				if (!ParseValue(member, depth))
+					return false;
+
+				m_Members.push_back(Dictionary::Pair(std::move(key), std::move(member)));
+
+				if (!Next(offset))
+					return false;
+
+				if (m_Data[offset] == '}')
+					break;
+
+				if (m_Data[offset] != ',' || !Next(offset))
+					return false;
+			}
+		}
+
+		Dictionary::PairVector members;
+		members.reserve(m_Members.size() - first);
+
+		for (size_t i = first; i < m_Members.size(); i++)
+			members.push_back(std::move(m_Members[i]));
+
+		m_Members.resize(first);
+
+		value = new Dictionary(std::move(members));
+		return true;
+	}
+
+	bool ParseArray(Value& value, int depth)
+	{
+		if (depth > JSONDECODER_MAX_DEPTH)
+			return false;
+
+		/* Elements are collected on a shared stack first so that the
+		 * array can be allocated with its final size. */
+		size_t first = m_Elements.size();
+
+		if (m_Position < m_Index.size() && m_Data[m_Index[m_Position]] == ']') {
+			m_Position++;
+		} else {
+			for (;;) {
+				Value element;
+
+				if (!ParseValue(element, depth))
+					return false;
+
+				m_Elements.push_back(std::move(element));
+
+				unsigned int offset;
+
+				if (!Next(offset))
+					return false;
+
+				if (m_Data[offset] == ']')
+					break;
+
+				if (m_Data[offset] != ',')
+					return false;
+			}
+		}
+
+		Array::Ptr arr = new Array();
+		arr->Reserve(m_Elements.size() - first);
+
+		for (size_t i = first; i < m_Elements.size(); i++)
+			arr->Add(std::move(m_Elements[i]));
+
+		m_Elements.resize(first);
+
+		value = arr;
+		return true;
+	}
+
+	bool ParseString(unsigned int offset, String& result)
+	{
+		unsigned int end;
+
+		/* the closing quote is always the next entry in the index */
+		if (!Next(end) || m_Data[end] != '"')
+			return false;
+
+		const char *begin = m_Data + offset + 1;
+		size_t length = end - offset - 1;
+
+		const char *escape = static_cast<const char *>(memchr(begin, '\\', length));
+
+		if (!escape) {
+			result = String(begin, begin + length);
+			return true;
+		}
+
+		std::string buffer;
+		buffer.reserve(length);
+
+		const char *p = begin;
+		const char *last = begin + length;
+
+		while (escape) {
+			buffer.append(p, escape);
+
+			/* the index guarantees that a backslash is never the last
+			 * character of a string */
+			p = escape + 1;
+
+			switch (*p) {
+				case '"':
+				case '\\':
+				case '/':
+					buffer += *p;
+					break;
+				case 'b':
+					buffer += '\b';
+					break;
+				case 'f':
+					buffer += '\f';
+					break;
+				case 'n':
+					buffer += '\n';
+					break;
+				case 'r':
+					buffer += '\r';
+					break;
+				case 't':
+					buffer += '\t';
+					break;
+				case 'u':
+					if (!DecodeUnicodeEscape(p + 1, last, buffer))
+						return false;
+
+					p += 4;
+					break;
+				default:
+					return false;
+			}
+
+			p++;
+			escape = static_cast<const char *>(memchr(p, '\\', last - p));
+		}
+
+		buffer.append(p, last);
+		result = String(std::move(buffer));
+		return true;
+	}
+
+	static bool DecodeUnicodeEscape(const char *p, const char *last, std::string& buffer)
+	{
+		if (last - p < 4)
+			return false;
+
+		unsigned int codepoint = 0;
+
+		for (int i = 0; i < 4; i++) {
+			char ch = p[i];
+			unsigned int digit;
+
+			if (ch >= '0' && ch <= '9')
+				digit = ch - '0';
+			else if (ch >= 'a' && ch <= 'f')
+				digit = ch - 'a' + 10;
+			else if (ch >= 'A' && ch <= 'F')
+				digit = ch - 'A' + 10;
+			else
+				return false;
+
+			codepoint = (codepoint << 4) | digit;
+		}
+
+		/* NUL characters and surrogate pairs are rare; leave them to yajl
+		 * so that both decoders produce the same strings. */
+		if (codepoint == 0 || (codepoint >= 0xd800 && codepoint <= 0xdfff))
+			return false;
+
+		if (codepoint < 0x80) {
+			buffer += static_cast<char>(codepoint);
+		} else if (codepoint < 0x800) {
+			buffer += static_cast<char>(0xc0 | (codepoint >> 6));
+			buffer += static_cast<char>(0x80 | (codepoint & 0x3f));
+		} else {
+			buffer += static_cast<char>(0xe0 | (codepoint >> 12));
+			buffer += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+			buffer += static_cast<char>(0x80 | (codepoint & 0x3f));
+		}
+
+		return true;
+	}
+
+	bool ParseScalar(unsigned int offset, Value& value)
+	{
+		const char *begin = m_Data + offset;
+		const char *end = begin;
+		const char *last = m_Data + m_Length;
+
+		while (end < last && !(l_JsonCharClasses.Classes[static_cast<unsigned char>(*end)] &
+		    (JsonClassStructural | JsonClassWhitespace | JsonClassQuote)))
+			end++;
+
+		size_t length = end - begin;
+
+		switch (*begin) {
+			case 't':
+				if (length != 4 || memcmp(begin, "true", 4) != 0)
+					return false;
+
+				value = true;
+				return true;
+			case 'f':
+				if (length != 5 || memcmp(begin, "false", 5) != 0)
+					return false;
+
+				value = false;
+				return true;
+			case 'n':
+				if (length != 4 || memcmp(begin, "null", 4) != 0)
+					return false;
+
+				value = Empty;
+				return true;
+			default:
+				return ParseNumber(begin, end, value);
+		}
+	}
+
+	static inline bool IsDigit(char ch)
+	{
+		return ch >= '0' && ch <= '9';
+	}
+
+	static bool ParseNumber(const char *begin, const char *end, Value& value)
+	{
+		const char *p = begin;
+		bool negative = false;
+
+		if (p < end && *p == '-') {
+			negative = true;
+			p++;
+		}
+
+		if (p == end || !IsDigit(*p))
+			return false;
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		/* no leading zeros */
+		if (*p == '0') {
+			p++;
+		} else {
+			while (p < end && IsDigit(*p)) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits++;
+				p++;
+			}
+		}
+
+		if (p < end && *p == '.') {
+			p++;
+
+			if (p == end || !IsDigit(*p))
+				return false;
+
+			while (p < end && IsDigit(*p)) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits++;
+				exponent--;
+				p++;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+
+			bool negativeExponent = false;
+
+			if (p < end && (*p == '+' || *p == '-')) {
+				negativeExponent = (*p == '-');
+				p++;
+			}
+
+			if (p == end || !IsDigit(*p))
+				return false;
+
+			int exp = 0;
+
+			while (p < end && IsDigit(*p)) {
+				if (exp < 100000)
+					exp = exp * 10 + (*p - '0');
+				p++;
+			}
+
+			exponent += negativeExponent ? -exp : exp;
+		}
+
+		if (p != end)
+			return false;
+
+		/* Exact for mantissas which fit into a double and small exponents
+		 * (Clinger's fast path). Everything else is left to lexical_cast
+		 * which is what the yajl-based decoder uses. */
+		if (digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+			double result = static_cast<double>(mantissa);
+
+			if (exponent < 0)
+				result /= l_JsonPowersOfTen[-exponent];
+			else
+				result *= l_JsonPowersOfTen[exponent];
+
+			value = negative ? -result : result;
+			return true;
+		}
+
+		try {
+			value = Convert::ToDouble(String(begin, end));
+		} catch (const std::exception&) {
+			return false;
+		}
+
+		return true;
+	}
+};
+
+/**
+ * Decodes a JSON document.
+ *
+ * @param data The JSON document.
+ * @param[out] result The decoded value.
+ * @returns true if the document could be decoded, false if the caller
+ *          should fall back to the yajl-based decoder.
+ */
+bool JsonDecoder::Decode(const String& data, Value *result)
+{
+	return Decode(data.CStr(), data.GetLength(), result);
+}
+
+bool JsonDecoder::Decode(const char *data, size_t length, Value *result)
+{
+	std::vector<unsigned int> index;
+
+	if (!BuildIndex(data, length, index) || index.empty())
+		return false;
+
+	JsonIndexParser parser(data, length, index);
+	return parser.Parse(result);
+}
+
+/**
+ * Returns the name of the SIMD implementation that is used for building
+ * the structural index on this CPU.
+ *
+ * @returns "avx2", "sse2" or "generic"
+ */
+const char *JsonDecoder::GetImplementation(void)
+{
+	return l_JsonClassifier.Name;
+}
+
+/**
+ * Builds the structural index for a document, i.e. the offsets of all
+ * structural characters outside of strings, all unescaped quotes and the
+ * first character of every number/literal.
+ *
+ * @returns false if the document contains something the index-based
+ *          decoder doesn't handle (comments, control characters in
+ *          strings, unterminated strings).
+ */
+bool JsonDecoder::BuildIndex(const char *data, size_t length, std::vector<unsigned int>& index)
+{
+	if (length >= UINT_MAX)
+		return false;
+
+	index.reserve(length / 4 + 1);
+
+	JsonClassifyFunc classify = l_JsonClassifier.Classify;
+
+	uint64_t escapeCarry = 0;
+	uint64_t stringCarry = 0;
+	uint64_t scalarCarry = 0;
+
+	char tail[64];
+
+	for (size_t offset = 0; offset < length; offset += 64) {
+		const char *block;
+
+		if (length - offset >= 64) {
+			block = data + offset;
+		} else {
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, data + offset, length - offset);
+			block = tail;
+		}
+
+		JsonBlockMasks masks;
+		classify(block, masks);
+
+		/* A backslash escapes the next character unless it is escaped
+		 * itself. Backslashes are rare enough that walking them one by
+		 * one is cheaper than the branch-free variant. */
+		uint64_t escaped = escapeCarry;
+		uint64_t backslash = masks.Backslash & ~escaped;
+		escapeCarry = 0;
+
+		while (backslash) {
+			int bit = JsonCountTrailingZeros(backslash);
+
+			if (bit == 63)
+				escapeCarry = 1;
+			else
+				escaped |= 2ULL << bit;
+
+			backslash &= ~(3ULL << bit);
+		}
+
+		uint64_t quotes = masks.Quote & ~escaped;
+		uint64_t inString = JsonPrefixXor(quotes) ^ stringCarry;
+		stringCarry = (inString >> 63) ? ~0ULL : 0;
+
+		if ((masks.Control & ~masks.Whitespace & ~inString) || (masks.Control & inString) || (masks.Slash & ~inString))
+			return false;
+
+		uint64_t scalar = ~(masks.Structural | masks.Whitespace | masks.Quote) & ~inString;
+		uint64_t scalarStarts = scalar & ~((scalar << 1) | scalarCarry);
+		scalarCarry = scalar >> 63;
+
+		uint64_t tokens = (masks.Structural & ~inString) | quotes | scalarStarts;
+
+		while (tokens) {
+			index.push_back(offset + JsonCountTrailingZeros(tokens));
+			tokens &= tokens - 1;
+		}
+	}
+
+	return !stringCarry && !escapeCarry;
+}
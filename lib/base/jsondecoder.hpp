@@ -0,0 +1,58 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef JSONDECODER_H
+#define JSONDECODER_H
+
+#include "base/i2-base.hpp"
+#include "base/value.hpp"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A JSON decoder which first builds an index of all structural characters
+ * using SIMD instructions (where available) and then builds the Value tree
+ * from that index without looking at every byte again.
+ *
+ * The decoder only handles strict JSON. For anything else (comments,
+ * invalid documents, unusual escapes) Decode() returns false and the
+ * caller is expected to fall back to the yajl-based decoder, which also
+ * produces the error messages.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API JsonDecoder
+{
+public:
+	static bool Decode(const String& data, Value *result);
+	static bool Decode(const char *data, size_t length, Value *result);
+
+	static const char *GetImplementation(void);
+
+private:
+	JsonDecoder(void);
+
+	static bool BuildIndex(const char *data, size_t length, std::vector<unsigned int>& index);
+};
+
+}
+
+#endif /* JSONDECODER_H */
@@ -19,6 +19,7 @@
 
 #include "base/netstring.hpp"
 #include "base/debug.hpp"
+#include "base/convert.hpp"
 #include <sstream>
 
 using namespace icinga;
@@ -126,3 +127,81 @@ void NetString::WriteStringToStream(std::ostream& stream, const String& str)
 {
 	stream << str.GetLength() << ":" << str << ",";
 }
+
+/**
+ * Reads a netstring from a buffer chain. The message is returned without
+ * copying it unless it spans more than one segment.
+ *
+ * @param chain The chain.
+ * @param[out] message The message.
+ * @returns StatusNewItem if a message was read, StatusNeedData otherwise.
+ * @exception invalid_argument The input is invalid.
+ */
+StreamReadStatus NetString::ReadStringFromChain(BufferChain& chain, BufferRange *message)
+{
+	char header[18];
+	size_t count = chain.Peek(header, sizeof(header));
+
+	size_t header_length = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (header[i] == ':') {
+			header_length = i;
+
+			/* make sure there's a header */
+			if (header_length == 0)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (no length specifier)"));
+
+			break;
+		} else if (i > 16)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+	}
+
+	if (header_length == 0)
+		return StatusNeedData;
+
+	/* no leading zeros allowed */
+	if (header[0] == '0' && isdigit(header[1]))
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+	size_t len, i;
+
+	len = 0;
+	for (i = 0; i < header_length && isdigit(header[i]); i++) {
+		/* length specifier must have at most 9 characters */
+		if (i >= 9)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+		len = len * 10 + (header[i] - '0');
+	}
+
+	if (chain.GetAvailableBytes() < header_length + 1 + len + 1)
+		return StatusNeedData;
+
+	chain.Read(NULL, header_length + 1);
+	chain.ReadRange(len, message);
+
+	char trailer;
+	chain.Read(&trailer, 1);
+
+	if (trailer != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+	return StatusNewItem;
+}
+
+/**
+ * Appends a message in netstring format to a buffer chain. The message
+ * itself is not copied.
+ *
+ * @param chain The chain.
+ * @param message The message.
+ */
+void NetString::WriteStringToChain(BufferChain& chain, const BufferRange& message)
+{
+	String header = Convert::ToString(message.Length) + ":";
+
+	chain.Append(header.CStr(), header.GetLength());
+	chain.Append(message);
+	chain.Append(",", 1);
+}
@@ -22,6 +22,7 @@
 
 #include "base/i2-base.hpp"
 #include "base/stream.hpp"
+#include "base/bufferchain.hpp"
 
 namespace icinga
 {
@@ -42,6 +43,9 @@ public:
 	static void WriteStringToStream(const Stream::Ptr& stream, const String& message);
 	static void WriteStringToStream(std::ostream& stream, const String& message);
 
+	static StreamReadStatus ReadStringFromChain(BufferChain& chain, BufferRange *message);
+	static void WriteStringToChain(BufferChain& chain, const BufferRange& message);
+
 private:
 	NetString(void);
 };
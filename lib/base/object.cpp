@@ -25,6 +25,7 @@
 #include "base/timer.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/objectpool.hpp"
 #include <boost/lexical_cast.hpp>
 
 using namespace icinga;
@@ -37,6 +38,13 @@ static std::map<String, int> l_ObjectCounts;
 static Timer::Ptr l_ObjectCountTimer;
 #endif /* I2_LEAK_DEBUG */
 
+#ifdef I2_ALLOC_DEBUG
+static boost::mutex l_ObjectAllocLock;
+static std::map<String, unsigned long> l_ObjectAllocs;
+static double l_ObjectAllocStart;
+static Timer::Ptr l_ObjectAllocTimer;
+#endif /* I2_ALLOC_DEBUG */
+
 /**
  * Default constructor for the Object class.
  */
@@ -55,6 +63,22 @@ Object::~Object(void)
 	delete reinterpret_cast<boost::recursive_mutex *>(m_Mutex);
 }
 
+/**
+ * Allocates memory for an object from the object pool.
+ */
+void *Object::operator new(size_t size)
+{
+	return ObjectPool::Allocate(size);
+}
+
+/**
+ * Returns an object's memory to the object pool.
+ */
+void Object::operator delete(void *ptr, size_t size)
+{
+	ObjectPool::Free(ptr, size);
+}
+
 /**
  * Returns a string representation for the object.
  */
@@ -261,3 +285,41 @@ INITIALIZE_ONCE([]() {
 });
 #endif /* I2_LEAK_DEBUG */
 
+#ifdef I2_ALLOC_DEBUG
+void icinga::TypeAllocObject(Object *object)
+{
+	boost::mutex::scoped_lock lock(l_ObjectAllocLock);
+	String typeName = Utility::GetTypeName(typeid(*object));
+	l_ObjectAllocs[typeName]++;
+}
+
+static void TypeAllocTimerHandler(void)
+{
+	boost::mutex::scoped_lock lock(l_ObjectAllocLock);
+
+	double now = Utility::GetTime();
+	double interval = now - l_ObjectAllocStart;
+	l_ObjectAllocStart = now;
+
+	typedef std::map<String, unsigned long>::value_type kv_pair;
+	for (kv_pair& kv : l_ObjectAllocs) {
+		if (kv.second == 0)
+			continue;
+
+		Log(LogInformation, "TypeInfo")
+		    << kv.second / interval << " " << kv.first << " objects/s allocated";
+
+		kv.second = 0;
+	}
+}
+
+INITIALIZE_ONCE([]() {
+	l_ObjectAllocStart = Utility::GetTime();
+
+	l_ObjectAllocTimer = new Timer();
+	l_ObjectAllocTimer->SetInterval(10);
+	l_ObjectAllocTimer->OnTimerExpired.connect(boost::bind(TypeAllocTimerHandler));
+	l_ObjectAllocTimer->Start();
+});
+#endif /* I2_ALLOC_DEBUG */
+
@@ -116,6 +116,9 @@ public:
 	Object(void);
 	virtual ~Object(void);
 
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
 	virtual String ToString(void) const;
 
 	virtual intrusive_ptr<Type> GetReflectionType(void) const;
@@ -167,6 +170,7 @@ I2_BASE_API Value GetPrototypeField(const Value& context, const String& field, b
 
 void TypeAddObject(Object *object);
 void TypeRemoveObject(Object *object);
+void TypeAllocObject(Object *object);
 
 inline void intrusive_ptr_add_ref(Object *object)
 {
@@ -175,6 +179,11 @@ inline void intrusive_ptr_add_ref(Object *object)
 		TypeAddObject(object);
 #endif /* I2_LEAK_DEBUG */
 
+#ifdef I2_ALLOC_DEBUG
+	if (object->m_References == 0)
+		TypeAllocObject(object);
+#endif /* I2_ALLOC_DEBUG */
+
 #ifdef _WIN32
 	InterlockedIncrement(&object->m_References);
 #else /* _WIN32 */
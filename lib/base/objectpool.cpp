@@ -0,0 +1,222 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "base/objectpool.hpp"
+#include "base/statsfunction.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <cstdlib>
+#include <new>
+
+using namespace icinga;
+
+REGISTER_STATSFUNCTION(ObjectPool, &ObjectPool::StatsFunc);
+
+struct ObjectPoolBlock
+{
+	ObjectPoolBlock *Next;
+};
+
+struct ObjectPoolFreeList
+{
+	ObjectPoolBlock *Head;
+	size_t Count;
+
+	ObjectPoolFreeList(void)
+		: Head(NULL), Count(0)
+	{ }
+
+	inline void Push(ObjectPoolBlock *block)
+	{
+		block->Next = Head;
+		Head = block;
+		Count++;
+	}
+
+	inline ObjectPoolBlock *Pop(void)
+	{
+		ObjectPoolBlock *block = Head;
+		Head = block->Next;
+		Count--;
+		return block;
+	}
+
+	void MoveTo(ObjectPoolFreeList& other, size_t count)
+	{
+		while (Head && count > 0) {
+			other.Push(Pop());
+			count--;
+		}
+	}
+};
+
+struct ObjectPoolDepot
+{
+	boost::mutex Mutex;
+	ObjectPoolFreeList Free;
+	size_t Slabs;
+
+	ObjectPoolDepot(void)
+		: Slabs(0)
+	{ }
+};
+
+static ObjectPoolDepot *GetObjectPoolDepots(void)
+{
+	/* objects may still be freed while static destructors are running,
+	 * so the depots are never destroyed */
+	static ObjectPoolDepot *depots = new ObjectPoolDepot[OBJECTPOOL_CLASSES];
+	return depots;
+}
+
+/**
+ * The free lists of a thread. They are returned to the depot when the
+ * thread exits.
+ */
+struct ObjectPoolCache
+{
+	ObjectPoolFreeList Free[OBJECTPOOL_CLASSES];
+
+	~ObjectPoolCache(void)
+	{
+		for (int i = 0; i < OBJECTPOOL_CLASSES; i++) {
+			ObjectPoolDepot& depot = GetObjectPoolDepots()[i];
+
+			boost::mutex::scoped_lock lock(depot.Mutex);
+			Free[i].MoveTo(depot.Free, Free[i].Count);
+		}
+	}
+};
+
+static ObjectPoolCache *GetObjectPoolCache(void)
+{
+	static boost::thread_specific_ptr<ObjectPoolCache> *caches = new boost::thread_specific_ptr<ObjectPoolCache>();
+
+	ObjectPoolCache *cache = caches->get();
+
+	if (!cache) {
+		cache = new ObjectPoolCache();
+		caches->reset(cache);
+	}
+
+	return cache;
+}
+
+static void ObjectPoolRefill(size_t index, ObjectPoolFreeList& list)
+{
+	ObjectPoolDepot& depot = GetObjectPoolDepots()[index];
+
+	{
+		boost::mutex::scoped_lock lock(depot.Mutex);
+		depot.Free.MoveTo(list, OBJECTPOOL_BATCH_SIZE);
+
+		if (list.Head)
+			return;
+	}
+
+	size_t blockSize = (index + 1) * OBJECTPOOL_GRANULARITY;
+	char *slab = static_cast<char *>(malloc(OBJECTPOOL_SLAB_SIZE));
+
+	if (!slab)
+		throw std::bad_alloc();
+
+	ObjectPoolFreeList blocks;
+
+	for (size_t offset = 0; offset + blockSize <= OBJECTPOOL_SLAB_SIZE; offset += blockSize)
+		blocks.Push(reinterpret_cast<ObjectPoolBlock *>(slab + offset));
+
+	blocks.MoveTo(list, OBJECTPOOL_BATCH_SIZE);
+
+	boost::mutex::scoped_lock lock(depot.Mutex);
+	blocks.MoveTo(depot.Free, blocks.Count);
+	depot.Slabs++;
+}
+
+/**
+ * Allocates memory for an object. Sizes which are larger than
+ * OBJECTPOOL_MAX_SIZE are passed on to the global allocator.
+ *
+ * @param size The size of the object.
+ * @returns The memory block.
+ */
+void *ObjectPool::Allocate(size_t size)
+{
+	if (size == 0 || size > OBJECTPOOL_MAX_SIZE)
+		return ::operator new(size);
+
+	size_t index = (size - 1) / OBJECTPOOL_GRANULARITY;
+	ObjectPoolFreeList& list = GetObjectPoolCache()->Free[index];
+
+	if (!list.Head)
+		ObjectPoolRefill(index, list);
+
+	return list.Pop();
+}
+
+/**
+ * Frees memory which was allocated with Allocate().
+ *
+ * @param ptr The memory block.
+ * @param size The size which was passed to Allocate().
+ */
+void ObjectPool::Free(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+
+	if (size == 0 || size > OBJECTPOOL_MAX_SIZE) {
+		::operator delete(ptr);
+		return;
+	}
+
+	size_t index = (size - 1) / OBJECTPOOL_GRANULARITY;
+	ObjectPoolFreeList& list = GetObjectPoolCache()->Free[index];
+
+	list.Push(static_cast<ObjectPoolBlock *>(ptr));
+
+	/* threads which free more objects than they allocate (e.g. the
+	 * consumers of a work queue) hand their surplus to other threads */
+	if (list.Count > 2 * OBJECTPOOL_BATCH_SIZE) {
+		ObjectPoolDepot& depot = GetObjectPoolDepots()[index];
+
+		boost::mutex::scoped_lock lock(depot.Mutex);
+		list.MoveTo(depot.Free, OBJECTPOOL_BATCH_SIZE);
+	}
+}
+
+void ObjectPool::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	size_t slabs = 0, blocks = 0;
+
+	for (int i = 0; i < OBJECTPOOL_CLASSES; i++) {
+		ObjectPoolDepot& depot = GetObjectPoolDepots()[i];
+
+		boost::mutex::scoped_lock lock(depot.Mutex);
+		slabs += depot.Slabs;
+		blocks += depot.Free.Count;
+	}
+
+	Dictionary::Ptr stats = new Dictionary();
+	stats->Set("slabs", slabs);
+	stats->Set("bytes", slabs * OBJECTPOOL_SLAB_SIZE);
+	stats->Set("free_blocks", blocks);
+
+	status->Set("objectpool", stats);
+}
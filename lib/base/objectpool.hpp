@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+
+namespace icinga
+{
+
+#define OBJECTPOOL_GRANULARITY 16
+#define OBJECTPOOL_MAX_SIZE 512
+#define OBJECTPOOL_CLASSES (OBJECTPOOL_MAX_SIZE / OBJECTPOOL_GRANULARITY)
+#define OBJECTPOOL_SLAB_SIZE (64 * 1024)
+#define OBJECTPOOL_BATCH_SIZE 64
+
+/**
+ * A slab allocator for small objects. Each size class has its own slabs,
+ * so short-lived objects (check results, perfdata values, temporary
+ * dictionaries) don't fragment the heap between long-lived ones.
+ *
+ * Blocks are handed out from per-thread free lists. Blocks are exchanged
+ * with a global depot in batches, which allows objects to be freed by a
+ * different thread than the one that allocated them. Slabs are never
+ * returned to the system.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API ObjectPool
+{
+public:
+	static void *Allocate(size_t size);
+	static void Free(void *ptr, size_t size);
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+private:
+	ObjectPool(void);
+};
+
+}
+
+#endif /* OBJECTPOOL_H */
@@ -29,11 +29,19 @@
 #include "base/scriptglobal.hpp"
 #include "base/json.hpp"
 #include <boost/algorithm/string/join.hpp>
+#include "base/statsfunction.hpp"
 #include <boost/thread/once.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <atomic>
+#include <set>
 
 #ifndef _WIN32
 #	include <execvpe.h>
 #	include <poll.h>
+#	ifdef __linux__
+#		include <sys/epoll.h>
+#		include <sys/signalfd.h>
+#	endif /* __linux__ */
 
 #	ifndef __APPLE__
 extern char **environ;
@@ -46,6 +54,9 @@ extern char **environ;
 using namespace icinga;
 
 #define IOTHREADS 4
+#define SPAWN_HELPERS 4
+
+REGISTER_STATSFUNCTION(Process, &Process::StatsFunc);
 
 static boost::mutex l_ProcessMutex[IOTHREADS];
 static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
@@ -54,16 +65,53 @@ static HANDLE l_Events[IOTHREADS];
 #else /* _WIN32 */
 static int l_EventFDs[IOTHREADS][2];
 static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+#	ifdef __linux__
+static int l_EpollFDs[IOTHREADS];
+#	endif /* __linux__ */
+
+typedef boost::function<void (const Dictionary::Ptr&)> ProcessResponseCallback;
+
+/**
+ * The daemon's end of the control socket of a spawn helper process.
+ */
+struct ProcessSpawnHelper
+{
+	boost::mutex Mutex;
+	int FD;
+	pid_t PID;
+	std::map<unsigned long, ProcessResponseCallback> Requests;
+
+	ProcessSpawnHelper(void)
+		: FD(-1), PID(-1)
+	{ }
+};
 
-static boost::mutex l_ProcessControlMutex;
+static ProcessSpawnHelper l_SpawnHelpers[SPAWN_HELPERS];
+static std::atomic<unsigned long> l_ProcessRequestID(0);
+static std::atomic<unsigned int> l_NextSpawnHelper(0);
+
+/* upper bounds of the spawn latency histogram buckets (in seconds), the
+ * last bucket counts everything above */
+static const double l_SpawnLatencyBuckets[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 1 };
+#define SPAWN_LATENCY_BUCKET_COUNT (sizeof(l_SpawnLatencyBuckets) / sizeof(l_SpawnLatencyBuckets[0]) + 1)
+
+static std::atomic<unsigned long long> l_SpawnLatency[SPAWN_LATENCY_BUCKET_COUNT];
+static std::atomic<unsigned long long> l_SpawnLatencyTotal(0);
+
+/* state of the spawn helper process itself */
 static int l_ProcessControlFD = -1;
-static pid_t l_ProcessControlPID;
+static std::set<pid_t> l_HelperChildren;
+static std::map<pid_t, int> l_HelperExitStatus;
+static std::map<pid_t, Value> l_HelperWaiters;
 #endif /* _WIN32 */
 static boost::once_flag l_ProcessOnceFlag = BOOST_ONCE_INIT;
 static boost::once_flag l_SpawnHelperOnceFlag = BOOST_ONCE_INIT;
 
 Process::Process(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment)
 	: m_Arguments(arguments), m_ExtraEnvironment(extraEnvironment), m_Timeout(600), m_AdjustPriority(false)
+#ifndef _WIN32
+	, m_SpawnHelper(0)
+#endif /* _WIN32 */
 #ifdef _WIN32
 	, m_ReadPending(false), m_ReadFailed(false), m_Overlapped()
 #endif /* _WIN32 */
@@ -81,13 +129,67 @@ Process::~Process(void)
 }
 
 #ifndef _WIN32
+static bool ProcessSendAll(int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = send(fd, data, length, 0);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		data += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+static bool ProcessRecvAll(int fd, char *data, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = recv(fd, data, length, 0);
+
+		if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		data += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+/**
+ * Writes an error message to stderr. Only uses async-signal-safe functions
+ * so that it can be called in a vfork()ed child.
+ */
+static void ProcessChildError(const char *prefix, const char *arg = NULL, const char *suffix = NULL)
+{
+	const char *parts[] = { prefix, arg, suffix, "\n" };
+
+	for (const char *part : parts) {
+		if (part && write(STDERR_FILENO, part, strlen(part)) < 0)
+			return;
+	}
+}
+
 static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
 {
 	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
 
 	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
 		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
-		return Empty;
+
+		Dictionary::Ptr response = new Dictionary();
+		response->Set("rc", -1);
+		return response;
 	}
 
 	int *fds = (int *)CMSG_DATA(cmsg);
@@ -134,7 +236,14 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 
 	extraEnvironment.reset();
 
+	/* vfork() doesn't copy the helper's page tables. The child must not
+	 * allocate memory or modify any state of the helper before it calls
+	 * exec. */
+#ifdef HAVE_VFORK
+	pid_t pid = vfork();
+#else /* HAVE_VFORK */
 	pid_t pid = fork();
+#endif /* HAVE_VFORK */
 
 	if (pid < 0) {
 		BOOST_THROW_EXCEPTION(posix_error()
@@ -148,12 +257,12 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		(void)close(l_ProcessControlFD);
 
 		if (setsid() < 0) {
-			perror("setsid() failed");
+			ProcessChildError("setsid() failed");
 			_exit(128);
 		}
 
 		if (dup2(fds[0], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[2], STDERR_FILENO) < 0) {
-			perror("dup2() failed");
+			ProcessChildError("dup2() failed");
 			_exit(128);
 		}
 
@@ -162,8 +271,9 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		(void)close(fds[2]);
 
 #ifdef HAVE_NICE
-		if (adjustPriority && nice(5) < 0)
-			Log(LogWarning, "base", "Failed to renice child process.");
+		if (adjustPriority && nice(5) < 0) {
+			/* not fatal */
+		}
 #endif /* HAVE_NICE */
 
 		sigset_t mask;
@@ -171,18 +281,15 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		sigprocmask(SIG_SETMASK, &mask, NULL);
 
 		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
-			char errmsg[512];
-			strcpy(errmsg, "execvpe(");
-			strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
-			strncat(errmsg, ") failed", sizeof(errmsg) - strlen(errmsg) - 1);
-			errmsg[sizeof(errmsg) - 1] = '\0';
-			perror(errmsg);
+			ProcessChildError("execvpe(", argv[0], ") failed");
 			_exit(128);
 		}
 
 		_exit(128);
 	}
 
+	l_HelperChildren.insert(pid);
+
 	(void)close(fds[0]);
 	(void)close(fds[1]);
 	(void)close(fds[2]);
@@ -217,18 +324,129 @@ static Value ProcessKillImpl(struct msghdr *msgh, const Dictionary::Ptr& request
 	return response;
 }
 
+static Dictionary::Ptr ProcessWaitPIDResponse(pid_t pid, int status)
+{
+	Dictionary::Ptr response = new Dictionary();
+	response->Set("status", status);
+	response->Set("rc", pid);
+	return response;
+}
+
 static Value ProcessWaitPIDImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
 {
 	pid_t pid = request->Get("pid");
 
-	int status;
-	int rc = waitpid(pid, &status, 0);
+	auto it = l_HelperExitStatus.find(pid);
 
-	Dictionary::Ptr response = new Dictionary();
-	response->Set("status", status);
-	response->Set("rc", rc);
+	if (it != l_HelperExitStatus.end()) {
+		Dictionary::Ptr response = ProcessWaitPIDResponse(pid, it->second);
+		l_HelperExitStatus.erase(it);
+		return response;
+	}
 
-	return response;
+	if (l_HelperChildren.find(pid) == l_HelperChildren.end())
+		return ProcessWaitPIDResponse(-1, 0);
+
+	/* the response is sent once the child has been reaped */
+	l_HelperWaiters[pid] = request->Get("id");
+	return Empty;
+}
+
+static void ProcessSendResponse(const Value& id, const Dictionary::Ptr& response)
+{
+	response->Set("id", id);
+
+	String jresponse = JsonEncode(response);
+	size_t length = jresponse.GetLength();
+
+	if (!ProcessSendAll(l_ProcessControlFD, reinterpret_cast<const char *>(&length), sizeof(length)) ||
+	    !ProcessSendAll(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength())) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("send")
+		    << boost::errinfo_errno(errno));
+	}
+}
+
+static void ProcessReapChildren(void)
+{
+	for (;;) {
+		int status;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+
+		if (pid <= 0)
+			break;
+
+		l_HelperChildren.erase(pid);
+
+		auto it = l_HelperWaiters.find(pid);
+
+		if (it == l_HelperWaiters.end()) {
+			l_HelperExitStatus[pid] = status;
+			continue;
+		}
+
+		ProcessSendResponse(it->second, ProcessWaitPIDResponse(pid, status));
+		l_HelperWaiters.erase(it);
+	}
+}
+
+static bool ProcessHandleRequest(void)
+{
+	size_t length;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	struct iovec io;
+	io.iov_base = &length;
+	io.iov_len = sizeof(length);
+
+	msg.msg_iov = &io;
+	msg.msg_iovlen = 1;
+
+	char cbuf[4096];
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	int rc;
+
+	do {
+		rc = recvmsg(l_ProcessControlFD, &msg, 0);
+	} while (rc < 0 && (errno == EINTR || errno == EAGAIN));
+
+	if (rc <= 0)
+		return false;
+
+	char *mbuf = new char[length];
+
+	if (!ProcessRecvAll(l_ProcessControlFD, mbuf, length)) {
+		delete [] mbuf;
+		return false;
+	}
+
+	String jrequest = String(mbuf, mbuf + length);
+
+	delete [] mbuf;
+
+	Dictionary::Ptr request = JsonDecode(jrequest);
+
+	String command = request->Get("command");
+
+	Value response;
+
+	if (command == "spawn")
+		response = ProcessSpawnImpl(&msg, request);
+	else if (command == "waitpid")
+		response = ProcessWaitPIDImpl(&msg, request);
+	else if (command == "kill")
+		response = ProcessKillImpl(&msg, request);
+	else
+		response = Empty;
+
+	if (response.IsObjectType<Dictionary>())
+		ProcessSendResponse(request->Get("id"), response);
+
+	return true;
 }
 
 static void ProcessHandler(void)
@@ -249,91 +467,67 @@ static void ProcessHandler(void)
 				(void)close(i);
 	}
 
-	for (;;) {
-		size_t length;
-
-		struct msghdr msg;
-		memset(&msg, 0, sizeof(msg));
-
-		struct iovec io;
-		io.iov_base = &length;
-		io.iov_len = sizeof(length);
+	pollfd pfds[2];
+	int count = 1;
 
-		msg.msg_iov = &io;
-		msg.msg_iovlen = 1;
+	pfds[0].fd = l_ProcessControlFD;
+	pfds[0].events = POLLIN;
 
-		char cbuf[4096];
-		msg.msg_control = cbuf;
-		msg.msg_controllen = sizeof(cbuf);
+#ifdef __linux__
+	/* SIGCHLD is blocked, the signalfd wakes us up when a child exits */
+	sigset_t chldmask;
+	sigemptyset(&chldmask);
+	sigaddset(&chldmask, SIGCHLD);
 
-		int rc = recvmsg(l_ProcessControlFD, &msg, 0);
+	int sfd = signalfd(-1, &chldmask, SFD_NONBLOCK | SFD_CLOEXEC);
 
-		if (rc <= 0) {
-			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
-				continue;
-
-			break;
-		}
-
-		char *mbuf = new char[length];
+	if (sfd >= 0) {
+		pfds[1].fd = sfd;
+		pfds[1].events = POLLIN;
+		count = 2;
+	}
+#endif /* __linux__ */
 
-		size_t count = 0;
-		while (count < length) {
-			rc = recv(l_ProcessControlFD, mbuf + count, length - count, 0);
+	for (;;) {
+		pfds[0].revents = 0;
+		pfds[1].revents = 0;
 
-			if (rc <= 0) {
-				if (rc < 0 && (errno == EINTR || errno == EAGAIN))
-					continue;
+		/* without a signalfd we have to check for exited children periodically */
+		int timeout = (count == 1 && !l_HelperChildren.empty()) ? 50 : -1;
 
-				delete [] mbuf;
+		int rc = poll(pfds, count, timeout);
 
-				_exit(0);
-			}
+		if (rc < 0 && errno != EINTR)
+			break;
 
-			count += rc;
+#ifdef __linux__
+		if (count == 2 && (pfds[1].revents & POLLIN)) {
+			signalfd_siginfo info;
 
-			if (rc == 0)
-				break;
+			while (read(sfd, &info, sizeof(info)) > 0)
+				; /* drain */
 		}
+#endif /* __linux__ */
 
-		String jrequest = String(mbuf, mbuf + count);
-
-		delete [] mbuf;
-
-		Dictionary::Ptr request = JsonDecode(jrequest);
-
-		String command = request->Get("command");
+		ProcessReapChildren();
 
-		Value response;
-
-		if (command == "spawn")
-			response = ProcessSpawnImpl(&msg, request);
-		else if (command == "waitpid")
-			response = ProcessWaitPIDImpl(&msg, request);
-		else if (command == "kill")
-			response = ProcessKillImpl(&msg, request);
-		else
-			response = Empty;
-
-		String jresponse = JsonEncode(response);
-
-		if (send(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength(), 0) < 0) {
-			BOOST_THROW_EXCEPTION(posix_error()
-			    << boost::errinfo_api_function("send")
-			    << boost::errinfo_errno(errno));
-		}
+		if ((pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) && !ProcessHandleRequest())
+			break;
 	}
 
 	_exit(0);
 }
 
-static void StartSpawnProcessHelper(void)
+static void StartSpawnProcessHelper(int helper)
 {
-	if (l_ProcessControlFD != -1) {
-		(void)close(l_ProcessControlFD);
+	ProcessSpawnHelper& sh = l_SpawnHelpers[helper];
+
+	if (sh.FD != -1) {
+		(void)close(sh.FD);
+		sh.FD = -1;
 
 		int status;
-		(void)waitpid(l_ProcessControlPID, &status, 0);
+		(void)waitpid(sh.PID, &status, 0);
 	}
 
 	int controlFDs[2];
@@ -363,23 +557,29 @@ static void StartSpawnProcessHelper(void)
 
 	(void)close(controlFDs[0]);
 
-	l_ProcessControlFD = controlFDs[1];
-	l_ProcessControlPID = pid;
+	Utility::SetCloExec(controlFDs[1]);
+
+	sh.FD = controlFDs[1];
+	sh.PID = pid;
 }
 
-static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
+/**
+ * Sends a request to a spawn helper. Requests are pipelined, i.e. the
+ * callback is invoked by the helper's reader thread once the response
+ * arrives. If the helper dies before it has responded the callback is
+ * invoked with an empty response.
+ */
+static bool ProcessSendRequest(int helper, const Dictionary::Ptr& request,
+    const ProcessResponseCallback& callback, const int *fds = NULL)
 {
-	Dictionary::Ptr request = new Dictionary();
-	request->Set("command", "spawn");
-	request->Set("arguments", Array::FromVector(arguments));
-	request->Set("extraEnvironment", extraEnvironment);
-	request->Set("adjustPriority", adjustPriority);
+	ProcessSpawnHelper& sh = l_SpawnHelpers[helper];
+
+	unsigned long id = ++l_ProcessRequestID;
+	request->Set("id", id);
 
 	String jrequest = JsonEncode(request);
 	size_t length = jrequest.GetLength();
 
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
-
 	struct msghdr msg;
 	memset(&msg, 0, sizeof(msg));
 
@@ -391,106 +591,222 @@ static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary
 	msg.msg_iovlen = 1;
 
 	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
-	msg.msg_control = cbuf;
-	msg.msg_controllen = sizeof(cbuf);
 
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	if (fds) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
 
-	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
 
-	msg.msg_controllen = cmsg->cmsg_len;
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
 
-send_message:
-	while (sendmsg(l_ProcessControlFD, &msg, 0) < 0)
-		StartSpawnProcessHelper();
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
 
-	if (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0)
-		goto send_message;
+	boost::mutex::scoped_lock lock(sh.Mutex);
 
-	char buf[4096];
+	if (sh.FD == -1)
+		return false;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	ssize_t rc;
 
-	if (rc < 0)
-		return -1;
+	do {
+		rc = sendmsg(sh.FD, &msg, 0);
+	} while (rc < 0 && errno == EINTR);
 
-	String jresponse = String(buf, buf + rc);
+	/* a failed helper is restarted by its reader thread */
+	if (rc < 0 || !ProcessSendAll(sh.FD, jrequest.CStr(), jrequest.GetLength()))
+		return false;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("rc");
+	sh.Requests[id] = callback;
+
+	return true;
 }
 
-static int ProcessKill(pid_t pid, int signum)
+static void ProcessReaderThreadProc(int helper)
 {
-	Dictionary::Ptr request = new Dictionary();
-	request->Set("command", "kill");
-	request->Set("pid", pid);
-	request->Set("signum", signum);
+	ProcessSpawnHelper& sh = l_SpawnHelpers[helper];
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	Utility::SetThreadName("ProcessSpawn");
 
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
+	for (;;) {
+		int fd;
 
-send_message:
-	while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0)
-		StartSpawnProcessHelper();
+		{
+			boost::mutex::scoped_lock lock(sh.Mutex);
+			fd = sh.FD;
+		}
 
-	if (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0)
-		goto send_message;
+		size_t length;
 
-	char buf[4096];
+		if (fd != -1 && ProcessRecvAll(fd, reinterpret_cast<char *>(&length), sizeof(length))) {
+			char *buffer = new char[length];
+			bool success = ProcessRecvAll(fd, buffer, length);
+			String jresponse = String(buffer, buffer + (success ? length : 0));
+			delete [] buffer;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+			Dictionary::Ptr response;
 
-	if (rc < 0)
-		return -1;
+			try {
+				if (success)
+					response = JsonDecode(jresponse);
+			} catch (const std::exception&) {
+				success = false;
+			}
 
-	String jresponse = String(buf, buf + rc);
+			if (response) {
+				ProcessResponseCallback callback;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("rc");
+				{
+					boost::mutex::scoped_lock lock(sh.Mutex);
+
+					auto it = sh.Requests.find(response->Get("id"));
+
+					if (it != sh.Requests.end()) {
+						callback = it->second;
+						sh.Requests.erase(it);
+					}
+				}
+
+				if (callback)
+					callback(response);
+
+				continue;
+			}
+		}
+
+		Log(LogWarning, "Process")
+		    << "Spawn helper " << helper << " terminated unexpectedly, restarting it.";
+
+		std::map<unsigned long, ProcessResponseCallback> requests;
+
+		{
+			boost::mutex::scoped_lock lock(sh.Mutex);
+
+			requests.swap(sh.Requests);
+
+			try {
+				StartSpawnProcessHelper(helper);
+			} catch (const std::exception& ex) {
+				Log(LogCritical, "Process")
+				    << "Failed to restart spawn helper " << helper << ": " << DiagnosticInformation(ex);
+			}
+		}
+
+		typedef std::pair<unsigned long, ProcessResponseCallback> kv_pair;
+		for (const kv_pair& kv : requests) {
+			if (kv.second)
+				kv.second(Dictionary::Ptr());
+		}
+
+		if (fd == -1)
+			Utility::Sleep(1);
+	}
 }
 
-static int ProcessWaitPID(pid_t pid, int *status)
+static void AddSpawnLatency(double latency)
+{
+	size_t bucket = 0;
+
+	while (bucket < SPAWN_LATENCY_BUCKET_COUNT - 1 && latency > l_SpawnLatencyBuckets[bucket])
+		bucket++;
+
+	l_SpawnLatency[bucket]++;
+	l_SpawnLatencyTotal += static_cast<unsigned long long>(latency * 1000000);
+}
+
+/**
+ * Asks a spawn helper to start a process.
+ *
+ * @param helper The preferred helper. If another helper had to be used this is
+ *               updated to that helper, which owns the child from then on.
+ */
+static pid_t ProcessSpawn(int *helper, const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
 {
 	Dictionary::Ptr request = new Dictionary();
-	request->Set("command", "waitpid");
-	request->Set("pid", pid);
+	request->Set("command", "spawn");
+	request->Set("arguments", Array::FromVector(arguments));
+	request->Set("extraEnvironment", extraEnvironment);
+	request->Set("adjustPriority", adjustPriority);
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	boost::mutex mutex;
+	boost::condition_variable cv;
+	bool done = false;
+	Dictionary::Ptr response;
 
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
+	double start = Utility::GetTime();
 
-send_message:
-	while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0)
-		StartSpawnProcessHelper();
+	bool sent = false;
 
-	if (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0)
-		goto send_message;
+	/* try the other helpers if this one is being restarted */
+	for (int i = 0; i < SPAWN_HELPERS; i++) {
+		int candidate = (*helper + i) % SPAWN_HELPERS;
 
-	char buf[4096];
+		sent = ProcessSendRequest(candidate, request, [&mutex, &cv, &done, &response](const Dictionary::Ptr& result) {
+			boost::mutex::scoped_lock lock(mutex);
+			response = result;
+			done = true;
+			cv.notify_all();
+		}, fds);
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+		if (sent) {
+			*helper = candidate;
+			break;
+		}
+	}
 
-	if (rc < 0)
+	if (!sent)
 		return -1;
 
-	String jresponse = String(buf, buf + rc);
+	boost::mutex::scoped_lock lock(mutex);
+
+	while (!done)
+		cv.wait(lock);
+
+	AddSpawnLatency(Utility::GetTime() - start);
+
+	if (!response)
+		return -1;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	*status = response->Get("status");
 	return response->Get("rc");
 }
 
+static void ProcessKill(int helper, pid_t pid, int signum)
+{
+	Dictionary::Ptr request = new Dictionary();
+	request->Set("command", "kill");
+	request->Set("pid", pid);
+	request->Set("signum", signum);
+
+	(void) ProcessSendRequest(helper, request, ProcessResponseCallback());
+}
+
+static void ProcessWaitPID(int helper, pid_t pid, const boost::function<void (pid_t, int)>& callback)
+{
+	Dictionary::Ptr request = new Dictionary();
+	request->Set("command", "waitpid");
+	request->Set("pid", pid);
+
+	auto handler = [callback](const Dictionary::Ptr& response) {
+		if (!response)
+			callback(-1, 0);
+		else
+			callback(response->Get("rc"), response->Get("status"));
+	};
+
+	if (!ProcessSendRequest(helper, request, handler))
+		callback(-1, 0);
+}
+
 void Process::InitializeSpawnHelper(void)
 {
-	if (l_ProcessControlFD == -1)
-		StartSpawnProcessHelper();
+	for (int helper = 0; helper < SPAWN_HELPERS; helper++) {
+		if (l_SpawnHelpers[helper].FD == -1)
+			StartSpawnProcessHelper(helper);
+	}
 }
 #endif /* _WIN32 */
 
@@ -520,6 +836,24 @@ static void InitializeProcess(void)
 			}
 		}
 #	endif /* HAVE_PIPE2 */
+
+#	ifdef __linux__
+		l_EpollFDs[tid] = epoll_create(128);
+
+		if (l_EpollFDs[tid] < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("epoll_create")
+			    << boost::errinfo_errno(errno));
+		}
+
+		Utility::SetCloExec(l_EpollFDs[tid]);
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.fd = l_EventFDs[tid][0];
+		event.events = EPOLLIN;
+		epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, l_EventFDs[tid][0], &event);
+#	endif /* __linux__ */
 #endif /* _WIN32 */
 	}
 }
@@ -533,6 +867,13 @@ void Process::ThreadInitialize(void)
 		boost::thread t(boost::bind(&Process::IOThreadProc, tid));
 		t.detach();
 	}
+
+#ifndef _WIN32
+	for (int helper = 0; helper < SPAWN_HELPERS; helper++) {
+		boost::thread t(boost::bind(&ProcessReaderThreadProc, helper));
+		t.detach();
+	}
+#endif /* _WIN32 */
 }
 
 Process::Arguments Process::PrepareCommand(const Value& command)
@@ -593,6 +934,85 @@ bool Process::GetAdjustPriority(void) const
 
 void Process::IOThreadProc(int tid)
 {
+#ifdef __linux__
+	epoll_event events[128];
+
+	Utility::SetThreadName("ProcessIO");
+
+	for (;;) {
+		double timeout = -1;
+		double now = Utility::GetTime();
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+			typedef std::pair<ProcessHandle, Process::Ptr> kv_pair;
+			for (const kv_pair& kv : l_Processes[tid]) {
+				const Process::Ptr& process = kv.second;
+
+				if (process->m_Timeout != 0) {
+					double delta = process->m_Timeout - (now - process->m_Result.ExecutionStart);
+
+					if (timeout == -1 || delta < timeout)
+						timeout = delta;
+				}
+			}
+		}
+
+		if (timeout < 0.01)
+			timeout = 0.5;
+
+		int rc = epoll_wait(l_EpollFDs[tid], events, sizeof(events) / sizeof(events[0]), timeout * 1000);
+
+		if (rc < 0)
+			continue;
+
+		now = Utility::GetTime();
+
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == l_EventFDs[tid][0]) {
+				char buffer[512];
+				if (read(l_EventFDs[tid][0], buffer, sizeof(buffer)) < 0)
+					Log(LogCritical, "base", "Read from event FD failed.");
+
+				continue;
+			}
+
+			auto it2 = l_FDs[tid].find(fd);
+
+			if (it2 == l_FDs[tid].end())
+				continue; /* This should never happen. */
+
+			auto it = l_Processes[tid].find(it2->second);
+
+			if (it == l_Processes[tid].end())
+				continue; /* This should never happen. */
+
+			if (!it->second->DoEvents()) {
+				/* closing the FD also removes it from the epoll set */
+				l_FDs[tid].erase(it2);
+				(void)close(fd);
+				l_Processes[tid].erase(it);
+			}
+		}
+
+		/* processes which exceeded their timeout don't necessarily have pending output */
+		for (auto it = l_Processes[tid].begin(); it != l_Processes[tid].end(); ) {
+			Process::Ptr process = it->second;
+
+			if (process->m_Timeout != 0 && process->m_Result.ExecutionStart + process->m_Timeout < now && !process->DoEvents()) {
+				l_FDs[tid].erase(process->m_FD);
+				(void)close(process->m_FD);
+				it = l_Processes[tid].erase(it);
+			} else
+				it++;
+		}
+	}
+#else /* __linux__ */
 #ifdef _WIN32
 	HANDLE *handles = NULL;
 	HANDLE *fhandles = NULL;
@@ -735,6 +1155,7 @@ void Process::IOThreadProc(int tid)
 			}
 		}
 	}
+#endif /* __linux__ */
 }
 
 String Process::PrettyPrintArguments(const Process::Arguments& arguments)
@@ -971,7 +1392,8 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 	fds[1] = outfds[1];
 	fds[2] = outfds[1];
 
-	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
+	m_SpawnHelper = l_NextSpawnHelper++ % SPAWN_HELPERS;
+	m_Process = ProcessSpawn(&m_SpawnHelper, m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
 	m_PID = m_Process;
 
 	Log(LogNotice, "Process")
@@ -993,6 +1415,16 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 		l_Processes[tid][m_Process] = this;
 #ifndef _WIN32
 		l_FDs[tid][m_FD] = m_Process;
+
+#	ifdef __linux__
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.fd = m_FD;
+		event.events = EPOLLIN;
+
+		if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, m_FD, &event) < 0)
+			Log(LogCritical, "base", "Failed to add process output FD to epoll set.");
+#	endif /* __linux__ */
 #endif /* _WIN32 */
 	}
 
@@ -1020,7 +1452,7 @@ bool Process::DoEvents(void)
 #ifdef _WIN32
 			TerminateProcess(m_Process, 1);
 #else /* _WIN32 */
-			ProcessKill(-m_Process, SIGKILL);
+			ProcessKill(m_SpawnHelper, -m_Process, SIGKILL);
 #endif /* _WIN32 */
 
 			is_timeout = true;
@@ -1064,9 +1496,26 @@ bool Process::DoEvents(void)
 
 	Log(LogNotice, "Process")
 	    << "PID " << m_PID << " (" << PrettyPrintArguments(m_Arguments) << ") terminated with exit code " << exitcode;
+
+	SetResult(exitcode, output);
 #else /* _WIN32 */
-	int status, exitcode;
-	if (ProcessWaitPID(m_Process, &status) != m_Process) {
+	/* the spawn helper responds once it has reaped the process */
+	Process::Ptr self = this;
+
+	ProcessWaitPID(m_SpawnHelper, m_Process, [self, output](pid_t pid, int status) {
+		self->ProcessExited(output, pid, status);
+	});
+#endif /* _WIN32 */
+
+	return false;
+}
+
+#ifndef _WIN32
+void Process::ProcessExited(String output, pid_t pid, int status)
+{
+	long exitcode;
+
+	if (pid != m_Process) {
 		exitcode = 128;
 
 		Log(LogWarning, "Process")
@@ -1098,8 +1547,13 @@ bool Process::DoEvents(void)
 	} else {
 		exitcode = 128;
 	}
+
+	SetResult(exitcode, output);
+}
 #endif /* _WIN32 */
 
+void Process::SetResult(long exitcode, const String& output)
+{
 	m_Result.PID = m_PID;
 	m_Result.ExecutionEnd = Utility::GetTime();
 	m_Result.ExitStatus = exitcode;
@@ -1107,8 +1561,6 @@ bool Process::DoEvents(void)
 
 	if (m_Callback)
 		Utility::QueueAsyncCallback(boost::bind(m_Callback, m_Result));
-
-	return false;
 }
 
 pid_t Process::GetPID(void) const
@@ -1117,6 +1569,33 @@ pid_t Process::GetPID(void) const
 }
 
 
+void Process::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	Dictionary::Ptr stats = new Dictionary();
+
+#ifndef _WIN32
+	unsigned long long count = 0;
+	Array::Ptr histogram = new Array();
+
+	for (size_t i = 0; i < SPAWN_LATENCY_BUCKET_COUNT; i++) {
+		unsigned long long bucketCount = l_SpawnLatency[i].load();
+		count += bucketCount;
+
+		Dictionary::Ptr bucket = new Dictionary();
+		bucket->Set("le", i < SPAWN_LATENCY_BUCKET_COUNT - 1 ? Value(l_SpawnLatencyBuckets[i]) : Value("+Inf"));
+		bucket->Set("count", bucketCount);
+		histogram->Add(bucket);
+	}
+
+	stats->Set("spawn_helpers", SPAWN_HELPERS);
+	stats->Set("spawned", count);
+	stats->Set("avg_spawn_latency", count > 0 ? l_SpawnLatencyTotal.load() / 1000000.0 / count : 0);
+	stats->Set("spawn_latency", histogram);
+#endif /* _WIN32 */
+
+	status->Set("process", stats);
+}
+
 int Process::GetTID(void) const
 {
 	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
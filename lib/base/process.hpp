@@ -22,6 +22,7 @@
 
 #include "base/i2-base.hpp"
 #include "base/dictionary.hpp"
+#include "base/array.hpp"
 #include <boost/function.hpp>
 #include <sstream>
 #include <deque>
@@ -90,6 +91,8 @@ public:
 	static void InitializeSpawnHelper(void);
 #endif /* _WIN32 */
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 private:
 	Arguments m_Arguments;
 	Dictionary::Ptr m_ExtraEnvironment;
@@ -101,6 +104,10 @@ private:
 	pid_t m_PID;
 	ConsoleHandle m_FD;
 
+#ifndef _WIN32
+	int m_SpawnHelper;
+#endif /* _WIN32 */
+
 #ifdef _WIN32
 	bool m_ReadPending;
 	bool m_ReadFailed;
@@ -114,6 +121,10 @@ private:
 
 	static void IOThreadProc(int tid);
 	bool DoEvents(void);
+#ifndef _WIN32
+	void ProcessExited(String output, pid_t pid, int status);
+#endif /* _WIN32 */
+	void SetResult(long exitcode, const String& output);
 	int GetTID(void) const;
 };
 
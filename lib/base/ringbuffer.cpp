@@ -79,3 +79,16 @@ int RingBuffer::GetValues(RingBuffer::SizeType span) const
 
 	return sum;
 }
+
+/**
+ * Returns the sum of the last span slots as of the time tv. Slots which
+ * have not been written since are treated as zero, so idle counters don't
+ * report stale values.
+ */
+int RingBuffer::UpdateAndGetValues(RingBuffer::SizeType tv, RingBuffer::SizeType span)
+{
+	ObjectLock olock(this);
+
+	InsertValue(tv, 0);
+	return GetValues(span);
+}
@@ -27,16 +27,18 @@
 
 using namespace icinga;
 
+SocketEventEngineEpoll::SocketEventEngineEpoll(int threads, bool edgeTriggered)
+	: SocketEventEngine(threads), m_EdgeTriggered(edgeTriggered), m_PollFDs(threads), m_Descriptors(threads)
+{ }
+
 void SocketEventEngineEpoll::InitializeThread(int tid)
 {
 	m_PollFDs[tid] = epoll_create(128);
 	Utility::SetCloExec(m_PollFDs[tid]);
 
-	SocketEventDescriptor sed;
-
-	m_Sockets[tid][m_EventFDs[tid][0]] = sed;
 	m_FDChanged[tid] = true;
 
+	/* the wake-up socket is always level-triggered */
 	epoll_event event;
 	memset(&event, 0, sizeof(event));
 	event.data.fd = m_EventFDs[tid][0];
@@ -44,7 +46,7 @@ void SocketEventEngineEpoll::InitializeThread(int tid)
 	epoll_ctl(m_PollFDs[tid], EPOLL_CTL_ADD, m_EventFDs[tid][0], &event);
 }
 
-int SocketEventEngineEpoll::PollToEpoll(int events)
+int SocketEventEngineEpoll::PollToEpoll(int events) const
 {
 	int result = 0;
 
@@ -54,7 +56,10 @@ int SocketEventEngineEpoll::PollToEpoll(int events)
 	if (events & POLLOUT)
 		result |= EPOLLOUT;
 
-	return events;
+	if (m_EdgeTriggered)
+		result |= EPOLLET;
+
+	return result;
 }
 
 int SocketEventEngineEpoll::EpollToPoll(int events)
@@ -67,13 +72,21 @@ int SocketEventEngineEpoll::EpollToPoll(int events)
 	if (events & EPOLLOUT)
 		result |= POLLOUT;
 
-	return events;
+	if (events & EPOLLHUP)
+		result |= POLLHUP;
+
+	if (events & EPOLLERR)
+		result |= POLLERR;
+
+	return result;
 }
 
 void SocketEventEngineEpoll::ThreadProc(int tid)
 {
 	Utility::SetThreadName("SocketIO");
 
+	std::vector<EventDescription> events;
+
 	for (;;) {
 		{
 			boost::mutex::scoped_lock lock(m_EventMutex[tid]);
@@ -84,22 +97,28 @@ void SocketEventEngineEpoll::ThreadProc(int tid)
 			}
 		}
 
-		epoll_event pevents[64];
+		epoll_event pevents[256];
 		int ready = epoll_wait(m_PollFDs[tid], pevents, sizeof(pevents) / sizeof(pevents[0]), -1);
 
-		std::vector<EventDescription> events;
+		events.clear();
 
 		{
 			boost::mutex::scoped_lock lock(m_EventMutex[tid]);
 
+			/* Events for sockets which were unregistered while we were waiting
+			 * are skipped below. The remaining events can't be dropped because
+			 * they wouldn't be reported again in edge-triggered mode. */
 			if (m_FDChanged[tid]) {
 				m_FDChanged[tid] = false;
-
-				continue;
+				m_CV[tid].notify_all();
 			}
 
+			const std::vector<SocketEventDescriptor>& descriptors = m_Descriptors[tid];
+
 			for (int i = 0; i < ready; i++) {
-				if (pevents[i].data.fd == m_EventFDs[tid][0]) {
+				SOCKET fd = pevents[i].data.fd;
+
+				if (fd == m_EventFDs[tid][0]) {
 					char buffer[512];
 					if (recv(m_EventFDs[tid][0], buffer, sizeof(buffer), 0) < 0)
 						Log(LogCritical, "SocketEvents", "Read from event FD failed.");
@@ -110,9 +129,13 @@ void SocketEventEngineEpoll::ThreadProc(int tid)
 				if ((pevents[i].events & (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR)) == 0)
 					continue;
 
+				/* the socket might have been unregistered in the meantime */
+				if (static_cast<size_t>(fd) >= descriptors.size() || !descriptors[fd].EventInterface)
+					continue;
+
 				EventDescription event;
 				event.REvents = SocketEventEngineEpoll::EpollToPoll(pevents[i].events);
-				event.Descriptor = m_Sockets[tid][pevents[i].data.fd];
+				event.Descriptor = descriptors[fd];
 				event.LifesupportReference = event.Descriptor.LifesupportObject;
 				VERIFY(event.LifesupportReference);
 
@@ -120,6 +143,9 @@ void SocketEventEngineEpoll::ThreadProc(int tid)
 			}
 		}
 
+		if (!events.empty())
+			AddEvents(tid, events.size());
+
 		for (const EventDescription& event : events) {
 			try {
 				event.Descriptor.EventInterface->OnEvent(event.REvents);
@@ -131,25 +157,35 @@ void SocketEventEngineEpoll::ThreadProc(int tid)
 				Log(LogCritical, "SocketEvents", "Exception of unknown type thrown in socket I/O handler.");
 			}
 		}
+
+		/* drop the references before waiting again */
+		events.clear();
 	}
 }
 
 void SocketEventEngineEpoll::Register(SocketEvents *se, Object *lifesupportObject)
 {
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = AssignThread();
+	se->m_Thread = tid;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
 
 		VERIFY(se->m_FD != INVALID_SOCKET);
 
-		SocketEventDescriptor desc;
+		std::vector<SocketEventDescriptor>& descriptors = m_Descriptors[tid];
+
+		if (static_cast<size_t>(se->m_FD) >= descriptors.size())
+			descriptors.resize(se->m_FD + 1);
+
+		VERIFY(!descriptors[se->m_FD].EventInterface);
+
+		SocketEventDescriptor& desc = descriptors[se->m_FD];
+		desc.Events = 0;
 		desc.EventInterface = se;
 		desc.LifesupportObject = lifesupportObject;
 
-		VERIFY(m_Sockets[tid].find(se->m_FD) == m_Sockets[tid].end());
-
-		m_Sockets[tid][se->m_FD] = desc;
+		m_SocketCount[tid]++;
 
 		epoll_event event;
 		memset(&event, 0, sizeof(event));
@@ -163,7 +199,7 @@ void SocketEventEngineEpoll::Register(SocketEvents *se, Object *lifesupportObjec
 
 void SocketEventEngineEpoll::Unregister(SocketEvents *se)
 {
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = se->m_Thread;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
@@ -171,7 +207,8 @@ void SocketEventEngineEpoll::Unregister(SocketEvents *se)
 		if (se->m_FD == INVALID_SOCKET)
 			return;
 
-		m_Sockets[tid].erase(se->m_FD);
+		m_Descriptors[tid][se->m_FD] = SocketEventDescriptor();
+		m_SocketCount[tid]--;
 		m_FDChanged[tid] = true;
 
 		epoll_ctl(m_PollFDs[tid], EPOLL_CTL_DEL, se->m_FD, NULL);
@@ -188,20 +225,24 @@ void SocketEventEngineEpoll::ChangeEvents(SocketEvents *se, int events)
 	if (se->m_FD == INVALID_SOCKET)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Tried to read/write from a closed socket."));
 
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = se->m_Thread;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
 
-		auto it = m_Sockets[tid].find(se->m_FD);
+		std::vector<SocketEventDescriptor>& descriptors = m_Descriptors[tid];
 
-		if (it == m_Sockets[tid].end())
+		if (static_cast<size_t>(se->m_FD) >= descriptors.size() || descriptors[se->m_FD].EventInterface != se)
 			return;
 
+		descriptors[se->m_FD].Events = events;
+
+		/* This also re-arms the descriptor in edge-triggered mode: if the
+		 * socket is already ready we get another event. */
 		epoll_event event;
 		memset(&event, 0, sizeof(event));
 		event.data.fd = se->m_FD;
-		event.events = SocketEventEngineEpoll::PollToEpoll(events);
+		event.events = PollToEpoll(events);
 		epoll_ctl(m_PollFDs[tid], EPOLL_CTL_MOD, se->m_FD, &event);
 	}
 }
@@ -25,6 +25,10 @@
 
 using namespace icinga;
 
+SocketEventEnginePoll::SocketEventEnginePoll(int threads)
+	: SocketEventEngine(threads), m_Sockets(threads)
+{ }
+
 void SocketEventEnginePoll::InitializeThread(int tid)
 {
 	SocketEventDescriptor sed;
@@ -112,6 +116,9 @@ void SocketEventEnginePoll::ThreadProc(int tid)
 			}
 		}
 
+		if (!events.empty())
+			AddEvents(tid, events.size());
+
 		for (const EventDescription& event : events) {
 			try {
 				event.Descriptor.EventInterface->OnEvent(event.REvents);
@@ -128,7 +135,8 @@ void SocketEventEnginePoll::ThreadProc(int tid)
 
 void SocketEventEnginePoll::Register(SocketEvents *se, Object *lifesupportObject)
 {
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = AssignThread();
+	se->m_Thread = tid;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
@@ -143,6 +151,7 @@ void SocketEventEnginePoll::Register(SocketEvents *se, Object *lifesupportObject
 		VERIFY(m_Sockets[tid].find(se->m_FD) == m_Sockets[tid].end());
 
 		m_Sockets[tid][se->m_FD] = desc;
+		m_SocketCount[tid]++;
 
 		m_FDChanged[tid] = true;
 
@@ -154,7 +163,7 @@ void SocketEventEnginePoll::Register(SocketEvents *se, Object *lifesupportObject
 
 void SocketEventEnginePoll::Unregister(SocketEvents *se)
 {
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = se->m_Thread;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
@@ -163,6 +172,7 @@ void SocketEventEnginePoll::Unregister(SocketEvents *se)
 			return;
 
 		m_Sockets[tid].erase(se->m_FD);
+		m_SocketCount[tid]--;
 		m_FDChanged[tid] = true;
 
 		se->m_FD = INVALID_SOCKET;
@@ -177,7 +187,7 @@ void SocketEventEnginePoll::ChangeEvents(SocketEvents *se, int events)
 	if (se->m_FD == INVALID_SOCKET)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Tried to read/write from a closed socket."));
 
-	int tid = se->m_ID % SOCKET_IOTHREADS;
+	int tid = se->m_Thread;
 
 	{
 		boost::mutex::scoped_lock lock(m_EventMutex[tid]);
@@ -22,6 +22,8 @@
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/statsfunction.hpp"
+#include "base/utility.hpp"
 #include <boost/thread/once.hpp>
 #include <map>
 #ifdef __linux__
@@ -35,10 +37,24 @@ static SocketEventEngine *l_SocketIOEngine;
 
 int SocketEvents::m_NextID = 0;
 
+REGISTER_STATSFUNCTION(SocketEvents, &SocketEvents::StatsFunc);
+
+SocketEventEngine::SocketEventEngine(int threads)
+	: m_ThreadCount(threads), m_Threads(threads), m_EventFDs(threads), m_FDChanged(threads, false),
+	  m_EventMutex(threads), m_CV(threads), m_SocketCount(threads, 0)
+{
+	for (int tid = 0; tid < threads; tid++)
+		m_EventCounters.push_back(new RingBuffer(60));
+}
+
+SocketEventEngine::~SocketEventEngine(void)
+{ }
+
 void SocketEventEngine::Start(void)
 {
-	for (int tid = 0; tid < SOCKET_IOTHREADS; tid++) {
-		Socket::SocketPair(m_EventFDs[tid]);
+	/* all threads have to be initialized before the first one is started */
+	for (int tid = 0; tid < m_ThreadCount; tid++) {
+		Socket::SocketPair(m_EventFDs[tid].c_array());
 
 		Utility::SetNonBlockingSocket(m_EventFDs[tid][0]);
 		Utility::SetNonBlockingSocket(m_EventFDs[tid][1]);
@@ -49,15 +65,75 @@ void SocketEventEngine::Start(void)
 #endif /* _WIN32 */
 
 		InitializeThread(tid);
+	}
 
+	for (int tid = 0; tid < m_ThreadCount; tid++)
 		m_Threads[tid] = boost::thread(boost::bind(&SocketEventEngine::ThreadProc, this, tid));
+}
+
+int SocketEventEngine::GetThreadCount(void) const
+{
+	return m_ThreadCount;
+}
+
+/**
+ * Picks the thread for a new socket. The load of a thread is the number of
+ * its sockets plus the number of events it handled per second in the last
+ * minute.
+ *
+ * @returns The thread ID.
+ */
+int SocketEventEngine::AssignThread(void)
+{
+	double now = Utility::GetTime();
+	int result = 0;
+	double minLoad = -1;
+
+	for (int tid = 0; tid < m_ThreadCount; tid++) {
+		double load = m_EventCounters[tid]->UpdateAndGetValues(now, 60) / 60.0;
+
+		{
+			boost::mutex::scoped_lock lock(m_EventMutex[tid]);
+			load += m_SocketCount[tid];
+		}
+
+		if (minLoad < 0 || load < minLoad) {
+			result = tid;
+			minLoad = load;
+		}
 	}
+
+	return result;
+}
+
+void SocketEventEngine::AddEvents(int tid, int count)
+{
+	m_EventCounters[tid]->InsertValue(Utility::GetTime(), count);
 }
 
-void SocketEventEngine::WakeUpThread(int sid, bool wait)
+Array::Ptr SocketEventEngine::GetThreadStats(void)
 {
-	int tid = sid % SOCKET_IOTHREADS;
+	Array::Ptr result = new Array();
+	double now = Utility::GetTime();
+
+	for (int tid = 0; tid < m_ThreadCount; tid++) {
+		Dictionary::Ptr stats = new Dictionary();
+
+		{
+			boost::mutex::scoped_lock lock(m_EventMutex[tid]);
+			stats->Set("sockets", m_SocketCount[tid]);
+		}
+
+		stats->Set("events_per_second", m_EventCounters[tid]->UpdateAndGetValues(now, 60) / 60.0);
 
+		result->Add(stats);
+	}
+
+	return result;
+}
+
+void SocketEventEngine::WakeUpThread(int tid, bool wait)
+{
 	if (boost::this_thread::get_id() == m_Threads[tid].get_id())
 		return;
 
@@ -88,11 +164,23 @@ void SocketEvents::InitializeEngine(void)
 		eventEngine = "poll";
 #endif /* __linux__ */
 
+	Value defaultThreads = SOCKET_IOTHREADS;
+	int threads = ScriptGlobal::Get("EventEngineThreads", &defaultThreads);
+
+	if (threads < 1) {
+		Log(LogWarning, "SocketEvents")
+		    << "Invalid number of event engine threads: " << threads << " - Using " << SOCKET_IOTHREADS << " threads";
+
+		threads = SOCKET_IOTHREADS;
+	}
+
 	if (eventEngine == "poll")
-		l_SocketIOEngine = new SocketEventEnginePoll();
+		l_SocketIOEngine = new SocketEventEnginePoll(threads);
 #ifdef __linux__
 	else if (eventEngine == "epoll")
-		l_SocketIOEngine = new SocketEventEngineEpoll();
+		l_SocketIOEngine = new SocketEventEngineEpoll(threads, false);
+	else if (eventEngine == "epoll-et")
+		l_SocketIOEngine = new SocketEventEngineEpoll(threads, true);
 #endif /* __linux__ */
 	else {
 		Log(LogWarning, "SocketEvents")
@@ -100,19 +188,20 @@ void SocketEvents::InitializeEngine(void)
 
 		eventEngine = "poll";
 
-		l_SocketIOEngine = new SocketEventEnginePoll();
+		l_SocketIOEngine = new SocketEventEnginePoll(threads);
 	}
 
 	l_SocketIOEngine->Start();
 
 	ScriptGlobal::Set("EventEngine", eventEngine);
+	ScriptGlobal::Set("EventEngineThreads", threads);
 }
 
 /**
  * Constructor for the SocketEvents class.
  */
 SocketEvents::SocketEvents(const Socket::Ptr& socket, Object *lifesupportObject)
-	: m_ID(m_NextID++), m_FD(socket->GetFD()), m_EnginePrivate(NULL)
+	: m_ID(m_NextID++), m_Thread(0), m_FD(socket->GetFD()), m_EnginePrivate(NULL)
 {
 	boost::call_once(l_SocketIOOnceFlag, &SocketEvents::InitializeEngine);
 
@@ -146,8 +235,7 @@ boost::mutex& SocketEventEngine::GetMutex(int tid)
 
 bool SocketEvents::IsHandlingEvents(void) const
 {
-	int tid = m_ID % SOCKET_IOTHREADS;
-	boost::mutex::scoped_lock lock(l_SocketIOEngine->GetMutex(tid));
+	boost::mutex::scoped_lock lock(l_SocketIOEngine->GetMutex(m_Thread));
 	return m_Events;
 }
 
@@ -156,3 +244,14 @@ void SocketEvents::OnEvent(int revents)
 
 }
 
+void SocketEvents::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	if (!l_SocketIOEngine)
+		return;
+
+	Dictionary::Ptr stats = new Dictionary();
+	stats->Set("engine", ScriptGlobal::Get("EventEngine", &Empty));
+	stats->Set("threads", l_SocketIOEngine->GetThreadStats());
+
+	status->Set("socket_events", stats);
+}
@@ -22,7 +22,13 @@
 
 #include "base/i2-base.hpp"
 #include "base/socket.hpp"
+#include "base/ringbuffer.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
 #include <boost/thread.hpp>
+#include <boost/array.hpp>
+#include <map>
+#include <vector>
 
 #ifndef _WIN32
 #	include <poll.h>
@@ -52,11 +58,14 @@ public:
 	void *GetEnginePrivate(void) const;
 	void SetEnginePrivate(void *priv);
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 protected:
 	SocketEvents(const Socket::Ptr& socket, Object *lifesupportObject);
 
 private:
 	int m_ID;
+	int m_Thread;
 	SOCKET m_FD;
 	bool m_Events;
 	void *m_EnginePrivate;
@@ -73,6 +82,10 @@ private:
 	friend class SocketEventEngineEpoll;
 };
 
+/**
+ * Default number of I/O threads, can be changed with the EventEngineThreads
+ * global variable.
+ */
 #define SOCKET_IOTHREADS 8
 
 struct SocketEventDescriptor
@@ -96,12 +109,18 @@ struct EventDescription
 class I2_BASE_API SocketEventEngine
 {
 public:
+	SocketEventEngine(int threads);
+	virtual ~SocketEventEngine(void);
+
 	void Start(void);
 
-	void WakeUpThread(int sid, bool wait);
+	void WakeUpThread(int tid, bool wait);
 
 	boost::mutex& GetMutex(int tid);
 
+	int GetThreadCount(void) const;
+	Array::Ptr GetThreadStats(void);
+
 protected:
 	virtual void InitializeThread(int tid) = 0;
 	virtual void ThreadProc(int tid) = 0;
@@ -109,12 +128,17 @@ protected:
 	virtual void Unregister(SocketEvents *se) = 0;
 	virtual void ChangeEvents(SocketEvents *se, int events) = 0;
 
-	boost::thread m_Threads[SOCKET_IOTHREADS];
-	SOCKET m_EventFDs[SOCKET_IOTHREADS][2];
-	bool m_FDChanged[SOCKET_IOTHREADS];
-	boost::mutex m_EventMutex[SOCKET_IOTHREADS];
-	boost::condition_variable m_CV[SOCKET_IOTHREADS];
-	std::map<SOCKET, SocketEventDescriptor> m_Sockets[SOCKET_IOTHREADS];
+	int AssignThread(void);
+	void AddEvents(int tid, int count);
+
+	int m_ThreadCount;
+	std::vector<boost::thread> m_Threads;
+	std::vector<boost::array<SOCKET, 2> > m_EventFDs;
+	std::vector<char> m_FDChanged; /* not vector<bool>, the flags are written by different threads */
+	std::vector<boost::mutex> m_EventMutex;
+	std::vector<boost::condition_variable> m_CV;
+	std::vector<size_t> m_SocketCount;
+	std::vector<RingBuffer::Ptr> m_EventCounters;
 
 	friend class SocketEvents;
 };
@@ -122,6 +146,8 @@ protected:
 class I2_BASE_API SocketEventEnginePoll : public SocketEventEngine
 {
 public:
+	SocketEventEnginePoll(int threads);
+
 	virtual void Register(SocketEvents *se, Object *lifesupportObject);
 	virtual void Unregister(SocketEvents *se);
 	virtual void ChangeEvents(SocketEvents *se, int events);
@@ -129,12 +155,23 @@ public:
 protected:
 	virtual void InitializeThread(int tid);
 	virtual void ThreadProc(int tid);
+
+private:
+	std::vector<std::map<SOCKET, SocketEventDescriptor> > m_Sockets;
 };
 
 #ifdef __linux__
+/**
+ * The epoll engine keeps its sockets in arrays which are indexed by the
+ * file descriptor. In edge-triggered mode event handlers must either
+ * consume all available data or call ChangeEvents() again, which re-arms
+ * the descriptor.
+ */
 class I2_BASE_API SocketEventEngineEpoll : public SocketEventEngine
 {
 public:
+	SocketEventEngineEpoll(int threads, bool edgeTriggered);
+
 	virtual void Register(SocketEvents *se, Object *lifesupportObject);
 	virtual void Unregister(SocketEvents *se);
 	virtual void ChangeEvents(SocketEvents *se, int events);
@@ -144,9 +181,11 @@ protected:
 	virtual void ThreadProc(int tid);
 
 private:
-	SOCKET m_PollFDs[SOCKET_IOTHREADS];
+	bool m_EdgeTriggered;
+	std::vector<SOCKET> m_PollFDs;
+	std::vector<std::vector<SocketEventDescriptor> > m_Descriptors;
 
-	static int PollToEpoll(int events);
+	int PollToEpoll(int events) const;
 	static int EpollToPoll(int events);
 };
 #endif /* __linux__ */
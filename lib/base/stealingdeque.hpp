@@ -0,0 +1,131 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef STEALINGDEQUE_H
+#define STEALINGDEQUE_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+
+namespace icinga
+{
+
+#define STEALINGDEQUESIZE 8192U
+
+/**
+ * A bounded Chase-Lev deque. The owning thread pushes and pops at the
+ * bottom, other threads steal from the top. Size must be a power of two.
+ *
+ * @ingroup base
+ */
+template<typename T, size_t Size = STEALINGDEQUESIZE>
+class StealingDeque
+{
+public:
+	StealingDeque(void)
+		: m_Top(0), m_Bottom(0)
+	{
+		for (size_t i = 0; i < Size; i++)
+			m_Items[i].store(NULL, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Pushes an item to the bottom of the deque. May only be called by the owner.
+	 *
+	 * @returns false if the deque is full.
+	 */
+	bool Push(T *item)
+	{
+		long long bottom = m_Bottom.load(std::memory_order_relaxed);
+		long long top = m_Top.load(std::memory_order_acquire);
+
+		if (bottom - top >= static_cast<long long>(Size))
+			return false;
+
+		m_Items[bottom & (Size - 1)].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	/**
+	 * Pops an item from the bottom of the deque. May only be called by the owner.
+	 */
+	T *Pop(void)
+	{
+		long long bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long top = m_Top.load(std::memory_order_relaxed);
+
+		if (top > bottom) {
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return NULL;
+		}
+
+		T *item = m_Items[bottom & (Size - 1)].load(std::memory_order_relaxed);
+
+		if (top == bottom) {
+			/* Last item, race against thieves. */
+			if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				item = NULL;
+
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return item;
+	}
+
+	/**
+	 * Steals an item from the top of the deque. May be called by any thread.
+	 */
+	T *Steal(void)
+	{
+		long long top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long bottom = m_Bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+			return NULL;
+
+		T *item = m_Items[top & (Size - 1)].load(std::memory_order_relaxed);
+
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NULL;
+
+		return item;
+	}
+
+	size_t GetLength(void) const
+	{
+		long long length = m_Bottom.load(std::memory_order_relaxed) - m_Top.load(std::memory_order_relaxed);
+
+		return length > 0 ? length : 0;
+	}
+
+private:
+	std::atomic<long long> m_Top;
+	std::atomic<long long> m_Bottom;
+	std::atomic<T *> m_Items[Size];
+};
+
+}
+
+#endif /* STEALINGDEQUE_H */
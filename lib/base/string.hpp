@@ -82,7 +82,7 @@ public:
 		: m_Data(other)
 	{ }
 
-	String(String&& other)
+	String(String&& other) BOOST_NOEXCEPT
 		: m_Data(std::move(other.m_Data))
 	{ }
 
@@ -104,7 +104,7 @@ public:
 		return *this;
 	}
 
-	String& operator=(String&& rhs)
+	String& operator=(String&& rhs) BOOST_NOEXCEPT
 	{
 		m_Data = std::move(rhs.m_Data);
 		return *this;
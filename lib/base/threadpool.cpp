@@ -23,15 +23,27 @@
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include "base/application.hpp"
+#include "base/convert.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/bind.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <fstream>
 #include <iostream>
+#include <set>
 
 using namespace icinga;
 
+REGISTER_STATSFUNCTION(ThreadPool, &ThreadPool::StatsFunc);
+
 int ThreadPool::m_NextID = 1;
 
+/* Workers are owned by the pool, the TLS slot must not free them on thread exit. */
+boost::thread_specific_ptr<ThreadPool::StealingWorker> ThreadPool::m_CurrentStealer([](ThreadPool::StealingWorker *) { });
+
 ThreadPool::ThreadPool(size_t max_threads)
-	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(true)
+	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(true),
+	  m_StealingStarted(false), m_StealingStopped(false), m_IdleStealers(0), m_InjectedCount(0)
 {
 	if (m_MaxThreads != UINT_MAX && m_MaxThreads < sizeof(m_Queues) / sizeof(m_Queues[0]))
 		m_MaxThreads = sizeof(m_Queues) / sizeof(m_Queues[0]);
@@ -71,6 +83,8 @@ void ThreadPool::Stop(void)
 	if (m_MgmtThread.joinable())
 		m_MgmtThread.join();
 
+	StopStealing();
+
 	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
 		boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
 		m_Queues[i].Stopped = true;
@@ -190,7 +204,9 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 }
 
 /**
- * Appends a work item to the work queue. Work items will be processed in FIFO order.
+ * Appends a work item to the work queue. Work items will be processed in FIFO order
+ * unless the work-stealing scheduler is used, which only guarantees that each
+ * item is run exactly once.
  *
  * @param callback The callback function for the work item.
  * @param policy The scheduling policy
@@ -198,6 +214,9 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
  */
 bool ThreadPool::Post(const ThreadPool::WorkFunction& callback, SchedulerPolicy policy)
 {
+	if (policy == WorkStealingScheduler)
+		return PostStealing(callback);
+
 	WorkItem wi;
 	wi.Callback = callback;
 	wi.Timestamp = Utility::GetTime();
@@ -399,3 +418,413 @@ void ThreadPool::WorkerThread::UpdateUtilization(ThreadState state)
 	if (state != ThreadUnspecified)
 		State = state;
 }
+
+/**
+ * Determines which CPUs belong to which NUMA node. Falls back to a single
+ * node with all CPUs if the topology is not available.
+ */
+std::vector<std::vector<int> > ThreadPool::GetNumaTopology(void)
+{
+	std::vector<std::vector<int> > nodes;
+
+#ifdef __linux__
+	for (int node = 0;; node++) {
+		std::ifstream fp(("/sys/devices/system/node/node" + Convert::ToString(node) + "/cpulist").CStr());
+
+		if (!fp)
+			break;
+
+		std::string line;
+		std::getline(fp, line);
+
+		std::vector<String> ranges;
+		boost::algorithm::split(ranges, line, boost::is_any_of(","));
+
+		std::vector<int> cpus;
+
+		for (const String& range : ranges) {
+			String trimmed = range.Trim();
+
+			if (trimmed.IsEmpty())
+				continue;
+
+			std::vector<String> bounds;
+			boost::algorithm::split(bounds, trimmed, boost::is_any_of("-"));
+
+			try {
+				int first = Convert::ToLong(bounds[0]);
+				int last = (bounds.size() > 1) ? Convert::ToLong(bounds[1]) : first;
+
+				for (int cpu = first; cpu <= last; cpu++)
+					cpus.push_back(cpu);
+			} catch (const std::exception&) {
+				continue;
+			}
+		}
+
+		if (!cpus.empty())
+			nodes.push_back(cpus);
+	}
+#endif /* __linux__ */
+
+	if (nodes.empty()) {
+		std::vector<int> cpus;
+		int count = boost::thread::hardware_concurrency();
+
+		for (int cpu = 0; cpu < count; cpu++)
+			cpus.push_back(cpu);
+
+		nodes.push_back(cpus);
+	}
+
+	return nodes;
+}
+
+/**
+ * Spawns the work-stealing workers. The number of workers per NUMA node is
+ * proportional to the node's share of the configured concurrency and each
+ * worker is bound to the CPUs of its node.
+ */
+void ThreadPool::StartStealing(void)
+{
+	boost::mutex::scoped_lock lock(m_StealingMutex);
+
+	if (m_StealingStarted.load())
+		return;
+
+	std::vector<std::vector<int> > nodes = GetNumaTopology();
+
+	size_t cpuCount = 0;
+
+	for (const std::vector<int>& node : nodes)
+		cpuCount += node.size();
+
+	size_t threadCount = Application::GetConcurrency();
+
+	if (threadCount < 1)
+		threadCount = 1;
+
+	if (m_MaxThreads != UINT_MAX && threadCount > m_MaxThreads)
+		threadCount = m_MaxThreads;
+
+	for (size_t node = 0; node < nodes.size(); node++) {
+		size_t nodeThreads = (threadCount * nodes[node].size() + cpuCount - 1) / cpuCount;
+
+		for (size_t i = 0; i < nodeThreads && m_StealingWorkers.size() < threadCount; i++) {
+			StealingWorker *worker = new StealingWorker();
+			worker->Pool = this;
+			worker->Index = m_StealingWorkers.size();
+			worker->Node = node;
+
+			if (nodes.size() > 1)
+				worker->CPUs = nodes[node];
+
+			m_StealingWorkers.push_back(worker);
+		}
+	}
+
+	m_StealingStopped = false;
+
+	for (StealingWorker *worker : m_StealingWorkers)
+		worker->Thread = new boost::thread(boost::bind(&ThreadPool::StealingWorker::ThreadProc, worker));
+
+	Log(LogNotice, "ThreadPool")
+	    << "Pool #" << m_ID << ": Started " << m_StealingWorkers.size() << " work-stealing threads on "
+	    << nodes.size() << " NUMA node(s).";
+
+	m_StealingStarted.store(true);
+}
+
+void ThreadPool::StopStealing(void)
+{
+	std::vector<StealingWorker *> workers;
+
+	{
+		boost::mutex::scoped_lock lock(m_StealingMutex);
+
+		if (!m_StealingStarted.load())
+			return;
+
+		m_StealingStopped = true;
+		m_StealingCV.notify_all();
+
+		workers = m_StealingWorkers;
+	}
+
+	for (StealingWorker *worker : workers) {
+		worker->Thread->join();
+		delete worker->Thread;
+	}
+
+	/* Run whatever was posted while the workers were shutting down. */
+	for (StealingWorker *worker : workers) {
+		WorkItem *item;
+
+		while ((item = worker->Deque.Steal())) {
+			RunWorkItem(*item);
+			delete item;
+		}
+	}
+
+	boost::mutex::scoped_lock lock(m_StealingMutex);
+
+	while (!m_InjectionQueue.empty()) {
+		WorkItem *item = m_InjectionQueue.front();
+		m_InjectionQueue.pop_front();
+
+		lock.unlock();
+		RunWorkItem(*item);
+		delete item;
+		lock.lock();
+	}
+
+	for (StealingWorker *worker : workers)
+		delete worker;
+
+	m_StealingWorkers.clear();
+	m_StealingStarted.store(false);
+}
+
+bool ThreadPool::PostStealing(const WorkFunction& callback)
+{
+	if (m_Stopped)
+		return false;
+
+	if (!m_StealingStarted.load())
+		StartStealing();
+
+	WorkItem *item = new WorkItem();
+	item->Callback = callback;
+	item->Timestamp = Utility::GetTime();
+
+	StealingWorker *current = m_CurrentStealer.get();
+
+	/* Work posted from one of our own workers stays local to keep caches warm. */
+	if (current && current->Pool == this && current->Deque.Push(item)) {
+		if (m_IdleStealers.load() > 0)
+			WakeStealer();
+
+		return true;
+	}
+
+	boost::mutex::scoped_lock lock(m_StealingMutex);
+
+	if (m_StealingStopped) {
+		delete item;
+		return false;
+	}
+
+	m_InjectionQueue.push_back(item);
+	m_InjectedCount++;
+	m_StealingCV.notify_one();
+
+	return true;
+}
+
+void ThreadPool::WakeStealer(void)
+{
+	boost::mutex::scoped_lock lock(m_StealingMutex);
+	m_StealingCV.notify_one();
+}
+
+void ThreadPool::RunWorkItem(const WorkItem& wi)
+{
+	try {
+		if (wi.Callback)
+			wi.Callback();
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ThreadPool")
+		    << "Exception thrown in event handler:\n"
+		    << DiagnosticInformation(ex);
+	} catch (...) {
+		Log(LogCritical, "ThreadPool", "Exception of unknown type thrown in event handler.");
+	}
+}
+
+/**
+ * Looks for work in the worker's own deque, the injection queue and finally
+ * the other workers' deques, preferring victims on the same NUMA node.
+ */
+ThreadPool::WorkItem *ThreadPool::StealingWorker::FindWork(void)
+{
+	WorkItem *item = Deque.Pop();
+
+	if (item)
+		return item;
+
+	{
+		boost::mutex::scoped_lock lock(Pool->m_StealingMutex);
+
+		if (!Pool->m_InjectionQueue.empty()) {
+			item = Pool->m_InjectionQueue.front();
+			Pool->m_InjectionQueue.pop_front();
+			return item;
+		}
+	}
+
+	const std::vector<StealingWorker *>& workers = Pool->m_StealingWorkers;
+	size_t count = workers.size();
+	size_t offset = Utility::Random();
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < count; i++) {
+			StealingWorker *victim = workers[(offset + i) % count];
+
+			if (victim == this || (pass == 0) != (victim->Node == Node))
+				continue;
+
+			item = victim->Deque.Steal();
+
+			if (item) {
+				StealCount++;
+				return item;
+			}
+		}
+	}
+
+	FailedSteals++;
+
+	return NULL;
+}
+
+void ThreadPool::StealingWorker::RecordLatency(double latency)
+{
+	unsigned long long us = latency > 0 ? latency * 1000000 : 0;
+
+	TaskCount++;
+	LatencyTotal += us;
+
+	unsigned long long max = LatencyMax.load(std::memory_order_relaxed);
+
+	while (us > max && !LatencyMax.compare_exchange_weak(max, us))
+		; /* retry */
+}
+
+void ThreadPool::StealingWorker::ThreadProc(void)
+{
+	std::ostringstream idbuf;
+	idbuf << "TP #" << Pool->m_ID << " WS #" << Index;
+	Utility::SetThreadName(idbuf.str());
+
+	Pool->m_CurrentStealer.reset(this);
+
+#ifdef __linux__
+	if (!CPUs.empty()) {
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+
+		for (int cpu : CPUs)
+			CPU_SET(cpu, &cpuset);
+
+		(void) pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	}
+#endif /* __linux__ */
+
+	int idleRounds = 0;
+
+	for (;;) {
+		WorkItem *item = FindWork();
+
+		if (!item) {
+			/* Spin briefly before going to sleep, new work usually arrives in bursts. */
+			if (idleRounds++ < 64) {
+				boost::this_thread::yield();
+				continue;
+			}
+
+			boost::mutex::scoped_lock lock(Pool->m_StealingMutex);
+
+			if (Pool->m_StealingStopped)
+				break;
+
+			if (!Pool->m_InjectionQueue.empty())
+				continue;
+
+			Pool->m_IdleStealers++;
+			/* Pushes to local deques don't take the lock, so don't sleep forever. */
+			Pool->m_StealingCV.timed_wait(lock, boost::posix_time::milliseconds(50));
+			Pool->m_IdleStealers--;
+
+			continue;
+		}
+
+		idleRounds = 0;
+
+		RecordLatency(Utility::GetTime() - item->Timestamp);
+		RunWorkItem(*item);
+		delete item;
+	}
+
+	Pool->m_CurrentStealer.release();
+}
+
+Dictionary::Ptr ThreadPool::GetStats(void) const
+{
+	Dictionary::Ptr stats = new Dictionary();
+
+	size_t pending = 0, threads = 0;
+
+	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
+		Queue& queue = const_cast<Queue&>(m_Queues[i]);
+
+		boost::mutex::scoped_lock lock(queue.Mutex);
+
+		pending += queue.Items.size();
+
+		for (size_t t = 0; t < sizeof(queue.Threads) / sizeof(queue.Threads[0]); t++) {
+			if (queue.Threads[t].State != ThreadDead && !queue.Threads[t].Zombie)
+				threads++;
+		}
+	}
+
+	stats->Set("pending", pending);
+	stats->Set("threads", threads);
+
+	Dictionary::Ptr stealing = new Dictionary();
+
+	boost::mutex::scoped_lock lock(m_StealingMutex);
+
+	unsigned long long tasks = 0, steals = 0, failedSteals = 0, latencyTotal = 0, latencyMax = 0;
+	size_t depth = 0, maxDepth = 0;
+	std::set<int> nodes;
+
+	for (const StealingWorker *worker : m_StealingWorkers) {
+		size_t length = worker->Deque.GetLength();
+
+		depth += length;
+
+		if (length > maxDepth)
+			maxDepth = length;
+
+		tasks += worker->TaskCount.load();
+		steals += worker->StealCount.load();
+		failedSteals += worker->FailedSteals.load();
+		latencyTotal += worker->LatencyTotal.load();
+
+		if (worker->LatencyMax.load() > latencyMax)
+			latencyMax = worker->LatencyMax.load();
+
+		nodes.insert(worker->Node);
+	}
+
+	stealing->Set("threads", m_StealingWorkers.size());
+	stealing->Set("numa_nodes", nodes.size());
+	stealing->Set("tasks", tasks);
+	stealing->Set("injected", m_InjectedCount.load());
+	stealing->Set("steals", steals);
+	stealing->Set("failed_steals", failedSteals);
+	stealing->Set("queue_depth", depth + m_InjectionQueue.size());
+	stealing->Set("injection_queue_depth", m_InjectionQueue.size());
+	stealing->Set("max_local_queue_depth", maxDepth);
+	stealing->Set("avg_latency", tasks > 0 ? latencyTotal / 1000000.0 / tasks : 0);
+	stealing->Set("max_latency", latencyMax / 1000000.0);
+
+	stats->Set("work_stealing", stealing);
+
+	return stats;
+}
+
+void ThreadPool::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	status->Set("threadpool", Application::GetTP().GetStats());
+}
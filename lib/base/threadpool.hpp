@@ -21,11 +21,17 @@
 #define THREADPOOL_H
 
 #include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include "base/stealingdeque.hpp"
 #include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <atomic>
 #include <deque>
+#include <vector>
 
 namespace icinga
 {
@@ -35,7 +41,8 @@ namespace icinga
 enum SchedulerPolicy
 {
 	DefaultScheduler,
-	LowLatencyScheduler
+	LowLatencyScheduler,
+	WorkStealingScheduler
 };
 
 /**
@@ -56,6 +63,10 @@ public:
 
 	bool Post(const WorkFunction& callback, SchedulerPolicy policy = DefaultScheduler);
 
+	Dictionary::Ptr GetStats(void) const;
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 private:
 	enum ThreadState
 	{
@@ -114,6 +125,32 @@ private:
 		void KillWorker(boost::thread_group& group);
 	};
 
+	struct StealingWorker
+	{
+		ThreadPool *Pool;
+		size_t Index;
+		int Node;
+		std::vector<int> CPUs;
+		boost::thread *Thread;
+
+		StealingDeque<WorkItem> Deque;
+
+		std::atomic<unsigned long long> TaskCount;
+		std::atomic<unsigned long long> StealCount;
+		std::atomic<unsigned long long> FailedSteals;
+		std::atomic<unsigned long long> LatencyTotal;
+		std::atomic<unsigned long long> LatencyMax;
+
+		StealingWorker(void)
+			: Pool(NULL), Index(0), Node(0), Thread(NULL), TaskCount(0),
+			  StealCount(0), FailedSteals(0), LatencyTotal(0), LatencyMax(0)
+		{ }
+
+		void ThreadProc(void);
+		WorkItem *FindWork(void);
+		void RecordLatency(double latency);
+	};
+
 	int m_ID;
 	static int m_NextID;
 
@@ -128,7 +165,26 @@ private:
 
 	Queue m_Queues[QUEUECOUNT];
 
+	mutable boost::mutex m_StealingMutex;
+	boost::condition_variable m_StealingCV;
+	std::deque<WorkItem *> m_InjectionQueue;
+	std::vector<StealingWorker *> m_StealingWorkers;
+	std::atomic<bool> m_StealingStarted;
+	bool m_StealingStopped;
+	std::atomic<int> m_IdleStealers;
+	std::atomic<unsigned long long> m_InjectedCount;
+
+	static boost::thread_specific_ptr<StealingWorker> m_CurrentStealer;
+
 	void ManagerThreadProc(void);
+
+	void StartStealing(void);
+	void StopStealing(void);
+	bool PostStealing(const WorkFunction& callback);
+	void WakeStealer(void);
+
+	static std::vector<std::vector<int> > GetNumaTopology(void);
+	static void RunWorkItem(const WorkItem& wi);
 };
 
 }
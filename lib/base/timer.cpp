@@ -20,35 +20,295 @@
 #include "base/timer.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
+#include "base/logger.hpp"
+#include "base/exception.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
+#include <atomic>
+#include <cmath>
+#include <limits>
 
 using namespace icinga;
 
-typedef boost::multi_index_container<
-	Timer::Holder,
-	boost::multi_index::indexed_by<
-		boost::multi_index::ordered_unique<boost::multi_index::const_mem_fun<Timer::Holder, Timer *, &Timer::Holder::GetObject> >,
-		boost::multi_index::ordered_non_unique<boost::multi_index::const_mem_fun<Timer::Holder, double, &Timer::Holder::GetNextUnlocked> >
-	>
-> TimerSet;
+#define TIMERSHARDS 16
+#define TIMERWHEELLEVELS 4
+#define TIMERWHEELBITS 8
+#define TIMERWHEELSIZE (1U << TIMERWHEELBITS)
+#define TIMERWHEELMASK (TIMERWHEELSIZE - 1)
+#define TIMERTICK 0.01
+#define TIMERBATCHSIZE 8
+
+REGISTER_STATSFUNCTION(Timer, &Timer::StatsFunc);
+
+namespace icinga
+{
+
+typedef std::vector<std::pair<Timer::Ptr, double> > TimerBatch;
+
+/**
+ * A hierarchical timing wheel. Level 0 has one slot per tick, each higher
+ * level covers TIMERWHEELSIZE slots of the level below it. Timers are
+ * cascaded to lower levels as the wheel turns.
+ *
+ * All members are protected by Mutex, which also protects the state of
+ * the timers that belong to this wheel.
+ */
+class TimerWheel
+{
+public:
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+
+	TimerWheel(void)
+		: m_Current(ToTick(Utility::GetTime())), m_Count(0)
+	{
+		for (int level = 0; level < TIMERWHEELLEVELS; level++) {
+			m_LevelCount[level] = 0;
+
+			for (size_t slot = 0; slot < TIMERWHEELSIZE; slot++)
+				m_Slots[level][slot] = NULL;
+		}
+	}
+
+	void Add(Timer *timer)
+	{
+		Link(timer, ToTick(timer->m_Next));
+		m_Count++;
+	}
+
+	void Remove(Timer *timer)
+	{
+		if (!timer->m_WheelSlot)
+			return;
+
+		Unlink(timer);
+		m_Count--;
+	}
+
+	size_t GetCount(void) const
+	{
+		return m_Count;
+	}
+
+	/**
+	 * Turns the wheel up to the specified time and moves all timers which
+	 * are due into the expired list.
+	 */
+	void Advance(double now, TimerBatch& expired)
+	{
+		/* Round down so that we only process ticks which have fully elapsed. */
+		unsigned long long nowTick = (now > 0) ? std::floor(now / TIMERTICK) : 0;
+
+		/* The clock was changed or we haven't run in a long time, it's
+		 * cheaper to re-sort the timers than to turn the wheel. */
+		if (nowTick + 1 < m_Current || nowTick - m_Current > TIMERWHEELSIZE * TIMERWHEELSIZE) {
+			Rebase(m_Current > nowTick ? now : (nowTick - TIMERWHEELSIZE) * TIMERTICK);
+		}
+
+		while (m_Current <= nowTick) {
+			if (m_Count == 0) {
+				m_Current = nowTick + 1;
+				break;
+			}
+
+			size_t index = m_Current & TIMERWHEELMASK;
+
+			if (index == 0)
+				Cascade(1);
+
+			Timer *timer;
+
+			while ((timer = m_Slots[0][index])) {
+				Unlink(timer);
+				m_Count--;
+
+				timer->m_Running = true;
+				expired.push_back(std::make_pair(Timer::Ptr(timer), timer->m_Next));
+			}
+
+			m_Current++;
+		}
+	}
+
+	/**
+	 * Returns when the wheel next needs to be turned, or -1 if there are no timers.
+	 */
+	double GetNextExpiry(void) const
+	{
+		if (m_Count == 0)
+			return -1;
+
+		bool cascade = (m_Count > m_LevelCount[0]);
+
+		for (size_t i = 0; i < TIMERWHEELSIZE; i++) {
+			unsigned long long tick = m_Current + i;
+
+			if (m_Slots[0][tick & TIMERWHEELMASK] || (cascade && i > 0 && (tick & TIMERWHEELMASK) == 0))
+				return tick * TIMERTICK;
+		}
+
+		return (m_Current + TIMERWHEELSIZE) * TIMERTICK;
+	}
+
+	/**
+	 * Re-links all timers relative to the specified time.
+	 */
+	void Rebase(double now)
+	{
+		std::vector<Timer *> timers = GetTimers();
+
+		for (Timer *timer : timers)
+			Unlink(timer);
+
+		m_Current = ToTick(now);
+
+		for (Timer *timer : timers)
+			Link(timer, ToTick(timer->m_Next));
+	}
+
+	std::vector<Timer *> GetTimers(void) const
+	{
+		std::vector<Timer *> timers;
+
+		for (int level = 0; level < TIMERWHEELLEVELS; level++) {
+			for (size_t slot = 0; slot < TIMERWHEELSIZE; slot++) {
+				for (Timer *timer = m_Slots[level][slot]; timer; timer = timer->m_WheelNext)
+					timers.push_back(timer);
+			}
+		}
+
+		return timers;
+	}
+
+private:
+	Timer *m_Slots[TIMERWHEELLEVELS][TIMERWHEELSIZE];
+	size_t m_LevelCount[TIMERWHEELLEVELS];
+	unsigned long long m_Current; /**< The next tick that needs to be processed. */
+	size_t m_Count;
+
+	static unsigned long long ToTick(double ts)
+	{
+		if (ts <= 0)
+			return 0;
+
+		/* Round up so that timers never fire before their deadline. */
+		return std::ceil(ts / TIMERTICK);
+	}
+
+	void Link(Timer *timer, unsigned long long expires)
+	{
+		if (expires < m_Current)
+			expires = m_Current;
+
+		unsigned long long delta = expires - m_Current;
+		int level;
+
+		for (level = 0; level < TIMERWHEELLEVELS - 1; level++) {
+			if (delta < (1ULL << (TIMERWHEELBITS * (level + 1))))
+				break;
+		}
+
+		if (delta >= (1ULL << (TIMERWHEELBITS * TIMERWHEELLEVELS)))
+			expires = m_Current + (1ULL << (TIMERWHEELBITS * TIMERWHEELLEVELS)) - 1;
+
+		Timer **slot = &m_Slots[level][(expires >> (TIMERWHEELBITS * level)) & TIMERWHEELMASK];
+
+		timer->m_WheelPrev = NULL;
+		timer->m_WheelNext = *slot;
+
+		if (*slot)
+			(*slot)->m_WheelPrev = timer;
+
+		*slot = timer;
+		timer->m_WheelSlot = slot;
+
+		m_LevelCount[level]++;
+	}
+
+	void Unlink(Timer *timer)
+	{
+		if (timer->m_WheelPrev)
+			timer->m_WheelPrev->m_WheelNext = timer->m_WheelNext;
+		else
+			*timer->m_WheelSlot = timer->m_WheelNext;
+
+		if (timer->m_WheelNext)
+			timer->m_WheelNext->m_WheelPrev = timer->m_WheelPrev;
+
+		m_LevelCount[(timer->m_WheelSlot - &m_Slots[0][0]) / TIMERWHEELSIZE]--;
+
+		timer->m_WheelPrev = NULL;
+		timer->m_WheelNext = NULL;
+		timer->m_WheelSlot = NULL;
+	}
+
+	/**
+	 * Moves the timers of the current slot of the specified level to lower levels.
+	 */
+	void Cascade(int level)
+	{
+		if (level >= TIMERWHEELLEVELS)
+			return;
+
+		size_t index = (m_Current >> (TIMERWHEELBITS * level)) & TIMERWHEELMASK;
+
+		if (index == 0)
+			Cascade(level + 1);
+
+		Timer *timer;
+
+		while ((timer = m_Slots[level][index])) {
+			Unlink(timer);
+			Link(timer, ToTick(timer->m_Next));
+		}
+	}
+};
+
+}
+
+static TimerWheel l_TimerWheels[TIMERSHARDS];
+static std::atomic<unsigned long> l_NextTimerID(0);
 
 static boost::mutex l_TimerMutex;
 static boost::condition_variable l_TimerCV;
 static boost::thread l_TimerThread;
 static bool l_StopTimerThread;
-static TimerSet l_Timers;
+static bool l_TimersChanged;
+
+/* When the timer thread will wake up next, infinity while it is awake. */
+static std::atomic<double> l_NextWakeup(std::numeric_limits<double>::infinity());
+
+static std::atomic<unsigned long long> l_TimerCalls(0);
+static std::atomic<unsigned long long> l_TimerLagTotal(0);
+static std::atomic<unsigned long long> l_TimerLagMax(0);
+
+static inline TimerWheel& GetTimerWheel(unsigned long id)
+{
+	return l_TimerWheels[id % TIMERSHARDS];
+}
+
+/**
+ * Wakes up the timer thread if a timer is due before its next wakeup.
+ */
+static void NotifyTimerThread(double next)
+{
+	if (next >= l_NextWakeup.load())
+		return;
+
+	boost::mutex::scoped_lock lock(l_TimerMutex);
+	l_TimersChanged = true;
+	l_TimerCV.notify_all();
+}
 
 /**
  * Constructor for the Timer class.
  */
 Timer::Timer(void)
-	: m_Interval(0), m_Next(0), m_Started(false), m_Running(false)
+	: m_ID(l_NextTimerID++), m_Interval(0), m_Next(0), m_Started(false), m_Running(false),
+	  m_Rescheduled(false), m_WheelPrev(NULL), m_WheelNext(NULL), m_WheelSlot(NULL)
 { }
 
 /**
@@ -86,9 +346,22 @@ void Timer::Uninitialize(void)
 
 /**
  * Calls this timer.
+ *
+ * @param deadline When the timer was supposed to fire.
  */
-void Timer::Call(void)
+void Timer::Call(double deadline)
 {
+	double lag = Utility::GetTime() - deadline;
+	unsigned long long lagUs = lag > 0 ? lag * 1000000 : 0;
+
+	l_TimerCalls++;
+	l_TimerLagTotal += lagUs;
+
+	unsigned long long lagMax = l_TimerLagMax.load();
+
+	while (lagUs > lagMax && !l_TimerLagMax.compare_exchange_weak(lagMax, lagUs))
+		; /* retry */
+
 	try {
 		OnTimerExpired(Timer::Ptr(this));
 	} catch (...) {
@@ -100,6 +373,24 @@ void Timer::Call(void)
 	InternalReschedule(true);
 }
 
+/**
+ * Calls a batch of timers which expired at the same time.
+ */
+void Timer::CallBatch(const TimerBatch& timers)
+{
+	for (const std::pair<Timer::Ptr, double>& timer : timers) {
+		try {
+			timer.first->Call(timer.second);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "Timer")
+			    << "Exception thrown in timer handler:\n"
+			    << DiagnosticInformation(ex);
+		} catch (...) {
+			Log(LogCritical, "Timer", "Exception of unknown type thrown in timer handler.");
+		}
+	}
+}
+
 /**
  * Sets the interval for this timer.
  *
@@ -107,7 +398,7 @@ void Timer::Call(void)
  */
 void Timer::SetInterval(double interval)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetTimerWheel(m_ID).Mutex);
 	m_Interval = interval;
 }
 
@@ -118,7 +409,7 @@ void Timer::SetInterval(double interval)
  */
 double Timer::GetInterval(void) const
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetTimerWheel(m_ID).Mutex);
 	return m_Interval;
 }
 
@@ -128,7 +419,7 @@ double Timer::GetInterval(void) const
 void Timer::Start(void)
 {
 	{
-		boost::mutex::scoped_lock lock(l_TimerMutex);
+		boost::mutex::scoped_lock lock(GetTimerWheel(m_ID).Mutex);
 		m_Started = true;
 	}
 
@@ -143,16 +434,15 @@ void Timer::Stop(bool wait)
 	if (l_StopTimerThread)
 		return;
 
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	TimerWheel& wheel = GetTimerWheel(m_ID);
 
-	m_Started = false;
-	l_Timers.erase(this);
+	boost::mutex::scoped_lock lock(wheel.Mutex);
 
-	/* Notify the worker thread that we've disabled a timer. */
-	l_TimerCV.notify_all();
+	m_Started = false;
+	wheel.Remove(this);
 
 	while (wait && m_Running)
-		l_TimerCV.wait(lock);
+		wheel.CV.wait(lock);
 }
 
 void Timer::Reschedule(double next)
@@ -169,29 +459,47 @@ void Timer::Reschedule(double next)
  */
 void Timer::InternalReschedule(bool completed, double next)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	TimerWheel& wheel = GetTimerWheel(m_ID);
 
-	if (completed)
-		m_Running = false;
+	{
+		boost::mutex::scoped_lock lock(wheel.Mutex);
 
-	if (next < 0) {
-		/* Don't schedule the next call if this is not a periodic timer. */
-		if (m_Interval <= 0)
-			return;
+		if (completed) {
+			m_Running = false;
 
-		next = Utility::GetTime() + m_Interval;
-	}
+			/* Notify Stop() that the timer proc is done. */
+			wheel.CV.notify_all();
 
-	m_Next = next;
+			/* Keep the deadline if the callback rescheduled its own timer. */
+			if (next < 0 && m_Rescheduled)
+				next = m_Next;
 
-	if (m_Started && !m_Running) {
-		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
+			m_Rescheduled = false;
+		}
 
-		/* Notify the worker that we've rescheduled a timer. */
-		l_TimerCV.notify_all();
+		if (next < 0) {
+			/* Don't schedule the next call if this is not a periodic timer. */
+			if (m_Interval <= 0)
+				return;
+
+			next = Utility::GetTime() + m_Interval;
+		}
+
+		m_Next = next;
+
+		if (m_Running)
+			m_Rescheduled = true;
+
+		if (!m_Started || m_Running)
+			return;
+
+		/* Remove and re-add the timer to update its slot. */
+		wheel.Remove(this);
+		wheel.Add(this);
 	}
+
+	/* Notify the worker that we've rescheduled a timer. */
+	NotifyTimerThread(next);
 }
 
 /**
@@ -201,7 +509,7 @@ void Timer::InternalReschedule(bool completed, double next)
  */
 double Timer::GetNext(void) const
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetTimerWheel(m_ID).Mutex);
 	return m_Next;
 }
 
@@ -213,29 +521,24 @@ double Timer::GetNext(void) const
  */
 void Timer::AdjustTimers(double adjustment)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
-
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
+	for (TimerWheel& wheel : l_TimerWheels) {
+		boost::mutex::scoped_lock lock(wheel.Mutex);
 
-	std::vector<Timer *> timers;
-
-	for (Timer *timer : idx) {
-		if (std::fabs(now - (timer->m_Next + adjustment)) <
-		    std::fabs(now - timer->m_Next)) {
-			timer->m_Next += adjustment;
-			timers.push_back(timer);
+		for (Timer *timer : wheel.GetTimers()) {
+			if (std::fabs(now - (timer->m_Next + adjustment)) <
+			    std::fabs(now - timer->m_Next)) {
+				timer->m_Next += adjustment;
+			}
 		}
-	}
 
-	for (Timer *timer : timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
+		wheel.Rebase(now);
 	}
 
 	/* Notify the worker that we've rescheduled some timers. */
+	boost::mutex::scoped_lock lock(l_TimerMutex);
+	l_TimersChanged = true;
 	l_TimerCV.notify_all();
 }
 
@@ -247,41 +550,82 @@ void Timer::TimerThreadProc(void)
 	Utility::SetThreadName("Timer Thread");
 
 	for (;;) {
-		boost::mutex::scoped_lock lock(l_TimerMutex);
+		double next = -1;
+
+		for (TimerWheel& wheel : l_TimerWheels) {
+			boost::mutex::scoped_lock lock(wheel.Mutex);
+
+			double expiry = wheel.GetNextExpiry();
+
+			if (expiry >= 0 && (next < 0 || expiry < next))
+				next = expiry;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(l_TimerMutex);
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
+			if (l_StopTimerThread)
+				break;
 
-		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopTimerThread)
-			l_TimerCV.wait(lock);
+			/* A timer was rescheduled while we were looking for the next one. */
+			if (l_TimersChanged) {
+				l_TimersChanged = false;
+				continue;
+			}
 
-		if (l_StopTimerThread)
-			break;
+			double wait = (next < 0) ? -1 : next - Utility::GetTime();
 
-		auto it = idx.begin();
-		Timer *timer = *it;
+			if (next < 0 || wait > 0) {
+				l_NextWakeup.store(next < 0 ? std::numeric_limits<double>::infinity() : next);
 
-		double wait = timer->m_Next - Utility::GetTime();
+				/* Wait until there is at least one timer or for the next timer. */
+				if (next < 0)
+					l_TimerCV.wait(lock);
+				else
+					l_TimerCV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000) + 1));
 
-		if (wait > 0.01) {
-			/* Wait for the next timer. */
-			l_TimerCV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+				l_NextWakeup.store(std::numeric_limits<double>::infinity());
+				l_TimersChanged = false;
 
-			continue;
+				if (l_StopTimerThread)
+					break;
+			}
 		}
 
-		Timer::Ptr ptimer = timer;
+		double now = Utility::GetTime();
+		TimerBatch expired;
 
-		/* Remove the timer from the list so it doesn't get called again
+		/* Timers are removed from the wheel so they don't get called again
 		 * until the current call is completed. */
-		l_Timers.erase(timer);
+		for (TimerWheel& wheel : l_TimerWheels) {
+			boost::mutex::scoped_lock lock(wheel.Mutex);
+			wheel.Advance(now, expired);
+		}
 
-		timer->m_Running = true;
+		/* Asynchronously call the timers in batches. */
+		for (size_t i = 0; i < expired.size(); i += TIMERBATCHSIZE) {
+			TimerBatch batch(expired.begin() + i, expired.begin() + std::min(expired.size(), i + TIMERBATCHSIZE));
+			Utility::QueueAsyncCallback(boost::bind(&Timer::CallBatch, batch));
+		}
+	}
+}
 
-		lock.unlock();
+void Timer::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	size_t count = 0;
 
-		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback(boost::bind(&Timer::Call, ptimer));
+	for (TimerWheel& wheel : l_TimerWheels) {
+		boost::mutex::scoped_lock lock(wheel.Mutex);
+		count += wheel.GetCount();
 	}
+
+	unsigned long long calls = l_TimerCalls.load();
+
+	Dictionary::Ptr stats = new Dictionary();
+	stats->Set("timers", count);
+	stats->Set("calls", calls);
+	stats->Set("avg_lag", calls > 0 ? l_TimerLagTotal.load() / 1000000.0 / calls : 0);
+	stats->Set("max_lag", l_TimerLagMax.load() / 1000000.0);
+
+	status->Set("timer", stats);
 }
@@ -22,6 +22,8 @@
 
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
 #include <boost/signals2.hpp>
 
 namespace icinga {
@@ -52,46 +54,32 @@ public:
 
 	boost::signals2::signal<void(const Timer::Ptr&)> OnTimerExpired;
 
-	class Holder {
-	public:
-		Holder(Timer *timer)
-			: m_Timer(timer)
-		{ }
-
-		inline Timer *GetObject(void) const
-		{
-			return m_Timer;
-		}
-
-		inline double GetNextUnlocked(void) const
-		{
-			return m_Timer->m_Next;
-		}
-
-		operator Timer *(void) const
-		{
-			return m_Timer;
-		}
-
-	private:
-		Timer *m_Timer;
-	};
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 private:
+	unsigned long m_ID; /**< Determines the wheel shard of the timer. */
 	double m_Interval; /**< The interval of the timer. */
 	double m_Next; /**< When the next event should happen. */
 	bool m_Started; /**< Whether the timer is enabled. */
 	bool m_Running; /**< Whether the timer proc is currently running. */
+	bool m_Rescheduled; /**< Whether the timer was rescheduled while it was running. */
+
+	Timer *m_WheelPrev; /**< Previous timer in the same wheel slot. */
+	Timer *m_WheelNext; /**< Next timer in the same wheel slot. */
+	Timer **m_WheelSlot; /**< The wheel slot the timer is linked into. */
 
-	void Call();
+	void Call(double deadline);
 	void InternalReschedule(bool completed, double next = -1);
 
+	static void CallBatch(const std::vector<std::pair<Timer::Ptr, double> >& timers);
+
 	static void TimerThreadProc(void);
 
 	static void Initialize(void);
 	static void Uninitialize(void);
 
 	friend class Application;
+	friend class TimerWheel;
 };
 
 }
@@ -23,6 +23,8 @@
 #include "base/logger.hpp"
 #include <boost/bind.hpp>
 #include <iostream>
+#include <algorithm>
+#include <climits>
 
 #ifndef _WIN32
 #	include <poll.h>
@@ -30,6 +32,12 @@
 
 using namespace icinga;
 
+/* minimum buffer size for SSL_read() */
+#define TLS_READ_MIN_SIZE 4096
+
+/* ranges smaller than this are copied together into one SSL_write() call */
+#define TLS_WRITE_BATCH_SIZE (64 * 1024)
+
 int I2_EXPORT TlsStream::m_SSLIndex;
 bool I2_EXPORT TlsStream::m_SSLIndexInitialized = false;
 
@@ -40,9 +48,8 @@ bool I2_EXPORT TlsStream::m_SSLIndexInitialized = false;
  * @param sslContext The SSL context for the client.
  */
 TlsStream::TlsStream(const Socket::Ptr& socket, const String& hostname, ConnectionRole role, const boost::shared_ptr<SSL_CTX>& sslContext)
-	: SocketEvents(socket, this), m_Eof(false), m_HandshakeOK(false), m_VerifyOK(true), m_ErrorCode(0),
-	  m_ErrorOccurred(false),  m_Socket(socket), m_Role(role), m_SendQ(new FIFO()), m_RecvQ(new FIFO()),
-	  m_CurrentAction(TlsActionNone), m_Retry(false), m_Shutdown(false)
+	: SocketEvents(socket, this), m_Eof(false), m_RecvWaiters(0), m_HandshakeOK(false), m_VerifyOK(true), m_ErrorCode(0),
+	  m_ErrorOccurred(false),  m_Socket(socket), m_Role(role), m_CurrentAction(TlsActionNone), m_Retry(false), m_Shutdown(false)
 {
 	std::ostringstream msgbuf;
 	char errbuf[120];
@@ -79,6 +86,9 @@ TlsStream::TlsStream(const Socket::Ptr& socket, const String& hostname, Connecti
 			SSL_set_tlsext_host_name(m_SSL.get(), hostname.CStr());
 #endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
 
+		if (!hostname.IsEmpty())
+			ResumeTlsSession(m_SSL.get(), hostname);
+
 		SSL_set_connect_state(m_SSL.get());
 	}
 }
@@ -105,6 +115,16 @@ int TlsStream::ValidateCertificate(int preverify_ok, X509_STORE_CTX *ctx)
 	return 1;
 }
 
+/**
+ * Checks whether the handshake resumed an earlier session.
+ *
+ * @returns true if the session was resumed, false otherwise.
+ */
+bool TlsStream::IsSessionReused(void) const
+{
+	return m_SSL && SSL_session_reused(m_SSL.get());
+}
+
 bool TlsStream::IsVerifyOK(void) const
 {
 	return m_VerifyOK;
@@ -140,19 +160,16 @@ boost::shared_ptr<X509> TlsStream::GetPeerCertificate(void) const
 void TlsStream::OnEvent(int revents)
 {
 	int rc;
-	size_t count;
 
 	boost::mutex::scoped_lock lock(m_Mutex);
 
 	if (!m_SSL)
 		return;
 
-	char buffer[64 * 1024];
-
 	if (m_CurrentAction == TlsActionNone) {
 		if (revents & (POLLIN | POLLERR | POLLHUP))
 			m_CurrentAction = TlsActionRead;
-		else if (m_SendQ->GetAvailableBytes() > 0 && (revents & POLLOUT))
+		else if (GetSendQueueSize() > 0 && (revents & POLLOUT))
 			m_CurrentAction = TlsActionWrite;
 		else {
 			ChangeEvents(POLLIN);
@@ -169,27 +186,74 @@ void TlsStream::OnEvent(int revents)
 
 	switch (m_CurrentAction) {
 		case TlsActionRead:
-			do {
-				rc = SSL_read(m_SSL.get(), buffer, sizeof(buffer));
+			{
+				/* SSL_read() writes directly into the receive queue's segments */
+				boost::mutex::scoped_lock rlock(m_RecvMutex);
 
-				if (rc > 0) {
-					m_RecvQ->Write(buffer, rc);
+				do {
+					size_t count = TLS_READ_MIN_SIZE;
+					char *buffer = m_RecvQ.Reserve(&count);
+
+					rc = SSL_read(m_SSL.get(), buffer, std::min<size_t>(count, INT_MAX));
+
+					if (rc > 0) {
+						m_RecvQ.Commit(rc);
+						success = true;
+					}
+				} while (rc > 0);
+
+				/* Post-handshake messages (e.g. TLS 1.3 session tickets) don't carry
+				 * any application data, the read is finished nonetheless. */
+				if (!success && SSL_get_error(m_SSL.get(), rc) == SSL_ERROR_WANT_READ)
 					success = true;
-				}
-			} while (rc > 0);
 
-			if (success)
-				m_CV.notify_all();
+				if (success && m_RecvWaiters > 0)
+					m_RecvCV.notify_all();
+			}
 
 			break;
 		case TlsActionWrite:
-			count = m_SendQ->Peek(buffer, sizeof(buffer), true);
+			{
+				char buffer[TLS_WRITE_BATCH_SIZE];
 
-			rc = SSL_write(m_SSL.get(), buffer, count);
+				rc = 1;
 
-			if (rc > 0) {
-				m_SendQ->Read(NULL, rc, true);
-				success = true;
+				for (;;) {
+					BufferRange range;
+					const char *data;
+					size_t count;
+
+					{
+						boost::mutex::scoped_lock slock(m_SendMutex);
+
+						if (!m_SendQ.GetFirst(&range)) {
+							success = true;
+							break;
+						}
+
+						/* The ranges at the front of the queue are only removed by this
+						 * thread, so large ranges can be written without holding the lock. */
+						if (range.Length < TLS_WRITE_BATCH_SIZE && m_SendQ.GetAvailableBytes() > range.Length) {
+							count = m_SendQ.Peek(buffer, sizeof(buffer));
+							data = buffer;
+						} else {
+							count = range.Length;
+							data = range.GetData();
+						}
+					}
+
+					rc = WriteInternal(data, count);
+
+					if (rc <= 0)
+						break;
+
+					{
+						boost::mutex::scoped_lock slock(m_SendMutex);
+						m_SendQ.Read(NULL, rc);
+					}
+
+					success = true;
+				}
 			}
 
 			break;
@@ -197,6 +261,20 @@ void TlsStream::OnEvent(int revents)
 			rc = SSL_do_handshake(m_SSL.get());
 
 			if (rc > 0) {
+				/* ValidateCertificate() isn't called for resumed sessions,
+				 * use the result which was stored in the session instead */
+				if (SSL_session_reused(m_SSL.get())) {
+					long result = SSL_get_verify_result(m_SSL.get());
+
+					if (result != X509_V_OK) {
+						m_VerifyOK = false;
+
+						std::ostringstream msgbuf;
+						msgbuf << "code " << result << ": " << X509_verify_cert_error_string(result);
+						m_VerifyError = msgbuf.str();
+					}
+				}
+
 				success = true;
 				m_HandshakeOK = true;
 				m_CV.notify_all();
@@ -250,7 +328,10 @@ void TlsStream::OnEvent(int revents)
 		m_CurrentAction = TlsActionNone;
 
 		if (!m_Eof) {
-			if (m_SendQ->GetAvailableBytes() > 0)
+			/* Write() changes the events while holding m_SendMutex, too */
+			boost::mutex::scoped_lock slock(m_SendMutex);
+
+			if (m_SendQ.GetAvailableBytes() > 0)
 				ChangeEvents(POLLIN|POLLOUT);
 			else
 				ChangeEvents(POLLIN);
@@ -258,11 +339,11 @@ void TlsStream::OnEvent(int revents)
 
 		lock.unlock();
 
-		while (m_RecvQ->IsDataAvailable() && IsHandlingEvents())
+		while (IsDataAvailable() && IsHandlingEvents())
 			SignalDataAvailable();
 	}
 
-	if (m_Shutdown && !m_SendQ->IsDataAvailable()) {
+	if (m_Shutdown && GetSendQueueSize() == 0) {
 		if (!success)
 			lock.unlock();
 
@@ -270,6 +351,20 @@ void TlsStream::OnEvent(int revents)
 	}
 }
 
+int TlsStream::WriteInternal(const char *buffer, size_t count)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	size_t written;
+
+	if (SSL_write_ex(m_SSL.get(), buffer, count, &written) <= 0)
+		return 0;
+
+	return written;
+#else /* OPENSSL_VERSION_NUMBER */
+	return SSL_write(m_SSL.get(), buffer, std::min<size_t>(count, INT_MAX));
+#endif /* OPENSSL_VERSION_NUMBER */
+}
+
 void TlsStream::HandleError(void) const
 {
 	if (m_ErrorOccurred) {
@@ -279,15 +374,31 @@ void TlsStream::HandleError(void) const
 	}
 }
 
-void TlsStream::Handshake(void)
+/**
+ * Performs the TLS handshake.
+ *
+ * @param timeout The timeout in seconds, or 0 to wait indefinitely. The
+ *		stream is closed if the timeout expires.
+ */
+void TlsStream::Handshake(double timeout)
 {
 	boost::mutex::scoped_lock lock(m_Mutex);
 
 	m_CurrentAction = TlsActionHandshake;
 	ChangeEvents(POLLOUT);
 
-	while (!m_HandshakeOK && !m_ErrorOccurred && !m_Eof)
-		m_CV.wait(lock);
+	boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(static_cast<long>(timeout * 1000));
+
+	while (!m_HandshakeOK && !m_ErrorOccurred && !m_Eof) {
+		if (timeout <= 0)
+			m_CV.wait(lock);
+		else if (!m_CV.timed_wait(lock, deadline) && !m_HandshakeOK && !m_ErrorOccurred && !m_Eof) {
+			lock.unlock();
+			Close();
+
+			BOOST_THROW_EXCEPTION(std::runtime_error("Timeout during TLS handshake."));
+		}
+	}
 
 	if (m_Eof)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Socket was closed during TLS handshake."));
@@ -300,39 +411,89 @@ void TlsStream::Handshake(void)
  */
 size_t TlsStream::Peek(void *buffer, size_t count, bool allow_partial)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	boost::mutex::scoped_lock lock(m_RecvMutex);
 
-	if (!allow_partial)
-		while (m_RecvQ->GetAvailableBytes() < count && !m_ErrorOccurred && !m_Eof)
-			m_CV.wait(lock);
+	if (!allow_partial) {
+		m_RecvWaiters++;
+
+		while (m_RecvQ.GetAvailableBytes() < count && !m_ErrorOccurred && !m_Eof)
+			m_RecvCV.wait(lock);
+
+		m_RecvWaiters--;
+	}
 
 	HandleError();
 
-	return m_RecvQ->Peek(buffer, count, true);
+	return m_RecvQ.Peek(buffer, count);
 }
 
 size_t TlsStream::Read(void *buffer, size_t count, bool allow_partial)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	boost::mutex::scoped_lock lock(m_RecvMutex);
 
-	if (!allow_partial)
-		while (m_RecvQ->GetAvailableBytes() < count && !m_ErrorOccurred && !m_Eof)
-			m_CV.wait(lock);
+	if (!allow_partial) {
+		m_RecvWaiters++;
+
+		while (m_RecvQ.GetAvailableBytes() < count && !m_ErrorOccurred && !m_Eof)
+			m_RecvCV.wait(lock);
+
+		m_RecvWaiters--;
+	}
 
 	HandleError();
 
-	return m_RecvQ->Read(buffer, count, true);
+	return m_RecvQ.Read(buffer, count);
+}
+
+/**
+ * Moves all data which has been received so far to the specified chain
+ * without copying it.
+ *
+ * @param chain The chain.
+ */
+void TlsStream::ReadChain(BufferChain& chain)
+{
+	boost::mutex::scoped_lock lock(m_RecvMutex);
+
+	HandleError();
+
+	chain.Append(m_RecvQ);
 }
 
 void TlsStream::Write(const void *buffer, size_t count)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
+	m_SendQ.Append(buffer, count);
+
+	ChangeEvents(POLLIN|POLLOUT);
+}
+
+/**
+ * Queues all data from the specified chain for sending without copying it.
+ *
+ * @param chain The chain. It is empty afterwards.
+ */
+void TlsStream::WriteChain(BufferChain& chain)
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
 
-	m_SendQ->Write(buffer, count);
+	m_SendQ.Append(chain);
 
 	ChangeEvents(POLLIN|POLLOUT);
 }
 
+/**
+ * Returns the number of bytes which have been written to the stream
+ * but not yet sent to the peer.
+ */
+size_t TlsStream::GetSendQueueSize(void) const
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
+	return m_SendQ.GetAvailableBytes();
+}
+
 void TlsStream::Shutdown(void)
 {
 	m_Shutdown = true;
@@ -373,6 +534,11 @@ void TlsStream::CloseInternal(bool inDestructor)
 	m_Socket.reset();
 
 	m_CV.notify_all();
+
+	lock.unlock();
+
+	boost::mutex::scoped_lock rlock(m_RecvMutex);
+	m_RecvCV.notify_all();
 }
 
 bool TlsStream::IsEof(void) const
@@ -387,9 +553,9 @@ bool TlsStream::SupportsWaiting(void) const
 
 bool TlsStream::IsDataAvailable(void) const
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	boost::mutex::scoped_lock lock(m_RecvMutex);
 
-	return m_RecvQ->GetAvailableBytes() > 0;
+	return m_RecvQ.GetAvailableBytes() > 0;
 }
 
 Socket::Ptr TlsStream::GetSocket(void) const
@@ -26,6 +26,7 @@
 #include "base/stream.hpp"
 #include "base/tlsutility.hpp"
 #include "base/fifo.hpp"
+#include "base/bufferchain.hpp"
 
 namespace icinga
 {
@@ -56,7 +57,7 @@ public:
 	boost::shared_ptr<X509> GetClientCertificate(void) const;
 	boost::shared_ptr<X509> GetPeerCertificate(void) const;
 
-	void Handshake(void);
+	void Handshake(double timeout = 0);
 
 	virtual void Close(void) override;
 	virtual void Shutdown(void) override;
@@ -70,14 +71,24 @@ public:
 	virtual bool SupportsWaiting(void) const override;
 	virtual bool IsDataAvailable(void) const override;
 
+	bool IsSessionReused(void) const;
 	bool IsVerifyOK(void) const;
 	String GetVerifyError(void) const;
 
+	size_t GetSendQueueSize(void) const;
+
+	void ReadChain(BufferChain& chain);
+	void WriteChain(BufferChain& chain);
+
 private:
 	boost::shared_ptr<SSL> m_SSL;
 	bool m_Eof;
 	mutable boost::mutex m_Mutex;
 	mutable boost::condition_variable m_CV;
+	mutable boost::mutex m_SendMutex;
+	mutable boost::mutex m_RecvMutex;
+	mutable boost::condition_variable m_RecvCV;
+	int m_RecvWaiters;
 	bool m_HandshakeOK;
 	bool m_VerifyOK;
 	String m_VerifyError;
@@ -87,8 +98,8 @@ private:
 	Socket::Ptr m_Socket;
 	ConnectionRole m_Role;
 
-	FIFO::Ptr m_SendQ;
-	FIFO::Ptr m_RecvQ;
+	BufferChain m_SendQ;
+	BufferChain m_RecvQ;
 
 	TlsAction m_CurrentAction;
 	bool m_Retry;
@@ -100,6 +111,7 @@ private:
 	virtual void OnEvent(int revents) override;
 
 	void HandleError(void) const;
+	int WriteInternal(const char *buffer, size_t count);
 
 	static int ValidateCertificate(int preverify_ok, X509_STORE_CTX *ctx);
 	static void NullCertificateDeleter(X509 *certificate);
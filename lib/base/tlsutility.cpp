@@ -25,6 +25,15 @@
 #include "base/application.hpp"
 #include "base/exception.hpp"
 #include <fstream>
+#include <sys/stat.h>
+
+/* lifetime of TLS sessions, resumed sessions skip the certificate checks
+ * (including the CRL) until they expire */
+#define TLS_SESSION_TIMEOUT 3600
+
+/* session ticket keys are replaced once they're older than this */
+#define TLS_TICKET_KEY_LIFETIME 86400
+#define TLS_TICKET_KEY_SIZE 80
 
 namespace icinga
 {
@@ -32,6 +41,11 @@ namespace icinga
 static bool l_SSLInitialized = false;
 static boost::mutex *l_Mutexes;
 
+/* client sessions by SSL context and host name, a session is only resumed
+ * with the context (and thus the certificate) it was negotiated with */
+static boost::mutex l_TlsSessionMutex;
+static std::map<std::pair<SSL_CTX *, String>, SSL_SESSION *> l_TlsSessions;
+
 #ifdef CRYPTO_LOCK
 static void OpenSSLLockingCallback(int mode, int type, const char *, int)
 {
@@ -73,6 +87,56 @@ void InitializeOpenSSL(void)
 	l_SSLInitialized = true;
 }
 
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+/**
+ * Remembers sessions which were negotiated by clients so that the next
+ * connection to the same host can resume them.
+ */
+static int NewTlsSessionHandler(SSL *ssl, SSL_SESSION *session)
+{
+	if (SSL_is_server(ssl))
+		return 0;
+
+	const char *hostname = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+	if (!hostname)
+		return 0;
+
+	boost::mutex::scoped_lock lock(l_TlsSessionMutex);
+
+	SSL_SESSION *& entry = l_TlsSessions[std::make_pair(SSL_get_SSL_CTX(ssl), String(hostname))];
+
+	if (entry)
+		SSL_SESSION_free(entry);
+
+	/* we keep the reference which was passed to us */
+	entry = session;
+
+	return 1;
+}
+#endif /* OPENSSL_VERSION_NUMBER */
+
+/**
+ * Frees an SSL context along with the client sessions which were negotiated
+ * with it.
+ */
+static void FreeSSLContext(SSL_CTX *context)
+{
+	{
+		boost::mutex::scoped_lock lock(l_TlsSessionMutex);
+
+		for (auto it = l_TlsSessions.begin(); it != l_TlsSessions.end();) {
+			if (it->first.first == context) {
+				SSL_SESSION_free(it->second);
+				it = l_TlsSessions.erase(it);
+			} else
+				it++;
+		}
+	}
+
+	SSL_CTX_free(context);
+}
+
 /**
  * Initializes an SSL context using the specified certificates.
  *
@@ -87,7 +151,7 @@ boost::shared_ptr<SSL_CTX> MakeSSLContext(const String& pubkey, const String& pr
 
 	InitializeOpenSSL();
 
-	boost::shared_ptr<SSL_CTX> sslContext = boost::shared_ptr<SSL_CTX>(SSL_CTX_new(SSLv23_method()), SSL_CTX_free);
+	boost::shared_ptr<SSL_CTX> sslContext = boost::shared_ptr<SSL_CTX>(SSL_CTX_new(SSLv23_method()), &FreeSSLContext);
 
 	long flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_CIPHER_SERVER_PREFERENCE;
 
@@ -100,6 +164,13 @@ boost::shared_ptr<SSL_CTX> MakeSSLContext(const String& pubkey, const String& pr
 	SSL_CTX_set_mode(sslContext.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 	SSL_CTX_set_session_id_context(sslContext.get(), (const unsigned char *)"Icinga 2", 8);
 
+	SSL_CTX_set_timeout(sslContext.get(), TLS_SESSION_TIMEOUT);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	SSL_CTX_set_session_cache_mode(sslContext.get(), SSL_SESS_CACHE_BOTH);
+	SSL_CTX_sess_set_new_cb(sslContext.get(), &NewTlsSessionHandler);
+#endif /* OPENSSL_VERSION_NUMBER */
+
 	if (!pubkey.IsEmpty()) {
 		if (!SSL_CTX_use_certificate_chain_file(sslContext.get(), pubkey.CStr())) {
 			Log(LogCritical, "SSL")
@@ -209,6 +280,103 @@ void SetTlsProtocolminToSSLContext(const boost::shared_ptr<SSL_CTX>& context, co
 	SSL_CTX_set_options(context.get(), flags);
 }
 
+/**
+ * Loads the session ticket keys for the specified SSL context. The keys are
+ * kept in a file so that sessions can still be resumed after a restart. New
+ * keys are generated if the file doesn't exist or if the keys are too old.
+ *
+ * @param context The SSL context.
+ * @param keyPath The path to the key file.
+ */
+void SetTicketKeysToSSLContext(const boost::shared_ptr<SSL_CTX>& context, const String& keyPath)
+{
+	unsigned char keys[TLS_TICKET_KEY_SIZE];
+	bool valid = false;
+
+	struct stat statbuf;
+
+	if (stat(keyPath.CStr(), &statbuf) == 0 && statbuf.st_mtime > Utility::GetTime() - TLS_TICKET_KEY_LIFETIME) {
+		std::ifstream fp(keyPath.CStr());
+		std::string hex;
+		fp >> hex;
+
+		if (hex.size() == sizeof(keys) * 2) {
+			valid = true;
+
+			for (size_t i = 0; i < sizeof(keys); i++) {
+				unsigned int value;
+
+				if (sscanf(hex.c_str() + i * 2, "%2x", &value) != 1) {
+					valid = false;
+					break;
+				}
+
+				keys[i] = value;
+			}
+		}
+	}
+
+	if (!valid) {
+		if (!RAND_bytes(keys, sizeof(keys))) {
+			BOOST_THROW_EXCEPTION(openssl_error()
+			    << boost::errinfo_api_function("RAND_bytes")
+			    << errinfo_openssl_error(ERR_peek_error()));
+		}
+
+		std::fstream fp;
+		String tempFilename = Utility::CreateTempFile(keyPath + ".XXXXXX", 0600, fp);
+
+		fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+		char hex[3];
+
+		for (size_t i = 0; i < sizeof(keys); i++) {
+			sprintf(hex, "%02x", keys[i]);
+			fp << hex;
+		}
+
+		fp << "\n";
+		fp.close();
+
+#ifdef _WIN32
+		_unlink(keyPath.CStr());
+#endif /* _WIN32 */
+
+		if (rename(tempFilename.CStr(), keyPath.CStr()) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("rename")
+			    << boost::errinfo_errno(errno)
+			    << boost::errinfo_file_name(tempFilename));
+		}
+	}
+
+	/* OpenSSL 1.1 uses 80 bytes of key material, older versions 48 bytes */
+	if (SSL_CTX_set_tlsext_ticket_keys(context.get(), keys, sizeof(keys)) != 1 &&
+	    SSL_CTX_set_tlsext_ticket_keys(context.get(), keys, 48) != 1) {
+		BOOST_THROW_EXCEPTION(openssl_error()
+		    << boost::errinfo_api_function("SSL_CTX_set_tlsext_ticket_keys")
+		    << errinfo_openssl_error(ERR_peek_error()));
+	}
+}
+
+/**
+ * Offers the session which was last negotiated with the specified host to
+ * the server. The server falls back to a full handshake if it doesn't
+ * accept the session.
+ *
+ * @param ssl The client's SSL object.
+ * @param hostname The host name.
+ */
+void ResumeTlsSession(SSL *ssl, const String& hostname)
+{
+	boost::mutex::scoped_lock lock(l_TlsSessionMutex);
+
+	auto it = l_TlsSessions.find(std::make_pair(SSL_get_SSL_CTX(ssl), hostname));
+
+	if (it != l_TlsSessions.end())
+		SSL_set_session(ssl, it->second);
+}
+
 /**
  * Loads a CRL and appends its certificates to the specified SSL context.
  *
@@ -103,7 +103,7 @@ public:
 		: m_Value(other.m_Value)
 	{ }
 
-	Value(Value&& other)
+	Value(Value&& other) BOOST_NOEXCEPT
 	{
 #if BOOST_VERSION >= 105400
 		m_Value = std::move(other.m_Value);
@@ -140,7 +140,7 @@ public:
 		return *this;
 	}
 
-	Value& operator=(Value&& other)
+	Value& operator=(Value&& other) BOOST_NOEXCEPT
 	{
 #if BOOST_VERSION >= 105400
 		m_Value = std::move(other.m_Value);
@@ -23,6 +23,7 @@
 #include "icinga/cib.hpp"
 #include "icinga/perfdatavalue.hpp"
 #include "remote/apilistener.hpp"
+#include "base/application.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
@@ -30,6 +31,7 @@
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/statsfunction.hpp"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace icinga;
 
@@ -37,6 +39,13 @@ REGISTER_TYPE(CheckerComponent);
 
 REGISTER_STATSFUNCTION(CheckerComponent, &CheckerComponent::StatsFunc);
 
+#define CHECKER_MAX_SCHEDULER_THREADS 8
+#define CHECKER_BATCH_SIZE 64
+
+/* Upper bounds (in seconds) of the "late by" histogram buckets, the last bucket is unbounded. */
+static const double l_LateByBuckets[CHECKER_LATEBY_BUCKETS - 1] = { 0.1, 0.5, 1, 5, 10, 30, 60 };
+static const char * const l_LateByNames[CHECKER_LATEBY_BUCKETS] = { "le_0.1", "le_0.5", "le_1", "le_5", "le_10", "le_30", "le_60", "gt_60" };
+
 void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = new Dictionary();
@@ -44,16 +53,27 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 	for (const CheckerComponent::Ptr& checker : ConfigType::GetObjectsByType<CheckerComponent>()) {
 		unsigned long idle = checker->GetIdleCheckables();
 		unsigned long pending = checker->GetPendingCheckables();
+		Array::Ptr shards = checker->GetShardStats();
+
+		unsigned long backlog = 0;
+
+		ObjectLock olock(shards);
+		for (const Dictionary::Ptr& shard : shards) {
+			backlog += Convert::ToLong(shard->Get("backlog"));
+		}
 
 		Dictionary::Ptr stats = new Dictionary();
 		stats->Set("idle", idle);
 		stats->Set("pending", pending);
+		stats->Set("backlog", backlog);
+		stats->Set("shards", shards);
 
 		nodes->Set(checker->GetName(), stats);
 
 		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "backlog", Convert::ToDouble(backlog)));
 	}
 
 	status->Set("checkercomponent", nodes);
@@ -65,6 +85,17 @@ CheckerComponent::CheckerComponent(void)
 
 void CheckerComponent::OnConfigLoaded(void)
 {
+	int threads = GetSchedulerThreads();
+
+	if (threads <= 0)
+		threads = std::min(Application::GetConcurrency(), CHECKER_MAX_SCHEDULER_THREADS);
+
+	if (threads < 1)
+		threads = 1;
+
+	for (int i = 0; i < threads; i++)
+		m_Shards.push_back(boost::make_shared<Shard>());
+
 	ConfigObject::OnActiveChanged.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 	ConfigObject::OnPausedChanged.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 
@@ -76,10 +107,10 @@ void CheckerComponent::Start(bool runtimeCreated)
 	ObjectImpl<CheckerComponent>::Start(runtimeCreated);
 
 	Log(LogInformation, "CheckerComponent")
-	    << "'" << GetName() << "' started.";
-
+	    << "'" << GetName() << "' started with " << m_Shards.size() << " scheduler thread(s).";
 
-	m_Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this));
+	for (size_t i = 0; i < m_Shards.size(); i++)
+		m_Shards[i]->Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this, m_Shards[i], i));
 
 	m_ResultTimer = new Timer();
 	m_ResultTimer->SetInterval(5);
@@ -92,115 +123,186 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	Log(LogInformation, "CheckerComponent")
 	    << "'" << GetName() << "' stopped.";
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	m_Stopped = true;
+
+	for (const boost::shared_ptr<Shard>& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		shard->CV.notify_all();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	for (const boost::shared_ptr<Shard>& shard : m_Shards)
+		shard->Thread.join();
 
 	ObjectImpl<CheckerComponent>::Stop(runtimeRemoved);
 }
 
-void CheckerComponent::CheckThreadProc(void)
+/**
+ * Maps a checkable to one of the scheduler threads. The object's address is
+ * run through a Fibonacci multiply because heap addresses are aligned and
+ * their low bits are always the same, the upper half of the product is
+ * then scaled to the number of threads.
+ */
+size_t CheckerComponent::GetShardIndex(const Checkable::Ptr& checkable, size_t shards)
+{
+	uint64_t hash = (reinterpret_cast<uintptr_t>(checkable.get()) * 11400714819323198485ULL) >> 32;
+
+	return (hash * shards) >> 32;
+}
+
+/**
+ * Returns how many of the free check slots the scheduler thread with the
+ * specified index may use. The slots are split evenly, the remainder goes
+ * to the threads starting at the index 0.
+ */
+long CheckerComponent::GetShardSlots(long slots, size_t shards, size_t index)
 {
-	Utility::SetThreadName("Check Scheduler");
+	if (slots <= 0)
+		return 0;
 
-	boost::mutex::scoped_lock lock(m_Mutex);
+	return slots / shards + (index % shards < static_cast<size_t>(slots) % shards ? 1 : 0);
+}
+
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable) const
+{
+	return *m_Shards[GetShardIndex(checkable, m_Shards.size())];
+}
+
+/**
+ * Checks whether the active check for the checkable should be executed now.
+ *
+ * @threadsafety Always.
+ */
+bool CheckerComponent::CanRunCheck(const Checkable::Ptr& checkable) const
+{
+	bool check = true;
+
+	if (!checkable->IsReachable(DependencyCheckExecution)) {
+		Log(LogNotice, "CheckerComponent")
+		    << "Skipping check for object '" << checkable->GetName() << "': Dependency failed.";
+		check = false;
+	}
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	if (host && !service && (!checkable->GetEnableActiveChecks() || !IcingaApplication::GetInstance()->GetEnableHostChecks())) {
+		Log(LogNotice, "CheckerComponent")
+		    << "Skipping check for host '" << host->GetName() << "': active host checks are disabled";
+		check = false;
+	}
+	if (host && service && (!checkable->GetEnableActiveChecks() || !IcingaApplication::GetInstance()->GetEnableServiceChecks())) {
+		Log(LogNotice, "CheckerComponent")
+		    << "Skipping check for service '" << service->GetName() << "': active service checks are disabled";
+		check = false;
+	}
+
+	TimePeriod::Ptr tp = checkable->GetCheckPeriod();
+
+	if (tp && !tp->IsInside(Utility::GetTime())) {
+		Log(LogNotice, "CheckerComponent")
+		    << "Skipping check for object '" << checkable->GetName()
+		    << "': not in check period '" << tp->GetName() << "'";
+		check = false;
+	}
+
+	return check;
+}
+
+void CheckerComponent::CheckThreadProc(const boost::shared_ptr<Shard>& shard, size_t index)
+{
+	Utility::SetThreadName("Check Scheduler #" + Convert::ToString(index));
+
+	boost::mutex::scoped_lock lock(shard->Mutex);
 
 	for (;;) {
 		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		CheckTimeView& idx = boost::get<1>(shard->IdleCheckables);
 
 		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			shard->CV.wait(lock);
 
 		if (m_Stopped)
 			break;
 
-		auto it = idx.begin();
-		CheckableScheduleInfo csi = *it;
+		double now = Utility::GetTime();
+		double wait = idx.begin()->NextCheck - now;
 
-		double wait = csi.NextCheck - Utility::GetTime();
+		/* Share the free check slots between the scheduler threads without
+		 * exceeding concurrent_checks. The threads which get the remainder
+		 * change every second so that none of them starves. */
+		long slots = GetShardSlots(GetConcurrentChecks() - Checkable::GetPendingChecks(),
+		    m_Shards.size(), index + static_cast<size_t>(now));
 
-		if (Checkable::GetPendingChecks() >= GetConcurrentChecks())
+		if (slots <= 0)
 			wait = 0.5;
 
 		if (wait > 0) {
 			/* Wait for the next check. */
-			m_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+			shard->CV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000)));
 
 			continue;
 		}
 
-		Checkable::Ptr checkable = csi.Object;
-
-		m_IdleCheckables.erase(checkable);
+		/* Take all checkables which are due, the pending set keeps
+		 * them from being scheduled again until we're done with them. */
+		std::vector<Checkable::Ptr> batch;
 
-		bool forced = checkable->GetForceNextCheck();
-		bool check = true;
+		for (auto it = idx.begin(); it != idx.end() && it->NextCheck <= now &&
+		    batch.size() < static_cast<size_t>(std::min<long>(slots, CHECKER_BATCH_SIZE));) {
+			double late = now - it->NextCheck;
+			size_t bucket = 0;
 
-		if (!forced) {
-			if (!checkable->IsReachable(DependencyCheckExecution)) {
-				Log(LogNotice, "CheckerComponent")
-				    << "Skipping check for object '" << checkable->GetName() << "': Dependency failed.";
-				check = false;
-			}
+			while (bucket < CHECKER_LATEBY_BUCKETS - 1 && late > l_LateByBuckets[bucket])
+				bucket++;
 
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
+			shard->LateBy[bucket]++;
 
-			if (host && !service && (!checkable->GetEnableActiveChecks() || !IcingaApplication::GetInstance()->GetEnableHostChecks())) {
-				Log(LogNotice, "CheckerComponent")
-				    << "Skipping check for host '" << host->GetName() << "': active host checks are disabled";
-				check = false;
-			}
-			if (host && service && (!checkable->GetEnableActiveChecks() || !IcingaApplication::GetInstance()->GetEnableServiceChecks())) {
-				Log(LogNotice, "CheckerComponent")
-				    << "Skipping check for service '" << service->GetName() << "': active service checks are disabled";
-				check = false;
-			}
+			batch.push_back(it->Object);
+			shard->PendingCheckables.insert(*it);
+			it = idx.erase(it);
+		}
 
-			TimePeriod::Ptr tp = checkable->GetCheckPeriod();
+		lock.unlock();
 
-			if (tp && !tp->IsInside(Utility::GetTime())) {
-				Log(LogNotice, "CheckerComponent")
-				    << "Skipping check for object '" << checkable->GetName()
-				    << "': not in check period '" << tp->GetName() << "'";
-				check = false;
-			}
-		}
+		/* Dependencies, enable flags and check periods are evaluated
+		 * without holding the lock so that other checkables can be
+		 * rescheduled in the meantime. */
+		for (const Checkable::Ptr& checkable : batch) {
+			bool forced = checkable->GetForceNextCheck();
 
-		/* reschedule the checkable if checks are disabled */
-		if (!check) {
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
-			lock.unlock();
+			/* reschedule the checkable if checks are disabled */
+			if (!forced && !CanRunCheck(checkable)) {
+				checkable->UpdateNextCheck();
 
-			checkable->UpdateNextCheck();
+				boost::mutex::scoped_lock plock(shard->Mutex);
 
-			lock.lock();
+				auto it = shard->PendingCheckables.find(checkable);
 
-			continue;
-		}
+				if (it != shard->PendingCheckables.end()) {
+					shard->PendingCheckables.erase(it);
 
-		m_PendingCheckables.insert(GetCheckableScheduleInfo(checkable));
+					if (checkable->IsActive())
+						shard->IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+				}
 
-		lock.unlock();
+				continue;
+			}
 
-		if (forced) {
-			ObjectLock olock(checkable);
-			checkable->SetForceNextCheck(false);
-		}
+			if (forced) {
+				ObjectLock olock(checkable);
+				checkable->SetForceNextCheck(false);
+			}
 
-		Log(LogDebug, "CheckerComponent")
-		    << "Executing check for '" << checkable->GetName() << "'";
+			Log(LogDebug, "CheckerComponent")
+			    << "Executing check for '" << checkable->GetName() << "'";
 
-		Checkable::IncreasePendingChecks();
+			Checkable::IncreasePendingChecks();
 
-		Utility::QueueAsyncCallback(boost::bind(&CheckerComponent::ExecuteCheckHelper, CheckerComponent::Ptr(this), checkable));
+			Utility::QueueAsyncCallback(boost::bind(&CheckerComponent::ExecuteCheckHelper, CheckerComponent::Ptr(this), checkable), WorkStealingScheduler);
+		}
 
 		lock.lock();
 	}
@@ -231,20 +333,22 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	Checkable::DecreasePendingChecks();
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		auto it = m_PendingCheckables.find(checkable);
+		auto it = shard.PendingCheckables.find(checkable);
 
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
 			if (checkable->IsActive())
-				m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+				shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -256,12 +360,8 @@ void CheckerComponent::ResultTimerHandler(void)
 {
 	std::ostringstream msgbuf;
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-		    << (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
-	}
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+	    << (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
 
 	Log(LogNotice, "CheckerComponent", msgbuf.str());
 }
@@ -277,19 +377,21 @@ void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.erase(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
@@ -303,11 +405,13 @@ CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	Shard& shard = GetShard(checkable);
+
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	/* remove and re-insert the object from the set in order to force an index update */
 	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	CheckableView& idx = boost::get<0>(shard.IdleCheckables);
 
 	auto it = idx.find(checkable);
 
@@ -319,19 +423,63 @@ void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 	CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
 	idx.insert(csi);
 
-	m_CV.notify_all();
+	shard.CV.notify_all();
 }
 
 unsigned long CheckerComponent::GetIdleCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
 
-	return m_IdleCheckables.size();
+	for (const boost::shared_ptr<Shard>& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->IdleCheckables.size();
+	}
+
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (const boost::shared_ptr<Shard>& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->PendingCheckables.size();
+	}
+
+	return count;
+}
+
+/**
+ * Returns the size, the number of overdue checkables and the histogram of
+ * how late checks were dispatched for each scheduler thread.
+ */
+Array::Ptr CheckerComponent::GetShardStats(void)
+{
+	Array::Ptr result = new Array();
+
+	double now = Utility::GetTime();
+
+	for (const boost::shared_ptr<Shard>& shard : m_Shards) {
+		Dictionary::Ptr stats = new Dictionary();
+		Dictionary::Ptr lateBy = new Dictionary();
+
+		boost::mutex::scoped_lock lock(shard->Mutex);
+
+		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+		CheckTimeView& idx = boost::get<1>(shard->IdleCheckables);
+
+		stats->Set("idle", shard->IdleCheckables.size());
+		stats->Set("pending", shard->PendingCheckables.size());
+		stats->Set("backlog", std::distance(idx.begin(), idx.upper_bound(now)));
+
+		for (size_t i = 0; i < CHECKER_LATEBY_BUCKETS; i++)
+			lateBy->Set(l_LateByNames[i], shard->LateBy[i]);
+
+		stats->Set("late_by", lateBy);
+
+		result->Add(stats);
+	}
 
-	return m_PendingCheckables.size();
+	return result;
 }
@@ -31,10 +31,15 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <atomic>
 
 namespace icinga
 {
 
+/* Number of buckets in the "late by" histogram of each shard. */
+#define CHECKER_LATEBY_BUCKETS 8
+
 /**
  * @ingroup checker
  */
@@ -54,7 +59,7 @@ struct CheckableNextCheckExtractor
 	/**
 	 * @threadsafety Always.
 	 */
-	double operator()(const CheckableScheduleInfo& csi)
+	double operator()(const CheckableScheduleInfo& csi) const
 	{
 		return csi.NextCheck;
 	}
@@ -86,19 +91,41 @@ public:
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	unsigned long GetIdleCheckables(void);
 	unsigned long GetPendingCheckables(void);
+	Array::Ptr GetShardStats(void);
+
+	static size_t GetShardIndex(const Checkable::Ptr& checkable, size_t shards);
+	static long GetShardSlots(long slots, size_t shards, size_t index);
 
 private:
-	boost::mutex m_Mutex;
-	boost::condition_variable m_CV;
-	bool m_Stopped;
-	boost::thread m_Thread;
+	/**
+	 * A partition of the checkables which is scheduled by its own thread.
+	 */
+	struct Shard
+	{
+		boost::mutex Mutex;
+		boost::condition_variable CV;
+		boost::thread Thread;
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
+
+		/* How late checks were dispatched, see l_LateByBuckets. */
+		unsigned long LateBy[CHECKER_LATEBY_BUCKETS];
+
+		Shard(void)
+			: LateBy()
+		{ }
+	};
+
+	std::atomic<bool> m_Stopped;
+	std::vector<boost::shared_ptr<Shard> > m_Shards;
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc(void);
+	Shard& GetShard(const Checkable::Ptr& checkable) const;
+
+	void CheckThreadProc(const boost::shared_ptr<Shard>& shard, size_t index);
+	bool CanRunCheck(const Checkable::Ptr& checkable) const;
 	void ResultTimerHandler(void);
 
 	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
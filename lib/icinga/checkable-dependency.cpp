@@ -20,19 +20,41 @@
 #include "icinga/service.hpp"
 #include "icinga/dependency.hpp"
 #include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <atomic>
 
 using namespace icinga;
 
+/**
+ * Maximum number of seconds for which a reachability result is cached even
+ * if none of its inputs change.
+ */
+#define REACHABILITY_CACHE_TTL 300
+
+static std::atomic<unsigned long long> l_ReachabilityCacheHits(0);
+static std::atomic<unsigned long long> l_ReachabilityCacheMisses(0);
+static std::atomic<unsigned long long> l_ReachabilityInvalidations(0);
+static std::atomic<unsigned long long> l_ReachabilityInvalidatedCheckables(0);
+static std::atomic<unsigned long long> l_ReachabilityMaxFanout(0);
+
 void Checkable::AddDependency(const Dependency::Ptr& dep)
 {
-	boost::mutex::scoped_lock lock(m_DependencyMutex);
-	m_Dependencies.insert(dep);
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+		m_Dependencies.insert(dep);
+	}
+
+	InvalidateReachability();
 }
 
 void Checkable::RemoveDependency(const Dependency::Ptr& dep)
 {
-	boost::mutex::scoped_lock lock(m_DependencyMutex);
-	m_Dependencies.erase(dep);
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+		m_Dependencies.erase(dep);
+	}
+
+	InvalidateReachability();
 }
 
 std::set<Dependency::Ptr> Checkable::GetDependencies(void) const
@@ -61,44 +83,255 @@ std::set<Dependency::Ptr> Checkable::GetReverseDependencies(void) const
 
 bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency, int rstack) const
 {
+	bool cacheable;
+	double expires;
+
+	return IsReachableInternal(dt, failedDependency, rstack, &cacheable, &expires);
+}
+
+/**
+ * Evaluates the reachability of this checkable or returns the cached result.
+ *
+ * @param cacheable Set to false if the result must not be cached by the
+ *                  caller, e.g. because the nesting limit was hit.
+ * @param expires The time until which the result is valid unless one of
+ *                its inputs changes.
+ */
+bool Checkable::IsReachableInternal(DependencyType dt, Dependency::Ptr *failedDependency,
+    int rstack, bool *cacheable, double *expires) const
+{
+	double now = Utility::GetTime();
+	unsigned long generation;
+
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+
+		const ReachabilityCacheEntry& entry = m_ReachabilityCache[dt];
+
+		if (entry.Valid && entry.Expires > now) {
+			l_ReachabilityCacheHits++;
+
+			if (failedDependency)
+				*failedDependency = entry.FailedDependency;
+
+			*cacheable = true;
+			*expires = entry.Expires;
+			return entry.Reachable;
+		}
+
+		generation = m_ReachabilityGeneration;
+	}
+
+	l_ReachabilityCacheMisses++;
+
+	*cacheable = true;
+	*expires = now + REACHABILITY_CACHE_TTL;
+
 	if (rstack > 20) {
 		Log(LogWarning, "Checkable")
 		    << "Too many nested dependencies for service '" << GetName() << "': Dependency failed.";
 
+		*cacheable = false;
 		return false;
 	}
 
+	bool reachable = true;
+	Dependency::Ptr failed;
+
 	for (const Checkable::Ptr& checkable : GetParents()) {
-		if (!checkable->IsReachable(dt, failedDependency, rstack + 1))
-			return false;
+		bool parentCacheable;
+		double parentExpires;
+
+		reachable = checkable->IsReachableInternal(dt, &failed, rstack + 1, &parentCacheable, &parentExpires);
+
+		if (!parentCacheable)
+			*cacheable = false;
+
+		*expires = std::min(*expires, parentExpires);
+
+		if (!reachable)
+			break;
 	}
 
 	/* implicit dependency on host if this is a service */
 	const Service *service = dynamic_cast<const Service *>(this);
-	if (service && (dt == DependencyState || dt == DependencyNotification)) {
+	if (reachable && service && (dt == DependencyState || dt == DependencyNotification)) {
 		Host::Ptr host = service->GetHost();
 
 		if (host && host->GetState() != HostUp && host->GetStateType() == StateTypeHard) {
-			if (failedDependency)
-				*failedDependency = Dependency::Ptr();
-
-			return false;
+			failed = Dependency::Ptr();
+			reachable = false;
 		}
 	}
 
-	for (const Dependency::Ptr& dep : GetDependencies()) {
-		if (!dep->IsAvailable(dt)) {
-			if (failedDependency)
-				*failedDependency = dep;
+	if (reachable) {
+		for (const Dependency::Ptr& dep : GetDependencies()) {
+			*expires = std::min(*expires, dep->GetNextPeriodTransition(now));
 
-			return false;
+			if (!dep->IsAvailable(dt)) {
+				failed = dep;
+				reachable = false;
+				break;
+			}
 		}
 	}
 
+	if (reachable)
+		failed = Dependency::Ptr();
+
+	if (*cacheable) {
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+
+		/* Don't cache the result if one of the inputs was changed while
+		 * it was evaluated, and don't let the caller cache it either. */
+		if (generation == m_ReachabilityGeneration) {
+			ReachabilityCacheEntry& entry = m_ReachabilityCache[dt];
+			entry.Valid = true;
+			entry.Reachable = reachable;
+			entry.FailedDependency = failed;
+			entry.Expires = *expires;
+		} else
+			*cacheable = false;
+	}
+
 	if (failedDependency)
-		*failedDependency = Dependency::Ptr();
+		*failedDependency = failed;
+
+	return reachable;
+}
+
+/**
+ * Drops the cached reachability of this checkable (unless includeSelf is
+ * false) and of everything which depends on it. The walk stops at
+ * checkables which don't have any cached results: their dependents were
+ * either invalidated along with them or have been evaluated after them,
+ * which would have cached a result for them as well.
+ *
+ * @param includeSelf Whether the checkable's own results are affected.
+ */
+void Checkable::InvalidateReachability(bool includeSelf)
+{
+	std::vector<Checkable::Ptr> queue;
+
+	if (includeSelf)
+		queue.push_back(this);
+	else
+		queue = GetReachabilityDependents();
+
+	std::set<Checkable::Ptr> roots(queue.begin(), queue.end());
+	std::set<Checkable::Ptr> visited;
+	unsigned long long fanout = 0;
+
+	while (!queue.empty()) {
+		Checkable::Ptr checkable = queue.back();
+		queue.pop_back();
+
+		if (!visited.insert(checkable).second)
+			continue;
 
-	return true;
+		bool cached = false;
+
+		{
+			boost::mutex::scoped_lock lock(checkable->m_DependencyMutex);
+
+			checkable->m_ReachabilityGeneration++;
+
+			for (ReachabilityCacheEntry& entry : checkable->m_ReachabilityCache) {
+				if (entry.Valid)
+					cached = true;
+
+				entry = ReachabilityCacheEntry();
+			}
+		}
+
+		if (cached)
+			fanout++;
+		else if (roots.find(checkable) == roots.end())
+			continue;
+
+		std::vector<Checkable::Ptr> dependents = checkable->GetReachabilityDependents();
+		queue.insert(queue.end(), dependents.begin(), dependents.end());
+	}
+
+	l_ReachabilityInvalidations++;
+	l_ReachabilityInvalidatedCheckables += fanout;
+
+	unsigned long long maxFanout = l_ReachabilityMaxFanout;
+
+	while (fanout > maxFanout && !l_ReachabilityMaxFanout.compare_exchange_weak(maxFanout, fanout))
+		; /* empty loop body */
+}
+
+std::vector<Checkable::Ptr> Checkable::GetReachabilityDependents(void) const
+{
+	std::set<Checkable::Ptr> children = GetChildren();
+	std::vector<Checkable::Ptr> dependents(children.begin(), children.end());
+
+	/* services have an implicit dependency on their host */
+	const Host *host = dynamic_cast<const Host *>(this);
+
+	if (host) {
+		for (const Service::Ptr& service : host->GetServices())
+			dependents.push_back(service);
+	}
+
+	return dependents;
+}
+
+/**
+ * Invalidates the reachability of all dependents if the state which is
+ * evaluated by their dependencies has changed.
+ */
+void Checkable::UpdateReachabilityInputs(void)
+{
+	ServiceState state = GetStateRaw();
+	StateType stateType = GetStateType();
+	bool checked = static_cast<bool>(GetLastCheckResult());
+
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+
+		if (state == m_ReachabilityStateRaw && stateType == m_ReachabilityStateType && checked == m_ReachabilityChecked)
+			return;
+
+		m_ReachabilityStateRaw = state;
+		m_ReachabilityStateType = stateType;
+		m_ReachabilityChecked = checked;
+	}
+
+	InvalidateReachability(false);
+}
+
+void Checkable::NotifyStateRaw(const Value& cookie)
+{
+	UpdateReachabilityInputs();
+
+	ObjectImpl<Checkable>::NotifyStateRaw(cookie);
+}
+
+void Checkable::NotifyStateType(const Value& cookie)
+{
+	UpdateReachabilityInputs();
+
+	ObjectImpl<Checkable>::NotifyStateType(cookie);
+}
+
+void Checkable::NotifyLastCheckResult(const Value& cookie)
+{
+	UpdateReachabilityInputs();
+
+	ObjectImpl<Checkable>::NotifyLastCheckResult(cookie);
+}
+
+ReachabilityCacheStatistics Checkable::GetReachabilityCacheStatistics(void)
+{
+	ReachabilityCacheStatistics stats;
+	stats.hits = l_ReachabilityCacheHits;
+	stats.misses = l_ReachabilityCacheMisses;
+	stats.invalidations = l_ReachabilityInvalidations;
+	stats.invalidated_checkables = l_ReachabilityInvalidatedCheckables;
+	stats.max_fanout = l_ReachabilityMaxFanout;
+	return stats;
 }
 
 std::set<Checkable::Ptr> Checkable::GetParents(void) const
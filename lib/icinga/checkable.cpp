@@ -44,7 +44,8 @@ void Checkable::StaticInitialize(void)
 }
 
 Checkable::Checkable(void)
-	: m_CheckRunning(false)
+	: m_CheckRunning(false), m_ReachabilityGeneration(0), m_ReachabilityStateRaw(ServiceOK),
+	  m_ReachabilityStateType(StateTypeSoft), m_ReachabilityChecked(false)
 {
 	SetSchedulingOffset(Utility::Random());
 }
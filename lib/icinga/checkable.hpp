@@ -53,6 +53,20 @@ enum CheckableType
 	CheckableService
 };
 
+/**
+ * Counters for the reachability cache.
+ *
+ * @ingroup icinga
+ */
+struct ReachabilityCacheStatistics
+{
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long invalidations;
+	unsigned long long invalidated_checkables;
+	unsigned long long max_fanout;
+};
+
 class CheckCommand;
 class EventCommand;
 class Dependency;
@@ -79,6 +93,9 @@ public:
 	void AddGroup(const String& name);
 
 	bool IsReachable(DependencyType dt = DependencyState, intrusive_ptr<Dependency> *failedDependency = NULL, int rstack = 0) const;
+	void InvalidateReachability(bool includeSelf = true);
+
+	static ReachabilityCacheStatistics GetReachabilityCacheStatistics(void);
 
 	AcknowledgementType GetAcknowledgement(void);
 
@@ -185,6 +202,10 @@ public:
 
 	static Object::Ptr GetPrototype(void);
 
+	virtual void NotifyStateRaw(const Value& cookie = Empty) override;
+	virtual void NotifyStateType(const Value& cookie = Empty) override;
+	virtual void NotifyLastCheckResult(const Value& cookie = Empty) override;
+
 protected:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void OnAllConfigLoaded(void) override;
@@ -221,6 +242,31 @@ private:
 	std::set<intrusive_ptr<Dependency> > m_ReverseDependencies;
 
 	void GetAllChildrenInternal(std::set<Checkable::Ptr>& children, int level = 0) const;
+
+	/* Reachability */
+	struct ReachabilityCacheEntry
+	{
+		bool Valid;
+		bool Reachable;
+		intrusive_ptr<Dependency> FailedDependency;
+		double Expires;
+
+		ReachabilityCacheEntry(void)
+			: Valid(false), Reachable(false), Expires(0)
+		{ }
+	};
+
+	/* protected by m_DependencyMutex */
+	mutable ReachabilityCacheEntry m_ReachabilityCache[DependencyNotification + 1];
+	unsigned long m_ReachabilityGeneration;
+	ServiceState m_ReachabilityStateRaw;
+	StateType m_ReachabilityStateType;
+	bool m_ReachabilityChecked;
+
+	bool IsReachableInternal(DependencyType dt, intrusive_ptr<Dependency> *failedDependency,
+	    int rstack, bool *cacheable, double *expires) const;
+	std::vector<Checkable::Ptr> GetReachabilityDependents(void) const;
+	void UpdateReachabilityInputs(void);
 };
 
 }
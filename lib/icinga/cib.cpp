@@ -334,4 +334,12 @@ void CIB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata) {
 	status->Set("num_hosts_flapping", hs.hosts_flapping);
 	status->Set("num_hosts_in_downtime", hs.hosts_in_downtime);
 	status->Set("num_hosts_acknowledged", hs.hosts_acknowledged);
+
+	ReachabilityCacheStatistics rcs = Checkable::GetReachabilityCacheStatistics();
+
+	status->Set("reachability_cache_hits", rcs.hits);
+	status->Set("reachability_cache_misses", rcs.misses);
+	status->Set("reachability_cache_invalidations", rcs.invalidations);
+	status->Set("reachability_cache_invalidated_checkables", rcs.invalidated_checkables);
+	status->Set("reachability_cache_max_fanout", rcs.max_fanout);
 }
@@ -68,6 +68,14 @@ void ClusterEvents::StaticInitialize(void)
 	Checkable::OnAcknowledgementSet.connect(&ClusterEvents::AcknowledgementSetHandler);
 	Checkable::OnAcknowledgementCleared.connect(&ClusterEvents::AcknowledgementClearedHandler);
 
+	/* only the latest update for an object matters when messages are coalesced,
+	 * check results make the receiver calculate the next check on its own */
+	ApiListener::RegisterSupersededMethod("event::SetNextCheck", "event::SetNextCheck");
+	ApiListener::RegisterSupersededMethod("event::CheckResult", "event::SetNextCheck");
+	ApiListener::RegisterSupersededMethod("event::SetForceNextCheck", "event::SetForceNextCheck");
+	ApiListener::RegisterSupersededMethod("event::SetNextNotification", "event::SetNextNotification");
+	ApiListener::RegisterSupersededMethod("event::SetForceNextNotification", "event::SetForceNextNotification");
+
 	l_RepositoryTimer = new Timer();
 	l_RepositoryTimer->SetInterval(30);
 	l_RepositoryTimer->OnTimerExpired.connect(boost::bind(&ClusterEvents::RepositoryTimerHandler));
@@ -27,6 +27,10 @@ using namespace icinga;
 
 REGISTER_TYPE(Command);
 
+Command::Command(void)
+	: m_MacroTemplates(new MacroTemplateCache())
+{ }
+
 void Command::Validate(int types, const ValidationUtils& utils)
 {
 	ObjectImpl<Command>::Validate(types, utils);
@@ -83,3 +87,35 @@ void Command::Validate(int types, const ValidationUtils& utils)
 		}
 	}
 }
+
+/**
+ * Returns the compiled macro templates for the command line, the arguments
+ * and the environment variables of this command.
+ *
+ * @returns The template cache.
+ */
+MacroTemplateCache::Ptr Command::GetMacroTemplates(void) const
+{
+	return m_MacroTemplates;
+}
+
+void Command::NotifyCommandLine(const Value& cookie)
+{
+	m_MacroTemplates->Clear();
+
+	ObjectImpl<Command>::NotifyCommandLine(cookie);
+}
+
+void Command::NotifyArguments(const Value& cookie)
+{
+	m_MacroTemplates->Clear();
+
+	ObjectImpl<Command>::NotifyArguments(cookie);
+}
+
+void Command::NotifyEnv(const Value& cookie)
+{
+	m_MacroTemplates->Clear();
+
+	ObjectImpl<Command>::NotifyEnv(cookie);
+}
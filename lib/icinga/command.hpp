@@ -22,6 +22,7 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/command.thpp"
+#include "icinga/macrotemplate.hpp"
 #include "remote/messageorigin.hpp"
 
 namespace icinga
@@ -37,9 +38,20 @@ class I2_ICINGA_API Command : public ObjectImpl<Command>
 public:
 	DECLARE_OBJECT(Command);
 
+	Command(void);
+
 	//virtual Dictionary::Ptr Execute(const Object::Ptr& context) = 0;
 
 	virtual void Validate(int types, const ValidationUtils& utils) override;
+
+	MacroTemplateCache::Ptr GetMacroTemplates(void) const;
+
+	virtual void NotifyCommandLine(const Value& cookie = Empty) override;
+	virtual void NotifyArguments(const Value& cookie = Empty) override;
+	virtual void NotifyEnv(const Value& cookie = Empty) override;
+
+private:
+	MacroTemplateCache::Ptr m_MacroTemplates;
 };
 
 }
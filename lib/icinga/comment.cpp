@@ -23,7 +23,7 @@
 #include "remote/configobjectutility.hpp"
 #include "base/utility.hpp"
 #include "base/configtype.hpp"
-#include "base/timer.hpp"
+#include "base/deadlinequeue.hpp"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 
@@ -32,7 +32,7 @@ using namespace icinga;
 static int l_NextCommentID = 1;
 static boost::mutex l_CommentMutex;
 static std::map<int, String> l_LegacyCommentsCache;
-static Timer::Ptr l_CommentsExpireTimer;
+static DeadlineQueue::Ptr l_CommentsExpireQueue;
 
 boost::signals2::signal<void (const Comment::Ptr&)> Comment::OnCommentAdded;
 boost::signals2::signal<void (const Comment::Ptr&)> Comment::OnCommentRemoved;
@@ -43,10 +43,8 @@ REGISTER_TYPE(Comment);
 
 void Comment::StaticInitialize(void)
 {
-	l_CommentsExpireTimer = new Timer();
-	l_CommentsExpireTimer->SetInterval(60);
-	l_CommentsExpireTimer->OnTimerExpired.connect(boost::bind(&Comment::CommentsExpireTimerHandler));
-	l_CommentsExpireTimer->Start();
+	l_CommentsExpireQueue = new DeadlineQueue(boost::bind(&Comment::CommentExpireHandler, _1));
+	l_CommentsExpireQueue->Start();
 }
 
 String CommentNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
@@ -118,10 +116,14 @@ void Comment::Start(bool runtimeCreated)
 
 	if (runtimeCreated)
 		OnCommentAdded(this);
+
+	UpdateExpireDeadline();
 }
 
 void Comment::Stop(bool runtimeRemoved)
 {
+	l_CommentsExpireQueue->Remove(this);
+
 	GetCheckable()->UnregisterComment(this);
 
 	if (runtimeRemoved)
@@ -142,6 +144,24 @@ bool Comment::IsExpired(void) const
 	return (expire_time != 0 && expire_time < Utility::GetTime());
 }
 
+void Comment::UpdateExpireDeadline(void)
+{
+	double expireTime = GetExpireTime();
+
+	if (expireTime == 0)
+		l_CommentsExpireQueue->Remove(this);
+	else
+		l_CommentsExpireQueue->Set(this, expireTime);
+}
+
+void Comment::NotifyExpireTime(const Value& cookie)
+{
+	ObjectImpl<Comment>::NotifyExpireTime(cookie);
+
+	if (IsActive())
+		UpdateExpireDeadline();
+}
+
 int Comment::GetNextCommentID(void)
 {
 	boost::mutex::scoped_lock lock(l_CommentMutex);
@@ -238,17 +258,22 @@ String Comment::GetCommentIDFromLegacyID(int id)
 	return it->second;
 }
 
-void Comment::CommentsExpireTimerHandler(void)
+void Comment::CommentExpireHandler(const Object::Ptr& object)
 {
-	std::vector<Comment::Ptr> comments;
+	Comment::Ptr comment = static_pointer_cast<Comment>(object);
 
-	for (const Comment::Ptr& comment : ConfigType::GetObjectsByType<Comment>()) {
-		comments.push_back(comment);
-	}
+	/* Only remove comment which are activated after daemon start. */
+	if (!comment->IsActive())
+		return;
 
-	for (const Comment::Ptr& comment : comments) {
-		/* Only remove comment which are activated after daemon start. */
-		if (comment->IsActive() && comment->IsExpired())
-			RemoveComment(comment->GetName());
+	if (comment->IsExpired()) {
+		RemoveComment(comment->GetName());
+		return;
 	}
+
+	/* IsExpired() compares against the expiry time itself, look again shortly after it. */
+	double expireTime = comment->GetExpireTime();
+
+	if (expireTime != 0)
+		l_CommentsExpireQueue->Set(comment, std::max(expireTime, Utility::GetTime() + 1));
 }
@@ -58,6 +58,8 @@ public:
 
 	static void StaticInitialize(void);
 
+	virtual void NotifyExpireTime(const Value& cookie = Empty) override;
+
 protected:
 	virtual void OnAllConfigLoaded(void) override;
 	virtual void Start(bool runtimeCreated) override;
@@ -66,7 +68,9 @@ protected:
 private:
 	ObjectImpl<Checkable>::Ptr m_Checkable;
 
-	static void CommentsExpireTimerHandler(void);
+	void UpdateExpireDeadline(void);
+
+	static void CommentExpireHandler(const Object::Ptr& object);
 };
 
 }
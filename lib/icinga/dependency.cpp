@@ -24,6 +24,7 @@
 #include "base/exception.hpp"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <limits>
 
 using namespace icinga;
 
@@ -194,6 +195,44 @@ bool Dependency::IsAvailable(DependencyType dt) const
 	return false;
 }
 
+/**
+ * Returns the time at which the result of IsAvailable() may change because
+ * the dependency's period is entered or left.
+ *
+ * @param ts The current time.
+ * @returns The next transition, or infinity if there is no period.
+ */
+double Dependency::GetNextPeriodTransition(double ts) const
+{
+	TimePeriod::Ptr tp = GetPeriod();
+
+	if (!tp)
+		return std::numeric_limits<double>::infinity();
+
+	double next = std::numeric_limits<double>::infinity();
+	double transition = tp->FindNextTransition(ts);
+
+	if (transition != -1)
+		next = transition;
+
+	/* segments aren't known beyond the end of the current validity range */
+	Value validEnd = tp->GetValidEnd();
+
+	if (!validEnd.IsEmpty() && static_cast<double>(validEnd) > ts)
+		next = std::min(next, static_cast<double>(validEnd));
+
+	return next;
+}
+
+void Dependency::SetField(int id, const Value& value, bool suppress_events, const Value& cookie)
+{
+	ObjectImpl<Dependency>::SetField(id, value, suppress_events, cookie);
+
+	/* any of the attributes may affect the result of IsAvailable() */
+	if (!suppress_events && m_Child)
+		m_Child->InvalidateReachability();
+}
+
 Checkable::Ptr Dependency::GetChild(void) const
 {
 	return m_Child;
@@ -48,6 +48,9 @@ public:
 	TimePeriod::Ptr GetPeriod(void) const;
 
 	bool IsAvailable(DependencyType dt) const;
+	double GetNextPeriodTransition(double ts) const;
+
+	virtual void SetField(int id, const Value& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
 	virtual void ValidateStates(const Array::Ptr& value, const ValidationUtils& utils) override;
 
@@ -24,7 +24,7 @@
 #include "remote/configobjectutility.hpp"
 #include "base/configtype.hpp"
 #include "base/utility.hpp"
-#include "base/timer.hpp"
+#include "base/deadlinequeue.hpp"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 
@@ -33,8 +33,8 @@ using namespace icinga;
 static int l_NextDowntimeID = 1;
 static boost::mutex l_DowntimeMutex;
 static std::map<int, String> l_LegacyDowntimesCache;
-static Timer::Ptr l_DowntimesExpireTimer;
-static Timer::Ptr l_DowntimesStartTimer;
+static DeadlineQueue::Ptr l_DowntimesStartQueue;
+static DeadlineQueue::Ptr l_DowntimesExpireQueue;
 
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeAdded;
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeRemoved;
@@ -47,15 +47,11 @@ REGISTER_TYPE(Downtime);
 
 void Downtime::StaticInitialize(void)
 {
-	l_DowntimesStartTimer = new Timer();
-	l_DowntimesStartTimer->SetInterval(5);
-	l_DowntimesStartTimer->OnTimerExpired.connect(boost::bind(&Downtime::DowntimesStartTimerHandler));
-	l_DowntimesStartTimer->Start();
-
-	l_DowntimesExpireTimer = new Timer();
-	l_DowntimesExpireTimer->SetInterval(60);
-	l_DowntimesExpireTimer->OnTimerExpired.connect(boost::bind(&Downtime::DowntimesExpireTimerHandler));
-	l_DowntimesExpireTimer->Start();
+	l_DowntimesStartQueue = new DeadlineQueue(boost::bind(&Downtime::DowntimeStartHandler, _1));
+	l_DowntimesStartQueue->Start();
+
+	l_DowntimesExpireQueue = new DeadlineQueue(boost::bind(&Downtime::DowntimeExpireHandler, _1));
+	l_DowntimesExpireQueue->Start();
 }
 
 String DowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
@@ -140,10 +136,15 @@ void Downtime::Start(bool runtimeCreated)
 		    << " Triggering downtime now.";
 		TriggerDowntime();
 	}
+
+	UpdateDeadlines();
 }
 
 void Downtime::Stop(bool runtimeRemoved)
 {
+	l_DowntimesStartQueue->Remove(this);
+	l_DowntimesExpireQueue->Remove(this);
+
 	GetCheckable()->UnregisterDowntime(this);
 
 	if (runtimeRemoved)
@@ -209,6 +210,93 @@ bool Downtime::HasValidConfigOwner(void) const
 	return configOwner.IsEmpty() || GetObject<ScheduledDowntime>(configOwner);
 }
 
+/**
+ * Returns when a fixed downtime needs to be started, or -1 if there's
+ * nothing to be done for it.
+ */
+double Downtime::GetStartDeadline(void) const
+{
+	/* Flexible downtimes are triggered on-demand. */
+	if (!GetFixed() || GetTriggerTime() > 0)
+		return -1;
+
+	return GetStartTime();
+}
+
+/**
+ * Returns when IsExpired() becomes true unless the downtime is modified.
+ */
+double Downtime::GetExpireDeadline(void) const
+{
+	double endTime = GetEndTime();
+
+	if (GetFixed())
+		return endTime;
+
+	double triggerTime = GetTriggerTime();
+
+	if (triggerTime > 0)
+		return std::min(endTime, triggerTime + GetDuration());
+
+	return endTime;
+}
+
+void Downtime::UpdateDeadlines(void)
+{
+	double startDeadline = GetStartDeadline();
+
+	if (startDeadline < 0)
+		l_DowntimesStartQueue->Remove(this);
+	else
+		l_DowntimesStartQueue->Set(this, startDeadline);
+
+	/* Downtimes whose scheduled downtime is gone are removed right away. */
+	if (!HasValidConfigOwner())
+		l_DowntimesExpireQueue->Set(this, 0);
+	else
+		l_DowntimesExpireQueue->Set(this, GetExpireDeadline());
+}
+
+void Downtime::NotifyStartTime(const Value& cookie)
+{
+	ObjectImpl<Downtime>::NotifyStartTime(cookie);
+
+	if (IsActive())
+		UpdateDeadlines();
+}
+
+void Downtime::NotifyEndTime(const Value& cookie)
+{
+	ObjectImpl<Downtime>::NotifyEndTime(cookie);
+
+	if (IsActive())
+		UpdateDeadlines();
+}
+
+void Downtime::NotifyTriggerTime(const Value& cookie)
+{
+	ObjectImpl<Downtime>::NotifyTriggerTime(cookie);
+
+	if (IsActive())
+		UpdateDeadlines();
+}
+
+void Downtime::NotifyDuration(const Value& cookie)
+{
+	ObjectImpl<Downtime>::NotifyDuration(cookie);
+
+	if (IsActive())
+		UpdateDeadlines();
+}
+
+void Downtime::NotifyFixed(const Value& cookie)
+{
+	ObjectImpl<Downtime>::NotifyFixed(cookie);
+
+	if (IsActive())
+		UpdateDeadlines();
+}
+
 int Downtime::GetNextDowntimeID(void)
 {
 	boost::mutex::scoped_lock lock(l_DowntimeMutex);
@@ -378,35 +466,50 @@ String Downtime::GetDowntimeIDFromLegacyID(int id)
 	return it->second;
 }
 
-void Downtime::DowntimesStartTimerHandler(void)
+void Downtime::DowntimeStartHandler(const Object::Ptr& object)
 {
+	Downtime::Ptr downtime = static_pointer_cast<Downtime>(object);
+
+	if (!downtime->IsActive())
+		return;
+
 	/* Start fixed downtimes. Flexible downtimes will be triggered on-demand. */
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
-		if (downtime->IsActive() &&
-		    downtime->CanBeTriggered() &&
-		    downtime->GetFixed()) {
-			/* Send notifications. */
-			OnDowntimeStarted(downtime);
-
-			/* Trigger fixed downtime immediately. */
-			downtime->TriggerDowntime();
-		}
+	if (downtime->CanBeTriggered() && downtime->GetFixed()) {
+		/* Send notifications. */
+		OnDowntimeStarted(downtime);
+
+		/* Trigger fixed downtime immediately. */
+		downtime->TriggerDowntime();
 	}
+
+	/* The start time may have been moved while we were waiting. */
+	double startDeadline = downtime->GetStartDeadline();
+
+	if (startDeadline > Utility::GetTime())
+		l_DowntimesStartQueue->Set(downtime, startDeadline);
 }
 
-void Downtime::DowntimesExpireTimerHandler(void)
+void Downtime::DowntimeExpireHandler(const Object::Ptr& object)
 {
-	std::vector<Downtime::Ptr> downtimes;
+	Downtime::Ptr downtime = static_pointer_cast<Downtime>(object);
 
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
-		downtimes.push_back(downtime);
-	}
+	/* Only remove downtimes which are activated after daemon start. */
+	if (!downtime->IsActive())
+		return;
 
-	for (const Downtime::Ptr& downtime : downtimes) {
-		/* Only remove downtimes which are activated after daemon start. */
-		if (downtime->IsActive() && (downtime->IsExpired() || !downtime->HasValidConfigOwner()))
-			RemoveDowntime(downtime->GetName(), false, true);
+	if (downtime->IsExpired() || !downtime->HasValidConfigOwner()) {
+		RemoveDowntime(downtime->GetName(), false, true);
+		return;
 	}
+
+	/* IsExpired() compares against the deadline itself, look again shortly after it. */
+	double now = Utility::GetTime();
+	double expireDeadline = downtime->GetExpireDeadline();
+
+	if (expireDeadline <= now)
+		expireDeadline = now + 1;
+
+	l_DowntimesExpireQueue->Set(downtime, expireDeadline);
 }
 
 void Downtime::ValidateStartTime(const Timestamp& value, const ValidationUtils& utils)
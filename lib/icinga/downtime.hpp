@@ -51,6 +51,9 @@ public:
 	bool IsExpired(void) const;
 	bool HasValidConfigOwner(void) const;
 
+	double GetStartDeadline(void) const;
+	double GetExpireDeadline(void) const;
+
 	static int GetNextDowntimeID(void);
 
 	static String AddDowntime(const intrusive_ptr<Checkable>& checkable, const String& author,
@@ -67,6 +70,12 @@ public:
 
 	static void StaticInitialize(void);
 
+	virtual void NotifyStartTime(const Value& cookie = Empty) override;
+	virtual void NotifyEndTime(const Value& cookie = Empty) override;
+	virtual void NotifyTriggerTime(const Value& cookie = Empty) override;
+	virtual void NotifyDuration(const Value& cookie = Empty) override;
+	virtual void NotifyFixed(const Value& cookie = Empty) override;
+
 protected:
 	virtual void OnAllConfigLoaded(void) override;
 	virtual void Start(bool runtimeCreated) override;
@@ -80,8 +89,10 @@ private:
 
 	bool CanBeTriggered(void);
 
-	static void DowntimesStartTimerHandler(void);
-	static void DowntimesExpireTimerHandler(void);
+	void UpdateDeadlines(void);
+
+	static void DowntimeStartHandler(const Object::Ptr& object);
+	static void DowntimeExpireHandler(const Object::Ptr& object);
 };
 
 }
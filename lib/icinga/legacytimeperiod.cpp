@@ -134,8 +134,21 @@ int LegacyTimePeriod::MonthFromString(const String& monthdef)
 
 void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end, tm *reference)
 {
-	/* Let mktime() figure out whether we're in DST or not. */
-	reference->tm_isdst = -1;
+	ResolveTimeSpec(CompileTimeSpec(timespec), begin, end, reference);
+}
+
+/**
+ * Parses a time specification into a representation which can be resolved
+ * for any reference time without having to parse it again.
+ */
+LegacyTimeSpec LegacyTimePeriod::CompileTimeSpec(const String& timespec)
+{
+	LegacyTimeSpec spec;
+	spec.Year = 0;
+	spec.Month = -1;
+	spec.Day = 0;
+	spec.Weekday = -1;
+	spec.N = 0;
 
 	/* YYYY-MM-DD */
 	if (timespec.GetLength() == 10 && timespec[4] == '-' && timespec[7] == '-') {
@@ -148,11 +161,64 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 		if (day < 1 || day > 31)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid day in time specification: " + timespec));
 
+		spec.Type = TimeSpecDate;
+		spec.Year = year;
+		spec.Month = month - 1;
+		spec.Day = day;
+
+		return spec;
+	}
+
+	std::vector<String> tokens;
+	boost::algorithm::split(tokens, timespec, boost::is_any_of(" "));
+
+	int mon = -1;
+
+	if (tokens.size() > 1 && (tokens[0] == "day" || (mon = MonthFromString(tokens[0])) != -1)) {
+		spec.Type = TimeSpecMonthDay;
+		spec.Month = mon;
+		spec.Day = Convert::ToLong(tokens[1]);
+
+		return spec;
+	}
+
+	int wday;
+
+	if (tokens.size() >= 1 && (wday = WeekdayFromString(tokens[0])) != -1) {
+		spec.Type = TimeSpecWeekday;
+		spec.Weekday = wday;
+
+		if (tokens.size() > 2) {
+			spec.Month = MonthFromString(tokens[2]);
+
+			if (spec.Month == -1)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid month in time specification: " + timespec));
+		}
+
+		if (tokens.size() > 1) {
+			spec.N = Convert::ToLong(tokens[1]);
+
+			if (spec.N == 0)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid weekday number in time specification: " + timespec));
+		}
+
+		return spec;
+	}
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + timespec));
+}
+
+void LegacyTimePeriod::ResolveTimeSpec(const LegacyTimeSpec& spec, tm *begin, tm *end, tm *reference)
+{
+	/* Let mktime() figure out whether we're in DST or not. */
+	reference->tm_isdst = -1;
+
+	if (spec.Type == TimeSpecDate) {
 		if (begin) {
 			*begin = *reference;
-			begin->tm_year = year - 1900;
-			begin->tm_mon = month - 1;
-			begin->tm_mday = day;
+			begin->tm_year = spec.Year - 1900;
+			begin->tm_mon = spec.Month;
+			begin->tm_mday = spec.Day;
 			begin->tm_hour = 0;
 			begin->tm_min = 0;
 			begin->tm_sec = 0;
@@ -160,27 +226,16 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 
 		if (end) {
 			*end = *reference;
-			end->tm_year = year - 1900;
-			end->tm_mon = month - 1;
-			end->tm_mday = day;
+			end->tm_year = spec.Year - 1900;
+			end->tm_mon = spec.Month;
+			end->tm_mday = spec.Day;
 			end->tm_hour = 24;
 			end->tm_min = 0;
 			end->tm_sec = 0;
 		}
-
-		return;
-	}
-
-	std::vector<String> tokens;
-	boost::algorithm::split(tokens, timespec, boost::is_any_of(" "));
-
-	int mon = -1;
-
-	if (tokens.size() > 1 && (tokens[0] == "day" || (mon = MonthFromString(tokens[0])) != -1)) {
-		if (mon == -1)
-			mon = reference->tm_mon;
-
-		int mday = Convert::ToLong(tokens[1]);
+	} else if (spec.Type == TimeSpecMonthDay) {
+		int mon = (spec.Month == -1) ? reference->tm_mon : spec.Month;
+		int mday = spec.Day;
 
 		if (begin) {
 			*begin = *reference;
@@ -211,36 +266,19 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 				end->tm_mon++;
 			}
 		}
-
-		return;
-	}
-
-	int wday;
-
-	if (tokens.size() >= 1 && (wday = WeekdayFromString(tokens[0])) != -1) {
+	} else {
 		tm myref = *reference;
 
-		if (tokens.size() > 2) {
-			mon = MonthFromString(tokens[2]);
-
-			if (mon == -1)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid month in time specification: " + timespec));
-
-			myref.tm_mon = mon;
-		}
-
-		int n = 0;
-
-		if (tokens.size() > 1)
-			n = Convert::ToLong(tokens[1]);
+		if (spec.Month != -1)
+			myref.tm_mon = spec.Month;
 
 		if (begin) {
 			*begin = myref;
 
-			if (tokens.size() > 1)
-				FindNthWeekday(wday, n, begin);
+			if (spec.N != 0)
+				FindNthWeekday(spec.Weekday, spec.N, begin);
 			else
-				begin->tm_mday += (7 - begin->tm_wday + wday) % 7;
+				begin->tm_mday += (7 - begin->tm_wday + spec.Weekday) % 7;
 
 			begin->tm_hour = 0;
 			begin->tm_min = 0;
@@ -250,25 +288,31 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 		if (end) {
 			*end = myref;
 
-			if (tokens.size() > 1)
-				FindNthWeekday(wday, n, end);
+			if (spec.N != 0)
+				FindNthWeekday(spec.Weekday, spec.N, end);
 			else
-				end->tm_mday += (7 - end->tm_wday + wday) % 7;
+				end->tm_mday += (7 - end->tm_wday + spec.Weekday) % 7;
 
 			end->tm_hour = 0;
 			end->tm_min = 0;
 			end->tm_sec = 0;
 			end->tm_mday++;
 		}
-
-		return;
 	}
-
-	BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + timespec));
 }
 
 void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *end, int *stride, tm *reference)
 {
+	ResolveTimeRange(CompileTimeRange(timerange), begin, end, stride, reference);
+}
+
+/**
+ * Parses a day definition into a representation which can be resolved
+ * for any reference time without having to parse it again.
+ */
+LegacyTimeRange LegacyTimePeriod::CompileTimeRange(const String& timerange)
+{
+	LegacyTimeRange range;
 	String def = timerange;
 
 	/* Figure out the stride. */
@@ -276,12 +320,12 @@ void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *en
 
 	if (pos != String::NPos) {
 		String strStride = def.SubStr(pos + 1).Trim();
-		*stride = Convert::ToLong(strStride);
+		range.Stride = Convert::ToLong(strStride);
 
 		/* Remove the stride parameter from the definition. */
 		def = def.SubStr(0, pos);
 	} else {
-		*stride = 1; /* User didn't specify anything, assume default. */
+		range.Stride = 1; /* User didn't specify anything, assume default. */
 	}
 
 	/* Figure out whether the user has specified two dates. */
@@ -292,7 +336,7 @@ void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *en
 
 		String second = def.SubStr(pos + 1).Trim();
 
-		ParseTimeSpec(first, begin, NULL, reference);
+		range.Begin = CompileTimeSpec(first);
 
 		/* If the second definition starts with a number we need
 		 * to add the first word from the first definition, e.g.:
@@ -313,10 +357,21 @@ void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *en
 			second = first.SubStr(0, xpos + 1) + second;
 		}
 
-		ParseTimeSpec(second, NULL, end, reference);
+		range.End = CompileTimeSpec(second);
 	} else {
-		ParseTimeSpec(def, begin, end, reference);
+		range.Begin = CompileTimeSpec(def);
+		range.End = range.Begin;
 	}
+
+	return range;
+}
+
+void LegacyTimePeriod::ResolveTimeRange(const LegacyTimeRange& range, tm *begin, tm *end, int *stride, tm *reference)
+{
+	*stride = range.Stride;
+
+	ResolveTimeSpec(range.Begin, begin, NULL, reference);
+	ResolveTimeSpec(range.End, NULL, end, reference);
 }
 
 bool LegacyTimePeriod::IsInDayDefinition(const String& daydef, tm *reference)
@@ -334,6 +389,38 @@ bool LegacyTimePeriod::IsInDayDefinition(const String& daydef, tm *reference)
 }
 
 void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end)
+{
+	LegacyTimeOfDayRange range = CompileTimeOfDayRange(timerange);
+
+	*begin = *reference;
+	begin->tm_sec = 0;
+	begin->tm_min = range.BeginMinute;
+	begin->tm_hour = range.BeginHour;
+
+	*end = *reference;
+	end->tm_sec = 0;
+	end->tm_min = range.EndMinute;
+	end->tm_hour = range.EndHour;
+}
+
+Dictionary::Ptr LegacyTimePeriod::ProcessTimeRange(const String& timestamp, tm *reference)
+{
+	tm begin, end;
+
+	ProcessTimeRangeRaw(timestamp, reference, &begin, &end);
+
+	Dictionary::Ptr segment = new Dictionary();
+	segment->Set("begin", (long)mktime(&begin));
+	segment->Set("end", (long)mktime(&end));
+	return segment;
+}
+
+void LegacyTimePeriod::ProcessTimeRanges(const String& timeranges, tm *reference, const Array::Ptr& result)
+{
+	ProcessTimeRanges(CompileTimeOfDayRanges(timeranges), reference, result);
+}
+
+LegacyTimeOfDayRange LegacyTimePeriod::CompileTimeOfDayRange(const String& timerange)
 {
 	std::vector<String> times;
 
@@ -353,45 +440,54 @@ void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *referenc
 	if (hd2.size() != 2)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + times[1]));
 
-	*begin = *reference;
-	begin->tm_sec = 0;
-	begin->tm_min = Convert::ToLong(hd1[1]);
-	begin->tm_hour = Convert::ToLong(hd1[0]);
-
-	*end = *reference;
-	end->tm_sec = 0;
-	end->tm_min = Convert::ToLong(hd2[1]);
-	end->tm_hour = Convert::ToLong(hd2[0]);
+	LegacyTimeOfDayRange range;
+	range.BeginMinute = Convert::ToLong(hd1[1]);
+	range.BeginHour = Convert::ToLong(hd1[0]);
+	range.EndMinute = Convert::ToLong(hd2[1]);
+	range.EndHour = Convert::ToLong(hd2[0]);
 
-	if (begin->tm_hour * 3600 + begin->tm_min * 60 + begin->tm_sec >=
-	    end->tm_hour * 3600 + end->tm_min * 60 + end->tm_sec)
+	if (range.BeginHour * 3600 + range.BeginMinute * 60 >= range.EndHour * 3600 + range.EndMinute * 60)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Time period segment ends before it begins"));
+
+	return range;
 }
 
-Dictionary::Ptr LegacyTimePeriod::ProcessTimeRange(const String& timestamp, tm *reference)
+std::vector<LegacyTimeOfDayRange> LegacyTimePeriod::CompileTimeOfDayRanges(const String& timeranges)
 {
-	tm begin, end;
+	std::vector<String> ranges;
 
-	ProcessTimeRangeRaw(timestamp, reference, &begin, &end);
+	boost::algorithm::split(ranges, timeranges, boost::is_any_of(","));
 
-	Dictionary::Ptr segment = new Dictionary();
-	segment->Set("begin", (long)mktime(&begin));
-	segment->Set("end", (long)mktime(&end));
-	return segment;
+	std::vector<LegacyTimeOfDayRange> result;
+
+	for (const String& range : ranges)
+		result.push_back(CompileTimeOfDayRange(range));
+
+	return result;
 }
 
-void LegacyTimePeriod::ProcessTimeRanges(const String& timeranges, tm *reference, const Array::Ptr& result)
+void LegacyTimePeriod::ProcessTimeRanges(const std::vector<LegacyTimeOfDayRange>& timeranges, tm *reference, const Array::Ptr& result)
 {
-	std::vector<String> ranges;
+	for (const LegacyTimeOfDayRange& range : timeranges) {
+		tm begin = *reference;
+		begin.tm_sec = 0;
+		begin.tm_min = range.BeginMinute;
+		begin.tm_hour = range.BeginHour;
 
-	boost::algorithm::split(ranges, timeranges, boost::is_any_of(","));
+		tm end = *reference;
+		end.tm_sec = 0;
+		end.tm_min = range.EndMinute;
+		end.tm_hour = range.EndHour;
 
-	for (const String& range : ranges) {
-		Dictionary::Ptr segment = ProcessTimeRange(range, reference);
+		long tsbegin = mktime(&begin);
+		long tsend = mktime(&end);
 
-		if (segment->Get("begin") >= segment->Get("end"))
+		if (tsbegin >= tsend)
 			continue;
 
+		Dictionary::Ptr segment = new Dictionary();
+		segment->Set("begin", tsbegin);
+		segment->Set("end", tsend);
 		result->Add(segment);
 	}
 }
@@ -461,6 +557,14 @@ Array::Ptr LegacyTimePeriod::ScriptFunc(const TimePeriod::Ptr& tp, double begin,
 	Dictionary::Ptr ranges = tp->GetRanges();
 
 	if (ranges) {
+		/* The ranges are only parsed again when they have been changed. */
+		LegacyTimePeriodRules::Ptr rules = dynamic_pointer_cast<LegacyTimePeriodRules>(static_cast<Object::Ptr>(tp->GetExtension("LegacyTimePeriodRules")));
+
+		if (!rules || !rules->Matches(ranges)) {
+			rules = new LegacyTimePeriodRules(ranges);
+			tp->SetExtension("LegacyTimePeriodRules", rules);
+		}
+
 		for (int i = 0; i <= (end - begin) / (24 * 60 * 60); i++) {
 			time_t refts = begin + i * 24 * 60 * 60;
 			tm reference = Utility::LocalTime(refts);
@@ -470,23 +574,7 @@ Array::Ptr LegacyTimePeriod::ScriptFunc(const TimePeriod::Ptr& tp, double begin,
 			    << "Checking reference time " << refts;
 #endif /* I2_DEBUG */
 
-			ObjectLock olock(ranges);
-			for (const Dictionary::Pair& kv : ranges) {
-				if (!IsInDayDefinition(kv.first, &reference)) {
-#ifdef I2_DEBUG
-					Log(LogDebug, "LegacyTimePeriod")
-					    << "Not in day definition '" << kv.first << "'.";
-#endif /* I2_DEBUG */
-					continue;
-				}
-
-#ifdef I2_DEBUG
-				Log(LogDebug, "LegacyTimePeriod")
-				    << "In day definition '" << kv.first << "'.";
-#endif /* I2_DEBUG */
-
-				ProcessTimeRanges(kv.second, &reference, segments);
-			}
+			rules->AddSegments(&reference, segments);
 		}
 	}
 
@@ -495,3 +583,66 @@ Array::Ptr LegacyTimePeriod::ScriptFunc(const TimePeriod::Ptr& tp, double begin,
 
 	return segments;
 }
+
+LegacyTimePeriodRules::LegacyTimePeriodRules(const Dictionary::Ptr& ranges)
+{
+	ObjectLock olock(ranges);
+	for (const Dictionary::Pair& kv : ranges) {
+		Rule rule;
+		rule.DayDefinition = kv.first;
+		rule.TimeRanges = kv.second;
+		rule.Days = LegacyTimePeriod::CompileTimeRange(rule.DayDefinition);
+		rule.Times = LegacyTimePeriod::CompileTimeOfDayRanges(rule.TimeRanges);
+		m_Rules.push_back(rule);
+	}
+}
+
+/**
+ * Checks whether the rules were compiled from the specified ranges.
+ */
+bool LegacyTimePeriodRules::Matches(const Dictionary::Ptr& ranges) const
+{
+	ObjectLock olock(ranges);
+
+	if (ranges->GetLength() != m_Rules.size())
+		return false;
+
+	auto it = m_Rules.begin();
+
+	for (const Dictionary::Pair& kv : ranges) {
+		if (kv.first != it->DayDefinition || kv.second != it->TimeRanges)
+			return false;
+
+		it++;
+	}
+
+	return true;
+}
+
+/**
+ * Adds the segments for the day of the reference time.
+ */
+void LegacyTimePeriodRules::AddSegments(tm *reference, const Array::Ptr& result) const
+{
+	for (const Rule& rule : m_Rules) {
+		tm begin, end;
+		int stride;
+
+		LegacyTimePeriod::ResolveTimeRange(rule.Days, &begin, &end, &stride, reference);
+
+		if (!LegacyTimePeriod::IsInTimeRange(&begin, &end, stride, reference)) {
+#ifdef I2_DEBUG
+			Log(LogDebug, "LegacyTimePeriod")
+			    << "Not in day definition '" << rule.DayDefinition << "'.";
+#endif /* I2_DEBUG */
+			continue;
+		}
+
+#ifdef I2_DEBUG
+		Log(LogDebug, "LegacyTimePeriod")
+		    << "In day definition '" << rule.DayDefinition << "'.";
+#endif /* I2_DEBUG */
+
+		LegacyTimePeriod::ProcessTimeRanges(rule.Times, reference, result);
+	}
+}
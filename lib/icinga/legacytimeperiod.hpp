@@ -27,6 +27,82 @@
 namespace icinga
 {
 
+enum LegacyTimeSpecType
+{
+	TimeSpecDate,
+	TimeSpecMonthDay,
+	TimeSpecWeekday
+};
+
+/**
+ * A parsed time specification, e.g. "2017-01-01", "day 15", "june 3"
+ * or "monday 2 may".
+ *
+ * @ingroup icinga
+ */
+struct LegacyTimeSpec
+{
+	LegacyTimeSpecType Type;
+	int Year;
+	int Month; /**< -1 if the reference's month should be used. */
+	int Day;
+	int Weekday;
+	int N; /**< The nth weekday of the month, 0 for the next weekday. */
+};
+
+/**
+ * A parsed day definition, e.g. "monday - friday" or "day 1 - 15 / 2".
+ *
+ * @ingroup icinga
+ */
+struct LegacyTimeRange
+{
+	LegacyTimeSpec Begin;
+	LegacyTimeSpec End;
+	int Stride;
+};
+
+/**
+ * A parsed time of day range, e.g. "09:00-17:00".
+ *
+ * @ingroup icinga
+ */
+struct LegacyTimeOfDayRange
+{
+	int BeginHour;
+	int BeginMinute;
+	int EndHour;
+	int EndMinute;
+};
+
+/**
+ * The ranges of a time period, parsed once so that they can be evaluated
+ * for any number of days.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API LegacyTimePeriodRules : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LegacyTimePeriodRules);
+
+	LegacyTimePeriodRules(const Dictionary::Ptr& ranges);
+
+	bool Matches(const Dictionary::Ptr& ranges) const;
+	void AddSegments(tm *reference, const Array::Ptr& result) const;
+
+private:
+	struct Rule
+	{
+		String DayDefinition;
+		String TimeRanges;
+		LegacyTimeRange Days;
+		std::vector<LegacyTimeOfDayRange> Times;
+	};
+
+	std::vector<Rule> m_Rules;
+};
+
 /**
  * Implements Icinga 1.x time periods.
  *
@@ -43,10 +119,17 @@ public:
 	static int MonthFromString(const String& monthdef);
 	static void ParseTimeSpec(const String& timespec, tm *begin, tm *end, tm *reference);
 	static void ParseTimeRange(const String& timerange, tm *begin, tm *end, int *stride, tm *reference);
+	static LegacyTimeSpec CompileTimeSpec(const String& timespec);
+	static void ResolveTimeSpec(const LegacyTimeSpec& spec, tm *begin, tm *end, tm *reference);
+	static LegacyTimeRange CompileTimeRange(const String& timerange);
+	static void ResolveTimeRange(const LegacyTimeRange& range, tm *begin, tm *end, int *stride, tm *reference);
 	static bool IsInDayDefinition(const String& daydef, tm *reference);
 	static void ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end);
 	static Dictionary::Ptr ProcessTimeRange(const String& timerange, tm *reference);
 	static void ProcessTimeRanges(const String& timeranges, tm *reference, const Array::Ptr& result);
+	static LegacyTimeOfDayRange CompileTimeOfDayRange(const String& timerange);
+	static std::vector<LegacyTimeOfDayRange> CompileTimeOfDayRanges(const String& timeranges);
+	static void ProcessTimeRanges(const std::vector<LegacyTimeOfDayRange>& timeranges, tm *reference, const Array::Ptr& result);
 	static Dictionary::Ptr FindNextSegment(const String& daydef, const String& timeranges, tm *reference);
 
 private:
@@ -19,6 +19,7 @@
 
 #include "icinga/macroprocessor.hpp"
 #include "icinga/macroresolver.hpp"
+#include "icinga/macrotemplate.hpp"
 #include "icinga/customvarobject.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
@@ -29,16 +30,13 @@
 #include "base/convert.hpp"
 #include "base/exception.hpp"
 #include <boost/assign.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/join.hpp>
-#include <boost/algorithm/string/classification.hpp>
 
 using namespace icinga;
 
 Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolvers,
     const CheckResult::Ptr& cr, String *missingMacro,
     const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
-    bool useResolvedMacros, int recursionLevel)
+    bool useResolvedMacros, int recursionLevel, const MacroTemplateCache::Ptr& templates)
 {
 	Value result;
 
@@ -47,7 +45,7 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 
 	if (str.IsScalar()) {
 		result = InternalResolveMacros(str, resolvers, cr, missingMacro, escapeFn,
-		    resolvedMacros, useResolvedMacros, recursionLevel + 1);
+		    resolvedMacros, useResolvedMacros, recursionLevel + 1, templates);
 	} else if (str.IsObjectType<Array>()) {
 		Array::Ptr resultArr = new Array();
 		Array::Ptr arr = str;
@@ -57,7 +55,7 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 		for (const Value& arg : arr) {
 			/* Note: don't escape macros here. */
 			Value value = InternalResolveMacros(arg, resolvers, cr, missingMacro,
-			    EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1);
+			    EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1, templates);
 
 			if (value.IsObjectType<Array>())
 				resultArr->Add(Utility::Join(value, ';'));
@@ -75,7 +73,7 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 		for (const Dictionary::Pair& kv : dict) {
 			/* Note: don't escape macros here. */
 			resultDict->Set(kv.first, InternalResolveMacros(kv.second, resolvers, cr, missingMacro,
-			    EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1));
+			    EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1, templates));
 		}
 
 		result = resultDict;
@@ -88,34 +86,25 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 	return result;
 }
 
-bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resolvers,
+bool MacroProcessor::ResolveMacro(const MacroTemplateToken& macro, const ResolverList& resolvers,
     const CheckResult::Ptr& cr, Value *result, bool *recursive_macro)
 {
-	CONTEXT("Resolving macro '" + macro + "'");
+	CONTEXT(macro.Context);
 
 	*recursive_macro = false;
 
-	std::vector<String> tokens;
-	boost::algorithm::split(tokens, macro, boost::is_any_of("."));
-
-	String objName;
-	if (tokens.size() > 1) {
-		objName = tokens[0];
-		tokens.erase(tokens.begin());
-	}
-
 	for (const ResolverSpec& resolver : resolvers) {
-		if (!objName.IsEmpty() && objName != resolver.first)
+		if (!macro.ObjectName.IsEmpty() && macro.ObjectName != resolver.first)
 			continue;
 
-		if (objName.IsEmpty()) {
+		if (macro.ObjectName.IsEmpty()) {
 			CustomVarObject::Ptr dobj = dynamic_pointer_cast<CustomVarObject>(resolver.second);
 
 			if (dobj) {
 				Dictionary::Ptr vars = dobj->GetVars();
 
-				if (vars && vars->Contains(macro)) {
-					*result = vars->Get(macro);
+				if (vars && vars->Contains(macro.Text)) {
+					*result = vars->Get(macro.Text);
 					*recursive_macro = true;
 					return true;
 				}
@@ -124,13 +113,13 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 
 		MacroResolver *mresolver = dynamic_cast<MacroResolver *>(resolver.second.get());
 
-		if (mresolver && mresolver->ResolveMacro(boost::algorithm::join(tokens, "."), cr, result))
+		if (mresolver && mresolver->ResolveMacro(macro.Attribute, cr, result))
 			return true;
 
 		Value ref = resolver.second;
 		bool valid = true;
 
-		for (const String& token : tokens) {
+		for (const String& token : macro.Path) {
 			if (ref.IsObjectType<Dictionary>()) {
 				Dictionary::Ptr dict = ref;
 				if (dict->Contains(token)) {
@@ -167,10 +156,12 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 		}
 
 		if (valid) {
-			if (tokens[0] == "vars" ||
-			    tokens[0] == "action_url" ||
-			    tokens[0] == "notes_url" ||
-			    tokens[0] == "notes")
+			const String& attr = macro.Path[0];
+
+			if (attr == "vars" ||
+			    attr == "action_url" ||
+			    attr == "notes_url" ||
+			    attr == "notes")
 				*recursive_macro = true;
 
 			*result = ref;
@@ -229,45 +220,53 @@ Value MacroProcessor::EvaluateFunction(const Function::Ptr& func, const Resolver
 Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverList& resolvers,
     const CheckResult::Ptr& cr, String *missingMacro,
     const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
-    bool useResolvedMacros, int recursionLevel)
+    bool useResolvedMacros, int recursionLevel, const MacroTemplateCache::Ptr& templates)
 {
-	CONTEXT("Resolving macros for string '" + str + "'");
-
 	if (recursionLevel > 15)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Infinite recursion detected while resolving macros"));
 
-	size_t offset, pos_first, pos_second;
-	offset = 0;
+	/* most custom variables don't contain any macros */
+	if (str.FindFirstOf("$") == String::NPos)
+		return str;
 
-	Dictionary::Ptr resolvers_this;
+	MacroTemplate::Ptr tmpl;
 
-	String result = str;
-	while ((pos_first = result.FindFirstOf("$", offset)) != String::NPos) {
-		pos_second = result.FindFirstOf("$", pos_first + 1);
+	if (templates)
+		tmpl = templates->Get(str);
+	else
+		tmpl = new MacroTemplate(str);
 
-		if (pos_second == String::NPos)
-			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+	CONTEXT(tmpl->GetContext());
+
+	if (!tmpl->IsValid())
+		BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+
+	String result;
+	result.GetData().reserve(tmpl->GetLiteralLength());
 
-		String name = result.SubStr(pos_first + 1, pos_second - pos_first - 1);
+	for (const MacroTemplateToken& token : tmpl->GetTokens()) {
+		if (!token.IsMacro) {
+			result += token.Text;
+			continue;
+		}
+
+		const String& name = token.Text;
 
 		Value resolved_macro;
-		bool recursive_macro;
+		bool recursive_macro = false;
 		bool found;
 
-		if (useResolvedMacros) {
-			recursive_macro = false;
+		/* $$ is an escape sequence for $. */
+		if (name.IsEmpty()) {
+			resolved_macro = "$";
+			found = true;
+		} else if (useResolvedMacros) {
 			found = resolvedMacros->Contains(name);
 
 			if (found)
 				resolved_macro = resolvedMacros->Get(name);
 		} else
-			found = ResolveMacro(name, resolvers, cr, &resolved_macro, &recursive_macro);
-
-		/* $$ is an escape sequence for $. */
-		if (name.IsEmpty()) {
-			resolved_macro = "$";
-			found = true;
-		}
+			found = ResolveMacro(token, resolvers, cr, &resolved_macro, &recursive_macro);
 
 		if (resolved_macro.IsObjectType<Function>()) {
 			resolved_macro = EvaluateFunction(resolved_macro, resolvers, cr, escapeFn,
@@ -313,29 +312,19 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 			resolved_macro = escapeFn(resolved_macro);
 
 		/* we're done if this is the only macro and there are no other non-macro parts in the string */
-		if (pos_first == 0 && pos_second == str.GetLength() - 1)
+		if (tmpl->IsSingleMacro())
 			return resolved_macro;
-		else if (resolved_macro.IsObjectType<Array>())
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
-
-		if (resolved_macro.IsObjectType<Array>()) {
-			/* don't allow mixing strings and arrays in macro strings */
-			if (pos_first != 0 || pos_second != str.GetLength() - 1)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
 
-			return resolved_macro;
-		}
+		/* don't allow mixing strings and arrays in macro strings */
+		if (resolved_macro.IsObjectType<Array>())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
 
-		String resolved_macro_str = resolved_macro;
-
-		result.Replace(pos_first, pos_second - pos_first + 1, resolved_macro_str);
-		offset = pos_first + resolved_macro_str.GetLength();
+		result += static_cast<String>(resolved_macro);
 	}
 
 	return result;
 }
 
-
 bool MacroProcessor::ValidateMacroString(const String& macro)
 {
 	if (macro.IsEmpty())
@@ -452,12 +441,13 @@ struct CommandArgument
 
 Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
     const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
-    const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
+    const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel,
+    const MacroTemplateCache::Ptr& templates)
 {
 	Value resolvedCommand;
 	if (!arguments || command.IsObjectType<Array>() || command.IsObjectType<Function>())
 		resolvedCommand = MacroProcessor::ResolveMacros(command, resolvers, cr, NULL,
-		    EscapeMacroShellArg, resolvedMacros, useResolvedMacros, recursionLevel + 1);
+		    EscapeMacroShellArg, resolvedMacros, useResolvedMacros, recursionLevel + 1, templates);
 	else {
 		Array::Ptr arr = new Array();
 		arr->Add(command);
@@ -495,7 +485,7 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 					String missingMacro;
 					Value set_if_resolved = MacroProcessor::ResolveMacros(set_if, resolvers,
 					    cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-					    useResolvedMacros, recursionLevel + 1);
+					    useResolvedMacros, recursionLevel + 1, templates);
 
 					if (!missingMacro.IsEmpty())
 						continue;
@@ -531,7 +521,7 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 			String missingMacro;
 			arg.AValue = MacroProcessor::ResolveMacros(argval, resolvers,
 			    cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-			    useResolvedMacros, recursionLevel + 1);
+			    useResolvedMacros, recursionLevel + 1, templates);
 
 			if (!missingMacro.IsEmpty()) {
 				if (required) {
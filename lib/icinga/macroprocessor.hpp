@@ -22,6 +22,7 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkable.hpp"
+#include "icinga/macrotemplate.hpp"
 #include "base/value.hpp"
 #include <boost/function.hpp>
 #include <vector>
@@ -45,11 +46,13 @@ public:
 	    const CheckResult::Ptr& cr = CheckResult::Ptr(), String *missingMacro = NULL,
 	    const EscapeCallback& escapeFn = EscapeCallback(),
 	    const Dictionary::Ptr& resolvedMacros = Dictionary::Ptr(),
-	    bool useResolvedMacros = false, int recursionLevel = 0);
+	    bool useResolvedMacros = false, int recursionLevel = 0,
+	    const MacroTemplateCache::Ptr& templates = MacroTemplateCache::Ptr());
 
 	static Value ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
 	    const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
-	    const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0);
+	    const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0,
+	    const MacroTemplateCache::Ptr& templates = MacroTemplateCache::Ptr());
 
 	static bool ValidateMacroString(const String& macro);
 	static void ValidateCustomVars(const ConfigObject::Ptr& object, const Dictionary::Ptr& value);
@@ -57,13 +60,13 @@ public:
 private:
 	MacroProcessor(void);
 
-	static bool ResolveMacro(const String& macro, const ResolverList& resolvers,
+	static bool ResolveMacro(const MacroTemplateToken& macro, const ResolverList& resolvers,
 		const CheckResult::Ptr& cr, Value *result, bool *recursive_macro);
 	static Value InternalResolveMacros(const String& str,
 	    const ResolverList& resolvers, const CheckResult::Ptr& cr,
 	    String *missingMacro, const EscapeCallback& escapeFn,
 	    const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros,
-	    int recursionLevel = 0);
+	    int recursionLevel = 0, const MacroTemplateCache::Ptr& templates = MacroTemplateCache::Ptr());
 	static Value InternalResolveMacrosShim(const std::vector<Value>& args, const ResolverList& resolvers,
 	    const CheckResult::Ptr& cr, const MacroProcessor::EscapeCallback& escapeFn,
             const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel);
@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/macrotemplate.hpp"
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+using namespace icinga;
+
+MacroTemplate::MacroTemplate(const String& str)
+	: m_Valid(true), m_LiteralLength(0), m_Context("Resolving macros for string '" + str + "'")
+{
+	size_t offset = 0, pos_first, pos_second;
+
+	while ((pos_first = str.FindFirstOf("$", offset)) != String::NPos) {
+		pos_second = str.FindFirstOf("$", pos_first + 1);
+
+		if (pos_second == String::NPos) {
+			m_Valid = false;
+			return;
+		}
+
+		if (pos_first > offset) {
+			MacroTemplateToken literal;
+			literal.IsMacro = false;
+			literal.Text = str.SubStr(offset, pos_first - offset);
+			m_LiteralLength += literal.Text.GetLength();
+			m_Tokens.push_back(literal);
+		}
+
+		MacroTemplateToken macro;
+		macro.IsMacro = true;
+		macro.Text = str.SubStr(pos_first + 1, pos_second - pos_first - 1);
+
+		/* $$ is an escape sequence for $ and doesn't need a resolution plan. */
+		if (!macro.Text.IsEmpty()) {
+			boost::algorithm::split(macro.Path, macro.Text, boost::is_any_of("."));
+
+			if (macro.Path.size() > 1) {
+				macro.ObjectName = macro.Path[0];
+				macro.Path.erase(macro.Path.begin());
+			}
+
+			macro.Attribute = boost::algorithm::join(macro.Path, ".");
+			macro.Context = "Resolving macro '" + macro.Text + "'";
+		}
+
+		m_Tokens.push_back(macro);
+
+		offset = pos_second + 1;
+	}
+
+	if (offset < str.GetLength()) {
+		MacroTemplateToken literal;
+		literal.IsMacro = false;
+		literal.Text = str.SubStr(offset);
+		m_LiteralLength += literal.Text.GetLength();
+		m_Tokens.push_back(literal);
+	}
+}
+
+const std::vector<MacroTemplateToken>& MacroTemplate::GetTokens(void) const
+{
+	return m_Tokens;
+}
+
+/**
+ * Returns whether all macros in the string were closed.
+ *
+ * @returns true if the string is valid, false otherwise.
+ */
+bool MacroTemplate::IsValid(void) const
+{
+	return m_Valid;
+}
+
+/**
+ * Returns whether the string consists of exactly one macro, in which case
+ * the resolved value is used as-is instead of being converted to a string.
+ *
+ * @returns true if the string is a single macro, false otherwise.
+ */
+bool MacroTemplate::IsSingleMacro(void) const
+{
+	return m_Tokens.size() == 1 && m_Tokens[0].IsMacro;
+}
+
+size_t MacroTemplate::GetLiteralLength(void) const
+{
+	return m_LiteralLength;
+}
+
+const String& MacroTemplate::GetContext(void) const
+{
+	return m_Context;
+}
+
+/**
+ * Returns the compiled template for a macro string, compiling it first if
+ * necessary. Templates are looked up by their content so a stale template
+ * is never returned for a modified string.
+ *
+ * @param str The macro string.
+ * @returns The template.
+ */
+MacroTemplate::Ptr MacroTemplateCache::Get(const String& str)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		std::map<String, MacroTemplate::Ptr>::const_iterator it = m_Templates.find(str);
+
+		if (it != m_Templates.end())
+			return it->second;
+	}
+
+	MacroTemplate::Ptr tmpl = new MacroTemplate(str);
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_Templates[str] = tmpl;
+
+	return tmpl;
+}
+
+void MacroTemplateCache::Clear(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_Templates.clear();
+}
+
+size_t MacroTemplateCache::GetLength(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_Templates.size();
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef MACROTEMPLATE_H
+#define MACROTEMPLATE_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/object.hpp"
+#include "base/string.hpp"
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A literal or a macro reference in a macro string.
+ *
+ * @ingroup icinga
+ */
+struct MacroTemplateToken
+{
+	bool IsMacro;
+
+	/* the literal text or the macro name, e.g. "host.vars.address" */
+	String Text;
+
+	/* only set for macros: "host", ["vars", "address"] and "vars.address" */
+	String ObjectName;
+	std::vector<String> Path;
+	String Attribute;
+
+	String Context;
+};
+
+/**
+ * A macro string which has been split into literals and macro references
+ * so that it doesn't have to be scanned again whenever it is resolved.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API MacroTemplate : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MacroTemplate);
+
+	MacroTemplate(const String& str);
+
+	const std::vector<MacroTemplateToken>& GetTokens(void) const;
+	bool IsValid(void) const;
+	bool IsSingleMacro(void) const;
+	size_t GetLiteralLength(void) const;
+	const String& GetContext(void) const;
+
+private:
+	std::vector<MacroTemplateToken> m_Tokens;
+	bool m_Valid;
+	size_t m_LiteralLength;
+	String m_Context;
+};
+
+/**
+ * Compiled macro templates for the macro strings of a single object.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API MacroTemplateCache : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MacroTemplateCache);
+
+	MacroTemplate::Ptr Get(const String& str);
+	void Clear(void);
+
+	size_t GetLength(void) const;
+
+private:
+	mutable boost::mutex m_Mutex;
+	std::map<String, MacroTemplate::Ptr> m_Templates;
+};
+
+}
+
+#endif /* MACROTEMPLATE_H */
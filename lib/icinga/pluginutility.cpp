@@ -44,7 +44,7 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 
 	try {
 		command = MacroProcessor::ResolveArguments(raw_command, raw_arguments,
-		    macroResolvers, cr, resolvedMacros, useResolvedMacros);
+		    macroResolvers, cr, resolvedMacros, useResolvedMacros, 0, commandObj->GetMacroTemplates());
 	} catch (const std::exception& ex) {
 		String message = DiagnosticInformation(ex);
 
@@ -74,7 +74,7 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 
 			Value value = MacroProcessor::ResolveMacros(name, macroResolvers, cr,
 			    NULL, MacroProcessor::EscapeCallback(), resolvedMacros,
-			    useResolvedMacros);
+			    useResolvedMacros, 0, commandObj->GetMacroTemplates());
 
 			if (value.IsObjectType<Array>())
 				value = Utility::Join(value, ';');
@@ -22,7 +22,7 @@
 #include "icinga/legacytimeperiod.hpp"
 #include "icinga/downtime.hpp"
 #include "icinga/service.hpp"
-#include "base/timer.hpp"
+#include "base/deadlinequeue.hpp"
 #include "base/configtype.hpp"
 #include "base/initialize.hpp"
 #include "base/utility.hpp"
@@ -39,7 +39,10 @@ REGISTER_TYPE(ScheduledDowntime);
 
 INITIALIZE_ONCE(&ScheduledDowntime::StaticInitialize);
 
-static Timer::Ptr l_Timer;
+/* How long to wait before looking at ranges again which didn't yield a segment. */
+#define SCHEDULEDDOWNTIME_RETRY_INTERVAL 60
+
+static DeadlineQueue::Ptr l_ScheduledDowntimesQueue;
 
 String ScheduledDowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
 {
@@ -81,10 +84,8 @@ Dictionary::Ptr ScheduledDowntimeNameComposer::ParseName(const String& name) con
 
 void ScheduledDowntime::StaticInitialize(void)
 {
-	l_Timer = new Timer();
-	l_Timer->SetInterval(60);
-	l_Timer->OnTimerExpired.connect(boost::bind(&ScheduledDowntime::TimerProc));
-	l_Timer->Start();
+	l_ScheduledDowntimesQueue = new DeadlineQueue(boost::bind(&ScheduledDowntime::ScheduledDowntimeHandler, _1));
+	l_ScheduledDowntimesQueue->Start();
 }
 
 void ScheduledDowntime::OnAllConfigLoaded(void)
@@ -102,14 +103,50 @@ void ScheduledDowntime::Start(bool runtimeCreated)
 	Utility::QueueAsyncCallback(boost::bind(&ScheduledDowntime::CreateNextDowntime, this));
 }
 
-void ScheduledDowntime::TimerProc(void)
+void ScheduledDowntime::Stop(bool runtimeRemoved)
 {
-	for (const ScheduledDowntime::Ptr& sd : ConfigType::GetObjectsByType<ScheduledDowntime>()) {
-		if (sd->IsActive())
-			sd->CreateNextDowntime();
+	l_ScheduledDowntimesQueue->Remove(this);
+
+	/* Downtimes without a config owner would otherwise only be removed once they expire. */
+	if (runtimeRemoved)
+		Utility::QueueAsyncCallback(boost::bind(&ScheduledDowntime::RemoveDowntimes, ScheduledDowntime::Ptr(this)));
+
+	ObjectImpl<ScheduledDowntime>::Stop(runtimeRemoved);
+}
+
+void ScheduledDowntime::ScheduledDowntimeHandler(const Object::Ptr& object)
+{
+	ScheduledDowntime::Ptr sd = static_pointer_cast<ScheduledDowntime>(object);
+
+	if (!sd->IsActive())
+		return;
+
+	try {
+		sd->CreateNextDowntime();
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ScheduledDowntime")
+		    << "Could not create the next downtime for '" << sd->GetName() << "': " << DiagnosticInformation(ex, false);
+
+		l_ScheduledDowntimesQueue->Set(sd, Utility::GetTime() + SCHEDULEDDOWNTIME_RETRY_INTERVAL);
 	}
 }
 
+void ScheduledDowntime::RemoveDowntimes(void)
+{
+	for (const Downtime::Ptr& downtime : GetCheckable()->GetDowntimes()) {
+		if (downtime->GetConfigOwner() == GetName())
+			Downtime::RemoveDowntime(downtime->GetName(), false, true);
+	}
+}
+
+void ScheduledDowntime::NotifyRanges(const Value& cookie)
+{
+	ObjectImpl<ScheduledDowntime>::NotifyRanges(cookie);
+
+	if (IsActive())
+		l_ScheduledDowntimesQueue->Set(this, 0);
+}
+
 Checkable::Ptr ScheduledDowntime::GetCheckable(void) const
 {
 	Host::Ptr host = Host::GetByName(GetHostName());
@@ -169,32 +206,43 @@ std::pair<double, double> ScheduledDowntime::FindNextSegment(void)
 		return std::make_pair(0, 0);
 }
 
+/**
+ * Makes sure that the next downtime is scheduled and looks at the ranges
+ * again once that downtime has started.
+ */
 void ScheduledDowntime::CreateNextDowntime(void)
 {
+	double now = Utility::GetTime();
+	double nextStart = -1;
+
 	for (const Downtime::Ptr& downtime : GetCheckable()->GetDowntimes()) {
 		if (downtime->GetScheduledBy() != GetName() ||
-		    downtime->GetStartTime() < Utility::GetTime())
+		    downtime->GetStartTime() < now)
 			continue;
 
-		/* We've found a downtime that is owned by us and that hasn't started yet - we're done. */
-		return;
+		/* We've found a downtime that is owned by us and that hasn't started yet. */
+		if (nextStart < 0 || downtime->GetStartTime() < nextStart)
+			nextStart = downtime->GetStartTime();
 	}
 
-	std::pair<double, double> segment = FindNextSegment();
+	if (nextStart < 0) {
+		std::pair<double, double> segment = FindNextSegment();
 
-	if (segment.first == 0 && segment.second == 0) {
-		tm reference = Utility::LocalTime(Utility::GetTime());
-		reference.tm_mday++;
-		reference.tm_hour = 0;
-		reference.tm_min = 0;
-		reference.tm_sec = 0;
+		if (segment.first == 0 && segment.second == 0) {
+			/* None of the ranges has another segment yet. */
+			l_ScheduledDowntimesQueue->Set(this, now + SCHEDULEDDOWNTIME_RETRY_INTERVAL);
+			return;
+		}
 
-		return;
+		Downtime::AddDowntime(GetCheckable(), GetAuthor(), GetComment(),
+		    segment.first, segment.second,
+		    GetFixed(), String(), GetDuration(), GetName(), GetName());
+
+		nextStart = segment.first;
 	}
 
-	Downtime::AddDowntime(GetCheckable(), GetAuthor(), GetComment(),
-	    segment.first, segment.second,
-	    GetFixed(), String(), GetDuration(), GetName(), GetName());
+	/* The downtime counts as started only once its start time has passed. */
+	l_ScheduledDowntimesQueue->Set(this, std::max(nextStart, now + 1));
 }
 
 void ScheduledDowntime::ValidateRanges(const Dictionary::Ptr& value, const ValidationUtils& utils)
@@ -53,12 +53,16 @@ public:
 
 	virtual void ValidateRanges(const Dictionary::Ptr& value, const ValidationUtils& utils) override;
 
+	virtual void NotifyRanges(const Value& cookie = Empty) override;
+
 protected:
 	virtual void OnAllConfigLoaded(void) override;
 	virtual void Start(bool runtimeCreated) override;
+	virtual void Stop(bool runtimeRemoved) override;
 
 private:
-	static void TimerProc(void);
+	static void ScheduledDowntimeHandler(const Object::Ptr& object);
+	void RemoveDowntimes(void);
 
 	std::pair<double, double> FindNextSegment(void);
 	void CreateNextDowntime(void);
@@ -20,12 +20,16 @@
 #include "icinga/timeperiod.hpp"
 #include "icinga/timeperiod.tcpp"
 #include "icinga/legacytimeperiod.hpp"
+#include "icinga/dependency.hpp"
 #include "base/configtype.hpp"
+#include "base/dependencygraph.hpp"
 #include "base/objectlock.hpp"
 #include "base/exception.hpp"
 #include "base/logger.hpp"
 #include "base/timer.hpp"
 #include "base/utility.hpp"
+#include <boost/make_shared.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -290,6 +294,26 @@ void TimePeriod::UpdateRegion(double begin, double end, bool clearExisting)
 				Merge(timeperiod, preferInclude);
 		}
 	}
+
+	/* Cached reachability results only expire at the next transition
+	 * of the segments they were evaluated against. Segments which are
+	 * appended by the update timer don't change existing transitions,
+	 * a recalculated region does. */
+	if (clearExisting) {
+		for (const Object::Ptr& parent : DependencyGraph::GetParents(this)) {
+			Dependency::Ptr dependency = dynamic_pointer_cast<Dependency>(parent);
+
+			if (!dependency)
+				continue;
+
+			Checkable::Ptr child = dependency->GetChild();
+
+			if (child)
+				child->InvalidateReachability();
+		}
+	}
+
+	UpdateSnapshot();
 }
 
 bool TimePeriod::GetIsInside(void) const
@@ -297,46 +321,134 @@ bool TimePeriod::GetIsInside(void) const
 	return IsInside(Utility::GetTime());
 }
 
+/**
+ * Finds the first segment which ends after the specified timestamp.
+ */
+static std::vector<std::pair<double, double> >::const_iterator FindSegment(const TimePeriodSnapshot& snapshot, double ts)
+{
+	return std::upper_bound(snapshot.Segments.begin(), snapshot.Segments.end(), ts,
+	    [](double ts, const std::pair<double, double>& segment) { return ts < segment.second; });
+}
+
 bool TimePeriod::IsInside(double ts) const
 {
-	ObjectLock olock(this);
+	boost::shared_ptr<const TimePeriodSnapshot> snapshot = GetSnapshot();
 
-	if (GetValidBegin().IsEmpty() || ts < GetValidBegin() || GetValidEnd().IsEmpty() || ts > GetValidEnd())
+	if (!snapshot->Valid || ts < snapshot->ValidBegin || ts > snapshot->ValidEnd)
 		return true; /* Assume that all invalid regions are "inside". */
 
-	Array::Ptr segments = GetSegments();
-
-	if (segments) {
-		ObjectLock dlock(segments);
-		for (const Dictionary::Ptr& segment : segments) {
-			if (ts > segment->Get("begin") && ts < segment->Get("end"))
-				return true;
-		}
-	}
+	auto it = FindSegment(*snapshot, ts);
 
-	return false;
+	return (it != snapshot->Segments.end() && ts > it->first);
 }
 
 double TimePeriod::FindNextTransition(double begin)
 {
+	boost::shared_ptr<const TimePeriodSnapshot> snapshot = GetSnapshot();
+
+	auto it = FindSegment(*snapshot, begin);
+
+	if (it == snapshot->Segments.end())
+		return -1;
+
+	if (it->first > begin)
+		return it->first;
+	else
+		return it->second;
+}
+
+boost::shared_ptr<const TimePeriodSnapshot> TimePeriod::GetSnapshot(void) const
+{
+	boost::shared_ptr<const TimePeriodSnapshot> snapshot = boost::atomic_load(&m_Snapshot);
+
+	if (snapshot)
+		return snapshot;
+
 	ObjectLock olock(this);
 
+	snapshot = CompileSnapshot();
+	boost::atomic_store(&m_Snapshot, snapshot);
+
+	return snapshot;
+}
+
+boost::shared_ptr<const TimePeriodSnapshot> TimePeriod::CompileSnapshot(void) const
+{
+	ASSERT(OwnsLock());
+
+	boost::shared_ptr<TimePeriodSnapshot> snapshot = boost::make_shared<TimePeriodSnapshot>();
+
+	Value validBegin = GetValidBegin();
+	Value validEnd = GetValidEnd();
+
+	snapshot->Valid = !validBegin.IsEmpty() && !validEnd.IsEmpty();
+	snapshot->ValidBegin = snapshot->Valid ? static_cast<double>(validBegin) : 0;
+	snapshot->ValidEnd = snapshot->Valid ? static_cast<double>(validEnd) : 0;
+
 	Array::Ptr segments = GetSegments();
 
-	double closestTransition = -1;
+	if (!segments)
+		return snapshot;
+
+	std::vector<std::pair<double, double> > sorted;
 
-	if (segments) {
+	{
 		ObjectLock dlock(segments);
 		for (const Dictionary::Ptr& segment : segments) {
-			if (segment->Get("begin") > begin && (segment->Get("begin") < closestTransition || closestTransition == -1))
-				closestTransition = segment->Get("begin");
+			double begin = segment->Get("begin");
+			double end = segment->Get("end");
 
-			if (segment->Get("end") > begin && (segment->Get("end") < closestTransition || closestTransition == -1))
-				closestTransition = segment->Get("end");
+			if (begin < end)
+				sorted.push_back(std::make_pair(begin, end));
 		}
 	}
 
-	return closestTransition;
+	std::sort(sorted.begin(), sorted.end());
+
+	/* Segments which overlap are merged. Segments which merely touch are kept
+	 * apart: the timestamp they share is not inside the time period. */
+	for (const std::pair<double, double>& segment : sorted) {
+		if (!snapshot->Segments.empty() && segment.first < snapshot->Segments.back().second) {
+			if (segment.second > snapshot->Segments.back().second)
+				snapshot->Segments.back().second = segment.second;
+		} else
+			snapshot->Segments.push_back(segment);
+	}
+
+	return snapshot;
+}
+
+void TimePeriod::UpdateSnapshot(void)
+{
+	ObjectLock olock(this);
+
+	boost::atomic_store(&m_Snapshot, CompileSnapshot());
+}
+
+void TimePeriod::InvalidateSnapshot(void)
+{
+	boost::atomic_store(&m_Snapshot, boost::shared_ptr<const TimePeriodSnapshot>());
+}
+
+void TimePeriod::NotifyValidBegin(const Value& cookie)
+{
+	InvalidateSnapshot();
+
+	ObjectImpl<TimePeriod>::NotifyValidBegin(cookie);
+}
+
+void TimePeriod::NotifyValidEnd(const Value& cookie)
+{
+	InvalidateSnapshot();
+
+	ObjectImpl<TimePeriod>::NotifyValidEnd(cookie);
+}
+
+void TimePeriod::NotifySegments(const Value& cookie)
+{
+	InvalidateSnapshot();
+
+	ObjectImpl<TimePeriod>::NotifySegments(cookie);
 }
 
 void TimePeriod::UpdateTimerHandler(void)
@@ -356,6 +468,8 @@ void TimePeriod::UpdateTimerHandler(void)
 			valid_end = tp->GetValidEnd();
 		}
 
+		tp->UpdateSnapshot();
+
 		tp->UpdateRegion(valid_end, now + 24 * 3600, false);
 #ifdef _DEBUG
 		tp->Dump();
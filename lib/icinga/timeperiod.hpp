@@ -22,10 +22,27 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/timeperiod.thpp"
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * An immutable copy of a time period's segments which can be searched
+ * without holding the time period's lock. The segments are sorted by their
+ * begin timestamp and overlapping segments are merged.
+ *
+ * @ingroup icinga
+ */
+struct TimePeriodSnapshot
+{
+	bool Valid;
+	double ValidBegin;
+	double ValidEnd;
+	std::vector<std::pair<double, double> > Segments;
+};
+
 /**
  * A time period.
  *
@@ -50,7 +67,18 @@ public:
 
 	virtual void ValidateRanges(const Dictionary::Ptr& value, const ValidationUtils& utils) override;
 
+	virtual void NotifyValidBegin(const Value& cookie = Empty) override;
+	virtual void NotifyValidEnd(const Value& cookie = Empty) override;
+	virtual void NotifySegments(const Value& cookie = Empty) override;
+
 private:
+	mutable boost::shared_ptr<const TimePeriodSnapshot> m_Snapshot;
+
+	boost::shared_ptr<const TimePeriodSnapshot> GetSnapshot(void) const;
+	boost::shared_ptr<const TimePeriodSnapshot> CompileSnapshot(void) const;
+	void UpdateSnapshot(void);
+	void InvalidateSnapshot(void);
+
 	void AddSegment(double s, double end);
 	void AddSegment(const Dictionary::Ptr& segment);
 	void RemoveSegment(double begin, double end);
@@ -27,6 +27,7 @@
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
+#include <limits>
 
 using namespace icinga;
 
@@ -34,17 +35,45 @@ REGISTER_TYPE(NotificationComponent);
 
 REGISTER_STATSFUNCTION(NotificationComponent, &NotificationComponent::StatsFunc);
 
+/* Due reminders are handed to the thread pool in batches of this size. */
+#define NOTIFICATION_BATCH_SIZE 64
+
+/* Upper bound (in seconds) for how long the scheduler sleeps without looking at the queue. */
+#define NOTIFICATION_MAX_WAIT 60
+
 void NotificationComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
 {
 	Dictionary::Ptr nodes = new Dictionary();
 
 	for (const NotificationComponent::Ptr& notification_component : ConfigType::GetObjectsByType<NotificationComponent>()) {
-		nodes->Set(notification_component->GetName(), 1); //add more stats
+		Dictionary::Ptr stats = new Dictionary();
+		stats->Set("idle", notification_component->GetIdleNotifications());
+		stats->Set("pending", notification_component->GetPendingNotifications());
+
+		nodes->Set(notification_component->GetName(), stats);
 	}
 
 	status->Set("notificationcomponent", nodes);
 }
 
+NotificationComponent::NotificationComponent(void)
+    : m_Stopped(false)
+{ }
+
+void NotificationComponent::OnConfigLoaded(void)
+{
+	ObjectImpl<NotificationComponent>::OnConfigLoaded();
+
+	ConfigObject::OnActiveChanged.connect(bind(&NotificationComponent::ObjectHandler, this, _1));
+	ConfigObject::OnPausedChanged.connect(bind(&NotificationComponent::ObjectHandler, this, _1));
+
+	/* Notification::OnNextNotificationChanged is the cluster event which
+	 * carries the message origin, the attribute signals live in ObjectImpl. */
+	ObjectImpl<Notification>::OnNextNotificationChanged.connect(bind(&NotificationComponent::NextNotificationChangedHandler, this, _1));
+	ObjectImpl<Notification>::OnIntervalChanged.connect(bind(&NotificationComponent::NextNotificationChangedHandler, this, _1));
+	ObjectImpl<Notification>::OnNoMoreNotificationsChanged.connect(bind(&NotificationComponent::NextNotificationChangedHandler, this, _1));
+}
+
 /**
  * Starts the component.
  */
@@ -58,10 +87,11 @@ void NotificationComponent::Start(bool runtimeCreated)
 	Checkable::OnNotificationsRequested.connect(boost::bind(&NotificationComponent::SendNotificationsHandler, this, _1,
 	    _2, _3, _4, _5));
 
-	m_NotificationTimer = new Timer();
-	m_NotificationTimer->SetInterval(5);
-	m_NotificationTimer->OnTimerExpired.connect(boost::bind(&NotificationComponent::NotificationTimerHandler, this));
-	m_NotificationTimer->Start();
+	/* pick up notifications which were activated before the component */
+	for (const Notification::Ptr& notification : ConfigType::GetObjectsByType<Notification>())
+		ObjectHandler(notification);
+
+	m_Thread = boost::thread(boost::bind(&NotificationComponent::NotificationThreadProc, this));
 }
 
 void NotificationComponent::Stop(bool runtimeRemoved)
@@ -69,72 +99,246 @@ void NotificationComponent::Stop(bool runtimeRemoved)
 	Log(LogInformation, "NotificationComponent")
 	    << "'" << GetName() << "' stopped.";
 
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_Stopped = true;
+		m_CV.notify_all();
+	}
+
+	m_Thread.join();
+
 	ObjectImpl<NotificationComponent>::Stop(runtimeRemoved);
 }
 
 /**
- * Periodically sends notifications.
- *
- * @param - Event arguments for the timer.
+ * Waits for the earliest reminder deadline and hands the due notifications
+ * to the thread pool in batches.
  */
-void NotificationComponent::NotificationTimerHandler(void)
+void NotificationComponent::NotificationThreadProc(void)
 {
-	double now = Utility::GetTime();
+	Utility::SetThreadName("Notification Scheduler");
 
-	for (const Notification::Ptr& notification : ConfigType::GetObjectsByType<Notification>()) {
-		if (!notification->IsActive())
-			continue;
+	boost::mutex::scoped_lock lock(m_Mutex);
 
-		if (notification->IsPaused() && GetEnableHA())
-			continue;
+	for (;;) {
+		typedef boost::multi_index::nth_index<NotificationSet, 1>::type NextNotificationView;
+		NextNotificationView& idx = boost::get<1>(m_IdleNotifications);
 
-		Checkable::Ptr checkable = notification->GetCheckable();
+		while (idx.begin() == idx.end() && !m_Stopped)
+			m_CV.wait(lock);
 
-		if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
-			continue;
+		if (m_Stopped)
+			break;
 
-		if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications())
-			continue;
+		double now = Utility::GetTime();
+		double wait = idx.begin()->NextNotification - now;
 
-		if (notification->GetNextNotification() > now)
-			continue;
+		if (wait > 0) {
+			/* Parked notifications have an infinite deadline, don't
+			 * let the wait overflow. */
+			if (wait > NOTIFICATION_MAX_WAIT)
+				wait = NOTIFICATION_MAX_WAIT;
 
-		bool reachable = checkable->IsReachable(DependencyNotification);
+			m_CV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000)));
 
-		{
-			ObjectLock olock(notification);
-			notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
+			continue;
 		}
 
-		{
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
+		/* Take all notifications which are due, the pending set keeps
+		 * them from being scheduled again until we're done with them. */
+		std::vector<Notification::Ptr> batch;
 
-			ObjectLock olock(checkable);
+		for (auto it = idx.begin(); it != idx.end() && it->NextNotification <= now;) {
+			batch.push_back(it->Object);
+			m_PendingNotifications.insert(*it);
+			it = idx.erase(it);
 
-			if (checkable->GetStateType() == StateTypeSoft)
-				continue;
+			if (batch.size() >= NOTIFICATION_BATCH_SIZE) {
+				Utility::QueueAsyncCallback(boost::bind(&NotificationComponent::SendRemindersHelper,
+				    NotificationComponent::Ptr(this), batch));
+				batch.clear();
+			}
+		}
 
-			if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
-				continue;
+		if (!batch.empty())
+			Utility::QueueAsyncCallback(boost::bind(&NotificationComponent::SendRemindersHelper,
+			    NotificationComponent::Ptr(this), batch));
+	}
+}
 
-			if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged())
-				continue;
-		}
+void NotificationComponent::SendRemindersHelper(const std::vector<Notification::Ptr>& batch)
+{
+	for (const Notification::Ptr& notification : batch) {
+		double notBefore;
 
 		try {
-			Log(LogNotice, "NotificationComponent")
-			    << "Attempting to send reminder notification '" << notification->GetName() << "'";
-			notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
+			notBefore = SendReminder(notification);
 		} catch (const std::exception& ex) {
 			Log(LogWarning, "NotificationComponent")
 			    << "Exception occured during notification for object '"
 			    << GetName() << "': " << DiagnosticInformation(ex);
+
+			notBefore = Utility::GetTime() + NOTIFICATION_RETRY_INTERVAL;
 		}
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		auto it = m_PendingNotifications.find(notification);
+
+		if (it == m_PendingNotifications.end())
+			continue;
+
+		m_PendingNotifications.erase(it);
+
+		if (!IsScheduled(notification))
+			continue;
+
+		NotificationScheduleInfo nsi = GetNotificationScheduleInfo(notification);
+		nsi.NextNotification = std::max(nsi.NextNotification, notBefore);
+
+		m_IdleNotifications.insert(nsi);
+		m_CV.notify_all();
 	}
 }
 
+/**
+ * Sends a reminder notification if the notification's checkable is still
+ * in a problem state.
+ *
+ * @returns The earliest time at which the notification should be looked at
+ *          again. Reminders which were skipped are retried after
+ *          NOTIFICATION_RETRY_INTERVAL at the earliest, even if the
+ *          notification's interval is shorter than that.
+ */
+double NotificationComponent::SendReminder(const Notification::Ptr& notification)
+{
+	if (!notification->IsActive())
+		return 0;
+
+	double now = Utility::GetTime();
+
+	Checkable::Ptr checkable = notification->GetCheckable();
+
+	if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
+		return now + NOTIFICATION_RETRY_INTERVAL;
+
+	if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications())
+		return 0;
+
+	if (notification->GetNextNotification() > now)
+		return 0;
+
+	bool reachable = checkable->IsReachable(DependencyNotification);
+
+	{
+		ObjectLock olock(notification);
+		notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
+	}
+
+	{
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(checkable);
+
+		ObjectLock olock(checkable);
+
+		if (checkable->GetStateType() == StateTypeSoft)
+			return now + NOTIFICATION_RETRY_INTERVAL;
+
+		if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
+			return now + NOTIFICATION_RETRY_INTERVAL;
+
+		if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged())
+			return now + NOTIFICATION_RETRY_INTERVAL;
+	}
+
+	Log(LogNotice, "NotificationComponent")
+	    << "Attempting to send reminder notification '" << notification->GetName() << "'";
+	notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
+
+	return now + NOTIFICATION_RETRY_INTERVAL;
+}
+
+/**
+ * Checks whether reminders should be sent for the notification.
+ *
+ * @threadsafety Always.
+ */
+bool NotificationComponent::IsScheduled(const Notification::Ptr& notification) const
+{
+	return notification->IsActive() && !(notification->IsPaused() && GetEnableHA());
+}
+
+void NotificationComponent::ObjectHandler(const ConfigObject::Ptr& object)
+{
+	Notification::Ptr notification = dynamic_pointer_cast<Notification>(object);
+
+	if (!notification)
+		return;
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (IsScheduled(notification)) {
+		if (m_PendingNotifications.find(notification) != m_PendingNotifications.end())
+			return;
+
+		m_IdleNotifications.insert(GetNotificationScheduleInfo(notification));
+	} else {
+		m_IdleNotifications.erase(notification);
+		m_PendingNotifications.erase(notification);
+	}
+
+	m_CV.notify_all();
+}
+
+/**
+ * Returns the deadline for the notification. Notifications which won't send
+ * any more reminders are parked until one of their attributes changes.
+ */
+NotificationScheduleInfo NotificationComponent::GetNotificationScheduleInfo(const Notification::Ptr& notification)
+{
+	NotificationScheduleInfo nsi;
+	nsi.Object = notification;
+
+	if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications())
+		nsi.NextNotification = std::numeric_limits<double>::infinity();
+	else
+		nsi.NextNotification = notification->GetNextNotification();
+
+	return nsi;
+}
+
+void NotificationComponent::NextNotificationChangedHandler(const Notification::Ptr& notification)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	/* remove and re-insert the object from the set in order to force an index update */
+	typedef boost::multi_index::nth_index<NotificationSet, 0>::type NotificationView;
+	NotificationView& idx = boost::get<0>(m_IdleNotifications);
+
+	auto it = idx.find(notification);
+
+	if (it == idx.end())
+		return;
+
+	idx.erase(it);
+	idx.insert(GetNotificationScheduleInfo(notification));
+
+	m_CV.notify_all();
+}
+
+unsigned long NotificationComponent::GetIdleNotifications(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_IdleNotifications.size();
+}
+
+unsigned long NotificationComponent::GetPendingNotifications(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_PendingNotifications.size();
+}
+
 /**
  * Processes icinga::SendNotifications messages.
  */
@@ -23,29 +23,92 @@
 #include "notification/notificationcomponent.thpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
-#include "base/timer.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/key_extractors.hpp>
 
 namespace icinga
 {
 
+/* Reminders which were skipped are looked at again after this many seconds at the earliest. */
+#define NOTIFICATION_RETRY_INTERVAL 5
+
+/**
+ * @ingroup notification
+ */
+struct NotificationScheduleInfo
+{
+	Notification::Ptr Object;
+	double NextNotification;
+};
+
+/**
+ * @ingroup notification
+ */
+struct NotificationNextNotificationExtractor
+{
+	typedef double result_type;
+
+	/**
+	 * @threadsafety Always.
+	 */
+	double operator()(const NotificationScheduleInfo& nsi) const
+	{
+		return nsi.NextNotification;
+	}
+};
+
 /**
  * @ingroup notification
  */
-class NotificationComponent : public ObjectImpl<NotificationComponent>
+class I2_NOTIFICATION_API NotificationComponent : public ObjectImpl<NotificationComponent>
 {
 public:
 	DECLARE_OBJECT(NotificationComponent);
 	DECLARE_OBJECTNAME(NotificationComponent);
 
+	typedef boost::multi_index_container<
+		NotificationScheduleInfo,
+		boost::multi_index::indexed_by<
+			boost::multi_index::ordered_unique<boost::multi_index::member<NotificationScheduleInfo, Notification::Ptr, &NotificationScheduleInfo::Object> >,
+			boost::multi_index::ordered_non_unique<NotificationNextNotificationExtractor>
+		>
+	> NotificationSet;
+
+	NotificationComponent(void);
+
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	virtual void OnConfigLoaded(void) override;
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
+	unsigned long GetIdleNotifications(void);
+	unsigned long GetPendingNotifications(void);
+
+	static double SendReminder(const Notification::Ptr& notification);
+
 private:
-	Timer::Ptr m_NotificationTimer;
+	boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	boost::thread m_Thread;
+	bool m_Stopped;
+
+	NotificationSet m_IdleNotifications;
+	NotificationSet m_PendingNotifications;
+
+	void NotificationThreadProc(void);
+	void SendRemindersHelper(const std::vector<Notification::Ptr>& batch);
+
+	bool IsScheduled(const Notification::Ptr& notification) const;
+	void ObjectHandler(const ConfigObject::Ptr& object);
+	void NextNotificationChangedHandler(const Notification::Ptr& notification);
+
+	static NotificationScheduleInfo GetNotificationScheduleInfo(const Notification::Ptr& notification);
 
-	void NotificationTimerHandler(void);
 	void SendNotificationsHandler(const Checkable::Ptr& checkable, NotificationType type,
 	    const CheckResult::Ptr& cr, const String& author, const String& text);
 };
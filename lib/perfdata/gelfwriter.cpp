@@ -30,15 +30,37 @@
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/stream.hpp"
-#include "base/networkstream.hpp"
 #include "base/json.hpp"
 #include "base/context.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/algorithm/string/replace.hpp>
 
 using namespace icinga;
 
 REGISTER_TYPE(GelfWriter);
 
+REGISTER_STATSFUNCTION(GelfWriter, &GelfWriter::StatsFunc);
+
+void GelfWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr nodes = new Dictionary();
+
+	for (const GelfWriter::Ptr& gelfwriter : ConfigType::GetObjectsByType<GelfWriter>()) {
+		if (!gelfwriter->m_Queue)
+			continue;
+
+		Dictionary::Ptr stats = gelfwriter->m_Queue->GetStats();
+		nodes->Set(gelfwriter->GetName(), stats);
+
+		String perfdata_prefix = "gelfwriter_" + gelfwriter->GetName() + "_";
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "queue_length", stats->Get("queue_length")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "dropped", stats->Get("dropped")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_flush_latency", stats->Get("avg_flush_latency")));
+	}
+
+	status->Set("gelfwriter", nodes);
+}
+
 void GelfWriter::Start(bool runtimeCreated)
 {
 	ObjectImpl<GelfWriter>::Start(runtimeCreated);
@@ -46,6 +68,15 @@ void GelfWriter::Start(bool runtimeCreated)
 	Log(LogInformation, "GelfWriter")
 	    << "'" << GetName() << "' started.";
 
+	String spoolPath;
+
+	if (GetEnableSpool())
+		spoolPath = MetricQueue::GetSpoolDir() + "gelfwriter-" + GetName();
+
+	m_Queue = new MetricQueue("GelfWriter '" + GetName() + "'", GetBufferSize(), spoolPath,
+	    boost::bind(&GelfWriter::WriteMessages, this, _1));
+	m_Queue->Start();
+
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&GelfWriter::ReconnectTimerHandler, this));
@@ -65,12 +96,14 @@ void GelfWriter::Stop(bool runtimeRemoved)
 	Log(LogInformation, "GelfWriter")
 	    << "'" << GetName() << "' stopped.";
 
+	m_Queue->Stop();
+
 	ObjectImpl<GelfWriter>::Stop(runtimeRemoved);
 }
 
 void GelfWriter::ReconnectTimerHandler(void)
 {
-	if (m_Stream)
+	if (m_Socket)
 		return;
 
 	TcpSocket::Ptr socket = new TcpSocket();
@@ -86,7 +119,7 @@ void GelfWriter::ReconnectTimerHandler(void)
 		return;
 	}
 
-	m_Stream = new NetworkStream(socket);
+	m_Socket = socket;
 }
 
 void GelfWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -275,22 +308,35 @@ void GelfWriter::SendLogMessage(const String& gelf)
 	msgbuf << gelf;
 	msgbuf << '\0';
 
-	String log = msgbuf.str();
+	m_Queue->Enqueue(msgbuf.str());
+}
 
+size_t GelfWriter::WriteMessages(const String& data)
+{
 	ObjectLock olock(this);
 
-	if (!m_Stream)
-		return;
+	if (!m_Socket)
+		return 0;
+
+	size_t written = 0;
 
 	try {
-		//TODO remove
-		Log(LogDebug, "GelfWriter")
-		    << "Sending '" << log << "'.";
-		m_Stream->Write(log.CStr(), log.GetLength());
+		while (written < data.GetLength())
+			written += m_Socket->Write(data.CStr() + written, data.GetLength() - written);
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "GelfWriter")
 		    << "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		m_Stream.reset();
+		m_Socket.reset();
 	}
+
+	return written;
+}
+
+void GelfWriter::ValidateBufferSize(int value, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::ValidateBufferSize(value, utils);
+
+	if (value <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("buffer_size"), "Value must be greater than 0."));
 }
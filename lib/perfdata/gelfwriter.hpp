@@ -21,6 +21,7 @@
 #define GELFWRITER_H
 
 #include "perfdata/gelfwriter.thpp"
+#include "perfdata/metricqueue.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
@@ -41,12 +42,17 @@ public:
 	DECLARE_OBJECT(GelfWriter);
 	DECLARE_OBJECTNAME(GelfWriter);
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+	virtual void ValidateBufferSize(int value, const ValidationUtils& utils) override;
+
 protected:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
 private:
-	Stream::Ptr m_Stream;
+	Socket::Ptr m_Socket;
+	MetricQueue::Ptr m_Queue;
 
 	Timer::Ptr m_ReconnectTimer;
 
@@ -58,6 +64,8 @@ private:
 	void StateChangeHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, StateType type);
 	void SendLogMessage(const String& gelf);
 
+	size_t WriteMessages(const String& data);
+
 	void ReconnectTimerHandler(void);
 };
 
@@ -32,7 +32,6 @@
 #include "base/utility.hpp"
 #include "base/application.hpp"
 #include "base/stream.hpp"
-#include "base/networkstream.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
@@ -46,12 +45,21 @@ REGISTER_TYPE(GraphiteWriter);
 
 REGISTER_STATSFUNCTION(GraphiteWriter, &GraphiteWriter::StatsFunc);
 
-void GraphiteWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void GraphiteWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = new Dictionary();
 
 	for (const GraphiteWriter::Ptr& graphitewriter : ConfigType::GetObjectsByType<GraphiteWriter>()) {
-		nodes->Set(graphitewriter->GetName(), 1); //add more stats
+		if (!graphitewriter->m_Queue)
+			continue;
+
+		Dictionary::Ptr stats = graphitewriter->m_Queue->GetStats();
+		nodes->Set(graphitewriter->GetName(), stats);
+
+		String perfdata_prefix = "graphitewriter_" + graphitewriter->GetName() + "_";
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "queue_length", stats->Get("queue_length")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "dropped", stats->Get("dropped")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_flush_latency", stats->Get("avg_flush_latency")));
 	}
 
 	status->Set("graphitewriter", nodes);
@@ -64,6 +72,15 @@ void GraphiteWriter::Start(bool runtimeCreated)
 	Log(LogInformation, "GraphiteWriter")
 	    << "'" << GetName() << "' started.";
 
+	String spoolPath;
+
+	if (GetEnableSpool())
+		spoolPath = MetricQueue::GetSpoolDir() + "graphitewriter-" + GetName();
+
+	m_Queue = new MetricQueue("GraphiteWriter '" + GetName() + "'", GetBufferSize(), spoolPath,
+	    boost::bind(&GraphiteWriter::WriteMessages, this, _1));
+	m_Queue->Start();
+
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&GraphiteWriter::ReconnectTimerHandler, this));
@@ -78,12 +95,14 @@ void GraphiteWriter::Stop(bool runtimeRemoved)
 	Log(LogInformation, "GraphiteWriter")
 	    << "'" << GetName() << "' stopped.";
 
+	m_Queue->Stop();
+
 	ObjectImpl<GraphiteWriter>::Stop(runtimeRemoved);
 }
 
 void GraphiteWriter::ReconnectTimerHandler(void)
 {
-	if (m_Stream)
+	if (m_Socket)
 		return;
 
 	TcpSocket::Ptr socket = new TcpSocket();
@@ -99,7 +118,7 @@ void GraphiteWriter::ReconnectTimerHandler(void)
 		return;
 	}
 
-	m_Stream = new NetworkStream(socket);
+	m_Socket = socket;
 }
 
 void GraphiteWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -244,21 +263,30 @@ void GraphiteWriter::SendMetric(const String& prefix, const String& name, double
 
 	// do not send \n to debug log
 	msgbuf << "\n";
-	String metric = msgbuf.str();
 
+	m_Queue->Enqueue(msgbuf.str());
+}
+
+size_t GraphiteWriter::WriteMessages(const String& data)
+{
 	ObjectLock olock(this);
 
-	if (!m_Stream)
-		return;
+	if (!m_Socket)
+		return 0;
+
+	size_t written = 0;
 
 	try {
-		m_Stream->Write(metric.CStr(), metric.GetLength());
+		while (written < data.GetLength())
+			written += m_Socket->Write(data.CStr() + written, data.GetLength() - written);
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "GraphiteWriter")
 		    << "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		m_Stream.reset();
+		m_Socket.reset();
 	}
+
+	return written;
 }
 
 String GraphiteWriter::EscapeMetric(const String& str, bool legacyMode)
@@ -321,3 +349,11 @@ void GraphiteWriter::ValidateServiceNameTemplate(const String& value, const Vali
 	if (!MacroProcessor::ValidateMacroString(value))
 		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("service_name_template"), "Closing $ not found in macro format string '" + value + "'."));
 }
+
+void GraphiteWriter::ValidateBufferSize(int value, const ValidationUtils& utils)
+{
+	ObjectImpl<GraphiteWriter>::ValidateBufferSize(value, utils);
+
+	if (value <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("buffer_size"), "Value must be greater than 0."));
+}
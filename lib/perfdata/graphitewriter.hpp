@@ -21,6 +21,7 @@
 #define GRAPHITEWRITER_H
 
 #include "perfdata/graphitewriter.thpp"
+#include "perfdata/metricqueue.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
@@ -45,13 +46,15 @@ public:
 
 	virtual void ValidateHostNameTemplate(const String& value, const ValidationUtils& utils) override;
 	virtual void ValidateServiceNameTemplate(const String& value, const ValidationUtils& utils) override;
+	virtual void ValidateBufferSize(int value, const ValidationUtils& utils) override;
 
 protected:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
 private:
-	Stream::Ptr m_Stream;
+	Socket::Ptr m_Socket;
+	MetricQueue::Ptr m_Queue;
 
 	Timer::Ptr m_ReconnectTimer;
 
@@ -62,6 +65,8 @@ private:
 	static String EscapeMetricLabel(const String& str);
 	static Value EscapeMacroMetric(const Value& value, bool legacyMode = false);
 
+	size_t WriteMessages(const String& data);
+
 	void ReconnectTimerHandler(void);
 };
 
@@ -29,9 +29,9 @@
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/stream.hpp"
-#include "base/networkstream.hpp"
 #include "base/json.hpp"
 #include "base/context.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <string>
@@ -40,10 +40,41 @@ using namespace icinga;
 
 REGISTER_TYPE(LogstashWriter);
 
+REGISTER_STATSFUNCTION(LogstashWriter, &LogstashWriter::StatsFunc);
+
+void LogstashWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr nodes = new Dictionary();
+
+	for (const LogstashWriter::Ptr& logstashwriter : ConfigType::GetObjectsByType<LogstashWriter>()) {
+		if (!logstashwriter->m_Queue)
+			continue;
+
+		Dictionary::Ptr stats = logstashwriter->m_Queue->GetStats();
+		nodes->Set(logstashwriter->GetName(), stats);
+
+		String perfdata_prefix = "logstashwriter_" + logstashwriter->GetName() + "_";
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "queue_length", stats->Get("queue_length")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "dropped", stats->Get("dropped")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_flush_latency", stats->Get("avg_flush_latency")));
+	}
+
+	status->Set("logstashwriter", nodes);
+}
+
 void LogstashWriter::Start(bool runtimeCreated)
 {
 	ObjectImpl<LogstashWriter>::Start(runtimeCreated);
 
+	String spoolPath;
+
+	if (GetEnableSpool())
+		spoolPath = MetricQueue::GetSpoolDir() + "logstashwriter-" + GetName();
+
+	m_Queue = new MetricQueue("LogstashWriter '" + GetName() + "'", GetBufferSize(), spoolPath,
+	    boost::bind(&LogstashWriter::WriteMessages, this, _1), GetSocketType() == "tcp");
+	m_Queue->Start();
+
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&LogstashWriter::ReconnectTimerHandler, this));
@@ -58,9 +89,16 @@ void LogstashWriter::Start(bool runtimeCreated)
 	Service::OnStateChange.connect(boost::bind(&LogstashWriter::StateChangeHandler, this, _1, _2, _3));
 }
 
+void LogstashWriter::Stop(bool runtimeRemoved)
+{
+	m_Queue->Stop();
+
+	ObjectImpl<LogstashWriter>::Stop(runtimeRemoved);
+}
+
 void LogstashWriter::ReconnectTimerHandler(void)
 {
- 	if (m_Stream)
+ 	if (m_Socket)
 		return;
 
 	Socket::Ptr socket;
@@ -81,7 +119,7 @@ void LogstashWriter::ReconnectTimerHandler(void)
 		return;
 	}
 
-	m_Stream = new NetworkStream(socket);
+	m_Socket = socket;
 }
 
 void LogstashWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -270,20 +308,30 @@ String LogstashWriter::ComposeLogstashMessage(const Dictionary::Ptr& fields, con
 
 void LogstashWriter::SendLogMessage(const String& message)
 {
-        ObjectLock olock(this);
+	m_Queue->Enqueue(message);
+}
+
+size_t LogstashWriter::WriteMessages(const String& data)
+{
+	ObjectLock olock(this);
 
-        if (!m_Stream)
-                return;
+	if (!m_Socket)
+		return 0;
 
-        try {
-		m_Stream->Write(&message[0], message.GetLength());
-        } catch (const std::exception& ex) {
-                Log(LogCritical, "LogstashWriter")
+	size_t written = 0;
+
+	try {
+		while (written < data.GetLength())
+			written += m_Socket->Write(data.CStr() + written, data.GetLength() - written);
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "LogstashWriter")
 		    << "Cannot write to " << GetSocketType()
 		    << " socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-                m_Stream.reset();
-        }
+		m_Socket.reset();
+	}
+
+	return written;
 }
 
 String LogstashWriter::EscapeMetricLabel(const String& str)
@@ -305,3 +353,11 @@ void LogstashWriter::ValidateSocketType(const String& value, const ValidationUti
 	if (value != "udp" && value != "tcp")
 		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("socket_type"), "Socket type '" + value + "' is invalid."));
 }
+
+void LogstashWriter::ValidateBufferSize(int value, const ValidationUtils& utils)
+{
+	ObjectImpl<LogstashWriter>::ValidateBufferSize(value, utils);
+
+	if (value <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("buffer_size"), "Value must be greater than 0."));
+}
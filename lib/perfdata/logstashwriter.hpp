@@ -21,6 +21,7 @@
 #define LOGSTASHWRITER_H
 
 #include "perfdata/logstashwriter.thpp"
+#include "perfdata/metricqueue.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
@@ -44,13 +45,18 @@ public:
 	DECLARE_OBJECT(LogstashWriter);
 	DECLARE_OBJECTNAME(LogstashWriter);
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 	virtual void ValidateSocketType(const String& value, const ValidationUtils& utils) override;
+	virtual void ValidateBufferSize(int value, const ValidationUtils& utils) override;
 
 protected:
 	virtual void Start(bool runtimeCreated) override;
+	virtual void Stop(bool runtimeRemoved) override;
 
 private:
-	Stream::Ptr m_Stream;
+	Socket::Ptr m_Socket;
+	MetricQueue::Ptr m_Queue;
 
 	Timer::Ptr m_ReconnectTimer;
 
@@ -64,6 +70,8 @@ private:
 
 	static String EscapeMetricLabel(const String& str);
 
+	size_t WriteMessages(const String& data);
+
 	void ReconnectTimerHandler(void);
 };
 
@@ -0,0 +1,389 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "perfdata/metricqueue.hpp"
+#include "base/netstring.hpp"
+#include "base/stdiostream.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include "base/exception.hpp"
+#include "base/application.hpp"
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+#define METRICQUEUE_MAX_BATCH_SIZE (64 * 1024)
+
+/**
+ * Constructor for the MetricQueue class.
+ *
+ * @param name The name which is used for log messages and the flush thread.
+ * @param capacity The maximum number of messages held in memory.
+ * @param spoolPath The spool file for messages which don't fit into the
+ *		    queue. Messages are dropped if this is empty.
+ * @param callback The function which writes the messages.
+ * @param combineMessages Whether multiple messages may be passed to the
+ *			  callback at once, e.g. not for datagram sockets.
+ */
+MetricQueue::MetricQueue(const String& name, size_t capacity, const String& spoolPath,
+    const WriteCallback& callback, bool combineMessages)
+	: m_Name(name), m_SpoolPath(spoolPath), m_Callback(callback),
+	  m_MaxBatchSize(combineMessages ? METRICQUEUE_MAX_BATCH_SIZE : 0), m_Stopped(true),
+	  m_Items(capacity > 0 ? capacity : 1), m_Head(0), m_Count(0), m_SpoolLength(0),
+	  m_Written(0), m_Dropped(0), m_Spooled(0), m_Flushes(0), m_FlushTime(0), m_LastFlushTime(0)
+{ }
+
+MetricQueue::~MetricQueue(void)
+{
+	Stop();
+}
+
+void MetricQueue::Start(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (!m_Stopped)
+		return;
+
+	m_Stopped = false;
+
+	if (!m_SpoolPath.IsEmpty()) {
+		Utility::MkDirP(Utility::DirName(m_SpoolPath), 0750);
+
+		/* Pick up messages which were spooled before a restart. */
+		if (Utility::PathExists(m_SpoolPath) || Utility::PathExists(m_SpoolPath + ".replay"))
+			m_SpoolLength = 1;
+	}
+
+	m_Thread = boost::thread(boost::bind(&MetricQueue::FlushThreadProc, this));
+}
+
+/**
+ * Stops the flush thread. Messages which are still queued are moved to
+ * the spool file if spooling is enabled.
+ */
+void MetricQueue::Stop(void)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (m_Stopped)
+			return;
+
+		m_Stopped = true;
+		m_CV.notify_all();
+	}
+
+	m_Thread.join();
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	size_t count = m_Count;
+
+	while (m_Count > 0) {
+		String& message = m_Items[m_Head];
+
+		if (!m_SpoolPath.IsEmpty())
+			SpoolMessage(message);
+		else
+			m_Dropped++;
+
+		message = String();
+		m_Head = (m_Head + 1) % m_Items.size();
+		m_Count--;
+	}
+
+	if (m_SpoolFile.is_open())
+		m_SpoolFile.close();
+
+	if (count > 0) {
+		Log(LogWarning, "MetricQueue")
+		    << "'" << m_Name << "' stopped with " << count << " queued messages which were "
+		    << (m_SpoolPath.IsEmpty() ? "dropped." : "spooled.");
+	}
+}
+
+/**
+ * Adds a message to the queue. This never blocks on the network.
+ *
+ * @param message The message, including its terminator.
+ */
+void MetricQueue::Enqueue(const String& message)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Count >= m_Items.size()) {
+		if (!m_SpoolPath.IsEmpty())
+			SpoolMessage(message);
+		else
+			m_Dropped++;
+
+		return;
+	}
+
+	m_Items[(m_Head + m_Count) % m_Items.size()] = message;
+	m_Count++;
+
+	if (m_Count == 1)
+		m_CV.notify_all();
+}
+
+/**
+ * Note: Caller must hold m_Mutex.
+ */
+void MetricQueue::SpoolMessage(const String& message)
+{
+	if (!m_SpoolFile.is_open()) {
+		m_SpoolFile.open(m_SpoolPath.CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+
+		if (!m_SpoolFile) {
+			m_Dropped++;
+			return;
+		}
+	}
+
+	NetString::WriteStringToStream(m_SpoolFile, message);
+
+	m_SpoolLength++;
+	m_Spooled++;
+}
+
+String MetricQueue::GetSpoolDir(void)
+{
+	return Application::GetLocalStateDir() + "/lib/icinga2/spool/";
+}
+
+size_t MetricQueue::GetLength(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	return m_Count;
+}
+
+Dictionary::Ptr MetricQueue::GetStats(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	Dictionary::Ptr stats = new Dictionary();
+	stats->Set("queue_length", m_Count);
+	stats->Set("queue_capacity", m_Items.size());
+	stats->Set("written", m_Written);
+	stats->Set("dropped", m_Dropped);
+	stats->Set("spooled", m_Spooled);
+	stats->Set("flushes", m_Flushes);
+	stats->Set("avg_flush_latency", m_Flushes > 0 ? m_FlushTime / m_Flushes : 0);
+	stats->Set("last_flush_latency", m_LastFlushTime);
+
+	return stats;
+}
+
+void MetricQueue::FlushThreadProc(void)
+{
+	Utility::SetThreadName(m_Name + " Flush");
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	for (;;) {
+		while (m_Count == 0 && m_SpoolLength == 0 && !m_Stopped)
+			m_CV.wait(lock);
+
+		if (m_Stopped)
+			break;
+
+		if (m_Count == 0) {
+			lock.unlock();
+			ReplaySpool();
+			lock.lock();
+
+			/* Replay failed, try again later. */
+			if (m_SpoolLength > 0 && m_Count == 0 && !m_Stopped)
+				m_CV.timed_wait(lock, boost::posix_time::seconds(5));
+
+			continue;
+		}
+
+		/* Combine as many messages as possible into a single write. The
+		 * messages stay in the queue until they have been written. */
+		String data;
+		size_t count = 0;
+
+		do {
+			data += m_Items[(m_Head + count) % m_Items.size()];
+			count++;
+		} while (count < m_Count && data.GetLength() < m_MaxBatchSize);
+
+		lock.unlock();
+
+		double start = Utility::GetTime();
+		size_t written = CallWriteCallback(data);
+		double latency = Utility::GetTime() - start;
+
+		lock.lock();
+
+		/* Only remove the messages which were written completely. A message
+		 * which was cut off is sent again in full once the writer has
+		 * reconnected. */
+		size_t done = 0;
+
+		while (done < count && m_Items[m_Head].GetLength() <= written) {
+			written -= m_Items[m_Head].GetLength();
+			m_Items[m_Head] = String();
+			m_Head = (m_Head + 1) % m_Items.size();
+			done++;
+		}
+
+		m_Count -= done;
+		m_Written += done;
+
+		if (done < count) {
+			/* Not connected, wait for the writer to reconnect. */
+			if (!m_Stopped)
+				m_CV.timed_wait(lock, boost::posix_time::seconds(1));
+
+			continue;
+		}
+
+		m_Flushes++;
+		m_FlushTime += latency;
+		m_LastFlushTime = latency;
+	}
+}
+
+/**
+ * Passes a batch of messages to the write callback.
+ *
+ * @returns The number of bytes which were written.
+ */
+size_t MetricQueue::CallWriteCallback(const String& data)
+{
+	try {
+		return m_Callback(data);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "MetricQueue")
+		    << "Exception while writing messages for '" << m_Name << "': " << DiagnosticInformation(ex);
+		return 0;
+	}
+}
+
+/**
+ * Sends the spooled messages. Messages which could not be sent are kept
+ * in the replay file.
+ */
+void MetricQueue::ReplaySpool(void)
+{
+	String replayPath = m_SpoolPath + ".replay";
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (!Utility::PathExists(replayPath)) {
+			if (m_SpoolFile.is_open())
+				m_SpoolFile.close();
+
+			if (Utility::PathExists(m_SpoolPath) && rename(m_SpoolPath.CStr(), replayPath.CStr()) < 0) {
+				Log(LogCritical, "MetricQueue")
+				    << "Cannot rename spool file '" << m_SpoolPath << "' for '" << m_Name << "'.";
+				return;
+			}
+		}
+
+		m_SpoolLength = 0;
+	}
+
+	if (!Utility::PathExists(replayPath))
+		return;
+
+	std::fstream fp;
+	fp.open(replayPath.CStr(), std::ios_base::in | std::ios_base::binary);
+
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+
+	std::vector<String> remaining;
+	std::vector<String> batch;
+	size_t batchSize = 0;
+	size_t sent = 0;
+
+	String message;
+	StreamReadContext src;
+
+	for (;;) {
+		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+		if (srs == StatusNewItem) {
+			/* Once a write has failed we keep the rest of the file. */
+			if (!remaining.empty()) {
+				remaining.push_back(message);
+				continue;
+			}
+
+			batch.push_back(message);
+			batchSize += message.GetLength();
+		}
+
+		if (srs == StatusEof || (!batch.empty() && batchSize >= m_MaxBatchSize)) {
+			if (!batch.empty()) {
+				String data;
+
+				for (const String& item : batch)
+					data += item;
+
+				size_t written = CallWriteCallback(data);
+				std::vector<String>::iterator it = batch.begin();
+
+				while (it != batch.end() && it->GetLength() <= written) {
+					written -= it->GetLength();
+					++it;
+					sent++;
+				}
+
+				remaining.insert(remaining.end(), it, batch.end());
+
+				batch.clear();
+				batchSize = 0;
+			}
+		}
+
+		if (srs == StatusEof)
+			break;
+	}
+
+	sfp->Close();
+	fp.close();
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_Written += sent;
+
+	if (remaining.empty()) {
+		(void) unlink(replayPath.CStr());
+
+		Log(LogInformation, "MetricQueue")
+		    << "Replayed " << sent << " spooled messages for '" << m_Name << "'.";
+
+		return;
+	}
+
+	std::ofstream rfp(replayPath.CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+
+	for (const String& item : remaining)
+		NetString::WriteStringToStream(rfp, item);
+
+	m_SpoolLength += remaining.size();
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef METRICQUEUE_H
+#define METRICQUEUE_H
+
+#include "base/object.hpp"
+#include "base/dictionary.hpp"
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <fstream>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A bounded queue which decouples the perfdata writers from the threads
+ * that process check results. Messages are written by a dedicated thread
+ * which combines as many queued messages as possible into a single write.
+ *
+ * When the queue is full new messages are either dropped or appended to
+ * a spool file which is replayed once the queue has been drained.
+ *
+ * @ingroup perfdata
+ */
+class MetricQueue : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MetricQueue);
+
+	/**
+	 * Writes a batch of messages. Returns the number of bytes which were
+	 * written; if this is less than the length of the batch the remaining
+	 * messages are retried later.
+	 */
+	typedef boost::function<size_t (const String& data)> WriteCallback;
+
+	MetricQueue(const String& name, size_t capacity, const String& spoolPath,
+	    const WriteCallback& callback, bool combineMessages = true);
+	~MetricQueue(void);
+
+	void Start(void);
+	void Stop(void);
+
+	void Enqueue(const String& message);
+
+	size_t GetLength(void) const;
+	Dictionary::Ptr GetStats(void) const;
+
+	static String GetSpoolDir(void);
+
+private:
+	String m_Name;
+	String m_SpoolPath;
+	WriteCallback m_Callback;
+	size_t m_MaxBatchSize;
+
+	mutable boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	boost::thread m_Thread;
+	bool m_Stopped;
+
+	std::vector<String> m_Items;
+	size_t m_Head;
+	size_t m_Count;
+
+	std::ofstream m_SpoolFile;
+	size_t m_SpoolLength;
+
+	unsigned long long m_Written;
+	unsigned long long m_Dropped;
+	unsigned long long m_Spooled;
+	unsigned long long m_Flushes;
+	double m_FlushTime;
+	double m_LastFlushTime;
+
+	size_t CallWriteCallback(const String& data);
+	void FlushThreadProc(void);
+	void ReplaySpool(void);
+	void SpoolMessage(const String& message);
+};
+
+}
+
+#endif /* METRICQUEUE_H */
@@ -32,7 +32,6 @@
 #include "base/utility.hpp"
 #include "base/application.hpp"
 #include "base/stream.hpp"
-#include "base/networkstream.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
@@ -46,12 +45,21 @@ REGISTER_TYPE(OpenTsdbWriter);
 
 REGISTER_STATSFUNCTION(OpenTsdbWriter, &OpenTsdbWriter::StatsFunc);
 
-void OpenTsdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void OpenTsdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = new Dictionary();
 
 	for (const OpenTsdbWriter::Ptr& opentsdbwriter : ConfigType::GetObjectsByType<OpenTsdbWriter>()) {
-		nodes->Set(opentsdbwriter->GetName(), 1); //add more stats
+		if (!opentsdbwriter->m_Queue)
+			continue;
+
+		Dictionary::Ptr stats = opentsdbwriter->m_Queue->GetStats();
+		nodes->Set(opentsdbwriter->GetName(), stats);
+
+		String perfdata_prefix = "opentsdbwriter_" + opentsdbwriter->GetName() + "_";
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "queue_length", stats->Get("queue_length")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "dropped", stats->Get("dropped")));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_flush_latency", stats->Get("avg_flush_latency")));
 	}
 
 	status->Set("opentsdbwriter", nodes);
@@ -64,6 +72,15 @@ void OpenTsdbWriter::Start(bool runtimeCreated)
 	Log(LogInformation, "OpentsdbWriter")
 	    << "'" << GetName() << "' started.";
 
+	String spoolPath;
+
+	if (GetEnableSpool())
+		spoolPath = MetricQueue::GetSpoolDir() + "opentsdbwriter-" + GetName();
+
+	m_Queue = new MetricQueue("OpenTsdbWriter '" + GetName() + "'", GetBufferSize(), spoolPath,
+	    boost::bind(&OpenTsdbWriter::WriteMessages, this, _1));
+	m_Queue->Start();
+
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&OpenTsdbWriter::ReconnectTimerHandler, this));
@@ -78,12 +95,14 @@ void OpenTsdbWriter::Stop(bool runtimeRemoved)
 	Log(LogInformation, "OpentsdbWriter")
 	    << "'" << GetName() << "' stopped.";
 
+	m_Queue->Stop();
+
 	ObjectImpl<OpenTsdbWriter>::Stop(runtimeRemoved);
 }
 
 void OpenTsdbWriter::ReconnectTimerHandler(void)
 {
-	if (m_Stream)
+	if (m_Socket)
 		return;
 
 	TcpSocket::Ptr socket = new TcpSocket();
@@ -99,7 +118,7 @@ void OpenTsdbWriter::ReconnectTimerHandler(void)
 		return;
 	}
 
-	m_Stream = new NetworkStream(socket);
+	m_Socket = socket;
 }
 
 void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -219,21 +238,30 @@ void OpenTsdbWriter::SendMetric(const String& metric, const std::map<String, Str
 
 	/* do not send \n to debug log */
 	msgbuf << "\n";
-	String put = msgbuf.str();
 
+	m_Queue->Enqueue(msgbuf.str());
+}
+
+size_t OpenTsdbWriter::WriteMessages(const String& data)
+{
 	ObjectLock olock(this);
 
-	if (!m_Stream)
-		return;
+	if (!m_Socket)
+		return 0;
+
+	size_t written = 0;
 
 	try {
-		m_Stream->Write(put.CStr(), put.GetLength());
+		while (written < data.GetLength())
+			written += m_Socket->Write(data.CStr() + written, data.GetLength() - written);
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "OpenTsdbWriter")
-			<< "Cannot write to OpenTSDB TSD on host '" << GetHost() << "' port '" << GetPort() + "'.";
+		    << "Cannot write to OpenTSDB TSD on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		m_Stream.reset();
+		m_Socket.reset();
 	}
+
+	return written;
 }
 
 /* for metric and tag name rules, see
@@ -259,3 +287,11 @@ String OpenTsdbWriter::EscapeMetric(const String& str)
 
 	return result;
 }
+
+void OpenTsdbWriter::ValidateBufferSize(int value, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTsdbWriter>::ValidateBufferSize(value, utils);
+
+	if (value <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, boost::assign::list_of("buffer_size"), "Value must be greater than 0."));
+}
@@ -21,6 +21,7 @@
 #define OPENTSDBWRITER_H
 
 #include "perfdata/opentsdbwriter.thpp"
+#include "perfdata/metricqueue.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
@@ -43,12 +44,15 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	virtual void ValidateBufferSize(int value, const ValidationUtils& utils) override;
+
 protected:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
 private:
-	Stream::Ptr m_Stream;
+	Socket::Ptr m_Socket;
+	MetricQueue::Ptr m_Queue;
 
 	Timer::Ptr m_ReconnectTimer;
 
@@ -58,6 +62,8 @@ private:
 	static String EscapeTag(const String& str);
 	static String EscapeMetric(const String& str);
 
+	size_t WriteMessages(const String& data);
+
 	void ReconnectTimerHandler(void);
 };
 
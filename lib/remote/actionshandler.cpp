@@ -19,6 +19,7 @@
 
 #include "remote/actionshandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresultwriter.hpp"
 #include "remote/filterutility.hpp"
 #include "remote/apiaction.hpp"
 #include "base/exception.hpp"
@@ -72,29 +73,28 @@ bool ActionsHandler::HandleRequest(const ApiUser::Ptr& user, HttpRequest& reques
 		objs.push_back(ConfigObject::Ptr());
 	}
 
-	Array::Ptr results = new Array();
+	/* Results are sent as soon as each action has been invoked, bulk
+	 * requests with thousands of targets (e.g. process-check-result)
+	 * would otherwise keep all of them in memory until the end. */
+	HttpResultWriter writer(response);
 
 	Log(LogNotice, "ApiActionHandler")
 	    << "Running action " << actionName;
 
 	for (const ConfigObject::Ptr& obj : objs) {
 		try {
-			results->Add(action->Invoke(obj, params));
+			writer.Add(action->Invoke(obj, params));
 		} catch (const std::exception& ex) {
 			Dictionary::Ptr fail = new Dictionary();
 			fail->Set("code", 500);
 			fail->Set("status", "Action execution failed: '" + DiagnosticInformation(ex, false) + "'.");
 			if (HttpUtility::GetLastParameter(params, "verboseErrors"))
 				fail->Set("diagnostic information", DiagnosticInformation(ex));
-			results->Add(fail);
+			writer.Add(fail);
 		}
 	}
 
-	Dictionary::Ptr result = new Dictionary();
-	result->Set("results", results);
-
-	response.SetStatus(200, "OK");
-	HttpUtility::SendJsonBody(response, result);
+	writer.Finish();
 
 	return true;
 }
@@ -0,0 +1,169 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/apilistener.hpp"
+#include "remote/jsonrpcconnection.hpp"
+#include "base/objectlock.hpp"
+#include "base/logger.hpp"
+
+using namespace icinga;
+
+/* method -> methods whose queued messages it replaces */
+static std::map<String, std::set<String> > l_CoalesceSupersedes;
+static std::set<String> l_CoalesceMethods;
+
+/**
+ * Registers a method whose queued messages for an object are replaced by
+ * a later message for the same object. Must be called during initialization.
+ *
+ * @param method The method of the new message.
+ * @param supersededMethod The method of the queued messages which can be dropped.
+ */
+void ApiListener::RegisterSupersededMethod(const String& method, const String& supersededMethod)
+{
+	l_CoalesceSupersedes[method].insert(supersededMethod);
+	l_CoalesceMethods.insert(supersededMethod);
+}
+
+String ApiListener::GetCoalesceKey(const String& method, const Dictionary::Ptr& message)
+{
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params)
+		return String();
+
+	String host = params->Get("host");
+
+	if (host.IsEmpty())
+		return String();
+
+	return method + "\n" + host + "!" + params->Get("service") + "!" + params->Get("notification");
+}
+
+void ApiListener::CoalesceMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, const BufferRange& json)
+{
+	String method = message->Get("method");
+
+	boost::mutex::scoped_lock lock(m_CoalesceMutex);
+
+	CoalesceQueue& queue = m_CoalesceQueues[endpoint];
+
+	std::map<String, std::set<String> >::const_iterator rule = l_CoalesceSupersedes.find(method);
+
+	if (rule != l_CoalesceSupersedes.end()) {
+		for (const String& supersededMethod : rule->second) {
+			String key = GetCoalesceKey(supersededMethod, message);
+
+			if (key.IsEmpty())
+				continue;
+
+			std::map<String, size_t>::iterator it = queue.Latest.find(key);
+
+			if (it == queue.Latest.end())
+				continue;
+
+			queue.Messages[it->second] = std::make_pair(Dictionary::Ptr(), BufferRange());
+			queue.Latest.erase(it);
+			m_CoalesceSuperseded++;
+		}
+	}
+
+	queue.Messages.push_back(std::make_pair(message, json));
+
+	if (l_CoalesceMethods.find(method) != l_CoalesceMethods.end()) {
+		String key = GetCoalesceKey(method, message);
+
+		if (!key.IsEmpty())
+			queue.Latest[key] = queue.Messages.size() - 1;
+	}
+}
+
+void ApiListener::CoalesceTimerHandler(void)
+{
+	std::map<Endpoint::Ptr, CoalesceQueue> queues;
+
+	{
+		boost::mutex::scoped_lock lock(m_CoalesceMutex);
+		queues.swap(m_CoalesceQueues);
+	}
+
+	typedef std::map<Endpoint::Ptr, CoalesceQueue>::value_type QueuePair;
+	for (const QueuePair& kv : queues)
+		FlushCoalesceQueue(kv.first, kv.second);
+}
+
+void ApiListener::FlushCoalesceQueue(const Endpoint::Ptr& endpoint, const CoalesceQueue& queue)
+{
+	std::vector<BufferRange> messages;
+
+	typedef std::pair<Dictionary::Ptr, BufferRange> MessagePair;
+	for (const MessagePair& kv : queue.Messages) {
+		if (kv.first)
+			messages.push_back(kv.second);
+	}
+
+	if (messages.empty())
+		return;
+
+	ObjectLock olock(endpoint);
+
+	if (endpoint->GetSyncing())
+		return;
+
+	Log(LogNotice, "ApiListener")
+	    << "Sending " << messages.size() << " coalesced message(s) to '" << endpoint->GetName() << "'";
+
+	/* the messages are already encoded, the envelope is put around them as-is */
+	BufferRange batch;
+	size_t frames = 0;
+
+	for (const JsonRpcConnection::Ptr& client : GetSendClients(endpoint)) {
+		if (messages.size() > 1 && (client->GetCapabilities() & ApiCapabilityBatch)) {
+			if (!batch.Segment) {
+				String envelope = "{\"jsonrpc\":\"2.0\",\"method\":\"icinga::Batch\",\"params\":{\"messages\":[";
+
+				for (std::vector<BufferRange>::size_type i = 0; i < messages.size(); i++) {
+					if (i > 0)
+						envelope += ",";
+
+					envelope += String(messages[i].GetData(), messages[i].GetData() + messages[i].Length);
+				}
+
+				envelope += "]}}";
+
+				batch = BufferRange::FromString(envelope);
+			}
+
+			client->SendRawMessage(batch);
+			frames++;
+		} else {
+			for (const BufferRange& json : messages)
+				client->SendRawMessage(json);
+
+			frames += messages.size();
+		}
+	}
+
+	if (frames == 0)
+		return;
+
+	boost::mutex::scoped_lock lock(m_CoalesceMutex);
+	m_CoalesceMessages += queue.Messages.size();
+	m_CoalesceFrames += frames;
+}
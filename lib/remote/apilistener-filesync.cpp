@@ -24,13 +24,30 @@
 #include "base/logger.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
 #include <fstream>
 #include <iomanip>
+#include <sys/stat.h>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(Update, config, &ApiListener::ConfigUpdateHandler);
 
+static String ReadConfigFile(const String& path)
+{
+	std::ifstream fp(path.CStr(), std::ifstream::binary);
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open file '" + path + "'."));
+
+	return String((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+}
+
+static void ConfigManifestGlobHandler(std::vector<String>& files, const String& file)
+{
+	files.push_back(file);
+}
+
 void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String& path, const String& file)
 {
 	CONTEXT("Creating config update for file '" + file + "'");
@@ -76,6 +93,135 @@ ConfigDirInformation ApiListener::LoadConfigDir(const String& dir)
 	return config;
 }
 
+/**
+ * Calculates the SHA256 hashes for all files in a zone's API config
+ * directory. The hashes are cached on disk and are only recalculated
+ * for files whose size or modification time has changed.
+ *
+ * @param zoneName The name of the zone.
+ * @returns A dictionary which maps the files' relative paths to their hashes.
+ */
+Dictionary::Ptr ApiListener::LoadConfigManifest(const String& zoneName)
+{
+	String dir = Application::GetLocalStateDir() + "/lib/icinga2/api/zones/" + zoneName;
+	String cacheDir = Application::GetLocalStateDir() + "/lib/icinga2/api/checksums";
+	String cachePath = cacheDir + "/" + zoneName + ".json";
+
+	Dictionary::Ptr cache;
+	double cacheTimestamp = 0;
+
+	if (Utility::PathExists(cachePath)) {
+		try {
+			Dictionary::Ptr cacheData = Utility::LoadJsonFile(cachePath);
+			cache = cacheData->Get("files");
+			cacheTimestamp = cacheData->Get("timestamp");
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+			    << "Ignoring invalid checksum cache '" << cachePath << "': " << DiagnosticInformation(ex, false);
+			cache.reset();
+		}
+	}
+
+	std::vector<String> paths;
+
+	if (Utility::PathExists(dir))
+		Utility::GlobRecursive(dir, "*", boost::bind(&ConfigManifestGlobHandler, boost::ref(paths), _1), GlobFile);
+
+	Dictionary::Ptr manifest = new Dictionary();
+	Dictionary::Ptr files = new Dictionary();
+	bool changed = !cache;
+	double now = Utility::GetTime();
+
+	for (const String& path : paths) {
+		struct stat statbuf;
+
+		if (stat(path.CStr(), &statbuf) < 0)
+			continue;
+
+		String relPath = path.SubStr(dir.GetLength());
+		Array::Ptr entry;
+
+		if (cache)
+			entry = cache->Get(relPath);
+
+		/* Files which were modified right before the cache was written might
+		 * have been changed again without changing their modification time. */
+		bool valid = entry && entry->GetLength() == 3
+		    && static_cast<double>(entry->Get(0)) == statbuf.st_size
+		    && static_cast<double>(entry->Get(1)) == statbuf.st_mtime
+		    && statbuf.st_mtime < cacheTimestamp - 1;
+
+		if (!valid) {
+			String content;
+
+			try {
+				content = ReadConfigFile(path);
+			} catch (const std::exception&) {
+				continue;
+			}
+
+			entry = new Array();
+			entry->Add(statbuf.st_size);
+			entry->Add(statbuf.st_mtime);
+			entry->Add(SHA256(content));
+
+			changed = true;
+		}
+
+		manifest->Set(relPath, entry->Get(2));
+		files->Set(relPath, entry);
+	}
+
+	if (cache && cache->GetLength() != files->GetLength())
+		changed = true;
+
+	if (changed) {
+		Dictionary::Ptr cacheData = new Dictionary();
+		cacheData->Set("timestamp", now);
+		cacheData->Set("files", files);
+
+		try {
+			Utility::MkDirP(cacheDir, 0700);
+			Utility::SaveJsonFile(cachePath, 0600, cacheData);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+			    << "Could not write checksum cache '" << cachePath << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	return manifest;
+}
+
+/**
+ * Writes a config file. The content is written to a temporary file first
+ * which then replaces the file, so readers never see partially written files.
+ *
+ * @param path The path.
+ * @param content The new content.
+ */
+void ApiListener::WriteConfigFile(const String& path, const String& content)
+{
+	Utility::MkDirP(Utility::DirName(path), 0755);
+
+	std::fstream fp;
+	String tempFilename = Utility::CreateTempFile(path + ".XXXXXX", 0644, fp);
+
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	fp << content;
+	fp.close();
+
+#ifdef _WIN32
+	_unlink(path.CStr());
+#endif /* _WIN32 */
+
+	if (rename(tempFilename.CStr(), path.CStr()) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("rename")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(tempFilename));
+	}
+}
+
 bool ApiListener::UpdateConfigDir(const ConfigDirInformation& oldConfigInfo, const ConfigDirInformation& newConfigInfo, const String& configDir, bool authoritative)
 {
 	bool configChange = false;
@@ -112,11 +258,7 @@ bool ApiListener::UpdateConfigDir(const ConfigDirInformation& oldConfigInfo, con
 				Log(LogInformation, "ApiListener")
 				    << "Updating configuration file: " << path;
 
-				//pass the directory and generate a dir tree, if not existing already
-				Utility::MkDirP(Utility::DirName(path), 0755);
-				std::ofstream fp(path.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::trunc);
-				fp << kv.second;
-				fp.close();
+				WriteConfigFile(path, kv.second);
 			}
 		}
 	}
@@ -133,9 +275,9 @@ bool ApiListener::UpdateConfigDir(const ConfigDirInformation& oldConfigInfo, con
 
 	String tsPath = configDir + "/.timestamp";
 	if (!Utility::PathExists(tsPath)) {
-		std::ofstream fp(tsPath.CStr(), std::ofstream::out | std::ostream::trunc);
-		fp << std::fixed << newTimestamp;
-		fp.close();
+		std::ostringstream msgbuf;
+		msgbuf << std::fixed << newTimestamp;
+		WriteConfigFile(tsPath, msgbuf.str());
 	}
 
 	if (authoritative) {
@@ -213,8 +355,15 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 	if (!azone->IsChildOf(lzone))
 		return;
 
+	/* Peers which support it sent the hashes of their files in their
+	 * icinga::Hello message and only get the files which have changed. */
+	bool manifestSync = (aclient->GetCapabilities() & ApiCapabilityConfigSync);
+	Dictionary::Ptr peerManifests = aclient->GetConfigManifest();
+
+	Dictionary::Ptr manifests = new Dictionary();
 	Dictionary::Ptr configUpdateV1 = new Dictionary();
 	Dictionary::Ptr configUpdateV2 = new Dictionary();
+	size_t count = 0;
 
 	String zonesDir = Application::GetLocalStateDir() + "/lib/icinga2/api/zones";
 
@@ -227,19 +376,92 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 		if (!Utility::PathExists(zoneDir))
 			continue;
 
+		if (!manifestSync) {
+			Log(LogInformation, "ApiListener")
+			    << "Syncing configuration files for " << (zone->IsGlobal() ? "global " : "")
+			    << "zone '" << zone->GetName() << "' to endpoint '" << endpoint->GetName() << "'.";
+
+			ConfigDirInformation config = LoadConfigDir(zoneDir);
+			configUpdateV1->Set(zone->GetName(), config.UpdateV1);
+			configUpdateV2->Set(zone->GetName(), config.UpdateV2);
+			continue;
+		}
+
+		Dictionary::Ptr manifest = LoadConfigManifest(zone->GetName());
+		Dictionary::Ptr peerManifest;
+
+		if (peerManifests)
+			peerManifest = peerManifests->Get(zone->GetName());
+
+		Dictionary::Ptr filesV1 = new Dictionary();
+		Dictionary::Ptr filesV2 = new Dictionary();
+		bool changed = false;
+
+		{
+			ObjectLock mlock(manifest);
+			for (const Dictionary::Pair& kv : manifest) {
+				if (peerManifest && peerManifest->Get(kv.first) == kv.second)
+					continue;
+
+				changed = true;
+
+				String content;
+
+				try {
+					content = ReadConfigFile(zoneDir + kv.first);
+				} catch (const std::exception&) {
+					continue;
+				}
+
+				if (Utility::Match("*.conf", kv.first))
+					filesV1->Set(kv.first, content);
+				else
+					filesV2->Set(kv.first, content);
+
+				count++;
+			}
+		}
+
+		if (!changed && peerManifest) {
+			/* files which have been removed */
+			ObjectLock plock(peerManifest);
+			for (const Dictionary::Pair& kv : peerManifest) {
+				if (!manifest->Contains(kv.first)) {
+					changed = true;
+					break;
+				}
+			}
+		}
+
+		if (!changed)
+			continue;
+
 		Log(LogInformation, "ApiListener")
 		    << "Syncing configuration files for " << (zone->IsGlobal() ? "global " : "")
 		    << "zone '" << zone->GetName() << "' to endpoint '" << endpoint->GetName() << "'.";
 
-		ConfigDirInformation config = LoadConfigDir(zonesDir + "/" + zone->GetName());
-		configUpdateV1->Set(zone->GetName(), config.UpdateV1);
-		configUpdateV2->Set(zone->GetName(), config.UpdateV2);
+		configUpdateV1->Set(zone->GetName(), filesV1);
+		configUpdateV2->Set(zone->GetName(), filesV2);
+		manifests->Set(zone->GetName(), manifest);
 	}
 
 	Dictionary::Ptr params = new Dictionary();
 	params->Set("update", configUpdateV1);
 	params->Set("update_v2", configUpdateV2);
 
+	if (manifestSync) {
+		if (manifests->GetLength() == 0) {
+			Log(LogInformation, "ApiListener")
+			    << "Configuration files for endpoint '" << endpoint->GetName() << "' are up to date.";
+			return;
+		}
+
+		Log(LogInformation, "ApiListener")
+		    << "Sending " << count << " changed configuration files to endpoint '" << endpoint->GetName() << "'.";
+
+		params->Set("manifest", manifests);
+	}
+
 	Dictionary::Ptr message = new Dictionary();
 	message->Set("jsonrpc", "2.0");
 	message->Set("method", "config::Update");
@@ -248,58 +470,152 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 	aclient->SendMessage(message);
 }
 
-Value ApiListener::ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+/**
+ * Returns the hashes of the config files we have received from the specified
+ * parent endpoint's zones, so it only has to send the files which have
+ * changed.
+ *
+ * @param endpoint The parent endpoint.
+ * @returns The hashes per zone, or an empty value if we don't accept config
+ *          from the endpoint.
+ */
+Dictionary::Ptr ApiListener::MakeConfigManifest(const Endpoint::Ptr& endpoint)
+{
+	if (!endpoint)
+		return Dictionary::Ptr();
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener || !listener->GetAcceptConfig())
+		return Dictionary::Ptr();
+
+	Zone::Ptr lzone = Zone::GetLocalZone();
+
+	if (!lzone || !lzone->IsChildOf(endpoint->GetZone()))
+		return Dictionary::Ptr();
+
+	Dictionary::Ptr manifests = new Dictionary();
+
+	String zonesDir = Application::GetLocalStateDir() + "/lib/icinga2/api/zones";
+
+	for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
+		if (!Utility::PathExists(zonesDir + "/" + zone->GetName()))
+			continue;
+
+		if (ConfigCompiler::HasZoneConfigAuthority(zone->GetName()))
+			continue;
+
+		manifests->Set(zone->GetName(), LoadConfigManifest(zone->GetName()));
+	}
+
+	return manifests;
+}
+
+static bool CanAcceptConfigUpdate(const MessageOrigin::Ptr& origin)
 {
 	if (!origin->FromClient->GetEndpoint() || (origin->FromZone && !Zone::GetLocalZone()->IsChildOf(origin->FromZone)))
-		return Empty;
+		return false;
 
 	ApiListener::Ptr listener = ApiListener::GetInstance();
 
 	if (!listener) {
 		Log(LogCritical, "ApiListener", "No instance available.");
-		return Empty;
+		return false;
 	}
 
 	if (!listener->GetAcceptConfig()) {
 		Log(LogWarning, "ApiListener")
 		    << "Ignoring config update. '" << listener->GetName() << "' does not accept config.";
-		return Empty;
+		return false;
 	}
 
+	return true;
+}
+
+static bool CanUpdateZoneConfig(const String& zoneName)
+{
+	if (!Zone::GetByName(zoneName)) {
+		Log(LogWarning, "ApiListener")
+		    << "Ignoring config update for unknown zone '" << zoneName << "'.";
+		return false;
+	}
+
+	if (ConfigCompiler::HasZoneConfigAuthority(zoneName)) {
+		Log(LogWarning, "ApiListener")
+		    << "Ignoring config update for zone '" << zoneName << "' because we have an authoritative version of the zone's config.";
+		return false;
+	}
+
+	return true;
+}
+
+Value ApiListener::ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	if (!CanAcceptConfigUpdate(origin))
+		return Empty;
+
 	Dictionary::Ptr updateV1 = params->Get("update");
 	Dictionary::Ptr updateV2 = params->Get("update_v2");
 
-	bool configChange = false;
+	/* Incremental updates only contain the files which have changed, the
+	 * manifest lists all files the zone is supposed to have. */
+	Dictionary::Ptr manifests = params->Get("manifest");
 
-	ObjectLock olock(updateV1);
-	for (const Dictionary::Pair& kv : updateV1) {
-		Zone::Ptr zone = Zone::GetByName(kv.first);
+	bool configChange = false;
 
-		if (!zone) {
-			Log(LogWarning, "ApiListener")
-			    << "Ignoring config update for unknown zone '" << kv.first << "'.";
-			continue;
-		}
+	Dictionary::Ptr zones = manifests ? manifests : updateV1;
 
-		if (ConfigCompiler::HasZoneConfigAuthority(kv.first)) {
-			Log(LogWarning, "ApiListener")
-			    << "Ignoring config update for zone '" << kv.first << "' because we have an authoritative version of the zone's config.";
+	ObjectLock olock(zones);
+	for (const Dictionary::Pair& kv : zones) {
+		if (!CanUpdateZoneConfig(kv.first))
 			continue;
-		}
 
-		String oldDir = Application::GetLocalStateDir() + "/lib/icinga2/api/zones/" + zone->GetName();
+		String oldDir = Application::GetLocalStateDir() + "/lib/icinga2/api/zones/" + kv.first;
 
 		Utility::MkDirP(oldDir, 0700);
 
 		ConfigDirInformation newConfigInfo;
-		newConfigInfo.UpdateV1 = kv.second;
+
+		if (updateV1)
+			newConfigInfo.UpdateV1 = updateV1->Get(kv.first);
 
 		if (updateV2)
 			newConfigInfo.UpdateV2 = updateV2->Get(kv.first);
 
-		Dictionary::Ptr newConfig = kv.second;
 		ConfigDirInformation oldConfigInfo = LoadConfigDir(oldDir);
 
+		if (manifests) {
+			if (!newConfigInfo.UpdateV1)
+				newConfigInfo.UpdateV1 = new Dictionary();
+
+			if (!newConfigInfo.UpdateV2)
+				newConfigInfo.UpdateV2 = new Dictionary();
+
+			Dictionary::Ptr manifest = kv.second;
+			Dictionary::Ptr oldConfig = MergeConfigUpdate(oldConfigInfo);
+
+			ObjectLock mlock(manifest);
+			for (const Dictionary::Pair& kvf : manifest) {
+				if (newConfigInfo.UpdateV1->Contains(kvf.first) || newConfigInfo.UpdateV2->Contains(kvf.first))
+					continue;
+
+				/* unchanged file, keep our copy */
+				if (!oldConfig->Contains(kvf.first)) {
+					Log(LogWarning, "ApiListener")
+					    << "Configuration file '" << kvf.first << "' for zone '" << kv.first << "' is missing in the incremental config update.";
+					continue;
+				}
+
+				if (Utility::Match("*.conf", kvf.first))
+					newConfigInfo.UpdateV1->Set(kvf.first, oldConfig->Get(kvf.first));
+				else
+					newConfigInfo.UpdateV2->Set(kvf.first, oldConfig->Get(kvf.first));
+			}
+		}
+
+		if (!newConfigInfo.UpdateV1)
+			continue;
+
 		if (UpdateConfigDir(oldConfigInfo, newConfigInfo, oldDir, false))
 			configChange = true;
 	}
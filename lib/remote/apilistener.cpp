@@ -38,6 +38,23 @@
 
 using namespace icinga;
 
+/* number of threads which accept new connections and perform TLS handshakes */
+#define API_HANDSHAKE_WORKERS 32
+#define API_HANDSHAKE_TIMEOUT 10
+#define API_CONNECT_WORKERS 32
+#define API_TICKET_KEY_INTERVAL 3600
+
+/* how often the reconnect timer checks for endpoints which need a connection */
+#define API_RECONNECT_CHECK_INTERVAL 5
+/* the delay between failed connection attempts doubles until it reaches the maximum */
+#define API_RECONNECT_MIN_DELAY 5
+#define API_RECONNECT_MAX_DELAY 60
+/* connections which were lost are re-established after a random delay of up to this many seconds */
+#define API_RECONNECT_SPLAY 15
+/* how long to wait for the peer's icinga::Hello message before new connections
+ * are synced without knowing the peer's capabilities */
+#define API_HELLO_TIMEOUT 5
+
 REGISTER_TYPE(ApiListener);
 
 boost::signals2::signal<void(bool)> ApiListener::OnMasterChanged;
@@ -48,10 +65,23 @@ REGISTER_STATSFUNCTION(ApiListener, &ApiListener::StatsFunc);
 REGISTER_APIFUNCTION(Hello, icinga, &ApiListener::HelloAPIHandler);
 
 ApiListener::ApiListener(void)
-	: m_SyncQueue(0, 4), m_LogMessageCount(0)
+	: m_SyncQueue(0, 4), m_HandshakeQueue(0, API_HANDSHAKE_WORKERS),
+	  m_ConnectQueue(0, API_CONNECT_WORKERS), m_LastReconnectLog(0), m_LogMessageCount(0), m_CoalesceMessages(0),
+	  m_CoalesceSuperseded(0), m_CoalesceFrames(0)
 {
-	m_RelayQueue.SetName("ApiListener, RelayQueue");
+	m_RelayQueueCount = Application::GetConcurrency();
+	m_RelayQueues = new WorkQueue[m_RelayQueueCount];
+
+	for (size_t i = 0; i < m_RelayQueueCount; i++)
+		m_RelayQueues[i].SetName("ApiListener, RelayQueue #" + Convert::ToString(i));
+
 	m_SyncQueue.SetName("ApiListener, SyncQueue");
+	m_HandshakeQueue.SetName("ApiListener, HandshakeQueue");
+	m_ConnectQueue.SetName("ApiListener, ConnectQueue");
+
+	m_Handshakes = new RingBuffer(60);
+	m_ResumedHandshakes = new RingBuffer(60);
+	m_HandshakeLatency = new RingBuffer(60);
 }
 
 void ApiListener::OnConfigLoaded(void)
@@ -140,6 +170,8 @@ void ApiListener::Start(bool runtimeCreated)
 		OpenLogFile();
 	}
 
+	UpdateTicketKeys();
+
 	/* create the primary JSON-RPC listener */
 	if (!AddListener(GetBindHost(), GetBindPort())) {
 		Log(LogCritical, "ApiListener")
@@ -155,7 +187,7 @@ void ApiListener::Start(bool runtimeCreated)
 
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&ApiListener::ApiReconnectTimerHandler, this));
-	m_ReconnectTimer->SetInterval(60);
+	m_ReconnectTimer->SetInterval(API_RECONNECT_CHECK_INTERVAL);
 	m_ReconnectTimer->Start();
 	m_ReconnectTimer->Reschedule(0);
 
@@ -164,6 +196,24 @@ void ApiListener::Start(bool runtimeCreated)
 	m_AuthorityTimer->SetInterval(30);
 	m_AuthorityTimer->Start();
 
+	/* the key file is only replaced once the keys have expired */
+	m_TicketKeyTimer = new Timer();
+	m_TicketKeyTimer->OnTimerExpired.connect(boost::bind(&ApiListener::UpdateTicketKeys, this));
+	m_TicketKeyTimer->SetInterval(API_TICKET_KEY_INTERVAL);
+	m_TicketKeyTimer->Start();
+
+	m_HelloTimer = new Timer();
+	m_HelloTimer->OnTimerExpired.connect(boost::bind(&ApiListener::HelloTimerHandler, this));
+	m_HelloTimer->SetInterval(1);
+	m_HelloTimer->Start();
+
+	if (GetRelayCoalesceWindow() > 0) {
+		m_CoalesceTimer = new Timer();
+		m_CoalesceTimer->OnTimerExpired.connect(boost::bind(&ApiListener::CoalesceTimerHandler, this));
+		m_CoalesceTimer->SetInterval(GetRelayCoalesceWindow());
+		m_CoalesceTimer->Start();
+	}
+
 	OnMasterChanged(true);
 }
 
@@ -174,6 +224,11 @@ void ApiListener::Stop(bool runtimeDeleted)
 	Log(LogInformation, "ApiListener")
 	    << "'" << GetName() << "' stopped.";
 
+	if (m_CoalesceTimer) {
+		m_CoalesceTimer->Stop();
+		CoalesceTimerHandler();
+	}
+
 	boost::mutex::scoped_lock lock(m_LogLock);
 	CloseLogFile();
 }
@@ -263,14 +318,27 @@ void ApiListener::ListenerThreadProc(const Socket::Ptr& server)
 	for (;;) {
 		try {
 			Socket::Ptr client = server->Accept();
-			boost::thread thread(boost::bind(&ApiListener::NewClientHandler, this, client, String(), RoleServer));
-			thread.detach();
+			m_HandshakeQueue.Enqueue(boost::bind(&ApiListener::NewClientHandler, this, client, String(), RoleServer));
 		} catch (const std::exception&) {
 			Log(LogCritical, "ApiListener", "Cannot accept new connection.");
 		}
 	}
 }
 
+/**
+ * Loads the session ticket keys. They are persisted so that clients can
+ * resume their sessions after a restart, and replaced once they've expired.
+ */
+void ApiListener::UpdateTicketKeys(void)
+{
+	try {
+		SetTicketKeysToSSLContext(m_SSLContext, GetApiDir() + "ticket.key");
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+		    << "Cannot set TLS session ticket keys: " << DiagnosticInformation(ex, false);
+	}
+}
+
 /**
  * Creates a new JSON-RPC client and connects to the specified endpoint.
  *
@@ -285,6 +353,7 @@ void ApiListener::AddConnection(const Endpoint::Ptr& endpoint)
 
 		if (!sslContext) {
 			Log(LogCritical, "ApiListener", "SSL context is required for AddConnection()");
+			endpoint->SetConnecting(false);
 			return;
 		}
 	}
@@ -312,6 +381,55 @@ void ApiListener::AddConnection(const Endpoint::Ptr& endpoint)
 		Log(LogDebug, "ApiListener")
 		    << info.str() << "\n" << DiagnosticInformation(ex);
 	}
+
+	ScheduleReconnect(endpoint, endpoint->GetConnected());
+}
+
+/**
+ * Determines when the next connection attempt for an endpoint is made. The
+ * delay after failed attempts grows exponentially and is randomized so that
+ * nodes which lost their connections at the same time don't reconnect at the
+ * same time.
+ *
+ * @param endpoint The endpoint.
+ * @param connected Whether the last attempt was successful.
+ */
+void ApiListener::ScheduleReconnect(const Endpoint::Ptr& endpoint, bool connected)
+{
+	boost::mutex::scoped_lock lock(m_ReconnectMutex);
+
+	ReconnectState& state = m_ReconnectStates[endpoint];
+
+	if (connected) {
+		state.Failures = 0;
+		state.Connected = true;
+		return;
+	}
+
+	state.Failures++;
+
+	double delay = API_RECONNECT_MAX_DELAY;
+
+	if (state.Failures < 5)
+		delay = std::min<double>(delay, API_RECONNECT_MIN_DELAY * (1 << (state.Failures - 1)));
+
+	state.NextAttempt = Utility::GetTime() + delay / 2 + GetReconnectJitter(endpoint, delay / 2);
+}
+
+/**
+ * Returns a random delay for connection attempts. The local identity is mixed
+ * into the random number because the random number generator is seeded with
+ * the current time, which is the same on all nodes that start at once.
+ *
+ * @param endpoint The endpoint.
+ * @param max The maximum delay.
+ * @returns The delay.
+ */
+double ApiListener::GetReconnectJitter(const Endpoint::Ptr& endpoint, double max) const
+{
+	unsigned long random = Utility::Random() ^ Utility::SDBM(GetIdentity() + "!" + endpoint->GetName());
+
+	return (random % 1000) / 1000.0 * max;
 }
 
 void ApiListener::NewClientHandler(const Socket::Ptr& client, const String& hostname, ConnectionRole role)
@@ -355,14 +473,26 @@ void ApiListener::NewClientHandlerInternal(const Socket::Ptr& client, const Stri
 		}
 	}
 
+	double handshakeStart = Utility::GetTime();
+
 	try {
-		tlsStream->Handshake();
+		tlsStream->Handshake(API_HANDSHAKE_TIMEOUT);
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "ApiListener")
 		    << "Client TLS handshake failed (" << conninfo << ")";
 		return;
 	}
 
+	{
+		double now = Utility::GetTime();
+
+		m_Handshakes->InsertValue(now, 1);
+		m_HandshakeLatency->InsertValue(now, (now - handshakeStart) * 1000);
+
+		if (tlsStream->IsSessionReused())
+			m_ResumedHandshakes->InsertValue(now, 1);
+	}
+
 	boost::shared_ptr<X509> cert = tlsStream->GetPeerCertificate();
 	String identity;
 	Endpoint::Ptr endpoint;
@@ -413,11 +543,7 @@ void ApiListener::NewClientHandlerInternal(const Socket::Ptr& client, const Stri
 	ClientType ctype;
 
 	if (role == RoleClient) {
-		Dictionary::Ptr message = new Dictionary();
-		message->Set("jsonrpc", "2.0");
-		message->Set("method", "icinga::Hello");
-		message->Set("params", new Dictionary());
-		JsonRpc::SendMessage(tlsStream, message);
+		JsonRpc::SendMessage(tlsStream, MakeHelloMessage(endpoint));
 		ctype = ClientJsonRpc;
 	} else {
 		tlsStream->WaitForData(5);
@@ -448,7 +574,7 @@ void ApiListener::NewClientHandlerInternal(const Socket::Ptr& client, const Stri
 
 			endpoint->AddClient(aclient);
 
-			m_SyncQueue.Enqueue(boost::bind(&ApiListener::SyncClient, this, aclient, endpoint, needSync));
+			ScheduleSyncClient(aclient, endpoint, needSync);
 		} else
 			AddAnonymousClient(aclient);
 	} else {
@@ -460,15 +586,69 @@ void ApiListener::NewClientHandlerInternal(const Socket::Ptr& client, const Stri
 	}
 }
 
-void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync)
+/**
+ * Syncs a new connection once the peer's icinga::Hello message has been
+ * processed, so that the config sync can use the peer's capabilities. Peers
+ * which don't send a hello message are synced after API_HELLO_TIMEOUT.
+ */
+void ApiListener::ScheduleSyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync)
 {
-	try {
-		{
-			ObjectLock olock(endpoint);
+	/* new messages go to the replay log until the endpoint has been synced */
+	{
+		ObjectLock olock(endpoint);
+
+		endpoint->SetSyncing(true);
+	}
+
+	boost::mutex::scoped_lock lock(m_PendingSyncsMutex);
+
+	if (aclient->HasCapabilities()) {
+		m_SyncQueue.Enqueue(boost::bind(&ApiListener::SyncClient, this, aclient, endpoint, needSync));
+		return;
+	}
 
-			endpoint->SetSyncing(true);
+	PendingSync& sync = m_PendingSyncs[aclient];
+	sync.Peer = endpoint;
+	sync.NeedSync = needSync;
+	sync.Deadline = Utility::GetTime() + API_HELLO_TIMEOUT;
+}
+
+void ApiListener::StartSyncClient(const JsonRpcConnection::Ptr& aclient)
+{
+	boost::mutex::scoped_lock lock(m_PendingSyncsMutex);
+
+	std::map<JsonRpcConnection::Ptr, PendingSync>::iterator it = m_PendingSyncs.find(aclient);
+
+	if (it == m_PendingSyncs.end())
+		return;
+
+	m_SyncQueue.Enqueue(boost::bind(&ApiListener::SyncClient, this, aclient, it->second.Peer, it->second.NeedSync));
+	m_PendingSyncs.erase(it);
+}
+
+void ApiListener::HelloTimerHandler(void)
+{
+	double now = Utility::GetTime();
+
+	boost::mutex::scoped_lock lock(m_PendingSyncsMutex);
+
+	for (std::map<JsonRpcConnection::Ptr, PendingSync>::iterator it = m_PendingSyncs.begin(); it != m_PendingSyncs.end(); ) {
+		if (it->second.Deadline > now) {
+			++it;
+			continue;
 		}
 
+		Log(LogNotice, "ApiListener")
+		    << "No hello message received from endpoint '" << it->second.Peer->GetName() << "', syncing without its capabilities.";
+
+		m_SyncQueue.Enqueue(boost::bind(&ApiListener::SyncClient, this, it->first, it->second.Peer, it->second.NeedSync));
+		m_PendingSyncs.erase(it++);
+	}
+}
+
+void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync)
+{
+	try {
 		/* Make sure that the config updates are synced
 		 * before the logs are replayed.
 		 */
@@ -582,6 +762,7 @@ void ApiListener::ApiTimerHandler(void)
 void ApiListener::ApiReconnectTimerHandler(void)
 {
 	Zone::Ptr my_zone = Zone::GetLocalZone();
+	double now = Utility::GetTime();
 
 	for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
 		/* don't connect to global zones */
@@ -620,19 +801,48 @@ void ApiListener::ApiReconnectTimerHandler(void)
 				continue;
 			}
 
+			boost::mutex::scoped_lock lock(m_ReconnectMutex);
+
+			ReconnectState& state = m_ReconnectStates[endpoint];
+
 			/* don't try to connect if we're already connected */
 			if (endpoint->GetConnected()) {
 				Log(LogDebug, "ApiListener")
 				    << "Not connecting to Endpoint '" << endpoint->GetName()
 				    << "' because we're already connected to it.";
+
+				state.Connected = true;
 				continue;
 			}
 
-			boost::thread thread(boost::bind(&ApiListener::AddConnection, this, endpoint));
-			thread.detach();
+			/* spread out reconnects after a connection was lost */
+			if (state.Connected) {
+				state.Connected = false;
+				state.NextAttempt = now + GetReconnectJitter(endpoint, API_RECONNECT_SPLAY);
+			}
+
+			if (state.NextAttempt > now) {
+				Log(LogDebug, "ApiListener")
+				    << "Not connecting to Endpoint '" << endpoint->GetName()
+				    << "' before " << Utility::FormatDateTime("%Y/%m/%d %H:%M:%S", state.NextAttempt) << ".";
+				continue;
+			}
+
+			/* set here rather than in AddConnection(), the attempt might have to wait for a free connect worker */
+			endpoint->SetConnecting(true);
+
+			/* Outgoing connects block until the TCP connect times out. They
+			 * have their own workers so that unreachable endpoints can't hold
+			 * up the handshakes for incoming connections. */
+			m_ConnectQueue.Enqueue(boost::bind(&ApiListener::AddConnection, this, endpoint));
 		}
 	}
 
+	if (now < m_LastReconnectLog + 60)
+		return;
+
+	m_LastReconnectLog = now;
+
 	Endpoint::Ptr master = GetMaster();
 
 	if (master)
@@ -654,30 +864,51 @@ void ApiListener::RelayMessage(const MessageOrigin::Ptr& origin,
 	if (!IsActive())
 		return;
 
-	m_RelayQueue.Enqueue(boost::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log), PriorityNormal, true);
+	Zone::Ptr target_zone;
+
+	if (secobj) {
+		if (secobj->GetReflectionType() == Zone::TypeInstance)
+			target_zone = static_pointer_cast<Zone>(secobj);
+		else
+			target_zone = static_pointer_cast<Zone>(secobj->GetZone());
+	}
+
+	if (!target_zone)
+		target_zone = Zone::GetLocalZone();
+
+	/* messages for the same zone are relayed in order */
+	size_t index = Utility::SDBM(target_zone->GetName()) % m_RelayQueueCount;
+
+	m_RelayQueues[index].Enqueue(boost::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, target_zone, message, log), PriorityNormal, true);
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj)
+/* must hold m_RelayMutex so that the log is written in timestamp order */
+void ApiListener::PersistMessage(double ts, const String& json, const ConfigObject::Ptr& secobj)
 {
-	double ts = message->Get("ts");
-
 	ASSERT(ts != 0);
 
-	Dictionary::Ptr pmessage = new Dictionary();
-	pmessage->Set("timestamp", ts);
-
-	pmessage->Set("message", JsonEncode(message));
+	/* determine the zone for Zone::CanAccessObject() now so that replaying
+	 * the log doesn't have to look up the object for each message */
+	String zone;
 
 	if (secobj) {
-		Dictionary::Ptr secname = new Dictionary();
-		secname->Set("type", secobj->GetReflectionType()->GetName());
-		secname->Set("name", secobj->GetName());
-		pmessage->Set("secobj", secname);
+		Zone::Ptr objectZone;
+
+		if (secobj->GetReflectionType() == Zone::TypeInstance)
+			objectZone = static_pointer_cast<Zone>(secobj);
+		else
+			objectZone = static_pointer_cast<Zone>(secobj->GetZone());
+
+		if (!objectZone)
+			objectZone = Zone::GetLocalZone();
+
+		if (objectZone)
+			zone = objectZone->GetName();
 	}
 
 	boost::mutex::scoped_lock lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
+		m_LogFile->Write(ts, zone, json);
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
@@ -689,31 +920,51 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 	}
 }
 
+/* must hold the endpoint's lock */
+std::vector<JsonRpcConnection::Ptr> ApiListener::GetSendClients(const Endpoint::Ptr& endpoint)
+{
+	double maxTs = 0;
+
+	for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+		if (client->GetTimestamp() > maxTs)
+			maxTs = client->GetTimestamp();
+	}
+
+	std::vector<JsonRpcConnection::Ptr> clients;
+
+	for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+		if (client->GetTimestamp() == maxTs)
+			clients.push_back(client);
+	}
+
+	return clients;
+}
+
 void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
 {
+	SendEncodedMessage(endpoint, message, BufferRange::FromString(JsonEncode(message)));
+}
+
+void ApiListener::SendEncodedMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, const BufferRange& json)
+{
+	if (m_CoalesceTimer) {
+		CoalesceMessage(endpoint, message, json);
+		return;
+	}
+
 	ObjectLock olock(endpoint);
 
 	if (!endpoint->GetSyncing()) {
 		Log(LogNotice, "ApiListener")
 		    << "Sending message '" << message->Get("method") << "' to '" << endpoint->GetName() << "'";
 
-		double maxTs = 0;
-
-		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
-			if (client->GetTimestamp() > maxTs)
-				maxTs = client->GetTimestamp();
-		}
-
-		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
-			if (client->GetTimestamp() != maxTs)
-				continue;
-
-			client->SendMessage(message);
-		}
+		for (const JsonRpcConnection::Ptr& client : GetSendClients(endpoint))
+			client->SendRawMessage(json);
 	}
 }
 
-bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentMaster)
+bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Endpoint::Ptr& currentMaster,
+    std::set<Endpoint::Ptr>& relayEndpoints, std::set<Endpoint::Ptr>& skippedEndpoints)
 {
 	ASSERT(targetZone);
 
@@ -729,8 +980,6 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 	Endpoint::Ptr myEndpoint = GetLocalEndpoint();
 
-	std::vector<Endpoint::Ptr> skippedEndpoints;
-
 	bool relayed = false, log_needed = false, log_done = false;
 
 	std::set<Endpoint::Ptr> targetEndpoints;
@@ -768,78 +1017,87 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 		/* don't relay the message to the zone through more than one endpoint unless this is our own zone */
 		if (relayed && targetZone != myZone) {
-			skippedEndpoints.push_back(endpoint);
+			skippedEndpoints.insert(endpoint);
 			continue;
 		}
 
 		/* don't relay messages back to the endpoint which we got the message from */
 		if (origin && origin->FromClient && endpoint == origin->FromClient->GetEndpoint()) {
-			skippedEndpoints.push_back(endpoint);
+			skippedEndpoints.insert(endpoint);
 			continue;
 		}
 
 		/* don't relay messages back to the zone which we got the message from */
 		if (origin && origin->FromZone && targetZone == origin->FromZone) {
-			skippedEndpoints.push_back(endpoint);
+			skippedEndpoints.insert(endpoint);
 			continue;
 		}
 
 		/* only relay message to the master if we're not currently the master */
 		if (currentMaster != myEndpoint && currentMaster != endpoint) {
-			skippedEndpoints.push_back(endpoint);
+			skippedEndpoints.insert(endpoint);
 			continue;
 		}
 
 		relayed = true;
 
-		SyncSendMessage(endpoint, message);
-	}
-
-	if (!skippedEndpoints.empty()) {
-		double ts = message->Get("ts");
-
-		for (const Endpoint::Ptr& endpoint : skippedEndpoints)
-			endpoint->SetLocalLogPosition(ts);
+		relayEndpoints.insert(endpoint);
 	}
 
 	return !log_needed || log_done;
 }
 
 void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
-    const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log)
+    const ConfigObject::Ptr& secobj, const Zone::Ptr& target_zone, const Dictionary::Ptr& message, bool log)
 {
-	double ts = Utility::GetTime();
-	message->Set("ts", ts);
-
 	Log(LogNotice, "ApiListener")
 	    << "Relaying '" << message->Get("method") << "' message";
 
 	if (origin && origin->FromZone)
 		message->Set("originZone", origin->FromZone->GetName());
 
-	Zone::Ptr target_zone;
+	Endpoint::Ptr master = GetMaster();
 
-	if (secobj) {
-		if (secobj->GetReflectionType() == Zone::TypeInstance)
-			target_zone = static_pointer_cast<Zone>(secobj);
-		else
-			target_zone = static_pointer_cast<Zone>(secobj->GetZone());
+	std::set<Endpoint::Ptr> relayEndpoints, skippedEndpoints;
+
+	bool need_log = !RelayMessageOne(target_zone, origin, master, relayEndpoints, skippedEndpoints);
+
+	for (const Zone::Ptr& zone : target_zone->GetAllParents()) {
+		if (!RelayMessageOne(zone, origin, master, relayEndpoints, skippedEndpoints))
+			need_log = true;
 	}
 
-	if (!target_zone)
-		target_zone = Zone::GetLocalZone();
+	need_log = log && need_log;
 
-	Endpoint::Ptr master = GetMaster();
+	if (relayEndpoints.empty() && skippedEndpoints.empty() && !need_log)
+		return;
 
-	bool need_log = !RelayMessageOne(target_zone, origin, message, master);
+	/* The message is encoded once for all endpoints. Receivers ignore messages
+	 * which are older than the last one they've seen so the timestamp is
+	 * added while holding m_RelayMutex. */
+	message->Remove("ts");
+	String body = JsonEncode(message);
 
-	for (const Zone::Ptr& zone : target_zone->GetAllParents()) {
-		if (!RelayMessageOne(zone, origin, message, master))
-			need_log = true;
+	boost::mutex::scoped_lock lock(m_RelayMutex);
+
+	double ts = Utility::GetTime();
+	message->Set("ts", ts);
+
+	String json = "{\"ts\":" + JsonEncode(ts) + "," + body.SubStr(1);
+
+	if (!relayEndpoints.empty()) {
+		/* all connections share the same buffer */
+		BufferRange range = BufferRange::FromString(json);
+
+		for (const Endpoint::Ptr& endpoint : relayEndpoints)
+			SendEncodedMessage(endpoint, message, range);
 	}
 
-	if (log && need_log)
-		PersistMessage(message, secobj);
+	for (const Endpoint::Ptr& endpoint : skippedEndpoints)
+		endpoint->SetLocalLogPosition(ts);
+
+	if (need_log)
+		PersistMessage(ts, json, secobj);
 }
 
 String ApiListener::GetApiDir(void)
@@ -854,15 +1112,22 @@ void ApiListener::OpenLogFile(void)
 
 	Utility::MkDirP(Utility::DirName(path), 0750);
 
-	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::ofstream::app);
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::fstream::binary | std::ofstream::app);
 
 	if (!fp->good()) {
 		Log(LogWarning, "ApiListener")
 		    << "Could not open spool file: " << path;
+		delete fp;
 		return;
 	}
 
-	m_LogFile = new StdioStream(fp, true);
+	struct stat statbuf;
+	uint64_t size = 0;
+
+	if (stat(path.CStr(), &statbuf) >= 0)
+		size = statbuf.st_size;
+
+	m_LogFile = new ReplayLogWriter(new StdioStream(fp, true), size);
 	m_LogMessageCount = 0;
 	SetLogMessageTimestamp(Utility::GetTime());
 }
@@ -908,6 +1173,122 @@ void ApiListener::LogGlobHandler(std::vector<int>& files, const String& file)
 	files.push_back(ts);
 }
 
+/**
+ * Replays a log segment which was written by an older version.
+ *
+ * @returns false if the replay was stopped because the peer is too slow,
+ *	    see ReplayMessage().
+ */
+bool ApiListener::ReplayLegacyLog(const JsonRpcConnection::Ptr& client, const String& path, int ts,
+    const Zone::Ptr& target_zone, double& peer_ts, double& logpos_ts, int& count, bool locked)
+{
+	bool completed = true;
+
+	Endpoint::Ptr endpoint = client->GetEndpoint();
+
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in | std::fstream::binary);
+	StdioStream::Ptr logStream = new StdioStream(fp, true);
+
+	String message;
+	StreamReadContext src;
+	while (true) {
+		Dictionary::Ptr pmessage;
+
+		try {
+			StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			pmessage = JsonDecode(message);
+		} catch (const std::exception&) {
+			Log(LogWarning, "ApiListener")
+			    << "Unexpected end-of-file for cluster log: " << path;
+
+			/* Log files may be incomplete or corrupted. This is perfectly OK. */
+			break;
+		}
+
+		if (pmessage->Get("timestamp") <= peer_ts)
+			continue;
+
+		Dictionary::Ptr secname = pmessage->Get("secobj");
+
+		if (secname) {
+			ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
+
+			if (!secobj)
+				continue;
+
+			if (!target_zone->CanAccessObject(secobj))
+				continue;
+		}
+
+		try  {
+			if (!ReplayMessage(client, BufferRange::FromString(pmessage->Get("message")), locked)) {
+				completed = false;
+				break;
+			}
+
+			count++;
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+			    << "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
+			break;
+		}
+
+		peer_ts = pmessage->Get("timestamp");
+
+		if (ts > logpos_ts + 10) {
+			logpos_ts = ts;
+			SendLogPosition(client, logpos_ts);
+		}
+	}
+
+	logStream->Close();
+
+	return completed;
+}
+
+/**
+ * Writes a message from the replay log to the peer. If more than
+ * JSONRPC_REPLAY_MAX_QUEUED_BYTES are still waiting to be sent this waits
+ * for the peer, unless the caller holds m_LogLock: relaying messages needs
+ * that lock, so the message is not written and the caller has to release
+ * the lock before it tries again.
+ *
+ * @returns false if the message was not written.
+ */
+bool ApiListener::ReplayMessage(const JsonRpcConnection::Ptr& client, const BufferRange& json, bool locked)
+{
+	if (client->GetStream()->GetSendQueueSize() > JSONRPC_REPLAY_MAX_QUEUED_BYTES) {
+		if (locked)
+			return false;
+
+		client->WaitForSendQueue(JSONRPC_REPLAY_MAX_QUEUED_BYTES);
+	}
+
+	client->WriteRawMessage(json);
+
+	return true;
+}
+
+void ApiListener::SendLogPosition(const JsonRpcConnection::Ptr& client, double ts)
+{
+	Dictionary::Ptr lparams = new Dictionary();
+	lparams->Set("log_position", ts);
+
+	Dictionary::Ptr lmessage = new Dictionary();
+	lmessage->Set("jsonrpc", "2.0");
+	lmessage->Set("method", "log::SetLogPosition");
+	lmessage->Set("params", lparams);
+
+	client->SendMessage(lmessage);
+}
+
 void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 {
 	Endpoint::Ptr endpoint = client->GetEndpoint();
@@ -936,6 +1317,9 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 		return;
 	}
 
+	/* whether the target zone may receive messages for a zone */
+	std::map<String, bool> zoneAccess;
+
 	for (;;) {
 		boost::mutex::scoped_lock lock(m_LogLock);
 
@@ -951,6 +1335,8 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 
 		count = 0;
 
+		bool completed = true;
+
 		std::vector<int> files;
 		Utility::Glob(GetApiDir() + "log/*", boost::bind(&ApiListener::LogGlobHandler, boost::ref(files), _1), GlobFile);
 		std::sort(files.begin(), files.end());
@@ -964,49 +1350,45 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 			Log(LogNotice, "ApiListener")
 			    << "Replaying log: " << path;
 
-			std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in | std::fstream::binary);
-			StdioStream::Ptr logStream = new StdioStream(fp, true);
-
-			String message;
-			StreamReadContext src;
-			while (true) {
-				Dictionary::Ptr pmessage;
+			ReplayLogReader::Ptr reader = new ReplayLogReader(path);
 
-				try {
-					StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+			if (!reader->IsValid()) {
+				completed = ReplayLegacyLog(client, path, ts, target_zone, peer_ts, logpos_ts, count, last_sync);
 
-					if (srs == StatusEof)
-						break;
+				if (!completed)
+					break;
 
-					if (srs != StatusNewItem)
-						continue;
+				continue;
+			}
 
-					pmessage = JsonDecode(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener")
-					    << "Unexpected end-of-file for cluster log: " << path;
+			reader->Seek(peer_ts);
 
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
-				}
-
-				if (pmessage->Get("timestamp") <= peer_ts)
+			ReplayLogRecord record;
+			while (reader->Next(&record)) {
+				if (record.Timestamp <= peer_ts)
 					continue;
 
-				Dictionary::Ptr secname = pmessage->Get("secobj");
+				if (record.ZoneLength > 0) {
+					String zoneName(record.Zone, record.Zone + record.ZoneLength);
 
-				if (secname) {
-					ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
+					std::map<String, bool>::const_iterator it = zoneAccess.find(zoneName);
 
-					if (!secobj)
-						continue;
+					if (it == zoneAccess.end()) {
+						Zone::Ptr zone = Zone::GetByName(zoneName);
+						bool access = zone && (zone->GetGlobal() || zone->IsChildOf(target_zone));
+						it = zoneAccess.insert(std::make_pair(zoneName, access)).first;
+					}
 
-					if (!target_zone->CanAccessObject(secobj))
+					if (!it->second)
 						continue;
 				}
 
 				try  {
-					NetString::WriteStringToStream(client->GetStream(), pmessage->Get("message"));
+					if (!ReplayMessage(client, BufferRange::FromString(String(record.Message, record.Message + record.MessageLength)), last_sync)) {
+						completed = false;
+						break;
+					}
+
 					count++;
 				} catch (const std::exception& ex) {
 					Log(LogWarning, "ApiListener")
@@ -1014,24 +1396,16 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 					break;
 				}
 
-				peer_ts = pmessage->Get("timestamp");
+				peer_ts = record.Timestamp;
 
 				if (ts > logpos_ts + 10) {
 					logpos_ts = ts;
-
-					Dictionary::Ptr lparams = new Dictionary();
-					lparams->Set("log_position", logpos_ts);
-
-					Dictionary::Ptr lmessage = new Dictionary();
-					lmessage->Set("jsonrpc", "2.0");
-					lmessage->Set("method", "log::SetLogPosition");
-					lmessage->Set("params", lparams);
-
-					JsonRpc::SendMessage(client->GetStream(), lmessage);
+					SendLogPosition(client, logpos_ts);
 				}
 			}
 
-			logStream->Close();
+			if (!completed)
+				break;
 		}
 
 		if (count > 0) {
@@ -1042,6 +1416,31 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 		Log(LogNotice, "ApiListener")
 		   << "Replayed " << count << " messages.";
 
+		if (!completed) {
+			/* The peer didn't keep up with the final pass. Let the
+			 * other endpoints' messages through and wait for it
+			 * without holding m_LogLock before trying again. */
+			OpenLogFile();
+			lock.unlock();
+
+			try {
+				client->WaitForSendQueue(JSONRPC_REPLAY_MAX_QUEUED_BYTES / 2);
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "ApiListener")
+				    << "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
+
+				ObjectLock olock2(endpoint);
+				endpoint->SetSyncing(false);
+
+				return;
+			}
+
+			last_sync = false;
+			count = -1;
+
+			continue;
+		}
+
 		if (last_sync) {
 			{
 				ObjectLock olock2(endpoint);
@@ -1073,6 +1472,34 @@ void ApiListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& per
 	status->Set("api", stats.first);
 }
 
+/**
+ * Sums up the traffic counters of an endpoint's connections.
+ */
+static Dictionary::Ptr GetEndpointTrafficStats(const Endpoint::Ptr& endpoint)
+{
+	double bytesSent = 0, bytesSentCompressed = 0, bytesReceived = 0, bytesReceivedCompressed = 0;
+	bool compressed = false;
+
+	for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+		Dictionary::Ptr stats = client->GetTrafficStats();
+		bytesSent += stats->Get("bytes_sent");
+		bytesSentCompressed += stats->Get("bytes_sent_compressed");
+		bytesReceived += stats->Get("bytes_received");
+		bytesReceivedCompressed += stats->Get("bytes_received_compressed");
+
+		if (client->GetCapabilities() & ApiCapabilityDeflate)
+			compressed = true;
+	}
+
+	Dictionary::Ptr result = new Dictionary();
+	result->Set("compression", compressed ? "deflate" : "none");
+	result->Set("bytes_sent", bytesSent);
+	result->Set("bytes_sent_compressed", bytesSentCompressed);
+	result->Set("bytes_received", bytesReceived);
+	result->Set("bytes_received_compressed", bytesReceivedCompressed);
+	return result;
+}
+
 std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 {
 	Dictionary::Ptr status = new Dictionary();
@@ -1084,6 +1511,8 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 	double allEndpoints = 0;
 	Array::Ptr allNotConnectedEndpoints = new Array();
 	Array::Ptr allConnectedEndpoints = new Array();
+	Dictionary::Ptr traffic = new Dictionary();
+	double allBytesSent = 0, allBytesSentCompressed = 0;
 
 	Zone::Ptr my_zone = Zone::GetLocalZone();
 
@@ -1123,6 +1552,11 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 				allConnectedEndpoints->Add(endpoint->GetName());
 				zoneConnected = true;
 			}
+
+			Dictionary::Ptr endpointTraffic = GetEndpointTrafficStats(endpoint);
+			traffic->Set(endpoint->GetName(), endpointTraffic);
+			allBytesSent += endpointTraffic->Get("bytes_sent");
+			allBytesSentCompressed += endpointTraffic->Get("bytes_sent_compressed");
 		}
 
 		/* if there's only one endpoint inside the zone, we're not connected - that's us, fake it */
@@ -1151,10 +1585,73 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 	status->Set("not_conn_endpoints", allNotConnectedEndpoints);
 
 	status->Set("zones", connectedZones);
+	status->Set("traffic", traffic);
+
+	double coalesceRatio = 0;
+
+	{
+		Dictionary::Ptr coalescing = new Dictionary();
+
+		boost::mutex::scoped_lock lock(m_CoalesceMutex);
+
+		if (m_CoalesceFrames > 0)
+			coalesceRatio = static_cast<double>(m_CoalesceMessages) / m_CoalesceFrames;
+
+		coalescing->Set("window", GetRelayCoalesceWindow());
+		coalescing->Set("messages", m_CoalesceMessages);
+		coalescing->Set("superseded", m_CoalesceSuperseded);
+		coalescing->Set("frames", m_CoalesceFrames);
+		coalescing->Set("ratio", coalesceRatio);
+
+		status->Set("relay_coalescing", coalescing);
+	}
+
+	double handshakeLatency = 0, resumptionRate = 0;
+
+	{
+		double now = Utility::GetTime();
+
+		int handshakes = m_Handshakes->UpdateAndGetValues(now, 60);
+		int resumed = m_ResumedHandshakes->UpdateAndGetValues(now, 60);
+		int latencyTotal = m_HandshakeLatency->UpdateAndGetValues(now, 60);
+
+		if (handshakes > 0) {
+			handshakeLatency = latencyTotal / 1000.0 / handshakes;
+			resumptionRate = static_cast<double>(resumed) / handshakes;
+		}
+
+		Dictionary::Ptr tls = new Dictionary();
+		tls->Set("workers", API_HANDSHAKE_WORKERS);
+		tls->Set("queued", m_HandshakeQueue.GetLength());
+		tls->Set("connect_workers", API_CONNECT_WORKERS);
+		tls->Set("connect_queued", m_ConnectQueue.GetLength());
+		tls->Set("handshakes_1min", handshakes);
+		tls->Set("resumed_1min", resumed);
+		tls->Set("resumption_rate", resumptionRate);
+		tls->Set("avg_latency", handshakeLatency);
+
+		status->Set("tls_handshakes", tls);
+	}
 
 	perfdata->Set("num_endpoints", allEndpoints);
 	perfdata->Set("num_conn_endpoints", Convert::ToDouble(allConnectedEndpoints->GetLength()));
 	perfdata->Set("num_not_conn_endpoints", Convert::ToDouble(allNotConnectedEndpoints->GetLength()));
+	perfdata->Set("relay_coalesce_ratio", coalesceRatio);
+	perfdata->Set("tls_handshake_latency", handshakeLatency);
+	perfdata->Set("tls_resumption_rate", resumptionRate);
+	perfdata->Set("compression_ratio", allBytesSentCompressed > 0 ? allBytesSent / allBytesSentCompressed : 1.0);
+
+	Dictionary::Ptr lanes = JsonRpcConnection::GetMessageLaneStats();
+	status->Set("message_lanes", lanes);
+
+	{
+		ObjectLock olock(lanes);
+		for (const Dictionary::Pair& kv : lanes) {
+			Dictionary::Ptr laneStats = kv.second;
+			perfdata->Set("lane_" + kv.first + "_latency", laneStats->Get("avg_latency"));
+			perfdata->Set("lane_" + kv.first + "_queued", laneStats->Get("queued"));
+		}
+	}
 
 	return std::make_pair(status, perfdata);
 }
@@ -1206,8 +1703,88 @@ std::set<HttpServerConnection::Ptr> ApiListener::GetHttpClients(void) const
 	return m_HttpClients;
 }
 
+/**
+ * Checks whether JSON-RPC connections may be compressed. Compression is
+ * only used when both sides of a connection have enabled it.
+ *
+ * @returns true if compression is enabled, false otherwise.
+ */
+bool ApiListener::IsCompressionEnabled(void)
+{
+#ifdef HAVE_ZLIB
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	return listener && listener->GetCompressMessages();
+#else /* HAVE_ZLIB */
+	return false;
+#endif /* HAVE_ZLIB */
+}
+
+Dictionary::Ptr ApiListener::MakeHelloMessage(const Endpoint::Ptr& endpoint)
+{
+	Array::Ptr capabilities = new Array();
+	capabilities->Add("batch");
+	capabilities->Add("config_sync");
+
+	if (IsCompressionEnabled())
+		capabilities->Add("deflate");
+
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("capabilities", capabilities);
+
+	/* our parent only sends us the config files which have changed */
+	Dictionary::Ptr manifest = MakeConfigManifest(endpoint);
+
+	if (manifest)
+		params->Set("config_manifest", manifest);
+
+	Dictionary::Ptr message = new Dictionary();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "icinga::Hello");
+	message->Set("params", params);
+
+	return message;
+}
+
 Value ApiListener::HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
 {
+	JsonRpcConnection::Ptr client = origin->FromClient;
+
+	if (!client || !params)
+		return Empty;
+
+	/* older versions don't announce any capabilities */
+	Array::Ptr capabilities = params->Get("capabilities");
+
+	int caps = 0;
+
+	if (capabilities) {
+		ObjectLock olock(capabilities);
+		for (const String& capability : capabilities) {
+			if (capability == "batch")
+				caps |= ApiCapabilityBatch;
+			else if (capability == "config_sync")
+				caps |= ApiCapabilityConfigSync;
+			else if (capability == "deflate" && IsCompressionEnabled())
+				caps |= ApiCapabilityDeflate;
+		}
+	}
+
+	client->SetConfigManifest(params->Get("config_manifest"));
+	client->SetCapabilities(caps);
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (listener)
+		listener->StartSyncClient(client);
+
+	if (!capabilities)
+		return Empty;
+
+	/* the connecting side sends its hello message first, let it know what we support */
+	if (client->GetRole() == RoleServer)
+		client->SendMessage(MakeHelloMessage(client->GetEndpoint()));
+
 	return Empty;
 }
 
@@ -25,9 +25,11 @@
 #include "remote/httpserverconnection.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
+#include "remote/replaylog.hpp"
 #include "base/configobject.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include "base/ringbuffer.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/tlsstream.hpp"
 #include <set>
@@ -86,6 +88,8 @@ public:
 
 	static double CalculateZoneLag(const Endpoint::Ptr& endpoint);
 
+	static bool IsCompressionEnabled(void);
+
 	/* filesync */
 	static Value ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	
@@ -96,6 +100,9 @@ public:
 	
 	static Value HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
+	/* coalescing */
+	static void RegisterSupersededMethod(const String& method, const String& supersededMethod);
+
 	static void UpdateObjectAuthority(void);
 
 	static bool IsHACluster(void);
@@ -116,6 +123,8 @@ private:
 	Timer::Ptr m_Timer;
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_AuthorityTimer;
+	Timer::Ptr m_TicketKeyTimer;
+	Timer::Ptr m_HelloTimer;
 	Endpoint::Ptr m_LocalEndpoint;
 
 	static ApiListener::Ptr m_Instance;
@@ -125,32 +134,92 @@ private:
 
 	bool AddListener(const String& node, const String& service);
 	void AddConnection(const Endpoint::Ptr& endpoint);
+	void UpdateTicketKeys(void);
 
 	void NewClientHandler(const Socket::Ptr& client, const String& hostname, ConnectionRole role);
 	void NewClientHandlerInternal(const Socket::Ptr& client, const String& hostname, ConnectionRole role);
 	void ListenerThreadProc(const Socket::Ptr& server);
 
-	WorkQueue m_RelayQueue;
+	WorkQueue *m_RelayQueues;
+	size_t m_RelayQueueCount;
 	WorkQueue m_SyncQueue;
+	WorkQueue m_HandshakeQueue;
+	WorkQueue m_ConnectQueue;
+
+	RingBuffer::Ptr m_Handshakes;
+	RingBuffer::Ptr m_ResumedHandshakes;
+	RingBuffer::Ptr m_HandshakeLatency;
+
+	struct ReconnectState
+	{
+		double NextAttempt;
+		int Failures;
+		bool Connected;
+
+		ReconnectState(void)
+			: NextAttempt(0), Failures(0), Connected(false)
+		{ }
+	};
+
+	boost::mutex m_ReconnectMutex;
+	std::map<Endpoint::Ptr, ReconnectState> m_ReconnectStates;
+	double m_LastReconnectLog;
+
+	void ScheduleReconnect(const Endpoint::Ptr& endpoint, bool connected);
+	double GetReconnectJitter(const Endpoint::Ptr& endpoint, double max) const;
 
 	boost::mutex m_LogLock;
-	Stream::Ptr m_LogFile;
+	ReplayLogWriter::Ptr m_LogFile;
 	size_t m_LogMessageCount;
 
-	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentMaster);
-	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj);
+	boost::mutex m_RelayMutex;
+
+	static std::vector<JsonRpcConnection::Ptr> GetSendClients(const Endpoint::Ptr& endpoint);
+	void SendEncodedMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, const BufferRange& json);
+	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Endpoint::Ptr& currentMaster,
+	    std::set<Endpoint::Ptr>& relayEndpoints, std::set<Endpoint::Ptr>& skippedEndpoints);
+	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj,
+	    const Zone::Ptr& target_zone, const Dictionary::Ptr& message, bool log);
+	void PersistMessage(double ts, const String& json, const ConfigObject::Ptr& secobj);
 
 	void OpenLogFile(void);
 	void RotateLogFile(void);
 	void CloseLogFile(void);
 	static void LogGlobHandler(std::vector<int>& files, const String& file);
 	void ReplayLog(const JsonRpcConnection::Ptr& client);
+	bool ReplayLegacyLog(const JsonRpcConnection::Ptr& client, const String& path, int ts,
+	    const Zone::Ptr& target_zone, double& peer_ts, double& logpos_ts, int& count, bool locked);
+	static bool ReplayMessage(const JsonRpcConnection::Ptr& client, const BufferRange& json, bool locked);
+	static void SendLogPosition(const JsonRpcConnection::Ptr& client, double ts);
+
+	static Dictionary::Ptr MakeHelloMessage(const Endpoint::Ptr& endpoint);
+
+	/* coalescing */
+	struct CoalesceQueue
+	{
+		std::vector<std::pair<Dictionary::Ptr, BufferRange> > Messages;
+		std::map<String, size_t> Latest;
+	};
+
+	boost::mutex m_CoalesceMutex;
+	std::map<Endpoint::Ptr, CoalesceQueue> m_CoalesceQueues;
+	Timer::Ptr m_CoalesceTimer;
+	uint64_t m_CoalesceMessages;
+	uint64_t m_CoalesceSuperseded;
+	uint64_t m_CoalesceFrames;
+
+	static String GetCoalesceKey(const String& method, const Dictionary::Ptr& message);
+	void CoalesceMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, const BufferRange& json);
+	void CoalesceTimerHandler(void);
+	void FlushCoalesceQueue(const Endpoint::Ptr& endpoint, const CoalesceQueue& queue);
 
 	/* filesync */
 	static ConfigDirInformation LoadConfigDir(const String& dir);
 	static Dictionary::Ptr MergeConfigUpdate(const ConfigDirInformation& config);
 	static bool UpdateConfigDir(const ConfigDirInformation& oldConfig, const ConfigDirInformation& newConfig, const String& configDir, bool authoritative);
+	static Dictionary::Ptr LoadConfigManifest(const String& zoneName);
+	static Dictionary::Ptr MakeConfigManifest(const Endpoint::Ptr& endpoint);
+	static void WriteConfigFile(const String& path, const String& content);
 
 	void SyncZoneDirs(void) const;
 	void SyncZoneDir(const Zone::Ptr& zone) const;
@@ -165,6 +234,20 @@ private:
 	    const JsonRpcConnection::Ptr& client = JsonRpcConnection::Ptr());
 	void SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient);
 
+	/* connections which wait for the peer's icinga::Hello message before they are synced */
+	struct PendingSync
+	{
+		Endpoint::Ptr Peer;
+		bool NeedSync;
+		double Deadline;
+	};
+
+	boost::mutex m_PendingSyncsMutex;
+	std::map<JsonRpcConnection::Ptr, PendingSync> m_PendingSyncs;
+
+	void ScheduleSyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync);
+	void StartSyncClient(const JsonRpcConnection::Ptr& aclient);
+	void HelloTimerHandler(void);
 	void SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync);
 };
 
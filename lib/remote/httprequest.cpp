@@ -33,7 +33,7 @@ HttpRequest::HttpRequest(const Stream::Ptr& stream)
       ProtocolVersion(HttpVersion11),
       Headers(new Dictionary()),
       m_Stream(stream),
-      m_State(HttpRequestStart)
+      m_State(HttpRequestStart), m_BodyRemaining(0)
 { }
 
 bool HttpRequest::Parse(StreamReadContext& src, bool may_wait)
@@ -76,10 +76,15 @@ bool HttpRequest::Parse(StreamReadContext& src, bool may_wait)
 				m_State = HttpRequestBody;
 
 				/* we're done if the request doesn't contain a message body */
-				if (!Headers->Contains("content-length") && !Headers->Contains("transfer-encoding"))
+				if (!Headers->Contains("content-length") && !Headers->Contains("transfer-encoding")) {
 					Complete = true;
-				else
-					m_Body = new FIFO();
+					return true;
+				}
+
+				m_BodyDecoder = boost::make_shared<JsonStreamDecoder>();
+
+				if (Headers->Get("transfer-encoding") != "chunked")
+					m_BodyRemaining = Convert::ToLong(Headers->Get("content-length"));
 
 				return true;
 
@@ -110,36 +115,45 @@ bool HttpRequest::Parse(StreamReadContext& src, bool may_wait)
 			if (srs != StatusNewItem)
 				return false;
 
-			m_Body->Write(data, size);
+			DecodeBody(data, size);
 
 			delete [] data;
 
 			if (size == 0) {
+				FinishBody();
 				Complete = true;
 				return true;
 			}
 		} else {
-			if (src.Eof)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected EOF in HTTP body"));
-
-			if (src.MustRead) {
-				if (!src.FillFromStream(m_Stream, false)) {
-					src.Eof = true;
+			if (m_BodyRemaining > 0) {
+				if (src.Eof)
 					BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected EOF in HTTP body"));
+
+				if (src.MustRead) {
+					if (!src.FillFromStream(m_Stream, false)) {
+						src.Eof = true;
+						BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected EOF in HTTP body"));
+					}
+
+					src.MustRead = false;
 				}
 
-				src.MustRead = false;
-			}
+				/* Decode whatever has arrived so far rather than waiting for
+				 * the whole body, so the read buffer never has to hold more
+				 * than a single read's worth of data. */
+				size_t count = std::min(src.Size, m_BodyRemaining);
 
-			size_t length_indicator = Convert::ToLong(Headers->Get("content-length"));
+				DecodeBody(src.Buffer, count);
+				src.DropData(count);
+				m_BodyRemaining -= count;
 
-			if (src.Size < length_indicator) {
-				src.MustRead = true;
-				return false;
+				if (m_BodyRemaining > 0) {
+					src.MustRead = true;
+					return false;
+				}
 			}
 
-			m_Body->Write(src.Buffer, length_indicator);
-			src.DropData(length_indicator);
+			FinishBody();
 			Complete = true;
 			return true;
 		}
@@ -148,12 +162,47 @@ bool HttpRequest::Parse(StreamReadContext& src, bool may_wait)
 	return true;
 }
 
-size_t HttpRequest::ReadBody(char *data, size_t count)
+/**
+ * Returns the decoded JSON body of a request which was read with Parse().
+ * Errors which were encountered while decoding the body are rethrown here
+ * so that the request itself can still be parsed and answered.
+ *
+ * @returns The decoded body or Empty if the request didn't have one.
+ */
+Value HttpRequest::GetBody(void) const
 {
-	if (!m_Body)
-		return 0;
-	else
-		return m_Body->Read(data, count, true);
+	if (m_BodyError)
+		boost::rethrow_exception(m_BodyError);
+
+	return m_BodyValue;
+}
+
+void HttpRequest::DecodeBody(const char *data, size_t count)
+{
+	if (!m_BodyDecoder)
+		return;
+
+	try {
+		m_BodyDecoder->Feed(data, count);
+	} catch (...) {
+		m_BodyError = boost::current_exception();
+		m_BodyDecoder.reset();
+	}
+}
+
+void HttpRequest::FinishBody(void)
+{
+	if (!m_BodyDecoder)
+		return;
+
+	try {
+		if (m_BodyDecoder->GetLength() > 0)
+			m_BodyValue = m_BodyDecoder->Finish();
+	} catch (...) {
+		m_BodyError = boost::current_exception();
+	}
+
+	m_BodyDecoder.reset();
 }
 
 void HttpRequest::AddHeader(const String& key, const String& value)
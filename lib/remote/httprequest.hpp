@@ -26,6 +26,8 @@
 #include "base/stream.hpp"
 #include "base/fifo.hpp"
 #include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include <boost/exception_ptr.hpp>
 
 namespace icinga
 {
@@ -63,7 +65,7 @@ public:
 	HttpRequest(const Stream::Ptr& stream);
 
 	bool Parse(StreamReadContext& src, bool may_wait);
-	size_t ReadBody(char *data, size_t count);
+	Value GetBody(void) const;
 
 	void AddHeader(const String& key, const String& value);
 	void WriteBody(const char *data, size_t count);
@@ -75,7 +77,15 @@ private:
 	HttpRequestState m_State;
 	FIFO::Ptr m_Body;
 
+	boost::shared_ptr<JsonStreamDecoder> m_BodyDecoder;
+	size_t m_BodyRemaining;
+	Value m_BodyValue;
+	boost::exception_ptr m_BodyError;
+
 	void FinishHeaders(void);
+
+	void DecodeBody(const char *data, size_t count);
+	void FinishBody(void);
 };
 
 }
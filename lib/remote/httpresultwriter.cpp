@@ -0,0 +1,96 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/httpresultwriter.hpp"
+#include "base/json.hpp"
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+HttpResultWriter::HttpResultWriter(HttpResponse& response)
+	: m_Response(response), m_Count(0)
+{
+	m_Buffer.reserve(JSON_CHUNK_SIZE);
+}
+
+/**
+ * Appends a result to the response. The response status and headers are
+ * sent along with the first result so handlers can still report an error
+ * as long as they haven't added any results yet.
+ *
+ * @param result The result.
+ */
+void HttpResultWriter::Add(const Value& result)
+{
+	if (m_Count == 0)
+		Start();
+	else
+		Write(",", 1);
+
+	JsonEncode(result, boost::bind(&HttpResultWriter::Write, this, _1, _2));
+
+	m_Count++;
+}
+
+/**
+ * Terminates the result array and sends any data which is still buffered.
+ */
+void HttpResultWriter::Finish(void)
+{
+	if (m_Count == 0)
+		Start();
+
+	Write("]}", 2);
+	Flush();
+}
+
+/**
+ * Returns the number of results which have been added so far.
+ *
+ * @returns The number of results.
+ */
+size_t HttpResultWriter::GetCount(void) const
+{
+	return m_Count;
+}
+
+void HttpResultWriter::Start(void)
+{
+	m_Response.SetStatus(200, "OK");
+	m_Response.AddHeader("Content-Type", "application/json");
+
+	Write("{\"results\":[", 12);
+}
+
+void HttpResultWriter::Write(const char *data, size_t count)
+{
+	m_Buffer.insert(m_Buffer.end(), data, data + count);
+
+	if (m_Buffer.size() >= JSON_CHUNK_SIZE)
+		Flush();
+}
+
+void HttpResultWriter::Flush(void)
+{
+	if (m_Buffer.empty())
+		return;
+
+	m_Response.WriteBody(&m_Buffer[0], m_Buffer.size());
+	m_Buffer.clear();
+}
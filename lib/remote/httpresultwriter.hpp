@@ -0,0 +1,59 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef HTTPRESULTWRITER_H
+#define HTTPRESULTWRITER_H
+
+#include "remote/httpresponse.hpp"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Writes a {"results":[...]} response body one result at a time. Results
+ * are encoded as soon as they are added and sent in chunks of at most
+ * JSON_CHUNK_SIZE bytes, so handlers never have to build the complete
+ * result array in memory.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API HttpResultWriter
+{
+public:
+	HttpResultWriter(HttpResponse& response);
+
+	void Add(const Value& result);
+	void Finish(void);
+
+	size_t GetCount(void) const;
+
+private:
+	HttpResponse& m_Response;
+	std::vector<char> m_Buffer;
+	size_t m_Count;
+
+	void Start(void);
+	void Write(const char *data, size_t count);
+	void Flush(void);
+};
+
+}
+
+#endif /* HTTPRESULTWRITER_H */
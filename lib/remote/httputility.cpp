@@ -20,6 +20,7 @@
 #include "remote/httputility.hpp"
 #include "base/json.hpp"
 #include "base/logger.hpp"
+#include <boost/bind.hpp>
 
 using namespace icinga;
 
@@ -27,19 +28,14 @@ Dictionary::Ptr HttpUtility::FetchRequestParameters(HttpRequest& request)
 {
 	Dictionary::Ptr result;
 
-	String body;
-	char buffer[1024];
-	size_t count;
-
-	while ((count = request.ReadBody(buffer, sizeof(buffer))) > 0)
-		body += String(buffer, buffer + count);
+	Value body = request.GetBody();
 
 	if (!body.IsEmpty()) {
 #ifdef I2_DEBUG
 		Log(LogDebug, "HttpUtility")
-		    << "Request body: '" << body << "'";
+		    << "Request body: '" << JsonEncode(body) << "'";
 #endif /* I2_DEBUG */
-		result = JsonDecode(body);
+		result = body;
 	}
 
 	if (!result)
@@ -57,8 +53,7 @@ void HttpUtility::SendJsonBody(HttpResponse& response, const Value& val)
 {
 	response.AddHeader("Content-Type", "application/json");
 
-	String body = JsonEncode(val);
-	response.WriteBody(body.CStr(), body.GetLength());
+	JsonEncode(val, boost::bind(&HttpResponse::WriteBody, &response, _1, _2));
 }
 
 Value HttpUtility::GetLastParameter(const Dictionary::Ptr& params, const String& key)
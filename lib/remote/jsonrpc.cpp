@@ -19,7 +19,10 @@
 
 #include "remote/jsonrpc.hpp"
 #include "base/netstring.hpp"
+#include "base/tlsstream.hpp"
 #include "base/json.hpp"
+#include "base/convert.hpp"
+#include <boost/bind.hpp>
 
 using namespace icinga;
 
@@ -27,11 +30,57 @@ using namespace icinga;
  * Sends a message to the connected peer.
  *
  * @param message The message.
+ * @returns The length of the encoded message.
  */
-void JsonRpc::SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message)
+size_t JsonRpc::SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message)
 {
-	String json = JsonEncode(message);
-	NetString::WriteStringToStream(stream, json);
+	BufferChain chain;
+	size_t length = EncodeMessage(chain, message);
+
+	TlsStream::Ptr tlsStream = dynamic_pointer_cast<TlsStream>(stream);
+
+	if (tlsStream) {
+		tlsStream->WriteChain(chain);
+		return length;
+	}
+
+	BufferRange range;
+
+	while (chain.GetFirst(&range)) {
+		stream->Write(range.GetData(), range.Length);
+		chain.Read(NULL, range.Length);
+	}
+
+	return length;
+}
+
+/**
+ * Encodes a message as a netstring. The message is encoded only once and
+ * the netstring header is written once its length is known, so nothing is
+ * added to the chain if encoding the message fails.
+ *
+ * @param chain The chain the netstring is appended to.
+ * @param message The message.
+ * @returns The length of the encoded message (excluding the netstring header).
+ */
+size_t JsonRpc::EncodeMessage(BufferChain& chain, const Dictionary::Ptr& message)
+{
+	BufferChain json;
+	JsonEncode(message, boost::bind(&JsonRpc::AppendChunk, boost::ref(json), _1, _2));
+
+	size_t length = json.GetAvailableBytes();
+	String header = Convert::ToString(length) + ":";
+
+	chain.Append(header.CStr(), header.GetLength());
+	chain.Append(json);
+	chain.Append(",", 1);
+
+	return length;
+}
+
+void JsonRpc::AppendChunk(BufferChain& chain, const char *data, size_t count)
+{
+	chain.Append(data, count);
 }
 
 StreamReadStatus JsonRpc::ReadMessage(const Stream::Ptr& stream, String *message, StreamReadContext& src, bool may_wait)
@@ -49,7 +98,12 @@ StreamReadStatus JsonRpc::ReadMessage(const Stream::Ptr& stream, String *message
 
 Dictionary::Ptr JsonRpc::DecodeMessage(const String& message)
 {
-	Value value = JsonDecode(message);
+	return DecodeMessage(message.CStr(), message.GetLength());
+}
+
+Dictionary::Ptr JsonRpc::DecodeMessage(const char *data, size_t length)
+{
+	Value value = JsonDecode(data, length);
 
 	if (!value.IsObjectType<Dictionary>()) {
 		BOOST_THROW_EXCEPTION(std::invalid_argument("JSON-RPC"
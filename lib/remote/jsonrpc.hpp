@@ -22,6 +22,7 @@
 
 #include "base/stream.hpp"
 #include "base/dictionary.hpp"
+#include "base/bufferchain.hpp"
 #include "remote/i2-remote.hpp"
 
 namespace icinga
@@ -35,12 +36,16 @@ namespace icinga
 class I2_REMOTE_API JsonRpc
 {
 public:
-	static void SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message);
+	static size_t SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message);
+	static size_t EncodeMessage(BufferChain& chain, const Dictionary::Ptr& message);
 	static StreamReadStatus ReadMessage(const Stream::Ptr& stream, String *message, StreamReadContext& src, bool may_wait = false);
 	static Dictionary::Ptr DecodeMessage(const String& message);
+	static Dictionary::Ptr DecodeMessage(const char *data, size_t length);
 
 private:
 	JsonRpc(void);
+
+	static void AppendChunk(BufferChain& chain, const char *data, size_t count);
 };
 
 }
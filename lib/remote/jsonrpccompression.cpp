@@ -0,0 +1,177 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/jsonrpccompression.hpp"
+
+#ifdef HAVE_ZLIB
+
+#include "base/exception.hpp"
+#include <string.h>
+
+using namespace icinga;
+
+/* Compression level for outgoing frames. The gain from higher levels is
+ * small for JSON and doesn't justify the extra CPU time on busy masters. */
+#define JSONRPC_DEFLATE_LEVEL 3
+
+/* Upper limit for the decompressed size of a single frame. */
+#define JSONRPC_INFLATE_MAX_BYTES (64 * 1024 * 1024)
+
+/* Preset dictionary for the deflate streams. It contains fragments which
+ * are part of most cluster messages; deflate prefers matches near the end
+ * of the dictionary so the most common fragments come last.
+ *
+ * Both sides of a connection have to use the same dictionary. If it is ever
+ * changed the capability name which is announced in icinga::Hello has to be
+ * changed as well. */
+static const char l_JsonRpcDictionary[] =
+	"{\"jsonrpc\":\"2.0\",\"method\":\"config::Update\",\"params\":{\"update\":{},\"update_v2\":{}}}"
+	"{\"jsonrpc\":\"2.0\",\"method\":\"log::SetLogPosition\",\"params\":{\"log_position\":}}"
+	"{\"jsonrpc\":\"2.0\",\"method\":\"event::Heartbeat\",\"params\":{\"timeout\":120.0}}"
+	"\"method\":\"event::SetAcknowledgement\",\"params\":{\"author\":\"\",\"comment\":\"\",\"expiry\":0.0,\"notify\":true,\"acktype\":"
+	"\"method\":\"event::AddComment\",\"params\":{\"comment\":{\"author\":\"\",\"entry_time\":,\"entry_type\":1.0,\"text\":\"\"}"
+	"\"method\":\"event::AddDowntime\",\"params\":{\"downtime\":{\"author\":\"\",\"comment\":\"\",\"start_time\":,\"end_time\":,\"fixed\":true,\"duration\":0.0,\"triggered_by\":\"\",\"scheduled_by\":\"\"}"
+	"\"method\":\"event::SendNotifications\",\"params\":{\"author\":\"\",\"text\":\"\",\"type\":"
+	"\"method\":\"event::NotificationSentUser\",\"params\":{\"notification\":\"\",\"user\":\"\",\"command\":\"\",\"type\":"
+	"\"method\":\"event::ExecuteCommand\",\"params\":{\"command_type\":\"check_command\",\"command\":\"\",\"macros\":{},\"endpoint\":\"\""
+	"\"method\":\"event::SetNextCheck\",\"params\":{\"next_check\":"
+	"\"method\":\"event::SetNextNotification\",\"params\":{\"next_notification\":"
+	"\"method\":\"event::SetLastCheckStarted\",\"params\":{\"last_check_started\":"
+	"\"vars_before\":{\"attempt\":1.0,\"reachable\":true,\"state\":0.0,\"state_type\":1.0},"
+	"\"vars_after\":{\"attempt\":1.0,\"reachable\":true,\"state\":0.0,\"state_type\":1.0}},"
+	"\"performance_data\":[\"time=0.000000s;;;0.000000\",\"size=0B;;;0\",\"rta=0.000000ms;3000.000000;5000.000000;0.000000\",\"pl=0%;80;100;0\"],"
+	"\"output\":\"OK - \",\"PING OK - Packet loss = 0%, RTA = 0.00 ms\",\"HTTP OK: HTTP/1.1 200 OK - \",\"DISK OK - free space: \","
+	"\"command\":[\"/usr/lib/nagios/plugins/check_\",\"-H\",\"-c\",\"-w\"],"
+	"{\"jsonrpc\":\"2.0\",\"method\":\"event::CheckResult\",\"params\":{\"cr\":{\"active\":true,\"check_source\":\"\","
+	"\"execution_end\":,\"execution_start\":,\"exit_status\":0.0,\"schedule_end\":,\"schedule_start\":,"
+	"\"state\":0.0,\"ttl\":0.0,\"type\":\"CheckResult\",\"host\":\"\",\"service\":\"\"},\"ts\":";
+
+JsonRpcDeflater::JsonRpcDeflater(void)
+{
+	memset(&m_Stream, 0, sizeof(m_Stream));
+
+	if (deflateInit(&m_Stream, JSONRPC_DEFLATE_LEVEL) != Z_OK)
+		BOOST_THROW_EXCEPTION(std::runtime_error("deflateInit() failed"));
+
+	if (deflateSetDictionary(&m_Stream, reinterpret_cast<const Bytef *>(l_JsonRpcDictionary), sizeof(l_JsonRpcDictionary) - 1) != Z_OK) {
+		deflateEnd(&m_Stream);
+		BOOST_THROW_EXCEPTION(std::runtime_error("deflateSetDictionary() failed"));
+	}
+}
+
+JsonRpcDeflater::~JsonRpcDeflater(void)
+{
+	deflateEnd(&m_Stream);
+}
+
+/**
+ * Compresses all data in the input chain. The output is flushed so that the
+ * peer can decompress it without waiting for further frames.
+ *
+ * @param input The uncompressed data. The chain is empty afterwards.
+ * @param output The chain the compressed data is appended to.
+ */
+void JsonRpcDeflater::Compress(BufferChain& input, BufferChain& output)
+{
+	BufferRange range;
+
+	while (input.GetFirst(&range)) {
+		input.ReadRange(range.Length, &range);
+		Deflate(range.GetData(), range.Length, Z_NO_FLUSH, output);
+	}
+
+	Deflate(NULL, 0, Z_SYNC_FLUSH, output);
+}
+
+void JsonRpcDeflater::Deflate(const char *data, size_t length, int flush, BufferChain& output)
+{
+	m_Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	m_Stream.avail_in = length;
+
+	do {
+		size_t count = 0;
+		char *buffer = output.Reserve(&count);
+
+		m_Stream.next_out = reinterpret_cast<Bytef *>(buffer);
+		m_Stream.avail_out = count;
+
+		int rc = deflate(&m_Stream, flush);
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			BOOST_THROW_EXCEPTION(std::runtime_error("deflate() failed"));
+
+		output.Commit(count - m_Stream.avail_out);
+	} while (m_Stream.avail_in > 0 || m_Stream.avail_out == 0);
+}
+
+JsonRpcInflater::JsonRpcInflater(void)
+{
+	memset(&m_Stream, 0, sizeof(m_Stream));
+
+	if (inflateInit(&m_Stream) != Z_OK)
+		BOOST_THROW_EXCEPTION(std::runtime_error("inflateInit() failed"));
+}
+
+JsonRpcInflater::~JsonRpcInflater(void)
+{
+	inflateEnd(&m_Stream);
+}
+
+/**
+ * Decompresses the payload of a compressed frame.
+ *
+ * @param data The compressed data.
+ * @param length The length of the compressed data.
+ * @param output The chain the decompressed data is appended to.
+ * @exception invalid_argument The data is invalid.
+ */
+void JsonRpcInflater::Decompress(const char *data, size_t length, BufferChain& output)
+{
+	m_Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	m_Stream.avail_in = length;
+
+	size_t total = 0;
+
+	do {
+		size_t count = 0;
+		char *buffer = output.Reserve(&count);
+
+		m_Stream.next_out = reinterpret_cast<Bytef *>(buffer);
+		m_Stream.avail_out = count;
+
+		int rc = inflate(&m_Stream, Z_SYNC_FLUSH);
+
+		if (rc == Z_NEED_DICT)
+			rc = inflateSetDictionary(&m_Stream, reinterpret_cast<const Bytef *>(l_JsonRpcDictionary), sizeof(l_JsonRpcDictionary) - 1);
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid compressed JSON-RPC frame"));
+
+		output.Commit(count - m_Stream.avail_out);
+		total += count - m_Stream.avail_out;
+
+		if (total > JSONRPC_INFLATE_MAX_BYTES)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Compressed JSON-RPC frame exceeds the size limit"));
+
+		if (rc == Z_BUF_ERROR)
+			break;
+	} while (m_Stream.avail_in > 0 || m_Stream.avail_out == 0);
+}
+
+#endif /* HAVE_ZLIB */
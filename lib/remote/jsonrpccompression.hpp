@@ -0,0 +1,89 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef JSONRPCCOMPRESSION_H
+#define JSONRPCCOMPRESSION_H
+
+#include "remote/i2-remote.hpp"
+#include "base/object.hpp"
+#include "base/bufferchain.hpp"
+
+/**
+ * The first byte of a compressed JSON-RPC frame's payload. Uncompressed
+ * frames always start with '{'.
+ */
+#define JSONRPC_COMPRESSED_FRAME 'Z'
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+namespace icinga
+{
+
+/**
+ * Compresses the outgoing JSON-RPC frames of a connection. All frames share
+ * one deflate stream so that later frames can refer to data from earlier
+ * ones.
+ *
+ * Instances of this class are not thread-safe.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API JsonRpcDeflater : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(JsonRpcDeflater);
+
+	JsonRpcDeflater(void);
+	~JsonRpcDeflater(void);
+
+	void Compress(BufferChain& input, BufferChain& output);
+
+private:
+	z_stream m_Stream;
+
+	void Deflate(const char *data, size_t length, int flush, BufferChain& output);
+};
+
+/**
+ * Decompresses the incoming JSON-RPC frames of a connection.
+ *
+ * Instances of this class are not thread-safe.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API JsonRpcInflater : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(JsonRpcInflater);
+
+	JsonRpcInflater(void);
+	~JsonRpcInflater(void);
+
+	void Decompress(const char *data, size_t length, BufferChain& output);
+
+private:
+	z_stream m_Stream;
+};
+
+}
+
+#endif /* HAVE_ZLIB */
+
+#endif /* JSONRPCCOMPRESSION_H */
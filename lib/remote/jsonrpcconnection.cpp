@@ -21,16 +21,27 @@
 #include "remote/apilistener.hpp"
 #include "remote/apifunction.hpp"
 #include "remote/jsonrpc.hpp"
+#include "base/netstring.hpp"
+#include "base/json.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
 #include "base/convert.hpp"
+#include "base/ringbuffer.hpp"
 #include <boost/thread/once.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
+/* limits for messages which are queued for a connection but haven't been
+ * sent yet, slow clients are disconnected once they're exceeded */
+#define JSONRPC_OUTBOUND_MAX_MESSAGES 25000
+#define JSONRPC_OUTBOUND_MAX_BYTES (64 * 1024 * 1024)
+
+#define JSONRPC_REPLAY_STALL_TIMEOUT 60
+
 static Value SetLogPositionHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 static Value RequestCertificateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
@@ -40,13 +51,53 @@ static boost::once_flag l_JsonRpcConnectionOnceFlag = BOOST_ONCE_INIT;
 static Timer::Ptr l_JsonRpcConnectionTimeoutTimer;
 static WorkQueue *l_JsonRpcConnectionWorkQueues;
 static size_t l_JsonRpcConnectionWorkQueueCount;
+static WorkQueue *l_JsonRpcConnectionSendQueues;
+static WorkQueue *l_JsonRpcConnectionLaneQueues[MESSAGE_LANE_COUNT];
+static size_t l_JsonRpcConnectionLaneQueueCount[MESSAGE_LANE_COUNT];
+static RingBuffer::Ptr l_JsonRpcConnectionLaneMessages[MESSAGE_LANE_COUNT];
 static int l_JsonRpcConnectionNextID;
 
+static const char * const l_JsonRpcConnectionLaneNames[MESSAGE_LANE_COUNT] = {
+	"heartbeat",
+	"checkable_events",
+	"config"
+};
+
+/* The sums of the message latencies (in seconds) for each second of the last
+ * minute. These are doubles because a backlog can overflow an int RingBuffer. */
+#define JSONRPC_LANE_LATENCY_SLOTS 60
+
+struct JsonRpcLaneLatency
+{
+	boost::mutex Mutex;
+	double Slots[JSONRPC_LANE_LATENCY_SLOTS];
+	long TimeValue;
+};
+
+static JsonRpcLaneLatency l_JsonRpcConnectionLaneLatency[MESSAGE_LANE_COUNT];
+
+/* must hold the latency's mutex */
+static void AdvanceLaneLatency(JsonRpcLaneLatency& latency, long tv)
+{
+	if (tv - latency.TimeValue >= JSONRPC_LANE_LATENCY_SLOTS)
+		std::fill(latency.Slots, latency.Slots + JSONRPC_LANE_LATENCY_SLOTS, 0);
+	else {
+		for (long i = latency.TimeValue + 1; i <= tv; i++)
+			latency.Slots[i % JSONRPC_LANE_LATENCY_SLOTS] = 0;
+	}
+
+	if (tv > latency.TimeValue)
+		latency.TimeValue = tv;
+}
+
 JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
     const TlsStream::Ptr& stream, ConnectionRole role)
 	: m_ID(l_JsonRpcConnectionNextID++), m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream),
 	  m_Role(role), m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()),
-	  m_NextHeartbeat(0), m_HeartbeatTimeout(0)
+	  m_NextHeartbeat(0), m_HeartbeatTimeout(0), m_Capabilities(0),
+	  m_CapabilitiesKnown(false),
+	  m_OutboundBytes(0), m_OutboundPending(false), m_OutboundOverflow(false),
+	  m_BytesSent(0), m_BytesSentCompressed(0), m_BytesReceived(0), m_BytesReceivedCompressed(0)
 {
 	boost::call_once(l_JsonRpcConnectionOnceFlag, &JsonRpcConnection::StaticInitialize);
 
@@ -63,9 +114,28 @@ void JsonRpcConnection::StaticInitialize(void)
 
 	l_JsonRpcConnectionWorkQueueCount = Application::GetConcurrency();
 	l_JsonRpcConnectionWorkQueues = new WorkQueue[l_JsonRpcConnectionWorkQueueCount];
+	l_JsonRpcConnectionSendQueues = new WorkQueue[l_JsonRpcConnectionWorkQueueCount];
 
 	for (size_t i = 0; i < l_JsonRpcConnectionWorkQueueCount; i++) {
 		l_JsonRpcConnectionWorkQueues[i].SetName("JsonRpcConnection, #" + Convert::ToString(i));
+		l_JsonRpcConnectionSendQueues[i].SetName("JsonRpcConnection, Send #" + Convert::ToString(i));
+	}
+
+	/* The number of queues is the lane's share of worker threads. Heartbeats
+	 * are cheap, bulk messages must not starve the other lanes. */
+	l_JsonRpcConnectionLaneQueueCount[MessageLaneHeartbeat] = 1;
+	l_JsonRpcConnectionLaneQueueCount[MessageLaneCheckable] = l_JsonRpcConnectionWorkQueueCount;
+	l_JsonRpcConnectionLaneQueueCount[MessageLaneBulk] = std::max<size_t>(1, l_JsonRpcConnectionWorkQueueCount / 2);
+
+	for (int lane = 0; lane < MESSAGE_LANE_COUNT; lane++) {
+		l_JsonRpcConnectionLaneQueues[lane] = new WorkQueue[l_JsonRpcConnectionLaneQueueCount[lane]];
+
+		for (size_t i = 0; i < l_JsonRpcConnectionLaneQueueCount[lane]; i++) {
+			l_JsonRpcConnectionLaneQueues[lane][i].SetName("JsonRpcConnection, " + String(l_JsonRpcConnectionLaneNames[lane])
+			    + " #" + Convert::ToString(i));
+		}
+
+		l_JsonRpcConnectionLaneMessages[lane] = new RingBuffer(60);
 	}
 }
 
@@ -107,13 +177,72 @@ ConnectionRole JsonRpcConnection::GetRole(void) const
 	return m_Role;
 }
 
+/**
+ * Returns the optional protocol features the peer announced.
+ *
+ * @returns A bitmask of ApiCapability values.
+ */
+int JsonRpcConnection::GetCapabilities(void) const
+{
+	return m_Capabilities;
+}
+
+/**
+ * Sets the capabilities the peer announced in its icinga::Hello message.
+ *
+ * @param capabilities The capabilities.
+ */
+void JsonRpcConnection::SetCapabilities(int capabilities)
+{
+	boost::mutex::scoped_lock lock(m_CapabilitiesMutex);
+
+	m_Capabilities = capabilities;
+	m_CapabilitiesKnown = true;
+}
+
+/**
+ * Checks whether the peer's icinga::Hello message has been processed.
+ *
+ * @returns true if the capabilities are known.
+ */
+bool JsonRpcConnection::HasCapabilities(void) const
+{
+	boost::mutex::scoped_lock lock(m_CapabilitiesMutex);
+
+	return m_CapabilitiesKnown;
+}
+
+/**
+ * Returns the hashes of the config files the peer announced in its
+ * icinga::Hello message.
+ *
+ * @returns The hashes per zone, or an empty value.
+ */
+Dictionary::Ptr JsonRpcConnection::GetConfigManifest(void) const
+{
+	boost::mutex::scoped_lock lock(m_CapabilitiesMutex);
+
+	return m_ConfigManifest;
+}
+
+void JsonRpcConnection::SetConfigManifest(const Dictionary::Ptr& manifest)
+{
+	boost::mutex::scoped_lock lock(m_CapabilitiesMutex);
+
+	m_ConfigManifest = manifest;
+}
+
 void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 {
 	try {
+		BufferChain chain;
+		size_t length = JsonRpc::EncodeMessage(chain, message);
+
 		ObjectLock olock(m_Stream);
 		if (m_Stream->IsEof())
 			return;
-		JsonRpc::SendMessage(m_Stream, message);
+
+		WriteFrames(chain, length);
 	} catch (const std::exception& ex) {
 		std::ostringstream info;
 		info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
@@ -124,6 +253,184 @@ void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 	}
 }
 
+/**
+ * Queues an encoded message for the peer. The message is written to the stream
+ * by one of the send queues so that the caller doesn't have to wait for the
+ * stream. The same string can be queued for any number of connections.
+ *
+ * @param json The JSON-encoded message.
+ */
+void JsonRpcConnection::SendRawMessage(const BufferRange& json)
+{
+	boost::mutex::scoped_lock lock(m_OutboundMutex);
+
+	if (m_OutboundOverflow)
+		return;
+
+	if (m_OutboundQueue.size() >= JSONRPC_OUTBOUND_MAX_MESSAGES ||
+	    m_OutboundBytes + m_Stream->GetSendQueueSize() + json.Length > JSONRPC_OUTBOUND_MAX_BYTES) {
+		m_OutboundOverflow = true;
+
+		Log(LogWarning, "JsonRpcConnection")
+		    << "Outbound queue for identity '" << m_Identity << "' is full (" << m_OutboundQueue.size()
+		    << " messages, " << m_OutboundBytes << " bytes). Disconnecting client.";
+
+		Utility::QueueAsyncCallback(boost::bind(&JsonRpcConnection::Disconnect, JsonRpcConnection::Ptr(this)));
+
+		return;
+	}
+
+	m_OutboundQueue.push_back(json);
+	m_OutboundBytes += json.Length;
+
+	if (!m_OutboundPending) {
+		m_OutboundPending = true;
+		l_JsonRpcConnectionSendQueues[m_ID % l_JsonRpcConnectionWorkQueueCount].Enqueue(boost::bind(&JsonRpcConnection::FlushOutboundQueue, JsonRpcConnection::Ptr(this)));
+	}
+}
+
+void JsonRpcConnection::FlushOutboundQueue(void)
+{
+	std::deque<BufferRange> queue;
+
+	{
+		boost::mutex::scoped_lock lock(m_OutboundMutex);
+		queue.swap(m_OutboundQueue);
+		m_OutboundBytes = 0;
+		m_OutboundPending = false;
+	}
+
+	/* the messages are shared with other connections and aren't copied */
+	BufferChain chain;
+	size_t length = 0;
+
+	for (const BufferRange& json : queue) {
+		NetString::WriteStringToChain(chain, json);
+		length += json.Length;
+	}
+
+	try {
+		ObjectLock olock(m_Stream);
+
+		if (m_Stream->IsEof())
+			return;
+
+		WriteFrames(chain, length);
+	} catch (const std::exception& ex) {
+		std::ostringstream info;
+		info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
+		Log(LogWarning, "JsonRpcConnection")
+		    << info.str() << "\n" << DiagnosticInformation(ex);
+
+		Disconnect();
+	}
+}
+
+/**
+ * Waits until the stream's send queue holds no more than the specified
+ * number of bytes.
+ *
+ * @param limit The number of bytes.
+ */
+void JsonRpcConnection::WaitForSendQueue(size_t limit)
+{
+	size_t queued = m_Stream->GetSendQueueSize();
+	double lastProgress = Utility::GetTime();
+
+	while (queued > limit) {
+		if (m_Stream->IsEof())
+			BOOST_THROW_EXCEPTION(std::runtime_error("Connection was closed."));
+
+		Utility::Sleep(0.1);
+
+		size_t current = m_Stream->GetSendQueueSize();
+		double now = Utility::GetTime();
+
+		if (current < queued)
+			lastProgress = now;
+		else if (now - lastProgress > JSONRPC_REPLAY_STALL_TIMEOUT)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Peer did not read any data for " + Convert::ToString(JSONRPC_REPLAY_STALL_TIMEOUT) + " seconds."));
+
+		queued = current;
+	}
+}
+
+/**
+ * Writes an encoded message to the stream. Unlike SendRawMessage() this
+ * doesn't return until the message has been handed to the stream, and errors
+ * are passed on to the caller. The message isn't subject to the outbound
+ * queue limits, use WaitForSendQueue() to wait for the peer.
+ *
+ * @param json The JSON-encoded message.
+ */
+void JsonRpcConnection::WriteRawMessage(const BufferRange& json)
+{
+	BufferChain chain;
+	NetString::WriteStringToChain(chain, json);
+
+	ObjectLock olock(m_Stream);
+	WriteFrames(chain, json.Length);
+}
+
+/**
+ * Writes netstring-encoded messages to the stream. If the peer supports it
+ * they are compressed and sent as a single frame. The caller must hold the
+ * stream's object lock.
+ *
+ * @param chain The encoded messages. The chain is empty afterwards.
+ * @param length The total length of the messages (excluding the netstring
+ *		headers).
+ */
+void JsonRpcConnection::WriteFrames(BufferChain& chain, size_t length)
+{
+	size_t compressedLength = length;
+
+#ifdef HAVE_ZLIB
+	if (GetCapabilities() & ApiCapabilityDeflate) {
+		if (!m_Deflater)
+			m_Deflater = new JsonRpcDeflater();
+
+		BufferChain compressed;
+		m_Deflater->Compress(chain, compressed);
+
+		compressedLength = compressed.GetAvailableBytes() + 1;
+
+		String header = Convert::ToString(compressedLength) + ":";
+		char marker = JSONRPC_COMPRESSED_FRAME;
+
+		chain.Append(header.CStr(), header.GetLength());
+		chain.Append(&marker, 1);
+		chain.Append(compressed);
+		chain.Append(",", 1);
+	}
+#endif /* HAVE_ZLIB */
+
+	m_Stream->WriteChain(chain);
+
+	boost::mutex::scoped_lock lock(m_TrafficMutex);
+	m_BytesSent += length;
+	m_BytesSentCompressed += compressedLength;
+}
+
+/**
+ * Returns the number of bytes which were sent and received on this
+ * connection, before and after compression.
+ *
+ * @returns A dictionary with the counters.
+ */
+Dictionary::Ptr JsonRpcConnection::GetTrafficStats(void) const
+{
+	Dictionary::Ptr stats = new Dictionary();
+
+	boost::mutex::scoped_lock lock(m_TrafficMutex);
+	stats->Set("bytes_sent", m_BytesSent);
+	stats->Set("bytes_sent_compressed", m_BytesSentCompressed);
+	stats->Set("bytes_received", m_BytesReceived);
+	stats->Set("bytes_received_compressed", m_BytesReceivedCompressed);
+
+	return stats;
+}
+
 void JsonRpcConnection::Disconnect(void)
 {
 	Log(LogWarning, "JsonRpcConnection")
@@ -139,7 +446,7 @@ void JsonRpcConnection::Disconnect(void)
 	}
 }
 
-void JsonRpcConnection::MessageHandlerWrapper(const String& jsonString)
+void JsonRpcConnection::MessageHandlerWrapper(const BufferRange& jsonString)
 {
 	if (m_Stream->IsEof())
 		return;
@@ -157,15 +464,188 @@ void JsonRpcConnection::MessageHandlerWrapper(const String& jsonString)
 	}
 }
 
-void JsonRpcConnection::MessageHandler(const String& jsonString)
+void JsonRpcConnection::MessageHandler(const BufferRange& jsonString)
+{
+	if (jsonString.Length > 0 && jsonString.GetData()[0] == JSONRPC_COMPRESSED_FRAME) {
+		CompressedFrameHandler(jsonString);
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_TrafficMutex);
+		m_BytesReceived += jsonString.Length;
+		m_BytesReceivedCompressed += jsonString.Length;
+	}
+
+	DecodeFrame(jsonString);
+}
+
+/**
+ * Decompresses a frame and handles the messages it contains. Frames are
+ * processed in the order in which they were received because they share
+ * the connection's deflate stream.
+ *
+ * @param frame The frame, including the marker byte.
+ */
+void JsonRpcConnection::CompressedFrameHandler(const BufferRange& frame)
 {
-	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
+#ifdef HAVE_ZLIB
+	if (!ApiListener::IsCompressionEnabled())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Received a compressed JSON-RPC frame but compression is disabled"));
+
+	if (!m_Inflater)
+		m_Inflater = new JsonRpcInflater();
+
+	m_Inflater->Decompress(frame.GetData() + 1, frame.Length - 1, m_InflateChain);
+
+	size_t length = 0;
+	BufferRange jsonString;
+
+	while (NetString::ReadStringFromChain(m_InflateChain, &jsonString) == StatusNewItem) {
+		if (jsonString.Length > 0 && jsonString.GetData()[0] == JSONRPC_COMPRESSED_FRAME)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Compressed JSON-RPC frames must not be nested"));
+
+		length += jsonString.Length;
+
+		DecodeFrame(jsonString);
+	}
+
+	boost::mutex::scoped_lock lock(m_TrafficMutex);
+	m_BytesReceived += length;
+	m_BytesReceivedCompressed += frame.Length;
+#else /* HAVE_ZLIB */
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Received a compressed JSON-RPC frame but compression is not supported"));
+#endif /* HAVE_ZLIB */
+}
+
+void JsonRpcConnection::DecodeFrame(const BufferRange& jsonString)
+{
+	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString.GetData(), jsonString.Length);
 
 	m_Seen = Utility::GetTime();
 
 	if (m_HeartbeatTimeout != 0)
 		m_NextHeartbeat = Utility::GetTime() + m_HeartbeatTimeout;
 
+	/* unpack messages which were coalesced by the sender */
+	if (message->Get("method") == "icinga::Batch") {
+		Dictionary::Ptr params = message->Get("params");
+
+		if (!params)
+			return;
+
+		Array::Ptr messages = params->Get("messages");
+
+		if (!messages)
+			return;
+
+		ObjectLock olock(messages);
+		for (const Dictionary::Ptr& bmessage : messages) {
+			if (bmessage)
+				DispatchMessage(bmessage);
+		}
+
+		return;
+	}
+
+	DispatchMessage(message);
+}
+
+/**
+ * Determines which lane a message is processed in.
+ *
+ * @param method The message's method.
+ * @returns The lane.
+ */
+MessageLane JsonRpcConnection::GetMessageLane(const String& method)
+{
+	if (method == "event::Heartbeat" || method == "icinga::Hello" || method == "log::SetLogPosition")
+		return MessageLaneHeartbeat;
+
+	/* Check results, acknowledgements, downtimes etc. for the same object
+	 * must not overtake each other, they therefore share one lane. */
+	if (method.SubStr(0, 7) == "event::" && method != "event::UpdateRepository")
+		return MessageLaneCheckable;
+
+	return MessageLaneBulk;
+}
+
+/**
+ * Determines which lane a message is processed in and which checkable it
+ * refers to. Events may refer to comments, downtimes etc. which are created
+ * and deleted with config::UpdateObject and config::DeleteObject, so those
+ * messages are processed in the checkable's lane as well.
+ *
+ * @param message The message.
+ * @param checkable Receives the checkable's name ("host!service", the
+ *		    service is empty for hosts) if the message refers to one.
+ * @returns The lane.
+ */
+MessageLane JsonRpcConnection::GetMessageLane(const Dictionary::Ptr& message, String *checkable)
+{
+	String method = message->Get("method");
+	MessageLane lane = GetMessageLane(method);
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params)
+		return lane;
+
+	if (lane == MessageLaneCheckable) {
+		if (params->Contains("host")) {
+			String host = params->Get("host");
+			String service = params->Get("service");
+			*checkable = host + "!" + service;
+		}
+
+		return lane;
+	}
+
+	if (method != "config::UpdateObject" && method != "config::DeleteObject")
+		return lane;
+
+	String type = params->Get("type");
+	String name = params->Get("name");
+
+	if (type == "Host") {
+		*checkable = name + "!";
+		return MessageLaneCheckable;
+	}
+
+	if (type == "Service") {
+		*checkable = name;
+		return MessageLaneCheckable;
+	}
+
+	/* These objects' names start with the name of their host or service. */
+	if (type == "Comment" || type == "Downtime" || type == "Notification" ||
+	    type == "Dependency" || type == "ScheduledDowntime") {
+		String::SizeType pos = name.RFind("!");
+
+		if (pos == String::NPos)
+			return lane;
+
+		String prefix = name.SubStr(0, pos);
+
+		if (prefix.Find("!") == String::NPos)
+			prefix += "!";
+
+		*checkable = prefix;
+		return MessageLaneCheckable;
+	}
+
+	return lane;
+}
+
+/**
+ * Queues a message for processing in its lane. Messages for the same
+ * checkable (or, if they don't refer to one, from the same connection) always
+ * end up in the same queue so that they're processed in order.
+ *
+ * @param message The message.
+ */
+void JsonRpcConnection::DispatchMessage(const Dictionary::Ptr& message)
+{
+	/* This has to happen in the order in which the messages were received. */
 	if (m_Endpoint && message->Contains("ts")) {
 		double ts = message->Get("ts");
 
@@ -176,6 +656,93 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 		m_Endpoint->SetRemoteLogPosition(ts);
 	}
 
+	String checkable;
+	MessageLane lane = GetMessageLane(message, &checkable);
+	unsigned long key = m_ID;
+
+	if (!checkable.IsEmpty())
+		key = Utility::SDBM(checkable);
+
+	WorkQueue& queue = l_JsonRpcConnectionLaneQueues[lane][key % l_JsonRpcConnectionLaneQueueCount[lane]];
+	queue.Enqueue(boost::bind(&JsonRpcConnection::LaneHandlerWrapper, JsonRpcConnection::Ptr(this), message, lane, Utility::GetTime()));
+}
+
+void JsonRpcConnection::LaneHandlerWrapper(const Dictionary::Ptr& message, MessageLane lane, double enqueued)
+{
+	if (m_Stream->IsEof())
+		return;
+
+	try {
+		HandleMessage(message);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "JsonRpcConnection")
+		    << "Error while processing JSON-RPC message for identity '" << m_Identity
+		    << "': " << DiagnosticInformation(ex);
+
+		Disconnect();
+
+		return;
+	}
+
+	double now = Utility::GetTime();
+
+	l_JsonRpcConnectionLaneMessages[lane]->InsertValue(now, 1);
+
+	JsonRpcLaneLatency& latency = l_JsonRpcConnectionLaneLatency[lane];
+	boost::mutex::scoped_lock lock(latency.Mutex);
+	AdvanceLaneLatency(latency, static_cast<long>(now));
+	latency.Slots[static_cast<long>(now) % JSONRPC_LANE_LATENCY_SLOTS] += now - enqueued;
+}
+
+/**
+ * Returns the number of queued messages, the number of messages processed
+ * in the last minute and their average latency (in seconds, measured from
+ * when the message was queued until it was processed) for each lane.
+ */
+Dictionary::Ptr JsonRpcConnection::GetMessageLaneStats(void)
+{
+	boost::call_once(l_JsonRpcConnectionOnceFlag, &JsonRpcConnection::StaticInitialize);
+
+	Dictionary::Ptr stats = new Dictionary();
+	double now = Utility::GetTime();
+
+	for (int lane = 0; lane < MESSAGE_LANE_COUNT; lane++) {
+		size_t queued = 0;
+
+		for (size_t i = 0; i < l_JsonRpcConnectionLaneQueueCount[lane]; i++)
+			queued += l_JsonRpcConnectionLaneQueues[lane][i].GetLength();
+
+		int messages = l_JsonRpcConnectionLaneMessages[lane]->UpdateAndGetValues(now, 60);
+		double latencyTotal = 0;
+
+		{
+			JsonRpcLaneLatency& laneLatency = l_JsonRpcConnectionLaneLatency[lane];
+			boost::mutex::scoped_lock lock(laneLatency.Mutex);
+			AdvanceLaneLatency(laneLatency, static_cast<long>(now));
+
+			for (double slot : laneLatency.Slots)
+				latencyTotal += slot;
+		}
+
+		double latency = 0;
+
+		if (messages > 0)
+			latency = latencyTotal / messages;
+
+		Dictionary::Ptr laneStats = new Dictionary();
+		laneStats->Set("queue_threads", l_JsonRpcConnectionLaneQueueCount[lane]);
+		laneStats->Set("queued", queued);
+		laneStats->Set("messages_1min", messages);
+		laneStats->Set("avg_latency", latency);
+
+		stats->Set(l_JsonRpcConnectionLaneNames[lane], laneStats);
+	}
+
+	return stats;
+}
+
+void JsonRpcConnection::HandleMessage(const Dictionary::Ptr& message)
+{
 	MessageOrigin::Ptr origin = new MessageOrigin();
 	origin->FromClient = this;
 
@@ -218,9 +785,9 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 
 bool JsonRpcConnection::ProcessMessage(void)
 {
-	String message;
+	BufferRange message;
 
-	StreamReadStatus srs = JsonRpc::ReadMessage(m_Stream, &message, m_Context, false);
+	StreamReadStatus srs = NetString::ReadStringFromChain(m_RecvChain, &message);
 
 	if (srs != StatusNewItem)
 		return false;
@@ -241,6 +808,8 @@ void JsonRpcConnection::DataAvailableHandler(void)
 		boost::mutex::scoped_lock lock(m_DataHandlerMutex);
 
 		try {
+			m_Stream->ReadChain(m_RecvChain);
+
 			while (ProcessMessage())
 				; /* empty loop body */
 		} catch (const std::exception& ex) {
@@ -21,10 +21,12 @@
 #define JSONRPCCONNECTION_H
 
 #include "remote/endpoint.hpp"
+#include "remote/jsonrpccompression.hpp"
 #include "base/tlsstream.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include "remote/i2-remote.hpp"
+#include <deque>
 
 namespace icinga
 {
@@ -41,6 +43,42 @@ enum ClientType
 	ClientHttp
 };
 
+/**
+ * Optional protocol features which are announced in the icinga::Hello message.
+ *
+ * @ingroup remote
+ */
+enum ApiCapability
+{
+	ApiCapabilityBatch = 1,
+	ApiCapabilityConfigSync = 2,
+	ApiCapabilityDeflate = 4
+};
+
+/**
+ * Processing lanes for incoming messages. Each lane has its own work queues
+ * so that bulk traffic can't delay heartbeats or check results. All events
+ * for hosts and services, and the config updates for them and their
+ * comments, downtimes etc., share a lane so that they're processed in order
+ * for each object.
+ *
+ * @ingroup remote
+ */
+enum MessageLane
+{
+	MessageLaneHeartbeat,
+	MessageLaneCheckable,
+	MessageLaneBulk
+};
+
+#define MESSAGE_LANE_COUNT 3
+
+/**
+ * The replay log waits for the peer while the stream's send queue is larger
+ * than this, so that it can't use up the outbound limit of live messages.
+ */
+#define JSONRPC_REPLAY_MAX_QUEUED_BYTES (16 * 1024 * 1024)
+
 class MessageOrigin;
 
 /**
@@ -64,13 +102,28 @@ public:
 	TlsStream::Ptr GetStream(void) const;
 	ConnectionRole GetRole(void) const;
 
+	int GetCapabilities(void) const;
+	void SetCapabilities(int capabilities);
+	bool HasCapabilities(void) const;
+	Dictionary::Ptr GetConfigManifest(void) const;
+	void SetConfigManifest(const Dictionary::Ptr& manifest);
+
 	void Disconnect(void);
 
 	void SendMessage(const Dictionary::Ptr& request);
+	void SendRawMessage(const BufferRange& json);
+	void WriteRawMessage(const BufferRange& json);
+	void WaitForSendQueue(size_t limit);
+
+	Dictionary::Ptr GetTrafficStats(void) const;
 
 	static void HeartbeatTimerHandler(void);
 	static Value HeartbeatAPIHandler(const intrusive_ptr<MessageOrigin>& origin, const Dictionary::Ptr& params);
 
+	static MessageLane GetMessageLane(const String& method);
+	static MessageLane GetMessageLane(const Dictionary::Ptr& message, String *checkable);
+	static Dictionary::Ptr GetMessageLaneStats(void);
+
 private:
 	int m_ID;
 	String m_Identity;
@@ -82,14 +135,43 @@ private:
 	double m_Seen;
 	double m_NextHeartbeat;
 	double m_HeartbeatTimeout;
+	int m_Capabilities;
+	bool m_CapabilitiesKnown;
+	Dictionary::Ptr m_ConfigManifest;
+	mutable boost::mutex m_CapabilitiesMutex;
 	boost::mutex m_DataHandlerMutex;
 
-	StreamReadContext m_Context;
+	BufferChain m_RecvChain;
+
+	boost::mutex m_OutboundMutex;
+	std::deque<BufferRange> m_OutboundQueue;
+	size_t m_OutboundBytes;
+	bool m_OutboundPending;
+	bool m_OutboundOverflow;
+
+#ifdef HAVE_ZLIB
+	JsonRpcDeflater::Ptr m_Deflater;
+	JsonRpcInflater::Ptr m_Inflater;
+	BufferChain m_InflateChain;
+#endif /* HAVE_ZLIB */
+
+	mutable boost::mutex m_TrafficMutex;
+	double m_BytesSent;
+	double m_BytesSentCompressed;
+	double m_BytesReceived;
+	double m_BytesReceivedCompressed;
 
 	bool ProcessMessage(void);
-	void MessageHandlerWrapper(const String& jsonString);
-	void MessageHandler(const String& jsonString);
+	void MessageHandlerWrapper(const BufferRange& jsonString);
+	void MessageHandler(const BufferRange& jsonString);
+	void CompressedFrameHandler(const BufferRange& frame);
+	void DecodeFrame(const BufferRange& jsonString);
+	void DispatchMessage(const Dictionary::Ptr& message);
+	void LaneHandlerWrapper(const Dictionary::Ptr& message, MessageLane lane, double enqueued);
+	void HandleMessage(const Dictionary::Ptr& message);
 	void DataAvailableHandler(void);
+	void FlushOutboundQueue(void);
+	void WriteFrames(BufferChain& chain, size_t length);
 
 	static void StaticInitialize(void);
 	static void TimeoutTimerHandler(void);
@@ -19,6 +19,7 @@
 
 #include "remote/modifyobjecthandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresultwriter.hpp"
 #include "remote/filterutility.hpp"
 #include "remote/apiaction.hpp"
 #include "base/exception.hpp"
@@ -78,7 +79,7 @@ bool ModifyObjectHandler::HandleRequest(const ApiUser::Ptr& user, HttpRequest& r
 
 	Dictionary::Ptr attrs = attrsVal;
 
-	Array::Ptr results = new Array();
+	HttpResultWriter writer(response);
 
 	for (const ConfigObject::Ptr& obj : objs) {
 		Dictionary::Ptr result1 = new Dictionary();
@@ -104,14 +105,10 @@ bool ModifyObjectHandler::HandleRequest(const ApiUser::Ptr& user, HttpRequest& r
 			result1->Set("status", "Attribute '" + key + "' could not be set: " + DiagnosticInformation(ex));
 		}
 
-		results->Add(result1);
+		writer.Add(result1);
 	}
 
-	Dictionary::Ptr result = new Dictionary();
-	result->Set("results", results);
-
-	response.SetStatus(200, "OK");
-	HttpUtility::SendJsonBody(response, result);
+	writer.Finish();
 
 	return true;
 }
@@ -19,10 +19,12 @@
 
 #include "remote/objectqueryhandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresultwriter.hpp"
 #include "remote/filterutility.hpp"
 #include "base/serializer.hpp"
 #include "base/dependencygraph.hpp"
 #include "base/configtype.hpp"
+#include "base/logger.hpp"
 #include <boost/algorithm/string.hpp>
 #include <set>
 
@@ -30,11 +32,9 @@ using namespace icinga;
 
 REGISTER_URLHANDLER("/v1/objects", ObjectQueryHandler);
 
-Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& object,
+std::vector<int> ObjectQueryHandler::GetAttrFieldIds(const Type::Ptr& type,
     const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs)
 {
-	Type::Ptr type = object->GetReflectionType();
-
 	std::vector<int> fids;
 
 	if (isJoin && attrs) {
@@ -81,6 +81,46 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 		}
 	}
 
+	return fids;
+}
+
+/**
+ * Returns the type of the objects a navigation field refers to. Service
+ * references are plain strings and only the navigation name tells the type.
+ */
+Type::Ptr ObjectQueryHandler::GetJoinType(const Field& field)
+{
+	String typeName;
+
+	if (field.RefTypeName)
+		typeName = field.RefTypeName;
+	else if (String(field.TypeName) != "String")
+		typeName = field.TypeName;
+	else {
+		typeName = field.NavigationName;
+
+		String::SizeType upos = typeName.FindLastOf("_");
+		if (upos != String::NPos)
+			typeName = typeName.SubStr(upos + 1);
+
+		typeName = typeName.SubStr(0, 1).ToUpper() + typeName.SubStr(1);
+	}
+
+	Type::Ptr joinType = Type::GetByName(typeName);
+
+	if (!joinType || !ConfigObject::TypeInstance->IsAssignableFrom(joinType))
+		return Type::Ptr();
+
+	return joinType;
+}
+
+Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& object,
+    const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs)
+{
+	Type::Ptr type = object->GetReflectionType();
+
+	std::vector<int> fids = GetAttrFieldIds(type, attrPrefix, attrs, isJoin, allAttrs);
+
 	Dictionary::Ptr resultAttrs = new Dictionary();
 
 	for (int fid : fids)
@@ -147,8 +187,15 @@ bool ObjectQueryHandler::HandleRequest(const ApiUser::Ptr& user, HttpRequest& re
 		return true;
 	}
 
-	Array::Ptr results = new Array();
-	results->Reserve(objs.size());
+	if (umetas) {
+		ObjectLock olock(umetas);
+		for (const String& meta : umetas) {
+			if (meta != "used_by" && meta != "location") {
+				HttpUtility::SendJsonError(response, 400, "Invalid field specified for meta: " + meta);
+				return true;
+			}
+		}
+	}
 
 	std::set<String> joinAttrs;
 	std::set<String> userJoinAttrs;
@@ -172,98 +219,125 @@ bool ObjectQueryHandler::HandleRequest(const ApiUser::Ptr& user, HttpRequest& re
 		joinAttrs.insert(field.Name);
 	}
 
-	for (const ConfigObject::Ptr& obj : objs) {
-		Dictionary::Ptr result1 = new Dictionary();
-		results->Add(result1);
-
-		result1->Set("name", obj->GetName());
-		result1->Set("type", obj->GetReflectionType()->GetName());
-
-		Dictionary::Ptr metaAttrs = new Dictionary();
-		result1->Set("meta", metaAttrs);
-
-		if (umetas) {
-			ObjectLock olock(umetas);
-			for (const String& meta : umetas) {
-				if (meta == "used_by") {
-					Array::Ptr used_by = new Array();
-					metaAttrs->Set("used_by", used_by);
-
-					for (const Object::Ptr& pobj : DependencyGraph::GetParents((obj)))
-					{
-						ConfigObject::Ptr configObj = dynamic_pointer_cast<ConfigObject>(pobj);
-
-						if (!configObj)
-							continue;
-
-						Dictionary::Ptr refInfo = new Dictionary();
-						refInfo->Set("type", configObj->GetReflectionType()->GetName());
-						refInfo->Set("name", configObj->GetName());
-						used_by->Add(refInfo);
-					}
-				} else if (meta == "location") {
-					DebugInfo di = obj->GetDebugInfo();
-					Dictionary::Ptr dinfo = new Dictionary();
-					dinfo->Set("path", di.Path);
-					dinfo->Set("first_line", di.FirstLine);
-					dinfo->Set("first_column", di.FirstColumn);
-					dinfo->Set("last_line", di.LastLine);
-					dinfo->Set("last_column", di.LastColumn);
-					metaAttrs->Set("location", dinfo);
-				} else {
-					HttpUtility::SendJsonError(response, 400, "Invalid field specified for meta: " + meta);
-					return true;
-				}
-			}
+	/* The response status is sent with the first result, check the
+	 * attributes even if no objects match the query. */
+	try {
+		GetAttrFieldIds(type, String(), uattrs, false, false);
+
+		for (const String& joinAttr : joinAttrs) {
+			Field field = type->GetFieldInfo(type->GetFieldId(joinAttr));
+			Type::Ptr joinType = GetJoinType(field);
+
+			if (joinType)
+				GetAttrFieldIds(joinType, field.NavigationName, ujoins, true, allJoins);
 		}
+	} catch (const ScriptError& ex) {
+		HttpUtility::SendJsonError(response, 400, ex.what());
+		return true;
+	}
+
+	/* Results are encoded and sent one object at a time so that large
+	 * queries don't have to be materialized in memory first. */
+	HttpResultWriter writer(response);
+
+	for (const ConfigObject::Ptr& obj : objs) {
+		Dictionary::Ptr result1;
 
 		try {
-			result1->Set("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
+			result1 = SerializeObject(obj, uattrs, ujoins, umetas, allJoins, joinAttrs);
 		} catch (const ScriptError& ex) {
-			HttpUtility::SendJsonError(response, 400, ex.what());
-			return true;
+			if (writer.GetCount() == 0) {
+				HttpUtility::SendJsonError(response, 400, ex.what());
+				return true;
+			}
+
+			/* The response status has already been sent, report the error
+			 * in place of the object's attributes. */
+			result1 = new Dictionary();
+			result1->Set("name", obj->GetName());
+			result1->Set("type", obj->GetReflectionType()->GetName());
+			result1->Set("code", 500);
+			result1->Set("status", "Object could not be serialized: " + String(ex.what()));
 		}
 
-		Dictionary::Ptr joins = new Dictionary();
-		result1->Set("joins", joins);
+		writer.Add(result1);
+	}
 
-		for (const String& joinAttr : joinAttrs) {
-			Object::Ptr joinedObj;
-			int fid = type->GetFieldId(joinAttr);
+	writer.Finish();
 
-			if (fid < 0) {
-				HttpUtility::SendJsonError(response, 400, "Invalid field specified for join: " + joinAttr);
-				return true;
-			}
+	return true;
+}
 
-			Field field = type->GetFieldInfo(fid);
+Dictionary::Ptr ObjectQueryHandler::SerializeObject(const ConfigObject::Ptr& obj, const Array::Ptr& uattrs,
+    const Array::Ptr& ujoins, const Array::Ptr& umetas, bool allJoins, const std::set<String>& joinAttrs)
+{
+	Type::Ptr type = obj->GetReflectionType();
 
-			if (!(field.Attributes & FANavigation)) {
-				HttpUtility::SendJsonError(response, 400, "Not a joinable field: " + joinAttr);
-				return true;
-			}
+	Dictionary::Ptr result1 = new Dictionary();
 
-			joinedObj = obj->NavigateField(fid);
+	result1->Set("name", obj->GetName());
+	result1->Set("type", type->GetName());
 
-			if (!joinedObj)
-				continue;
+	Dictionary::Ptr metaAttrs = new Dictionary();
+	result1->Set("meta", metaAttrs);
 
-			String prefix = field.NavigationName;
+	if (umetas) {
+		ObjectLock olock(umetas);
+		for (const String& meta : umetas) {
+			if (meta == "used_by") {
+				Array::Ptr used_by = new Array();
+				metaAttrs->Set("used_by", used_by);
 
-			try {
-				joins->Set(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
-			} catch (const ScriptError& ex) {
-				HttpUtility::SendJsonError(response, 400, ex.what());
-				return true;
+				for (const Object::Ptr& pobj : DependencyGraph::GetParents((obj)))
+				{
+					ConfigObject::Ptr configObj = dynamic_pointer_cast<ConfigObject>(pobj);
+
+					if (!configObj)
+						continue;
+
+					Dictionary::Ptr refInfo = new Dictionary();
+					refInfo->Set("type", configObj->GetReflectionType()->GetName());
+					refInfo->Set("name", configObj->GetName());
+					used_by->Add(refInfo);
+				}
+			} else if (meta == "location") {
+				DebugInfo di = obj->GetDebugInfo();
+				Dictionary::Ptr dinfo = new Dictionary();
+				dinfo->Set("path", di.Path);
+				dinfo->Set("first_line", di.FirstLine);
+				dinfo->Set("first_column", di.FirstColumn);
+				dinfo->Set("last_line", di.LastLine);
+				dinfo->Set("last_column", di.LastColumn);
+				metaAttrs->Set("location", dinfo);
 			}
 		}
 	}
 
-	Dictionary::Ptr result = new Dictionary();
-	result->Set("results", results);
+	result1->Set("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
 
-	response.SetStatus(200, "OK");
-	HttpUtility::SendJsonBody(response, result);
+	Dictionary::Ptr joins = new Dictionary();
+	result1->Set("joins", joins);
 
-	return true;
+	for (const String& joinAttr : joinAttrs) {
+		int fid = type->GetFieldId(joinAttr);
+
+		if (fid < 0)
+			BOOST_THROW_EXCEPTION(ScriptError("Invalid field specified for join: " + joinAttr));
+
+		Field field = type->GetFieldInfo(fid);
+
+		if (!(field.Attributes & FANavigation))
+			BOOST_THROW_EXCEPTION(ScriptError("Not a joinable field: " + joinAttr));
+
+		Object::Ptr joinedObj = obj->NavigateField(fid);
+
+		if (!joinedObj)
+			continue;
+
+		String prefix = field.NavigationName;
+
+		joins->Set(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
+	}
+
+	return result1;
 }
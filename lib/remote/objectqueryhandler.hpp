@@ -21,6 +21,9 @@
 #define OBJECTQUERYHANDLER_H
 
 #include "remote/httphandler.hpp"
+#include "base/configobject.hpp"
+#include <set>
+#include <vector>
 
 namespace icinga
 {
@@ -34,8 +37,13 @@ public:
 	    HttpResponse& response, const Dictionary::Ptr& params) override;
 
 private:
+	static std::vector<int> GetAttrFieldIds(const Type::Ptr& type, const String& attrPrefix,
+	    const Array::Ptr& attrs, bool isJoin, bool allAttrs);
+	static Type::Ptr GetJoinType(const Field& field);
 	static Dictionary::Ptr SerializeObjectAttrs(const Object::Ptr& object, const String& attrPrefix,
 	    const Array::Ptr& attrs, bool isJoin, bool allAttrs);
+	static Dictionary::Ptr SerializeObject(const ConfigObject::Ptr& obj, const Array::Ptr& uattrs,
+	    const Array::Ptr& ujoins, const Array::Ptr& umetas, bool allJoins, const std::set<String>& joinAttrs);
 };
 
 }
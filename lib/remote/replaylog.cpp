@@ -0,0 +1,280 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "remote/replaylog.hpp"
+#include "base/exception.hpp"
+#include <fstream>
+#include <string.h>
+
+#ifndef _WIN32
+#	include <sys/mman.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+struct ReplayLogRecordHeader
+{
+	uint32_t MessageLength;
+	uint32_t ZoneLength;
+	double Timestamp;
+};
+
+struct ReplayLogIndexEntry
+{
+	double Timestamp;
+	uint64_t Offset;
+};
+
+struct ReplayLogFooter
+{
+	uint64_t IndexOffset;
+	uint64_t IndexCount;
+	char Magic[8];
+};
+
+/**
+ * Constructor for the ReplayLogWriter class.
+ *
+ * @param stream The stream for the segment.
+ * @param offset The current size of the segment.
+ */
+ReplayLogWriter::ReplayLogWriter(const Stream::Ptr& stream, uint64_t offset)
+	: m_Stream(stream), m_Offset(offset), m_Count(0), m_BlockTimestamp(0), m_BlockOffset(0)
+{
+	if (m_Offset == 0) {
+		m_Stream->Write(REPLAYLOG_MAGIC, 8);
+		m_Offset = 8;
+	}
+}
+
+void ReplayLogWriter::Write(double ts, const String& zone, const String& message)
+{
+	if (m_Count % REPLAYLOG_INDEX_INTERVAL == 0) {
+		if (m_Count > 0)
+			m_Index.push_back(std::make_pair(m_BlockTimestamp, m_BlockOffset));
+
+		m_BlockTimestamp = ts;
+		m_BlockOffset = m_Offset;
+	}
+
+	/* timestamps are not necessarily monotonic, messages from other
+	 * endpoints keep their original timestamp */
+	if (ts > m_BlockTimestamp)
+		m_BlockTimestamp = ts;
+
+	ReplayLogRecordHeader header;
+	header.MessageLength = message.GetLength();
+	header.ZoneLength = zone.GetLength();
+	header.Timestamp = ts;
+
+	m_Stream->Write(&header, sizeof(header));
+	m_Stream->Write(zone.CStr(), zone.GetLength());
+	m_Stream->Write(message.CStr(), message.GetLength());
+
+	m_Offset += sizeof(header) + zone.GetLength() + message.GetLength();
+	m_Count++;
+}
+
+void ReplayLogWriter::Close(void)
+{
+	if (m_Count > 0)
+		m_Index.push_back(std::make_pair(m_BlockTimestamp, m_BlockOffset));
+
+	ReplayLogFooter footer;
+	footer.IndexOffset = m_Offset;
+	footer.IndexCount = m_Index.size();
+	memcpy(footer.Magic, REPLAYLOG_INDEX_MAGIC, sizeof(footer.Magic));
+
+	typedef std::pair<double, uint64_t> IndexPair;
+	for (const IndexPair& kv : m_Index) {
+		ReplayLogIndexEntry entry;
+		entry.Timestamp = kv.first;
+		entry.Offset = kv.second;
+		m_Stream->Write(&entry, sizeof(entry));
+	}
+
+	m_Stream->Write(&footer, sizeof(footer));
+	m_Stream->Close();
+}
+
+size_t ReplayLogWriter::GetCount(void) const
+{
+	return m_Count;
+}
+
+/**
+ * Constructor for the ReplayLogReader class.
+ *
+ * @param path The path of the segment.
+ */
+ReplayLogReader::ReplayLogReader(const String& path)
+	: m_Data(NULL), m_Size(0), m_Offset(0), m_End(0), m_Index(NULL), m_IndexCount(0), m_Valid(false)
+{
+#ifndef _WIN32
+	int fd = open(path.CStr(), O_RDONLY);
+
+	if (fd < 0)
+		return;
+
+	struct stat statbuf;
+
+	if (fstat(fd, &statbuf) < 0 || statbuf.st_size < 8) {
+		(void)close(fd);
+		return;
+	}
+
+	void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	(void)close(fd);
+
+	if (data == MAP_FAILED)
+		return;
+
+	m_Data = static_cast<char *>(data);
+	m_Size = statbuf.st_size;
+
+#	ifdef MADV_SEQUENTIAL
+	(void)madvise(m_Data, m_Size, MADV_SEQUENTIAL);
+#	endif /* MADV_SEQUENTIAL */
+#else /* _WIN32 */
+	std::ifstream fp(path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	if (!fp)
+		return;
+
+	fp.seekg(0, std::ifstream::end);
+	m_Size = fp.tellg();
+	fp.seekg(0, std::ifstream::beg);
+
+	if (m_Size < 8)
+		return;
+
+	m_Data = new char[m_Size];
+
+	if (!fp.read(m_Data, m_Size)) {
+		delete [] m_Data;
+		m_Data = NULL;
+		return;
+	}
+#endif /* _WIN32 */
+
+	/* segments written by older versions contain netstrings */
+	if (memcmp(m_Data, REPLAYLOG_MAGIC, 8) != 0)
+		return;
+
+	m_Valid = true;
+	m_Offset = 8;
+	m_End = m_Size;
+
+	/* the segment which was being written when Icinga was stopped
+	 * doesn't have an index */
+	if (m_Size >= 8 + sizeof(ReplayLogFooter)) {
+		ReplayLogFooter footer;
+		memcpy(&footer, m_Data + m_Size - sizeof(footer), sizeof(footer));
+
+		if (memcmp(footer.Magic, REPLAYLOG_INDEX_MAGIC, sizeof(footer.Magic)) == 0 &&
+		    footer.IndexOffset >= 8 && footer.IndexCount <= m_Size / sizeof(ReplayLogIndexEntry) &&
+		    footer.IndexOffset + footer.IndexCount * sizeof(ReplayLogIndexEntry) == m_Size - sizeof(footer)) {
+			m_End = footer.IndexOffset;
+			m_Index = m_Data + footer.IndexOffset;
+			m_IndexCount = footer.IndexCount;
+		}
+	}
+}
+
+ReplayLogReader::~ReplayLogReader(void)
+{
+	if (!m_Data)
+		return;
+
+#ifndef _WIN32
+	(void)munmap(m_Data, m_Size);
+#else /* _WIN32 */
+	delete [] m_Data;
+#endif /* _WIN32 */
+}
+
+/**
+ * Checks whether the file is a replay log segment in the binary format.
+ *
+ * @returns true if the segment can be read, false otherwise.
+ */
+bool ReplayLogReader::IsValid(void) const
+{
+	return m_Valid;
+}
+
+/**
+ * Skips the records at the beginning of the segment which are known to
+ * be older than the specified timestamp. Newer records may still be
+ * followed by older records.
+ *
+ * @param ts The timestamp.
+ */
+void ReplayLogReader::Seek(double ts)
+{
+	for (size_t i = 0; i < m_IndexCount; i++) {
+		ReplayLogIndexEntry entry;
+		memcpy(&entry, m_Index + i * sizeof(entry), sizeof(entry));
+
+		if (entry.Timestamp > ts) {
+			if (entry.Offset > m_Offset && entry.Offset < m_End)
+				m_Offset = entry.Offset;
+
+			return;
+		}
+	}
+
+	/* all records are older */
+	if (m_IndexCount > 0)
+		m_Offset = m_End;
+}
+
+/**
+ * Reads the next record.
+ *
+ * @param record Receives the record. Its pointers are valid until the
+ *		 reader is destroyed.
+ * @returns true if a record was read, false if the end of the segment was
+ *	    reached or the segment is truncated.
+ */
+bool ReplayLogReader::Next(ReplayLogRecord *record)
+{
+	if (!m_Valid || m_End - m_Offset < sizeof(ReplayLogRecordHeader))
+		return false;
+
+	ReplayLogRecordHeader header;
+	memcpy(&header, m_Data + m_Offset, sizeof(header));
+
+	size_t offset = m_Offset + sizeof(header);
+
+	if (header.ZoneLength > m_End - offset || header.MessageLength > m_End - offset - header.ZoneLength)
+		return false;
+
+	record->Timestamp = header.Timestamp;
+	record->Zone = m_Data + offset;
+	record->ZoneLength = header.ZoneLength;
+	record->Message = m_Data + offset + header.ZoneLength;
+	record->MessageLength = header.MessageLength;
+
+	m_Offset = offset + header.ZoneLength + header.MessageLength;
+
+	return true;
+}
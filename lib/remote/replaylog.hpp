@@ -0,0 +1,114 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef REPLAYLOG_H
+#define REPLAYLOG_H
+
+#include "remote/i2-remote.hpp"
+#include "base/stream.hpp"
+#include <vector>
+#include <stdint.h>
+
+namespace icinga
+{
+
+#define REPLAYLOG_MAGIC "I2RPLOG1"
+#define REPLAYLOG_INDEX_MAGIC "I2RPIDX1"
+#define REPLAYLOG_INDEX_INTERVAL 256
+
+/**
+ * A record in a replay log segment.
+ *
+ * @ingroup remote
+ */
+struct ReplayLogRecord
+{
+	double Timestamp;
+	const char *Zone;
+	size_t ZoneLength;
+	const char *Message;
+	size_t MessageLength;
+};
+
+/**
+ * Writes a segment of the cluster replay log.
+ *
+ * A segment starts with REPLAYLOG_MAGIC. Each record consists of a fixed
+ * size header, the name of the zone the message's object belongs to (empty
+ * if every endpoint may receive the message) and the JSON-encoded message.
+ * When the segment is closed a sparse index with the offset and the
+ * highest timestamp of every REPLAYLOG_INDEX_INTERVAL records is
+ * appended, followed by a footer which points to the index.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API ReplayLogWriter : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ReplayLogWriter);
+
+	ReplayLogWriter(const Stream::Ptr& stream, uint64_t offset);
+
+	void Write(double ts, const String& zone, const String& message);
+	void Close(void);
+
+	size_t GetCount(void) const;
+
+private:
+	Stream::Ptr m_Stream;
+	uint64_t m_Offset;
+	size_t m_Count;
+	double m_BlockTimestamp;
+	uint64_t m_BlockOffset;
+	std::vector<std::pair<double, uint64_t> > m_Index;
+};
+
+/**
+ * Reads a segment of the cluster replay log. The file is mapped into
+ * memory and records are returned without copying or decoding them.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API ReplayLogReader : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ReplayLogReader);
+
+	ReplayLogReader(const String& path);
+	~ReplayLogReader(void);
+
+	bool IsValid(void) const;
+
+	void Seek(double ts);
+	bool Next(ReplayLogRecord *record);
+
+private:
+	char *m_Data;
+	size_t m_Size;
+	size_t m_Offset;
+	size_t m_End;
+	const char *m_Index;
+	size_t m_IndexCount;
+	bool m_Valid;
+};
+
+}
+
+#endif /* REPLAYLOG_H */
@@ -0,0 +1,111 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/bufferchain.hpp"
+#include "base/netstring.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_bufferchain)
+
+BOOST_AUTO_TEST_CASE(io)
+{
+	BufferChain chain;
+
+	BOOST_CHECK(chain.GetAvailableBytes() == 0);
+
+	std::string data(3 * BUFFER_SEGMENT_SIZE + 17, 'x');
+
+	for (std::string::size_type i = 0; i < data.size(); i++)
+		data[i] = 'a' + i % 26;
+
+	chain.Append(data.c_str(), 100);
+	chain.Append(data.c_str() + 100, data.size() - 100);
+
+	BOOST_CHECK(chain.GetAvailableBytes() == data.size());
+
+	char buffer[200];
+	BOOST_CHECK(chain.Peek(buffer, sizeof(buffer)) == sizeof(buffer));
+	BOOST_CHECK(std::string(buffer, sizeof(buffer)) == data.substr(0, sizeof(buffer)));
+	BOOST_CHECK(chain.GetAvailableBytes() == data.size());
+
+	std::string result;
+
+	for (;;) {
+		size_t rc = chain.Read(buffer, sizeof(buffer));
+
+		if (rc == 0)
+			break;
+
+		result.append(buffer, rc);
+	}
+
+	BOOST_CHECK(result == data);
+	BOOST_CHECK(chain.GetAvailableBytes() == 0);
+
+	size_t count = 10;
+	char *writeBuffer = chain.Reserve(&count);
+	BOOST_CHECK(count >= 10);
+	memcpy(writeBuffer, "hello", 5);
+	chain.Commit(5);
+
+	BufferChain other;
+	other.Append(chain);
+
+	BOOST_CHECK(chain.GetAvailableBytes() == 0);
+	BOOST_CHECK(other.GetAvailableBytes() == 5);
+	BOOST_CHECK(other.Read(NULL, 5) == 5);
+	BOOST_CHECK(other.GetAvailableBytes() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(range)
+{
+	BufferRange hello = BufferRange::FromString("hello");
+	BufferRange world = BufferRange::FromString("world");
+
+	BufferChain chain;
+	chain.Append(hello);
+	chain.Append(world);
+	chain.Append(hello);
+
+	BufferRange range;
+	BOOST_CHECK(chain.ReadRange(5, &range));
+	BOOST_CHECK(range.Segment == hello.Segment);
+	BOOST_CHECK(String(range.GetData(), range.GetData() + range.Length) == "hello");
+
+	/* spans two ranges and has to be copied */
+	BOOST_CHECK(chain.ReadRange(8, &range));
+	BOOST_CHECK(String(range.GetData(), range.GetData() + range.Length) == "worldhel");
+
+	BOOST_CHECK(!chain.ReadRange(3, &range));
+	BOOST_CHECK(chain.GetAvailableBytes() == 2);
+
+	BufferChain frames;
+	NetString::WriteStringToChain(frames, hello);
+	NetString::WriteStringToChain(frames, BufferRange::FromString(""));
+
+	BOOST_CHECK(NetString::ReadStringFromChain(frames, &range) == StatusNewItem);
+	BOOST_CHECK(String(range.GetData(), range.GetData() + range.Length) == "hello");
+	BOOST_CHECK(NetString::ReadStringFromChain(frames, &range) == StatusNewItem);
+	BOOST_CHECK(range.Length == 0);
+	BOOST_CHECK(NetString::ReadStringFromChain(frames, &range) == StatusNeedData);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,84 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/deadlinequeue.hpp"
+#include "base/dictionary.hpp"
+#include "base/utility.hpp"
+#include <boost/bind.hpp>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_deadlinequeue)
+
+static void Callback(std::vector<Object::Ptr> *objects, const Object::Ptr& object)
+{
+	objects->push_back(object);
+}
+
+BOOST_AUTO_TEST_CASE(process)
+{
+	std::vector<Object::Ptr> objects;
+	DeadlineQueue::Ptr queue = new DeadlineQueue(boost::bind(&Callback, &objects, _1));
+
+	Dictionary::Ptr first = new Dictionary();
+	Dictionary::Ptr second = new Dictionary();
+	Dictionary::Ptr third = new Dictionary();
+
+	queue->Set(first, 100);
+	queue->Set(second, 50);
+	queue->Set(third, 200);
+	queue->Set(third, 150);
+
+	BOOST_CHECK(queue->GetLength() == 3);
+	BOOST_CHECK(queue->GetNextDeadline() == 50);
+
+	BOOST_CHECK(queue->Process(49) == 0);
+	BOOST_CHECK(queue->Process(100) == 2);
+	BOOST_CHECK(objects.size() == 2 && objects[0] == second && objects[1] == first);
+
+	queue->Remove(third);
+	BOOST_CHECK(queue->Process(1000) == 0);
+	BOOST_CHECK(queue->GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(timer)
+{
+	std::vector<Object::Ptr> objects;
+	DeadlineQueue::Ptr queue = new DeadlineQueue(boost::bind(&Callback, &objects, _1));
+	queue->Start();
+
+	double now = Utility::GetTime();
+
+	Dictionary::Ptr first = new Dictionary();
+	Dictionary::Ptr second = new Dictionary();
+	queue->Set(first, now + 0.5);
+	queue->Set(second, now + 1);
+
+	/* the queue's interval is 60 seconds, the deadlines must not wait for it */
+	Utility::Sleep(0.75);
+	BOOST_CHECK(objects.size() == 1);
+
+	Utility::Sleep(0.5);
+	BOOST_CHECK(objects.size() == 2);
+
+	queue->Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
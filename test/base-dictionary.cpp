@@ -20,11 +20,40 @@
 #include "base/dictionary.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
 #include <boost/tuple/tuple.hpp>
+#include <map>
 
 using namespace icinga;
 
+static unsigned long l_Allocations = 0;
+
+/* Counts the allocations of the containers it is used with, so that the
+ * allocations test can compare Dictionary with the std::map it used before. */
+template<typename T>
+struct CountingAllocator : public std::allocator<T>
+{
+	template<typename U>
+	struct rebind
+	{
+		typedef CountingAllocator<U> other;
+	};
+
+	CountingAllocator(void)
+	{ }
+
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U>&)
+	{ }
+
+	T *allocate(size_t n)
+	{
+		l_Allocations++;
+		return std::allocator<T>::allocate(n);
+	}
+};
+
 BOOST_AUTO_TEST_SUITE(base_dictionary)
 
 BOOST_AUTO_TEST_CASE(construct)
@@ -179,4 +208,134 @@ BOOST_AUTO_TEST_CASE(json)
 	BOOST_CHECK(deserialized->Get("test2") == "hello world");
 }
 
+BOOST_AUTO_TEST_CASE(large)
+{
+	Dictionary::Ptr dictionary = new Dictionary();
+
+	/* grow beyond the flat threshold in non-sorted order */
+	for (int i = 0; i < 100; i++) {
+		int key = (i * 37) % 100;
+		dictionary->Set("key" + Convert::ToString(key), key);
+	}
+
+	BOOST_CHECK(dictionary->GetLength() == 100);
+
+	for (int i = 0; i < 100; i++)
+		BOOST_CHECK(dictionary->Get("key" + Convert::ToString(i)) == i);
+
+	{
+		ObjectLock olock(dictionary);
+
+		String last;
+		int count = 0;
+
+		for (const Dictionary::Pair& kv : dictionary) {
+			BOOST_CHECK(last < kv.first);
+			last = kv.first;
+			count++;
+		}
+
+		BOOST_CHECK(count == 100);
+	}
+
+	for (int i = 0; i < 100; i += 2)
+		dictionary->Remove("key" + Convert::ToString(i));
+
+	BOOST_CHECK(dictionary->GetLength() == 50);
+	BOOST_CHECK(!dictionary->Contains("key0"));
+	BOOST_CHECK(dictionary->Get("key1") == 1);
+
+	dictionary->Clear();
+	BOOST_CHECK(dictionary->GetLength() == 0);
+
+	dictionary->Set("test1", 7);
+	BOOST_CHECK(dictionary->Get("test1") == 7);
+}
+
+BOOST_AUTO_TEST_CASE(construct_pairs)
+{
+	Dictionary::PairVector pairs;
+	pairs.push_back(Dictionary::Pair("test2", "hello world"));
+	pairs.push_back(Dictionary::Pair("test1", 7));
+	pairs.push_back(Dictionary::Pair("test2", "duplicate"));
+
+	Dictionary::Ptr dictionary = new Dictionary(std::move(pairs));
+
+	BOOST_CHECK(dictionary->GetLength() == 2);
+	BOOST_CHECK(dictionary->Get("test1") == 7);
+	BOOST_CHECK(dictionary->Get("test2") == "duplicate");
+
+	ObjectLock olock(dictionary);
+	BOOST_CHECK(dictionary->Begin()->first == "test1");
+}
+
+static std::vector<Dictionary::Pair> GetCheckResultAttributes(void)
+{
+	std::vector<Dictionary::Pair> attrs;
+	attrs.push_back(Dictionary::Pair("type", "CheckResult"));
+	attrs.push_back(Dictionary::Pair("active", true));
+	attrs.push_back(Dictionary::Pair("check_source", "satellite-1"));
+	attrs.push_back(Dictionary::Pair("command", "/usr/lib/nagios/plugins/check_ping"));
+	attrs.push_back(Dictionary::Pair("execution_start", 1507000000.123456));
+	attrs.push_back(Dictionary::Pair("execution_end", 1507000000.623456));
+	attrs.push_back(Dictionary::Pair("schedule_start", 1507000000.0));
+	attrs.push_back(Dictionary::Pair("schedule_end", 1507000001.0));
+	attrs.push_back(Dictionary::Pair("exit_status", 0));
+	attrs.push_back(Dictionary::Pair("state", 0));
+	attrs.push_back(Dictionary::Pair("output", "PING OK - Packet loss = 0%, RTA = 0.54 ms"));
+	attrs.push_back(Dictionary::Pair("performance_data", "rta=0.540000ms;3000.000000;5000.000000;0.000000"));
+	attrs.push_back(Dictionary::Pair("vars_before", Empty));
+	attrs.push_back(Dictionary::Pair("vars_after", Empty));
+	return attrs;
+}
+
+static void CountAllocation(size_t)
+{
+	l_Allocations++;
+}
+
+BOOST_AUTO_TEST_CASE(allocations)
+{
+	const int count = 10000;
+
+	std::vector<Dictionary::Pair> attrs = GetCheckResultAttributes();
+
+	BOOST_CHECK(attrs.size() <= DICTIONARY_FLAT_THRESHOLD);
+
+	/* the previous representation: one map node per key */
+	unsigned long start = l_Allocations;
+
+	for (int i = 0; i < count; i++) {
+		std::map<String, Value, std::less<String>, CountingAllocator<std::pair<const String, Value> > > cr;
+
+		for (const Dictionary::Pair& kv : attrs)
+			cr[kv.first] = kv.second;
+	}
+
+	double mapAllocations = static_cast<double>(l_Allocations - start) / count;
+
+	Dictionary::SetAllocationHook(&CountAllocation);
+
+	start = l_Allocations;
+
+	for (int i = 0; i < count; i++) {
+		Dictionary::Ptr cr = new Dictionary();
+
+		for (const Dictionary::Pair& kv : attrs)
+			cr->Set(kv.first, kv.second);
+
+		for (const Dictionary::Pair& kv : attrs)
+			BOOST_REQUIRE(cr->Get(kv.first) == kv.second);
+	}
+
+	Dictionary::SetAllocationHook(NULL);
+
+	double flatAllocations = static_cast<double>(l_Allocations - start) / count;
+
+	BOOST_TEST_MESSAGE("Container allocations per check result: std::map " << mapAllocations << ", Dictionary " << flatAllocations);
+
+	BOOST_CHECK(flatAllocations > 0);
+	BOOST_CHECK(flatAllocations < mapAllocations);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/jsondecoder.hpp"
+#include "base/array.hpp"
+#include "base/utility.hpp"
+#include "base/convert.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_json)
+
+static String MakeCheckResultMessage(int index)
+{
+	Dictionary::Ptr cr = new Dictionary();
+	cr->Set("type", "CheckResult");
+	cr->Set("active", true);
+	cr->Set("check_source", "satellite-" + Convert::ToString(index % 4));
+	cr->Set("command", new Array({ "/usr/lib/nagios/plugins/check_ping", "-H", "192.168.0." + Convert::ToString(index % 250), "-c", "5000,100%", "-w", "3000,80%" }));
+	cr->Set("execution_start", 1507000000.123456 + index);
+	cr->Set("execution_end", 1507000000.623456 + index);
+	cr->Set("schedule_start", 1507000000.0 + index);
+	cr->Set("schedule_end", 1507000001.0 + index);
+	cr->Set("exit_status", 0);
+	cr->Set("state", 0);
+	cr->Set("output", "PING OK - Packet loss = 0%, RTA = 0.54 ms\nsecond line with \"quotes\"");
+	cr->Set("performance_data", new Array({ "rta=0.540000ms;3000.000000;5000.000000;0.000000", "pl=0%;80;100;0" }));
+
+	Dictionary::Ptr vars = new Dictionary();
+	vars->Set("attempt", 1);
+	vars->Set("reachable", true);
+	vars->Set("state", 0);
+	vars->Set("state_type", 1);
+	cr->Set("vars_before", vars);
+	cr->Set("vars_after", vars);
+
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("host", "host-" + Convert::ToString(index));
+	params->Set("service", "ping4");
+	params->Set("cr", cr);
+
+	Dictionary::Ptr message = new Dictionary();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "event::CheckResult");
+	message->Set("params", params);
+	message->Set("ts", 1507000001.5 + index);
+
+	return JsonEncode(message);
+}
+
+BOOST_AUTO_TEST_CASE(decode_benchmark)
+{
+	std::vector<String> corpus;
+
+	for (int i = 0; i < 2000; i++)
+		corpus.push_back(MakeCheckResultMessage(i));
+
+	double start = Utility::GetTime();
+
+	for (const String& message : corpus)
+		JsonDecode(message, false);
+
+	double yajlTime = Utility::GetTime() - start;
+
+	start = Utility::GetTime();
+
+	for (const String& message : corpus)
+		JsonDecode(message, true);
+
+	double indexTime = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Decoded " << corpus.size() << " event::CheckResult messages: yajl " << yajlTime * 1000
+	    << " ms, structural index (" << JsonDecoder::GetImplementation() << ") " << indexTime * 1000 << " ms");
+
+	for (const String& message : corpus)
+		BOOST_CHECK(JsonEncode(JsonDecode(message, true)) == JsonEncode(JsonDecode(message, false)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,8 +21,12 @@
 #include "base/dictionary.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
+#include "base/jsondecoder.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
 #include <boost/tuple/tuple.hpp>
+#include <boost/bind.hpp>
 
 using namespace icinga;
 
@@ -35,4 +39,88 @@ BOOST_AUTO_TEST_CASE(invalid1)
 	BOOST_CHECK_THROW(JsonDecode("{\"test\": \"test\""), std::exception);
 }
 
+static void AppendChunk(String& result, int& chunks, const char *data, size_t count)
+{
+	BOOST_CHECK(count > 0 && count <= JSON_CHUNK_SIZE);
+
+	result += String(data, data + count);
+	chunks++;
+}
+
+BOOST_AUTO_TEST_CASE(encode_chunked)
+{
+	Array::Ptr arr = new Array();
+
+	for (int i = 0; i < 10000; i++) {
+		Dictionary::Ptr dict = new Dictionary();
+		dict->Set("index", i);
+		dict->Set("name", "object-" + Convert::ToString(i));
+		arr->Add(dict);
+	}
+
+	String result;
+	int chunks = 0;
+	JsonEncode(arr, boost::bind(&AppendChunk, boost::ref(result), boost::ref(chunks), _1, _2));
+
+	BOOST_CHECK(chunks > 1);
+	BOOST_CHECK(result == JsonEncode(arr));
+}
+
+BOOST_AUTO_TEST_CASE(decode_stream)
+{
+	String doc = "{\"a\": [1, 2.5, -3e2, true, false, null], \"b\": {\"c\": \"\\u00e9 test\"}, \"d\": []}";
+
+	/* feed the document one byte at a time so tokens are split everywhere */
+	JsonStreamDecoder decoder;
+
+	for (size_t i = 0; i < doc.GetLength(); i++)
+		decoder.Feed(doc.CStr() + i, 1);
+
+	BOOST_CHECK(decoder.GetLength() == doc.GetLength());
+	BOOST_CHECK(JsonEncode(decoder.Finish()) == JsonEncode(JsonDecode(doc, false)));
+
+	JsonStreamDecoder invalid;
+	BOOST_CHECK_THROW(invalid.Feed("{8: ", 4), std::exception);
+
+	JsonStreamDecoder truncated;
+	truncated.Feed("{\"test\": ", 9);
+	BOOST_CHECK_THROW(truncated.Finish(), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(decode_index)
+{
+	std::vector<String> docs;
+	docs.push_back("{\"a\": [1, 2.5, -3e2, 0.1, 1507000000.123456, true, false, null], \"b\": {}}");
+	docs.push_back("[[[1], [2, [3]]], [], [[], {}], \"x\"]");
+	docs.push_back("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\u20ac\"");
+	docs.push_back("  {\"key\" :\t\"value\" , \"key\": \"duplicate\"}\r\n");
+	docs.push_back("12345678901234567890123");
+
+	/* escapes and strings which cross the 64-byte block boundaries */
+	String str = "[\"";
+	for (int i = 0; i < 200; i++)
+		str += (i % 7 == 0) ? "\\\\" : ((i % 5 == 0) ? "\\\"" : "x");
+	str += "\", \"\\\\\"]";
+	docs.push_back(str);
+
+	for (const String& doc : docs) {
+		Value result;
+		BOOST_CHECK(JsonDecoder::Decode(doc, &result));
+		BOOST_CHECK(JsonEncode(result) == JsonEncode(JsonDecode(doc, false)));
+	}
+
+	/* the index-based decoder leaves these to yajl */
+	Value result;
+	BOOST_CHECK(!JsonDecoder::Decode("[1, 2] // comment", &result));
+	BOOST_CHECK(!JsonDecoder::Decode("[1, 2", &result));
+	BOOST_CHECK(!JsonDecoder::Decode("{\"a\" 1}", &result));
+	BOOST_CHECK(!JsonDecoder::Decode("[01]", &result));
+	BOOST_CHECK(!JsonDecoder::Decode("[1] 2", &result));
+	BOOST_CHECK(!JsonDecoder::Decode("\"\\ud83d\\ude00\"", &result));
+
+	BOOST_CHECK_THROW(JsonDecode("[1, 2"), std::exception);
+	Array::Ptr arr = JsonDecode("[1, 2] // comment");
+	BOOST_CHECK(arr->GetLength() == 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,6 +19,8 @@
 
 #include "base/object.hpp"
 #include "base/value.hpp"
+#include "base/objectpool.hpp"
+#include <boost/thread/thread.hpp>
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -34,6 +36,17 @@ public:
 	}
 };
 
+class LargeTestObject : public Object
+{
+public:
+	char Data[2 * OBJECTPOOL_MAX_SIZE];
+};
+
+static void FreeTestObjects(std::vector<Object::Ptr> *objects)
+{
+	objects->clear();
+}
+
 BOOST_AUTO_TEST_SUITE(base_object)
 
 BOOST_AUTO_TEST_CASE(construct)
@@ -53,4 +66,31 @@ BOOST_AUTO_TEST_CASE(getself)
 	BOOST_CHECK(vobject.IsObjectType<TestObject>());
 }
 
+BOOST_AUTO_TEST_CASE(pool)
+{
+	std::vector<Object::Ptr> objects;
+
+	for (int i = 0; i < 10000; i++) {
+		objects.push_back(new TestObject());
+		objects.push_back(new LargeTestObject());
+	}
+
+	/* objects may be freed by another thread */
+	boost::thread thread(boost::bind(&FreeTestObjects, &objects));
+	thread.join();
+
+	BOOST_CHECK(objects.empty());
+
+	Object::Ptr first = new TestObject();
+	Object::Ptr second = new TestObject();
+	BOOST_CHECK(first != second);
+
+	Dictionary::Ptr status = new Dictionary();
+	ObjectPool::StatsFunc(status, new Array());
+
+	Dictionary::Ptr stats = status->Get("objectpool");
+	BOOST_CHECK(stats->Get("slabs") > 0);
+	BOOST_CHECK(stats->Get("free_blocks") > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
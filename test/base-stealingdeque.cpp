@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/stealingdeque.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <atomic>
+#include <vector>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_stealingdeque)
+
+BOOST_AUTO_TEST_CASE(pushpop)
+{
+	StealingDeque<int, 4> deque;
+	int items[5] = { 0, 1, 2, 3, 4 };
+
+	BOOST_CHECK(deque.Pop() == NULL);
+	BOOST_CHECK(deque.Steal() == NULL);
+
+	for (int i = 0; i < 4; i++)
+		BOOST_CHECK(deque.Push(&items[i]));
+
+	BOOST_CHECK(!deque.Push(&items[4]));
+	BOOST_CHECK(deque.GetLength() == 4);
+
+	/* The owner takes the newest item, thieves take the oldest one. */
+	BOOST_CHECK(deque.Pop() == &items[3]);
+	BOOST_CHECK(deque.Steal() == &items[0]);
+
+	BOOST_CHECK(deque.Push(&items[4]));
+	BOOST_CHECK(deque.Pop() == &items[4]);
+	BOOST_CHECK(deque.Pop() == &items[2]);
+	BOOST_CHECK(deque.Steal() == &items[1]);
+
+	BOOST_CHECK(deque.Pop() == NULL);
+	BOOST_CHECK(deque.Steal() == NULL);
+	BOOST_CHECK(deque.GetLength() == 0);
+}
+
+#define RACE_ITEMS 200000
+#define RACE_THIEVES 3
+
+static void Thief(StealingDeque<int, 64> *deque, std::atomic<int> *taken, std::atomic<bool> *done)
+{
+	while (!done->load()) {
+		int *item = deque->Steal();
+
+		if (item)
+			taken[*item]++;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(race)
+{
+	StealingDeque<int, 64> deque;
+	std::vector<int> items(RACE_ITEMS);
+	std::vector<std::atomic<int> > taken(RACE_ITEMS);
+	std::atomic<bool> done(false);
+
+	for (int i = 0; i < RACE_ITEMS; i++) {
+		items[i] = i;
+		taken[i] = 0;
+	}
+
+	boost::thread_group thieves;
+
+	for (int i = 0; i < RACE_THIEVES; i++)
+		thieves.create_thread(boost::bind(&Thief, &deque, &taken[0], &done));
+
+	/* Keep the deque short so that the owner often races the thieves for
+	 * the last item. */
+	for (int i = 0; i < RACE_ITEMS; i++) {
+		while (!deque.Push(&items[i])) {
+			int *item = deque.Pop();
+
+			if (item)
+				taken[*item]++;
+		}
+
+		if (i % 3 == 0) {
+			int *item = deque.Pop();
+
+			if (item)
+				taken[*item]++;
+		}
+
+		/* Let the thieves run even if there is only one CPU. */
+		if (i % 256 == 0)
+			boost::this_thread::yield();
+	}
+
+	int *item;
+
+	while ((item = deque.Pop()))
+		taken[*item]++;
+
+	done.store(true);
+	thieves.join_all();
+
+	int lost = 0, duplicated = 0;
+
+	for (int i = 0; i < RACE_ITEMS; i++) {
+		if (taken[i] == 0)
+			lost++;
+		else if (taken[i] > 1)
+			duplicated++;
+	}
+
+	BOOST_CHECK(lost == 0);
+	BOOST_CHECK(duplicated == 0);
+	BOOST_CHECK(deque.GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,41 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base-tlsstream-fixture.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_tlsstream)
+
+BOOST_FIXTURE_TEST_CASE(loopback_benchmark, TlsStreamFixture)
+{
+	const size_t total = 64 * 1024 * 1024;
+
+	double start = Utility::GetTime();
+	size_t received = Transfer(total);
+	double duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(received == total);
+	BOOST_TEST_MESSAGE("Transferred " << total / (1024 * 1024) << " MB over TLS loopback in " << duration * 1000
+	    << " ms (" << total / (1024 * 1024) / duration << " MB/s)");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
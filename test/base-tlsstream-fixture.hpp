@@ -0,0 +1,121 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef BASE_TLSSTREAM_FIXTURE_H
+#define BASE_TLSSTREAM_FIXTURE_H
+
+#include "base/tlsstream.hpp"
+#include "base/tlsutility.hpp"
+#include "base/socket.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * Creates a temporary directory with a self-signed certificate for
+ * "localhost" and removes it again when the test case is done.
+ */
+struct TlsStreamFixture
+{
+	String Dir;
+	String KeyFile;
+	String CertFile;
+
+	TlsStreamFixture(void)
+	{
+		InitializeOpenSSL();
+
+		char dirTemplate[] = "/tmp/icinga2-tls-XXXXXX";
+		BOOST_REQUIRE(mkdtemp(dirTemplate) != NULL);
+		Dir = dirTemplate;
+
+		KeyFile = Dir + "/localhost.key";
+		CertFile = Dir + "/localhost.crt";
+		MakeX509CSR("localhost", KeyFile, String(), CertFile);
+	}
+
+	~TlsStreamFixture(void)
+	{
+		(void) unlink(KeyFile.CStr());
+		(void) unlink(CertFile.CStr());
+		(void) rmdir(Dir.CStr());
+	}
+
+	/**
+	 * Sends data from a client to a server over a socket pair.
+	 *
+	 * @returns The number of bytes the server received.
+	 */
+	size_t Transfer(size_t total)
+	{
+		boost::shared_ptr<SSL_CTX> sslContext = MakeSSLContext(CertFile, KeyFile, CertFile);
+
+		SOCKET fds[2];
+		Socket::SocketPair(fds);
+
+		TlsStream::Ptr server = new TlsStream(new Socket(fds[0]), "localhost", RoleServer, sslContext);
+		TlsStream::Ptr client = new TlsStream(new Socket(fds[1]), "localhost", RoleClient, sslContext);
+
+		boost::thread clientThread(boost::bind(&TlsStreamFixture::ClientThreadProc, client, total));
+
+		server->Handshake();
+
+		BufferChain chain;
+		size_t received = 0;
+
+		while (received < total) {
+			/* blocks until at least one byte was received */
+			char ch;
+			server->Peek(&ch, 1, false);
+
+			server->ReadChain(chain);
+
+			received += chain.Read(NULL, chain.GetAvailableBytes());
+		}
+
+		clientThread.join();
+
+		client->Close();
+		server->Close();
+
+		return received;
+	}
+
+private:
+	static void ClientThreadProc(const TlsStream::Ptr& client, size_t total)
+	{
+		client->Handshake();
+
+		char buffer[1024];
+		memset(buffer, 'x', sizeof(buffer));
+
+		for (size_t sent = 0; sent < total; sent += BUFFER_SEGMENT_SIZE) {
+			BufferChain chain;
+
+			while (chain.GetAvailableBytes() < BUFFER_SEGMENT_SIZE)
+				chain.Append(buffer, sizeof(buffer));
+
+			client->WriteChain(chain);
+		}
+	}
+};
+
+#endif /* BASE_TLSSTREAM_FIXTURE_H */
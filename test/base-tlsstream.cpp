@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base-tlsstream-fixture.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_tlsstream)
+
+BOOST_FIXTURE_TEST_CASE(loopback, TlsStreamFixture)
+{
+	const size_t total = 4 * BUFFER_SEGMENT_SIZE;
+
+	BOOST_CHECK(Transfer(total) == total);
+}
+
+static void ResumptionClientThreadProc(const TlsStream::Ptr& client)
+{
+	client->Handshake(10);
+
+	/* TLS 1.3 servers send the session ticket after the handshake */
+	char ch;
+	client->Read(&ch, 1, false);
+}
+
+BOOST_FIXTURE_TEST_CASE(session_resumption, TlsStreamFixture)
+{
+	String ticketfile = Dir + "/ticket.key";
+
+	boost::shared_ptr<SSL_CTX> clientContext = MakeSSLContext(CertFile, KeyFile, CertFile);
+
+	for (int i = 0; i < 2; i++) {
+		/* a new server context for each connection, as if the server had been restarted */
+		boost::shared_ptr<SSL_CTX> serverContext = MakeSSLContext(CertFile, KeyFile, CertFile);
+		SetTicketKeysToSSLContext(serverContext, ticketfile);
+		BOOST_CHECK(Utility::PathExists(ticketfile));
+
+		SOCKET fds[2];
+		Socket::SocketPair(fds);
+
+		TlsStream::Ptr server = new TlsStream(new Socket(fds[0]), String(), RoleServer, serverContext);
+		TlsStream::Ptr client = new TlsStream(new Socket(fds[1]), "localhost", RoleClient, clientContext);
+
+		boost::thread clientThread(boost::bind(&ResumptionClientThreadProc, client));
+
+		server->Handshake(10);
+		server->Write("x", 1);
+
+		clientThread.join();
+
+		/* the first connection can't be resumed, the second one resumes the first one's session */
+		BOOST_CHECK(client->IsSessionReused() == (i > 0));
+		BOOST_CHECK(server->IsSessionReused() == (i > 0));
+		BOOST_CHECK(server->IsVerifyOK() == client->IsVerifyOK());
+
+		client->Close();
+		server->Close();
+	}
+
+	(void) unlink(ticketfile.CStr());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "checker/checkercomponent.hpp"
+#include "icinga/host.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(checker_component)
+
+BOOST_AUTO_TEST_CASE(shard_index)
+{
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 256; i++)
+		hosts.push_back(new Host());
+
+	for (size_t shards = 1; shards <= 8; shards++) {
+		std::vector<size_t> counts(shards);
+
+		for (const Host::Ptr& host : hosts) {
+			size_t index = CheckerComponent::GetShardIndex(host, shards);
+
+			BOOST_REQUIRE(index < shards);
+			BOOST_CHECK_EQUAL(index, CheckerComponent::GetShardIndex(host, shards));
+
+			counts[index]++;
+		}
+
+		for (size_t i = 0; i < shards; i++)
+			BOOST_CHECK_MESSAGE(counts[i] > 0, "Shard " << i << " of " << shards << " is not used.");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(shard_slots)
+{
+	for (size_t shards = 1; shards <= 8; shards++) {
+		for (long slots = -2; slots <= 20; slots++) {
+			for (size_t offset = 0; offset < shards; offset++) {
+				long total = 0;
+
+				for (size_t i = 0; i < shards; i++) {
+					long shardSlots = CheckerComponent::GetShardSlots(slots, shards, i + offset);
+
+					BOOST_CHECK(shardSlots >= 0);
+					total += shardSlots;
+				}
+
+				BOOST_CHECK_EQUAL(total, std::max(slots, 0L));
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/host.hpp"
+#include "icinga/dependency.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_dependency)
+
+static Host::Ptr MakeHost(const String& name)
+{
+	Host::Ptr host = new Host();
+	host->SetName(name);
+	host->Register();
+
+	return host;
+}
+
+static void SetHostState(const Host::Ptr& host, ServiceState state, StateType type)
+{
+	CheckResult::Ptr cr = new CheckResult();
+	cr->SetState(state);
+
+	host->SetStateRaw(state);
+	host->SetStateType(type);
+	host->SetLastCheckResult(cr);
+}
+
+BOOST_AUTO_TEST_CASE(reachability_cache)
+{
+	Host::Ptr parent = MakeHost("dependency-parent");
+	Host::Ptr child = MakeHost("dependency-child");
+	Host::Ptr grandchild = MakeHost("dependency-grandchild");
+
+	Dependency::Ptr dep1 = new Dependency();
+	dep1->SetName("dependency-parent-child");
+	dep1->SetParentHostName(parent->GetName());
+	dep1->SetChildHostName(child->GetName());
+
+	Dependency::Ptr dep2 = new Dependency();
+	dep2->SetName("dependency-child-grandchild");
+	dep2->SetParentHostName(child->GetName());
+	dep2->SetChildHostName(grandchild->GetName());
+
+	for (const ConfigObject::Ptr& object : std::vector<ConfigObject::Ptr>{ dep1, dep2 }) {
+		object->OnConfigLoaded();
+		object->OnAllConfigLoaded();
+	}
+
+	SetHostState(parent, ServiceOK, StateTypeHard);
+	SetHostState(child, ServiceOK, StateTypeHard);
+
+	ReachabilityCacheStatistics before = Checkable::GetReachabilityCacheStatistics();
+
+	BOOST_CHECK(grandchild->IsReachable());
+	BOOST_CHECK(grandchild->IsReachable());
+
+	ReachabilityCacheStatistics after = Checkable::GetReachabilityCacheStatistics();
+	BOOST_CHECK(after.misses - before.misses == 3);
+	BOOST_CHECK(after.hits - before.hits == 1);
+
+	/* a hard state change of the root must propagate through the chain */
+	SetHostState(parent, ServiceCritical, StateTypeHard);
+
+	Dependency::Ptr failed;
+	BOOST_CHECK(!child->IsReachable(DependencyState, &failed));
+	BOOST_CHECK(failed == dep1);
+	BOOST_CHECK(!grandchild->IsReachable(DependencyState, &failed));
+	BOOST_CHECK(failed == dep1);
+
+	SetHostState(parent, ServiceOK, StateTypeHard);
+	BOOST_CHECK(grandchild->IsReachable());
+
+	/* soft states are ignored unless the dependency says otherwise */
+	SetHostState(parent, ServiceCritical, StateTypeSoft);
+	BOOST_CHECK(grandchild->IsReachable());
+
+	dep1->ModifyAttribute("ignore_soft_states", false);
+	BOOST_CHECK(!grandchild->IsReachable());
+
+	BOOST_CHECK(Checkable::GetReachabilityCacheStatistics().max_fanout >= 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
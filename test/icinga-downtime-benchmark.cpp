@@ -0,0 +1,119 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/downtime.hpp"
+#include "base/deadlinequeue.hpp"
+#include "base/utility.hpp"
+#include <boost/bind.hpp>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_downtime)
+
+static void CountCallback(size_t *count, const Object::Ptr&)
+{
+	(*count)++;
+}
+
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	const int count = 100000;
+	const double day = 86400;
+
+	double now = Utility::GetTime();
+
+	std::vector<Downtime::Ptr> downtimes;
+	size_t fixedCount = 0;
+
+	for (int i = 0; i < count; i++) {
+		Downtime::Ptr downtime = new Downtime();
+
+		double startTime = now + (i * 7919) % static_cast<int>(day);
+		downtime->SetStartTime(startTime);
+		downtime->SetEndTime(startTime + 3600 * (1 + i % 4));
+		downtime->SetFixed(i % 2 == 0);
+		downtime->SetDuration(1800);
+
+		if (downtime->GetFixed())
+			fixedCount++;
+
+		downtimes.push_back(downtime);
+	}
+
+	/* What the start (every 5 s) and expire (every 60 s) timers used to do. */
+	const int scans = 20;
+
+	double start = Utility::GetTime();
+	size_t due = 0;
+
+	for (int i = 0; i < scans; i++) {
+		for (const Downtime::Ptr& downtime : downtimes) {
+			double startDeadline = downtime->GetStartDeadline();
+
+			if (startDeadline >= 0 && startDeadline <= now)
+				due++;
+
+			if (downtime->IsExpired())
+				due++;
+		}
+	}
+
+	double scanDuration = (Utility::GetTime() - start) / scans;
+	double scanDay = scanDuration * (day / 5 + day / 60);
+
+	BOOST_TEST_MESSAGE("Scanning " << count << " downtimes took " << scanDuration * 1000
+	    << " ms, " << scanDay << " s per simulated day");
+
+	size_t started = 0, expired = 0;
+	DeadlineQueue::Ptr startQueue = new DeadlineQueue(boost::bind(&CountCallback, &started, _1));
+	DeadlineQueue::Ptr expireQueue = new DeadlineQueue(boost::bind(&CountCallback, &expired, _1));
+
+	start = Utility::GetTime();
+
+	for (const Downtime::Ptr& downtime : downtimes) {
+		double startDeadline = downtime->GetStartDeadline();
+
+		if (startDeadline >= 0)
+			startQueue->Set(downtime, startDeadline);
+
+		expireQueue->Set(downtime, downtime->GetExpireDeadline());
+	}
+
+	double indexDuration = Utility::GetTime() - start;
+
+	/* Fire the deadlines of a whole day in one second steps. */
+	start = Utility::GetTime();
+
+	for (double ts = now; ts <= now + day + 4 * 3600; ts += 1) {
+		startQueue->Process(ts);
+		expireQueue->Process(ts);
+	}
+
+	double processDuration = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Indexing " << count << " downtimes took " << indexDuration * 1000
+	    << " ms, firing their deadlines took " << processDuration << " s per simulated day");
+
+	BOOST_CHECK(started == fixedCount);
+	BOOST_CHECK(expired == static_cast<size_t>(count));
+	BOOST_CHECK(startQueue->GetLength() == 0 && expireQueue->GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
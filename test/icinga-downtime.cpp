@@ -0,0 +1,56 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/downtime.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_downtime)
+
+BOOST_AUTO_TEST_CASE(deadlines)
+{
+	Downtime::Ptr fixed = new Downtime();
+	fixed->SetFixed(true);
+	fixed->SetStartTime(1000);
+	fixed->SetEndTime(2000);
+
+	BOOST_CHECK(fixed->GetStartDeadline() == 1000);
+	BOOST_CHECK(fixed->GetExpireDeadline() == 2000);
+
+	fixed->SetTriggerTime(1000);
+	BOOST_CHECK(fixed->GetStartDeadline() == -1);
+
+	Downtime::Ptr flexible = new Downtime();
+	flexible->SetFixed(false);
+	flexible->SetStartTime(1000);
+	flexible->SetEndTime(2000);
+	flexible->SetDuration(300);
+
+	BOOST_CHECK(flexible->GetStartDeadline() == -1);
+	BOOST_CHECK(flexible->GetExpireDeadline() == 2000);
+
+	flexible->SetTriggerTime(1200);
+	BOOST_CHECK(flexible->GetExpireDeadline() == 1500);
+
+	flexible->SetTriggerTime(1900);
+	BOOST_CHECK(flexible->GetExpireDeadline() == 2000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/macroprocessor.hpp"
+#include "base/json.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_macros)
+
+static Dictionary::Ptr MakeArgument(const String& value, int order = 0, bool repeatKey = true)
+{
+	Dictionary::Ptr argument = new Dictionary();
+	argument->Set("value", value);
+	argument->Set("order", order);
+	argument->Set("repeat_key", repeatKey);
+	return argument;
+}
+
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	Dictionary::Ptr vars = new Dictionary();
+	vars->Set("nrpe_command", "check_disk");
+	vars->Set("nrpe_arguments", "-w 20% -c 10% -p $service.vars.disk_partition$");
+	vars->Set("disk_partition", "/var");
+	vars->Set("snmp_community", "public");
+	vars->Set("snmp_oid", "1.3.6.1.2.1.25.2.3.1.6.1");
+
+	Dictionary::Ptr host = new Dictionary();
+	host->Set("name", "db01.example.com");
+	host->Set("address", "192.0.2.10");
+
+	Dictionary::Ptr service = new Dictionary();
+	service->Set("name", "disk /var");
+	service->Set("vars", vars);
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.push_back(std::make_pair("service", service));
+	resolvers.push_back(std::make_pair("host", host));
+
+	Array::Ptr nrpeCommand = new Array();
+	nrpeCommand->Add("/usr/lib/nagios/plugins/check_nrpe");
+
+	Dictionary::Ptr nrpeArguments = new Dictionary();
+	nrpeArguments->Set("-H", MakeArgument("$host.address$"));
+	nrpeArguments->Set("-p", MakeArgument("5666"));
+	nrpeArguments->Set("-c", MakeArgument("$service.vars.nrpe_command$"));
+	nrpeArguments->Set("-t", MakeArgument("$service.vars.nrpe_timeout$:UNKNOWN"));
+	nrpeArguments->Set("-a", MakeArgument("$service.vars.nrpe_arguments$", 1, false));
+
+	Array::Ptr snmpCommand = new Array();
+	snmpCommand->Add("/usr/lib/nagios/plugins/check_snmp");
+
+	Dictionary::Ptr snmpArguments = new Dictionary();
+	snmpArguments->Set("-H", MakeArgument("$host.address$"));
+	snmpArguments->Set("-C", MakeArgument("$service.vars.snmp_community$"));
+	snmpArguments->Set("-o", MakeArgument("$service.vars.snmp_oid$"));
+	snmpArguments->Set("-l", MakeArgument("$service.name$ on $host.name$"));
+
+	MacroTemplateCache::Ptr nrpeTemplates = new MacroTemplateCache();
+	MacroTemplateCache::Ptr snmpTemplates = new MacroTemplateCache();
+
+	String nrpeExpected = JsonEncode(MacroProcessor::ResolveArguments(nrpeCommand, nrpeArguments,
+	    resolvers, CheckResult::Ptr(), Dictionary::Ptr(), false));
+	String snmpExpected = JsonEncode(MacroProcessor::ResolveArguments(snmpCommand, snmpArguments,
+	    resolvers, CheckResult::Ptr(), Dictionary::Ptr(), false));
+
+	/* -t is skipped because of the missing macro, -a is resolved recursively */
+	BOOST_CHECK(nrpeExpected.Find("\"-t\"") == String::NPos);
+	BOOST_CHECK(nrpeExpected.Find("\"-w 20% -c 10% -p /var\"") != String::NPos);
+	BOOST_CHECK(snmpExpected.Find("\"disk /var on db01.example.com\"") != String::NPos);
+
+	const int iterations = 1000000;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < iterations; i++) {
+		Value command;
+
+		if (i % 2 == 0)
+			command = MacroProcessor::ResolveArguments(nrpeCommand, nrpeArguments, resolvers,
+			    CheckResult::Ptr(), Dictionary::Ptr(), false, 0, nrpeTemplates);
+		else
+			command = MacroProcessor::ResolveArguments(snmpCommand, snmpArguments, resolvers,
+			    CheckResult::Ptr(), Dictionary::Ptr(), false, 0, snmpTemplates);
+
+		if (i < 2)
+			BOOST_CHECK(JsonEncode(command) == (i % 2 == 0 ? nrpeExpected : snmpExpected));
+	}
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Resolved " << iterations << " check_nrpe/check_snmp command lines in " << duration
+	    << " s (" << duration * 1000000 / iterations << " us per command line)");
+
+	BOOST_CHECK(nrpeTemplates->GetLength() == 4);
+	BOOST_CHECK(snmpTemplates->GetLength() == 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
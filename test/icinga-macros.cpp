@@ -64,4 +64,51 @@ BOOST_AUTO_TEST_CASE(simple)
 
 }
 
+BOOST_AUTO_TEST_CASE(templates)
+{
+	MacroTemplate::Ptr tmpl = new MacroTemplate("-H $host.address$ -p $$5666 $port$");
+	BOOST_CHECK(tmpl->IsValid());
+	BOOST_CHECK(!tmpl->IsSingleMacro());
+	BOOST_CHECK(tmpl->GetTokens().size() == 6);
+	BOOST_CHECK(tmpl->GetTokens()[1].ObjectName == "host");
+	BOOST_CHECK(tmpl->GetTokens()[1].Attribute == "address");
+	BOOST_CHECK(tmpl->GetTokens()[3].Text == "");
+
+	BOOST_CHECK(MacroTemplate::Ptr(new MacroTemplate("$host.vars.disks$"))->IsSingleMacro());
+	BOOST_CHECK(!MacroTemplate::Ptr(new MacroTemplate("$host.address"))->IsValid());
+
+	Dictionary::Ptr host = new Dictionary();
+	host->Set("address", "192.0.2.1");
+
+	Array::Ptr disks = new Array();
+	disks->Add("/");
+	disks->Add("/var");
+	host->Set("disks", disks);
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.push_back(std::make_pair("host", host));
+
+	MacroTemplateCache::Ptr templates = new MacroTemplateCache();
+
+	for (int i = 0; i < 2; i++) {
+		BOOST_CHECK(MacroProcessor::ResolveMacros("-H $host.address$ -p $$5666", resolvers, CheckResult::Ptr(),
+		    NULL, MacroProcessor::EscapeCallback(), Dictionary::Ptr(), false, 0, templates) == "-H 192.0.2.1 -p $5666");
+
+		Array::Ptr result = MacroProcessor::ResolveMacros("$host.disks$", resolvers, CheckResult::Ptr(),
+		    NULL, MacroProcessor::EscapeCallback(), Dictionary::Ptr(), false, 0, templates);
+		BOOST_CHECK(result->GetLength() == 2);
+
+		BOOST_CHECK_THROW(MacroProcessor::ResolveMacros("-d $host.disks$", resolvers, CheckResult::Ptr(),
+		    NULL, MacroProcessor::EscapeCallback(), Dictionary::Ptr(), false, 0, templates), std::exception);
+		BOOST_CHECK_THROW(MacroProcessor::ResolveMacros("$host.address", resolvers, CheckResult::Ptr(),
+		    NULL, MacroProcessor::EscapeCallback(), Dictionary::Ptr(), false, 0, templates), std::exception);
+	}
+
+	/* strings without macros are never compiled */
+	BOOST_CHECK(templates->GetLength() == 4);
+
+	templates->Clear();
+	BOOST_CHECK(templates->GetLength() == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga-timeperiod-fixture.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_FIXTURE_TEST_SUITE(icinga_timeperiod, TimePeriodFixture)
+
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	TimePeriod::Ptr tp = MakeTimePeriod("timeperiod-benchmark", MakeRanges());
+
+	double begin = Utility::GetTime();
+	double end = begin + 31 * 24 * 60 * 60;
+
+	tp->UpdateRegion(begin, end, true);
+
+	const int iterations = 1000000;
+	double step = (end - begin) / iterations;
+	int insideLinear = 0, inside = 0;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < iterations; i++) {
+		if (IsInsideLinear(tp, begin + i * step))
+			insideLinear++;
+	}
+
+	double linearDuration = Utility::GetTime() - start;
+
+	start = Utility::GetTime();
+
+	for (int i = 0; i < iterations; i++) {
+		if (tp->IsInside(begin + i * step))
+			inside++;
+	}
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(inside == insideLinear);
+
+	BOOST_TEST_MESSAGE("Evaluated IsInside() " << iterations << " times against " << tp->GetSegments()->GetLength()
+	    << " segments: linear scan " << linearDuration << " s (" << iterations / linearDuration << " calls/s), snapshot "
+	    << duration << " s (" << iterations / duration << " calls/s)");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,85 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef ICINGA_TIMEPERIOD_FIXTURE_H
+#define ICINGA_TIMEPERIOD_FIXTURE_H
+
+#include "icinga/timeperiod.hpp"
+#include "icinga/legacytimeperiod.hpp"
+#include "base/function.hpp"
+#include "base/functionwrapper.hpp"
+#include "base/objectlock.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * Helpers for the time period tests and benchmarks.
+ */
+struct TimePeriodFixture
+{
+	static TimePeriod::Ptr MakeTimePeriod(const String& name, const Dictionary::Ptr& ranges)
+	{
+		TimePeriod::Ptr tp = new TimePeriod();
+		tp->SetName(name);
+		tp->SetRanges(ranges);
+		tp->SetUpdate(new Function("LegacyTimePeriod", WrapFunction(&LegacyTimePeriod::ScriptFunc)));
+
+		return tp;
+	}
+
+	static Dictionary::Ptr MakeRanges(void)
+	{
+		Dictionary::Ptr ranges = new Dictionary();
+		ranges->Set("monday", "08:00-12:00,13:00-17:00");
+		ranges->Set("tuesday", "08:00-12:00,13:00-17:00");
+		ranges->Set("wednesday", "08:00-12:00,11:00-18:00");
+		ranges->Set("thursday", "00:00-24:00");
+		ranges->Set("friday", "08:00-12:00,12:00-17:00");
+		ranges->Set("saturday 1 - 2", "10:00-14:00");
+		ranges->Set("day 1 - 31 / 3", "20:00-22:00");
+		ranges->Set("day -1", "23:00-24:00");
+
+		return ranges;
+	}
+
+	/* Mirrors the linear scan over the segment dictionaries which was used
+	 * before the segments were compiled into sorted snapshots. */
+	static bool IsInsideLinear(const TimePeriod::Ptr& tp, double ts)
+	{
+		ObjectLock olock(tp);
+
+		if (tp->GetValidBegin().IsEmpty() || ts < tp->GetValidBegin() || tp->GetValidEnd().IsEmpty() || ts > tp->GetValidEnd())
+			return true;
+
+		Array::Ptr segments = tp->GetSegments();
+
+		if (segments) {
+			ObjectLock dlock(segments);
+			for (const Dictionary::Ptr& segment : segments) {
+				if (ts > segment->Get("begin") && ts < segment->Get("end"))
+					return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+#endif /* ICINGA_TIMEPERIOD_FIXTURE_H */
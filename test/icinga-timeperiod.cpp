@@ -0,0 +1,116 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga-timeperiod-fixture.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_FIXTURE_TEST_SUITE(icinga_timeperiod, TimePeriodFixture)
+
+BOOST_AUTO_TEST_CASE(compiled_ranges)
+{
+	Dictionary::Ptr ranges = MakeRanges();
+	LegacyTimePeriodRules::Ptr rules = new LegacyTimePeriodRules(ranges);
+
+	BOOST_CHECK(rules->Matches(ranges));
+
+	double begin = Utility::GetTime();
+
+	for (int i = 0; i < 90; i++) {
+		tm reference = Utility::LocalTime(begin + i * 24 * 60 * 60);
+
+		Array::Ptr expected = new Array();
+
+		{
+			ObjectLock olock(ranges);
+			for (const Dictionary::Pair& kv : ranges) {
+				tm ref = reference;
+
+				if (LegacyTimePeriod::IsInDayDefinition(kv.first, &ref))
+					LegacyTimePeriod::ProcessTimeRanges(kv.second, &ref, expected);
+			}
+		}
+
+		Array::Ptr actual = new Array();
+		tm ref = reference;
+		rules->AddSegments(&ref, actual);
+
+		BOOST_REQUIRE(actual->GetLength() == expected->GetLength());
+
+		for (Array::SizeType j = 0; j < actual->GetLength(); j++) {
+			Dictionary::Ptr a = actual->Get(j);
+			Dictionary::Ptr e = expected->Get(j);
+
+			BOOST_CHECK(a->Get("begin") == e->Get("begin"));
+			BOOST_CHECK(a->Get("end") == e->Get("end"));
+		}
+	}
+
+	ranges->Set("sunday", "10:00-11:00");
+	BOOST_CHECK(!rules->Matches(ranges));
+
+	ranges->Remove("sunday");
+	ranges->Set("monday", "09:00-12:00");
+	BOOST_CHECK(!rules->Matches(ranges));
+
+	BOOST_CHECK_THROW(LegacyTimePeriod::CompileTimeSpec("monday 0"), std::invalid_argument);
+	BOOST_CHECK_THROW(LegacyTimePeriod::CompileTimeOfDayRange("12:00-08:00"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(is_inside)
+{
+	TimePeriod::Ptr tp = MakeTimePeriod("timeperiod-is-inside", MakeRanges());
+
+	double begin = Utility::GetTime();
+	double end = begin + 7 * 24 * 60 * 60;
+
+	tp->UpdateRegion(begin, end, true);
+
+	BOOST_REQUIRE(tp->GetSegments());
+	BOOST_CHECK(tp->GetSegments()->GetLength() > 0);
+
+	/* Outside of the valid region everything is inside. */
+	BOOST_CHECK(tp->IsInside(begin - 24 * 60 * 60));
+	BOOST_CHECK(tp->IsInside(end + 24 * 60 * 60));
+
+	for (double ts = begin; ts < end; ts += 397)
+		BOOST_CHECK(tp->IsInside(ts) == IsInsideLinear(tp, ts));
+
+	/* Segment boundaries are not inside. */
+	Array::Ptr segments = tp->GetSegments();
+
+	ObjectLock olock(segments);
+	for (const Dictionary::Ptr& segment : segments) {
+		double sbegin = segment->Get("begin");
+		double send = segment->Get("end");
+
+		BOOST_CHECK(tp->IsInside(sbegin) == IsInsideLinear(tp, sbegin));
+		BOOST_CHECK(tp->IsInside(send) == IsInsideLinear(tp, send));
+		if (sbegin < send)
+			BOOST_CHECK(tp->IsInside((sbegin + send) / 2));
+
+		double transition = tp->FindNextTransition(sbegin - 1);
+		BOOST_CHECK(transition != -1 && transition <= send);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "notification/notificationcomponent.hpp"
+#include "icinga/host.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(notification_component)
+
+BOOST_AUTO_TEST_CASE(reminder_interval_zero)
+{
+	Host::Ptr host = new Host();
+	host->SetName("notification-component-host");
+	host->Register();
+
+	host->SetStateRaw(ServiceOK);
+	host->SetStateType(StateTypeHard);
+
+	Notification::Ptr notification = new Notification();
+	notification->SetName("notification-component-host!interval-zero");
+	notification->SetField(notification->GetReflectionType()->GetFieldId("host_name"), host->GetName());
+	notification->SetInterval(0);
+	static_pointer_cast<ConfigObject>(notification)->OnAllConfigLoaded();
+	notification->Activate();
+
+	BOOST_CHECK(!notification->GetNoMoreNotifications());
+
+	/* The checkable is OK, so the reminder is skipped. With an interval
+	 * of 0 its next_notification is "now" again, the scheduler must not
+	 * pick it up again right away. */
+	for (int i = 0; i < 3; i++) {
+		double now = Utility::GetTime();
+
+		notification->SetNextNotification(0);
+
+		double notBefore = NotificationComponent::SendReminder(notification);
+
+		BOOST_CHECK(notBefore >= now + NOTIFICATION_RETRY_INTERVAL);
+		BOOST_CHECK(notification->GetNextNotification() < notBefore);
+		BOOST_CHECK(!notification->GetNoMoreNotifications());
+	}
+
+	/* The reminder isn't due yet. */
+	notification->SetNextNotification(Utility::GetTime() + 3600);
+	BOOST_CHECK(NotificationComponent::SendReminder(notification) == 0);
+
+	notification->Deactivate();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
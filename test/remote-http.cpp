@@ -0,0 +1,244 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/httpresultwriter.hpp"
+#include "remote/objectqueryhandler.hpp"
+#include "remote/apiuser.hpp"
+#include "remote/url.hpp"
+#include "base/json.hpp"
+#include "base/fifo.hpp"
+#include "base/convert.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * A stream which discards everything that is written to it and only keeps
+ * track of the number of bytes.
+ */
+class CountingStream : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(CountingStream);
+
+	CountingStream(void)
+		: m_Count(0)
+	{ }
+
+	virtual size_t Read(void *, size_t, bool) override
+	{
+		return 0;
+	}
+
+	virtual void Write(const void *, size_t count) override
+	{
+		m_Count += count;
+	}
+
+	virtual bool IsEof(void) const override
+	{
+		return false;
+	}
+
+	size_t GetCount(void) const
+	{
+		return m_Count;
+	}
+
+private:
+	size_t m_Count;
+};
+
+static Dictionary::Ptr MakeResult(int index)
+{
+	Dictionary::Ptr result = new Dictionary();
+	result->Set("code", 200);
+	result->Set("status", "Successfully processed check result for object 'host-" + Convert::ToString(index) + "'.");
+	return result;
+}
+
+/**
+ * Runs an object query and returns the response's status code.
+ */
+static int QueryObjects(const String& url, const Dictionary::Ptr& params)
+{
+	ApiUser::Ptr user = new ApiUser();
+	Array::Ptr permissions = new Array();
+	permissions->Add("*");
+	user->SetPermissions(permissions);
+
+	FIFO::Ptr fifo = new FIFO();
+	HttpRequest request(fifo);
+	request.RequestMethod = "GET";
+	request.RequestUrl = new Url(url);
+
+	HttpResponse response(fifo, request);
+	ObjectQueryHandler::Ptr handler = new ObjectQueryHandler();
+	handler->HandleRequest(user, request, response, params);
+	response.Finish();
+
+	HttpResponse parsed(fifo, request);
+	StreamReadContext src;
+
+	while (!parsed.Complete)
+		parsed.Parse(src, false);
+
+	return parsed.StatusCode;
+}
+
+BOOST_AUTO_TEST_SUITE(remote_http)
+
+BOOST_AUTO_TEST_CASE(request_body)
+{
+	Array::Ptr targets = new Array();
+
+	for (int i = 0; i < 50000; i++)
+		targets->Add("host-" + Convert::ToString(i) + "!service-" + Convert::ToString(i));
+
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("exit_status", 2);
+	params->Set("targets", targets);
+
+	String body = JsonEncode(params);
+	String header = "POST /v1/actions/process-check-result HTTP/1.1\r\n"
+	    "Content-Length: " + Convert::ToString(body.GetLength()) + "\r\n\r\n";
+
+	FIFO::Ptr fifo = new FIFO();
+	fifo->Write(header.CStr(), header.GetLength());
+	fifo->Write(body.CStr(), body.GetLength());
+
+	HttpRequest request(fifo);
+	StreamReadContext src;
+	size_t highWaterMark = 0;
+
+	while (!request.Complete) {
+		request.Parse(src, false);
+		highWaterMark = std::max(highWaterMark, src.Size);
+	}
+
+	BOOST_TEST_MESSAGE("Parsed a " << body.GetLength() << " byte request body, read buffer high-water mark: " << highWaterMark << " bytes");
+
+	/* The body is decoded while it arrives, the read buffer must not
+	 * grow beyond what a single FillFromStream() call returns. */
+	BOOST_CHECK(body.GetLength() > 1024 * 1024);
+	BOOST_CHECK(highWaterMark <= 64 * 1024 + 4096);
+	BOOST_CHECK(JsonEncode(request.GetBody()) == body);
+
+	String invalid = "POST /v1/actions/process-check-result HTTP/1.1\r\nContent-Length: 4\r\n\r\n{8: ";
+
+	fifo = new FIFO();
+	fifo->Write(invalid.CStr(), invalid.GetLength());
+
+	HttpRequest invalidRequest(fifo);
+	StreamReadContext invalidSrc;
+
+	while (!invalidRequest.Complete)
+		invalidRequest.Parse(invalidSrc, false);
+
+	BOOST_CHECK_THROW(invalidRequest.GetBody(), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(result_writer)
+{
+	CountingStream::Ptr stream = new CountingStream();
+	HttpRequest request(stream);
+	HttpResponse response(stream, request);
+	HttpResultWriter writer(response);
+
+	size_t encoded = 0;
+	size_t highWaterMark = 0;
+
+	for (int i = 0; i < 100000; i++) {
+		Dictionary::Ptr result = MakeResult(i);
+		writer.Add(result);
+
+		encoded += JsonEncode(result).GetLength() + 1;
+
+		if (encoded > stream->GetCount())
+			highWaterMark = std::max(highWaterMark, encoded - stream->GetCount());
+	}
+
+	writer.Finish();
+
+	BOOST_TEST_MESSAGE("Wrote " << encoded << " bytes of results, buffered high-water mark: " << highWaterMark << " bytes");
+
+	/* results must be sent while they are added rather than at the end */
+	BOOST_CHECK(writer.GetCount() == 100000);
+	BOOST_CHECK(stream->GetCount() >= encoded);
+	BOOST_CHECK(highWaterMark <= 2 * JSON_CHUNK_SIZE);
+
+	/* round-trip the chunked response through the client-side parser */
+	FIFO::Ptr fifo = new FIFO();
+	HttpRequest fifoRequest(fifo);
+	HttpResponse fifoResponse(fifo, fifoRequest);
+	HttpResultWriter fifoWriter(fifoResponse);
+
+	for (int i = 0; i < 1000; i++)
+		fifoWriter.Add(MakeResult(i));
+
+	fifoWriter.Finish();
+	fifoResponse.Finish();
+
+	HttpResponse parsed(fifo, fifoRequest);
+	StreamReadContext src;
+
+	while (!parsed.Complete)
+		parsed.Parse(src, false);
+
+	String body;
+	char buffer[1024];
+	size_t count;
+
+	while ((count = parsed.ReadBody(buffer, sizeof(buffer))) > 0)
+		body += String(buffer, buffer + count);
+
+	Dictionary::Ptr result = JsonDecode(body);
+	Array::Ptr results = result->Get("results");
+
+	BOOST_CHECK(parsed.StatusCode == 200);
+	BOOST_CHECK(results->GetLength() == 1000);
+	BOOST_CHECK(JsonEncode(results->Get(999)) == JsonEncode(MakeResult(999)));
+}
+
+BOOST_AUTO_TEST_CASE(object_query_no_matches)
+{
+	Array::Ptr attrs = new Array();
+	attrs->Add("name");
+
+	Array::Ptr joins = new Array();
+	joins->Add("parent.name");
+
+	/* the filter doesn't match any zone */
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("filter", "false");
+	params->Set("attrs", attrs);
+	params->Set("joins", joins);
+
+	BOOST_CHECK(QueryObjects("/v1/objects/zones", params) == 200);
+
+	/* invalid attributes are reported before the results are sent */
+	attrs->Add("invalid");
+	BOOST_CHECK(QueryObjects("/v1/objects/zones", params) == 400);
+
+	attrs->Remove(1);
+	joins->Add("parent.invalid");
+	BOOST_CHECK(QueryObjects("/v1/objects/zones", params) == 400);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
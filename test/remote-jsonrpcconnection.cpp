@@ -0,0 +1,202 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2017 Icinga Development Team (https://www.icinga.com/)  *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/jsonrpcconnection.hpp"
+#include "base/netstring.hpp"
+#include "base/workqueue.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <set>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_jsonrpcconnection)
+
+BOOST_AUTO_TEST_CASE(message_lanes)
+{
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::Heartbeat") == MessageLaneHeartbeat);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("icinga::Hello") == MessageLaneHeartbeat);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("log::SetLogPosition") == MessageLaneHeartbeat);
+
+	/* Events for the same object must be processed in order. */
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::CheckResult") == MessageLaneCheckable);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::SetNextCheck") == MessageLaneCheckable);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::SetAcknowledgement") == MessageLaneCheckable);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::ClearAcknowledgement") == MessageLaneCheckable);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::AddDowntime") == MessageLaneCheckable);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::SendNotifications") == MessageLaneCheckable);
+
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("event::UpdateRepository") == MessageLaneBulk);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("config::Update") == MessageLaneBulk);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("pki::RequestCertificate") == MessageLaneBulk);
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane("unknown") == MessageLaneBulk);
+}
+
+static Dictionary::Ptr MakeObjectMessage(const String& method, const String& type, const String& name)
+{
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("type", type);
+	params->Set("name", name);
+
+	Dictionary::Ptr message = new Dictionary();
+	message->Set("method", method);
+	message->Set("params", params);
+	return message;
+}
+
+static Dictionary::Ptr MakeEventMessage(const String& method, const String& host, const String& service)
+{
+	Dictionary::Ptr params = new Dictionary();
+	params->Set("host", host);
+
+	if (!service.IsEmpty())
+		params->Set("service", service);
+
+	Dictionary::Ptr message = new Dictionary();
+	message->Set("method", method);
+	message->Set("params", params);
+	return message;
+}
+
+static void ApplyMessage(const Dictionary::Ptr& message, const String& checkable, boost::mutex& mutex,
+    std::set<String>& objects, std::vector<String>& applied)
+{
+	String method = message->Get("method");
+
+	if (method == "config::UpdateObject") {
+		/* give a message in another queue the chance to overtake this one */
+		Utility::Sleep(0.1);
+
+		boost::mutex::scoped_lock lock(mutex);
+		objects.insert(checkable);
+		applied.push_back(method);
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	/* events for objects which don't exist are dropped */
+	if (objects.find(checkable) != objects.end())
+		applied.push_back(method);
+}
+
+BOOST_AUTO_TEST_CASE(message_order)
+{
+	std::vector<std::pair<Dictionary::Ptr, String> > messages;
+	messages.push_back(std::make_pair(MakeObjectMessage("config::UpdateObject", "Service", "example!ping"), "example!ping"));
+	messages.push_back(std::make_pair(MakeEventMessage("event::CheckResult", "example", "ping"), "example!ping"));
+	messages.push_back(std::make_pair(MakeObjectMessage("config::UpdateObject", "Downtime", "example!ping!downtime-1"), "example!ping"));
+	messages.push_back(std::make_pair(MakeEventMessage("event::SetAcknowledgement", "example", "ping"), "example!ping"));
+	messages.push_back(std::make_pair(MakeObjectMessage("config::UpdateObject", "Host", "example"), "example!"));
+	messages.push_back(std::make_pair(MakeObjectMessage("config::DeleteObject", "Comment", "example!comment-1"), "example!"));
+	messages.push_back(std::make_pair(MakeEventMessage("event::SetNextCheck", "example", ""), "example!"));
+
+	for (const auto& kv : messages) {
+		String checkable;
+		BOOST_CHECK(JsonRpcConnection::GetMessageLane(kv.first, &checkable) == MessageLaneCheckable);
+		BOOST_CHECK_EQUAL(checkable, kv.second);
+	}
+
+	String checkable;
+	BOOST_CHECK(JsonRpcConnection::GetMessageLane(MakeObjectMessage("config::UpdateObject", "Zone", "example"), &checkable) == MessageLaneBulk);
+	BOOST_CHECK(checkable.IsEmpty());
+
+	/* A service is created at runtime and a check result for it follows.
+	 * The messages are queued the same way DispatchMessage() does it, the
+	 * check result must not be processed before the service exists. */
+	WorkQueue queues[MESSAGE_LANE_COUNT][4];
+	boost::mutex mutex;
+	std::set<String> objects;
+	std::vector<String> applied;
+
+	for (int i = 0; i < 2; i++) {
+		const Dictionary::Ptr& message = messages[i].first;
+
+		checkable = String();
+		MessageLane lane = JsonRpcConnection::GetMessageLane(message, &checkable);
+
+		/* messages which don't refer to a checkable are keyed by their connection */
+		unsigned long key = checkable.IsEmpty() ? 0 : Utility::SDBM(checkable);
+
+		queues[lane][key % 4].Enqueue(boost::bind(&ApplyMessage, message, checkable,
+		    boost::ref(mutex), boost::ref(objects), boost::ref(applied)));
+	}
+
+	for (int lane = 0; lane < MESSAGE_LANE_COUNT; lane++) {
+		for (WorkQueue& queue : queues[lane])
+			queue.Join();
+	}
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 2);
+	BOOST_CHECK_EQUAL(applied[0], "config::UpdateObject");
+	BOOST_CHECK_EQUAL(applied[1], "event::CheckResult");
+}
+
+BOOST_AUTO_TEST_CASE(compression)
+{
+#ifdef HAVE_ZLIB
+	JsonRpcDeflater::Ptr deflater = new JsonRpcDeflater();
+	JsonRpcInflater::Ptr inflater = new JsonRpcInflater();
+
+	String message = "{\"jsonrpc\":\"2.0\",\"method\":\"event::CheckResult\",\"params\":{\"cr\":{\"active\":true,"
+	    "\"output\":\"PING OK - Packet loss = 0%, RTA = 0.42 ms\",\"state\":0.0},\"host\":\"example.localdomain\"},\"ts\":1490000000.0}";
+
+	size_t previous = 0;
+
+	for (int i = 0; i < 2; i++) {
+		BufferChain input;
+		NetString::WriteStringToChain(input, BufferRange::FromString(message));
+		NetString::WriteStringToChain(input, BufferRange::FromString(message));
+
+		size_t length = input.GetAvailableBytes();
+
+		BufferChain compressed;
+		deflater->Compress(input, compressed);
+		BOOST_CHECK(input.GetAvailableBytes() == 0);
+		BOOST_CHECK(compressed.GetAvailableBytes() < length);
+
+		/* the second frame refers to data from the first one */
+		if (i > 0)
+			BOOST_CHECK(compressed.GetAvailableBytes() < previous);
+
+		previous = compressed.GetAvailableBytes();
+
+		String frame;
+		frame.Append(previous, '\0');
+		compressed.Read(&frame[0], previous);
+
+		BufferChain output;
+		inflater->Decompress(frame.CStr(), frame.GetLength(), output);
+
+		for (int k = 0; k < 2; k++) {
+			BufferRange range;
+			BOOST_CHECK(NetString::ReadStringFromChain(output, &range) == StatusNewItem);
+			BOOST_CHECK(String(range.GetData(), range.GetData() + range.Length) == message);
+		}
+
+		BOOST_CHECK(output.GetAvailableBytes() == 0);
+	}
+
+	BufferChain output;
+	JsonRpcInflater::Ptr invalid = new JsonRpcInflater();
+	BOOST_CHECK_THROW(invalid->Decompress("not deflate", 11, output), std::invalid_argument);
+#endif /* HAVE_ZLIB */
+}
+
+BOOST_AUTO_TEST_SUITE_END()